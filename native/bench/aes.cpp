@@ -0,0 +1,171 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#include "seal/seal.h"
+#include "bench.h"
+#include "aes_he.hpp"
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <thread>
+
+using namespace benchmark;
+using namespace seal;
+using namespace std;
+
+/**
+This file defines benchmarks for the homomorphic evaluation of AES (keyswitching layer).
+Each case runs one stage (or the whole cipher) on an encrypted block for a poly_modulus_degree and a number of
+threads. The single layers (SubBytes, ShiftRows, MixColumns) also report the noise budget they consume (in bits)
+next to their time; the other stages manage the noise themselves (see CryptoBitset::manage_noise) and a budget
+measured on their output would only be the one left after their last refresh.
+*/
+
+namespace sealbench
+{
+    /**
+    Bit encryption context of each poly_modulus_degree, only created when a benchmark case needs it (the key
+    generation is long for the large degrees).
+    */
+    class AESBMEnv
+    {
+    public:
+        BitEncryptionContext &context(size_t poly_modulus_degree)
+        {
+            auto it = ctxts_.find(poly_modulus_degree);
+            if (it == ctxts_.end())
+            {
+                it = ctxts_.emplace(poly_modulus_degree, make_unique<BitEncryptionContext>(poly_modulus_degree))
+                         .first;
+            }
+            return *it->second;
+        }
+
+    private:
+        map<size_t, unique_ptr<BitEncryptionContext>> ctxts_;
+    };
+
+    template <size_t bitsize>
+    bitset<bitsize> random_bits(mt19937_64 &engine)
+    {
+        bitset<bitsize> bits;
+        for (size_t i = 0; i < bitsize; i++)
+        {
+            bits[i] = engine() & 1;
+        }
+        return bits;
+    }
+
+    /**
+    Time the stage returned by make_stage(ctxt, engine) on an encrypted block (the stages do not modify their
+    input). The encryption of the input and the setup of the stage (e.g. the encryption and expansion of its key)
+    are not timed. The number of iterations is left to the library: the whole cipher runs once, a layer as many
+    times as its minimal time requires. The counter "threads" is the number of threads running the stage and, if
+    report_noise, "noise" the noise budget consumed by the stage.
+    */
+    template <size_t input_size, typename MakeStage>
+    void bm_aes_stage(
+        State &state, AESBMEnv &env, size_t poly_modulus_degree, size_t nb_threads, bool report_noise,
+        MakeStage make_stage)
+    {
+        // (the caller of a parallel_for also runs a chunk)
+        TaskScheduler scheduler(nb_threads - 1);
+        DefaultSchedulerOverride override_scheduler(scheduler);
+        BitEncryptionContext &ctxt = env.context(poly_modulus_degree);
+        mt19937_64 engine(poly_modulus_degree);
+
+        CryptoBitset<input_size> input(ctxt, random_bits<input_size>(engine));
+        auto stage = make_stage(ctxt, engine);
+        for (auto _ : state)
+        {
+            CryptoBitset<128> output = stage(input);
+            DoNotOptimize(output);
+        }
+
+        if (report_noise)
+        {
+            state.counters["noise"] = input.min_noise_budget() - stage(input).min_noise_budget();
+        }
+        state.counters["threads"] = static_cast<double>(nb_threads);
+    }
+
+    template <AES_Mode key_size>
+    void register_bm_aes_family(AESBMEnv &env, size_t n, size_t nb_threads)
+    {
+        using Block = CryptoBitset<128>;
+        using Key = CryptoBitset<key_size>;
+
+#define SEAL_AES_BENCHMARK_REGISTER(name, input_size, report_noise, ...)                                         \
+    RegisterBenchmark(                                                                                           \
+        (string("n=") + to_string(n) + string(" / threads=") + to_string(nb_threads) + string(" / AES-") +       \
+         to_string(key_size) + string(" / " #name))                                                             \
+            .c_str(),                                                                                            \
+        [=, &env](State &st) { bm_aes_stage<input_size>(st, env, n, nb_threads, report_noise, __VA_ARGS__); })  \
+        ->Unit(benchmark::kMillisecond)                                                                          \
+        ->UseRealTime();
+
+        // The stages do not depend on the key size: they are only registered once
+        if (key_size == AES_128)
+        {
+            SEAL_AES_BENCHMARK_REGISTER(SubBytes, 128, true, [](BitEncryptionContext &, mt19937_64 &) {
+                return [](Block const &block) { return SubBytes(block); };
+            });
+            SEAL_AES_BENCHMARK_REGISTER(ShiftRows, 128, true, [](BitEncryptionContext &, mt19937_64 &) {
+                return [](Block const &block) { return ShiftRows(block); };
+            });
+            SEAL_AES_BENCHMARK_REGISTER(MixColumns, 128, true, [](BitEncryptionContext &, mt19937_64 &) {
+                return [](Block const &block) { return MixColumns(block); };
+            });
+        }
+        SEAL_AES_BENCHMARK_REGISTER(KeyExpansion, key_size, false, [](BitEncryptionContext &, mt19937_64 &) {
+            return [](Key const &key) { return KeyExpansion<key_size>(key).back(); };
+        });
+        // (the encryption only: the round keys are expanded in the setup)
+        SEAL_AES_BENCHMARK_REGISTER(HE_AES_Encrypt, 128, false, [](BitEncryptionContext &ctxt, mt19937_64 &engine) {
+            vector<Block> round_keys = KeyExpansion<key_size>(Key(ctxt, random_bits<key_size>(engine)));
+            return [round_keys](Block const &block) { return HE_AES_Encrypt<key_size>(block, round_keys); };
+        });
+        // (the key-switching expands k0 and k1 concurrently with the decryption: the expansions are timed)
+        SEAL_AES_BENCHMARK_REGISTER(
+            HE_AES_Keyswitching, 128, false, [](BitEncryptionContext &ctxt, mt19937_64 &engine) {
+                Key k0(ctxt, random_bits<key_size>(engine));
+                Key k1(ctxt, random_bits<key_size>(engine));
+                return [k0, k1](Block const &block) { return HE_AES_Keyswitching<key_size>(block, k0, k1); };
+            });
+
+#undef SEAL_AES_BENCHMARK_REGISTER
+    }
+} // namespace sealbench
+
+int main(int argc, char **argv)
+{
+    Initialize(&argc, argv);
+
+    cout << "Microsoft SEAL version: " << SEAL_VERSION << endl;
+
+    // The contexts are created by the first benchmark case of each degree
+    sealbench::AESBMEnv env;
+
+    // 1, 2, 4... threads up to the number of cores
+    vector<size_t> thread_counts;
+    const size_t nb_cores = max<size_t>(thread::hardware_concurrency(), 1);
+    for (size_t t = 1; t < nb_cores; t *= 2)
+    {
+        thread_counts.push_back(t);
+    }
+    thread_counts.push_back(nb_cores);
+
+    for (size_t n : { 4096, 8192, 16384, 32768 })
+    {
+        for (size_t t : thread_counts)
+        {
+            sealbench::register_bm_aes_family<AES_128>(env, n, t);
+            sealbench::register_bm_aes_family<AES_192>(env, n, t);
+            sealbench::register_bm_aes_family<AES_256>(env, n, t);
+        }
+    }
+
+    RunSpecifiedBenchmarks();
+    Shutdown();
+    return 0;
+}
@@ -26,25 +26,25 @@ Ciphertext InnerProductV1(Evaluator & eval,
     return result;
 }
 
-static Plaintext CreateMaskBatch(EncryptionParameters& parms)
+// The encoder (and its SEALContext) is the caller's: building a SEALContext
+// validates the primes and generates the NTT tables, once per program
+static Plaintext CreateMaskBatch(const BatchEncoder& batch_encoder, size_t NbOnes = 1)
 {
-    SEALContext context(parms);
-    BatchEncoder batch_encoder(context);
     Plaintext mask;
 
     size_t slot_count = batch_encoder.slot_count();
 
     std::vector<uint64_t> pod_matrix(slot_count, 0ULL);
-    // we only initialize the first value at one
-    // this gives us :
+    // we only initialize the first NbOnes values at one
+    // this gives us (NbOnes = 1) :
     //  [ 1,  0,  0,  0,  0,  0, ...,  0 ]
     //  [ 0,  0,  0,  0,  0,  0, ...,  0 ]
-    pod_matrix[0] = 1ULL;
+    std::fill(pod_matrix.begin(), pod_matrix.begin() + NbOnes, 1ULL);
     batch_encoder.encode(pod_matrix, mask);
     return mask;
 }
 
-Ciphertext InnerProductV2(EncryptionParameters& parms,
+Ciphertext InnerProductV2(const BatchEncoder& batch_encoder,
                           Evaluator & eval,
                           const Ciphertext& vec1, 
                           const Ciphertext& vec2,
@@ -55,7 +55,7 @@ Ciphertext InnerProductV2(EncryptionParameters& parms,
     // If the number of batched values is not given, we assume that the vector 
     // is at most of size poly_modulus_degree/2
     if (NbElem == 0)
-        NbElem = parms.poly_modulus_degree()/2;
+        NbElem = batch_encoder.slot_count()/2;
 
     Ciphertext out;
     // SIMD types multiplication
@@ -65,40 +65,25 @@ Ciphertext InnerProductV2(EncryptionParameters& parms,
     // equal to 2
     eval.relinearize_inplace(out, rk);
 
-    // Generate a "mask" batch
-    Plaintext mask = CreateMaskBatch(parms);
+    // The slots are summed by blocks of a power of two: if NbElem is not one,
+    // the slots after the vectors are masked first
+    size_t NbSummed = 1;
+    while (NbSummed < NbElem)
+        NbSummed <<= 1;
+    if (NbSummed != NbElem)
+        eval.multiply_plain_inplace(out, CreateMaskBatch(batch_encoder, NbElem));
 
-    Ciphertext shiftedvector(out);
-    Ciphertext temp;
-    
-    for (size_t i = 1; i < NbElem; i++)
-    {
-        // (Example) first iteration :
-        // let shiftedvector, an arbitrary vector encoded in the batched matrix
-        // shiftedvector = [ a,  b,  c,  d,  e,  f, ...,  z ]
-        //                 [ 0,  0,  0,  0,  0,  0, ...,  0 ]
+    // Each rotation doubles the number of slots summed (log2(NbElem) key
+    // switchings instead of NbElem-1 rotations by one slot)
+    // out = [ a,  b,  c,  d,  e, ...,  z ]
+    //     + [ b,  c,  d,  e,  f, ...,  a ] (rotation by 1)
+    //     = [a+b, b+c, c+d, d+e, ..., z+a]
+    //     + [c+d, d+e, ...            b+c] (rotation by 2)
+    //     = [a+b+c+d, ...                ]
+    // and so on until we have the sum a+b+c+...+z in 'out[0]'
+    eval.sum_slots_inplace(out, NbSummed, gk);
 
-        // We shift the matrix by the rows (once at each iteration)
-        // shiftedvector = [ b,  c,  d,  e,  f,  g, ...,  a ]
-        //                 [ 0,  0,  0,  0,  0,  0, ...,  0 ]
-        eval.rotate_rows_inplace(shiftedvector, 1, gk);
-        // The mask multiplication gives us
-        // temp = [ b,  0,  0,  0,  0,  0, ...,  0 ]
-        //        [ 0,  0,  0,  0,  0,  0, ...,  0 ]
-        eval.multiply_plain(shiftedvector, mask, temp);
-        // [ a,  b,  c,  d,  e,  f, ...,  z ]
-        // [ 0,  0,  0,  0,  0,  0, ...,  0 ]
-        //                 +
-        // [ b,  0,  0,  0,  0,  0, ...,  0 ]
-        // [ 0,  0,  0,  0,  0,  0, ...,  0 ]
-        //                 =
-        // [a+b, b,  c,  d,  e,  f, ...,  z ]
-        // [ 0,  0,  0,  0,  0,  0, ...,  0 ]
-        eval.add_inplace(out, temp);
-        // We repeat this process until we have the sum a+b+c+...+z in 'out[0]'
-    }
     // Finally, we mask the out cipher
-    // NOTE: we could do that before...
-    eval.multiply_plain_inplace(out, mask);
+    eval.multiply_plain_inplace(out, CreateMaskBatch(batch_encoder));
     return out;
-}
\ No newline at end of file
+}
@@ -23,9 +23,10 @@ Ciphertext InnerProductV1(Evaluator& eval,
 // about the (batched) ciphers like the number of values in the vectors, the 
 // galois keys, the relinearization keys, and at least the EncryptionParameters).
 // To sum up, all informations that are not related to the decryption of the ciphers!
-// The evaluator could be deduced from the enc. parameters but for code factorization 
-// purposes, we added a reference to it in the arguments list.
-Ciphertext InnerProductV2(EncryptionParameters& parms,
+// The evaluator and the batch encoder (used for the masks) could be deduced from
+// the enc. parameters but, as building their SEALContext is costly, the server
+// builds them once and passes them to each call.
+Ciphertext InnerProductV2(const BatchEncoder& batch_encoder,
                           Evaluator  & eval,
                           const Ciphertext& vec1, 
                           const Ciphertext& vec2,
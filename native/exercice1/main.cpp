@@ -3,6 +3,7 @@
 
 #include "innerproduct.hpp"
 #include "outerproduct.hpp"
+#include "matrixproduct.hpp"
 
 TEST_CASE("Computation of the inner product of few vectors (one cipher for each scalar)", "[innerproductV1]" ) 
 {
@@ -130,7 +131,7 @@ TEST_CASE("Computation of the inner product of few vectors (one cipher for each
     encryptor.encrypt(plain_vec1, encrypted_vec1);
     encryptor.encrypt(plain_vec2, encrypted_vec2);
 
-    Ciphertext innerProduct = InnerProductV2(parms, evaluator, 
+    Ciphertext innerProduct = InnerProductV2(batch_encoder, evaluator,
                                              encrypted_vec1, 
                                              encrypted_vec2, 
                                              galois_keys,
@@ -141,6 +142,19 @@ TEST_CASE("Computation of the inner product of few vectors (one cipher for each
     batch_encoder.decode(plain_vec1, out);
     REQUIRE( out[0] == 38 );
 
+    // only the first 3 slots (not a power of two) are summed
+    Ciphertext partialProduct = InnerProductV2(batch_encoder, evaluator,
+                                               encrypted_vec1, 
+                                               encrypted_vec2, 
+                                               galois_keys,
+                                               relin_keys,
+                                               3);
+    Plaintext plain_partial;
+    std::vector<uint64_t> partial;
+    decryptor.decrypt(partialProduct, plain_partial);
+    batch_encoder.decode(plain_partial, partial);
+    REQUIRE( partial[0] == 17 );
+
     std::cout << "InnerProductV2" << std::endl;
     std::cout << "[ " << vec1[0] << ", " << vec1[1] << ", " << vec1[2] << ", " << vec1[3] << " ]" << " * "
               << "[ " << vec2[0] << ", " << vec2[1] << ", " << vec2[2] << ", " << vec2[3] << " ] = " << out[0] << std::endl;
@@ -294,4 +308,115 @@ TEST_CASE("Computation of the outer product of few vectors (one cipher for each
     
     std::cout << "reconstructed (outer-product) matrix :" << std::endl;
     print_arbitrary_matrix(vec_out, real_row_size);
-}
\ No newline at end of file
+}
+
+TEST_CASE("Computation of the product of two encrypted matrices (one cipher for each matrix)", "[matrixproduct]")
+{
+    size_t poly_modulus_degree = 8192;
+
+    SECTION("BFV")
+    {
+        EncryptionParameters parms(scheme_type::bfv);
+        parms.set_poly_modulus_degree(poly_modulus_degree);
+        parms.set_coeff_modulus(CoeffModulus::BFVDefault(poly_modulus_degree));
+        parms.set_plain_modulus(PlainModulus::Batching(poly_modulus_degree, 20));
+
+        SEALContext context(parms);
+        KeyGenerator keygen(context);
+        PublicKey public_key;
+        RelinKeys relin_keys;
+        keygen.create_public_key(public_key);
+        keygen.create_relin_keys(relin_keys);
+
+        Encryptor encryptor(context, public_key);
+        Evaluator evaluator(context);
+        Decryptor decryptor(context, keygen.secret_key());
+        BatchEncoder batch_encoder(context);
+
+        // 3*3 matrices (padded to 4*4)
+        size_t d = 3;
+        MatrixProduct mp(context, d);
+        GaloisKeys galois_keys;
+        keygen.create_galois_keys(mp.RotationSteps(), galois_keys);
+
+        std::vector<uint64_t> A = { 1, 2, 3,
+                                    4, 5, 6,
+                                    7, 8, 9 };
+        std::vector<uint64_t> B = { 9, 8, 7,
+                                    6, 5, 4,
+                                    3, 2, 1 };
+        std::vector<uint64_t> AB(d*d, 0ULL);
+        for (size_t i = 0; i < d; i++)
+            for (size_t j = 0; j < d; j++)
+                for (size_t k = 0; k < d; k++)
+                    AB[i*d + j] += A[i*d + k]*B[k*d + j];
+
+        Plaintext plain;
+        Ciphertext encryptedA, encryptedB;
+        batch_encoder.encode(mp.Pack(A), plain);
+        encryptor.encrypt(plain, encryptedA);
+        batch_encoder.encode(mp.Pack(B), plain);
+        encryptor.encrypt(plain, encryptedB);
+
+        Ciphertext product = mp.Multiply(evaluator, encryptedA, encryptedB, relin_keys, galois_keys);
+        std::vector<uint64_t> slots;
+        decryptor.decrypt(product, plain);
+        batch_encoder.decode(plain, slots);
+
+        print_arbitrary_matrix(mp.Unpack(slots), d);
+        REQUIRE( mp.Unpack(slots) == AB );
+    }
+
+    SECTION("CKKS")
+    {
+        EncryptionParameters parms(scheme_type::ckks);
+        parms.set_poly_modulus_degree(poly_modulus_degree);
+        // sigma/tau, phi^k and the multiplication consume 3 levels
+        parms.set_coeff_modulus(CoeffModulus::Create(poly_modulus_degree, { 50, 35, 35, 35, 50 }));
+        double scale = std::pow(2.0, 35);
+
+        SEALContext context(parms);
+        KeyGenerator keygen(context);
+        PublicKey public_key;
+        RelinKeys relin_keys;
+        keygen.create_public_key(public_key);
+        keygen.create_relin_keys(relin_keys);
+
+        Encryptor encryptor(context, public_key);
+        Evaluator evaluator(context);
+        Decryptor decryptor(context, keygen.secret_key());
+        CKKSEncoder encoder(context);
+
+        size_t d = 4;
+        MatrixProduct mp(context, d);
+        GaloisKeys galois_keys;
+        keygen.create_galois_keys(mp.RotationSteps(), galois_keys);
+
+        std::vector<double> A(d*d), B(d*d), AB(d*d, 0.0);
+        for (size_t i = 0; i < d*d; i++) {
+            A[i] = 0.5*static_cast<double>(i % 5);
+            B[i] = static_cast<double>((3*i) % 7) - 3.0;
+        }
+        for (size_t i = 0; i < d; i++)
+            for (size_t j = 0; j < d; j++)
+                for (size_t k = 0; k < d; k++)
+                    AB[i*d + j] += A[i*d + k]*B[k*d + j];
+
+        Plaintext plain;
+        Ciphertext encryptedA, encryptedB;
+        encoder.encode(mp.Pack(A), scale, plain);
+        encryptor.encrypt(plain, encryptedA);
+        encoder.encode(mp.Pack(B), scale, plain);
+        encryptor.encrypt(plain, encryptedB);
+
+        Ciphertext product = mp.Multiply(evaluator, encryptedA, encryptedB, relin_keys, galois_keys);
+        std::vector<double> slots;
+        decryptor.decrypt(product, plain);
+        encoder.decode(plain, slots);
+
+        std::vector<double> out = mp.Unpack(slots);
+        print_arbitrary_matrix(out, d);
+        for (size_t i = 0; i < d*d; i++)
+            REQUIRE( std::abs(out[i] - AB[i]) < 0.01 );
+    }
+}
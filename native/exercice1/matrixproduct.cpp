@@ -0,0 +1,173 @@
+#include <set>
+#include "matrixproduct.hpp"
+
+MatrixProduct::MatrixProduct(const SEALContext& context, size_t dimension)
+    : _context(context), _dimension(dimension), _paddedDimension(1)
+{
+    while (_paddedDimension < _dimension) _paddedDimension <<= 1;
+
+    auto& parms = _context.first_context_data()->parms();
+    size_t rowSize = parms.poly_modulus_degree()/2;
+    if (_dimension == 0 || _paddedDimension*_paddedDimension > rowSize)
+        throw "illegal dimension of matrix";
+
+    if (parms.scheme() == scheme_type::ckks) {
+        _ckks_encoder = std::make_unique<CKKSEncoder>(_context);
+        _slotCount = _ckks_encoder->slot_count();
+    }
+    else {
+        _batch_encoder = std::make_unique<BatchEncoder>(_context);
+        _slotCount = _batch_encoder->slot_count();
+    }
+
+    const size_t D = _paddedDimension;
+    // sigma(A)[i][j] = A[i][i+j]
+    _permutations.push_back(MakePermutation([D](size_t i, size_t j) { return D*i + (i + j) % D; }));
+    // tau(B)[i][j] = B[i+j][j]
+    _permutations.push_back(MakePermutation([D](size_t i, size_t j) { return D*((i + j) % D) + j; }));
+    // phi^k(A)[i][j] = A[i][j+k]
+    for (size_t k = 1; k < D; k++)
+        _permutations.push_back(MakePermutation([D, k](size_t i, size_t j) { return D*i + (j + k) % D; }));
+    // psi^k(B)[i][j] = B[i+k][j]
+    for (size_t k = 1; k < D; k++)
+        _permutations.push_back(MakePermutation([D, k](size_t i, size_t j) { return D*((i + k) % D) + j; }));
+}
+
+MatrixProduct::Permutation MatrixProduct::MakePermutation(const std::function<size_t(size_t, size_t)>& source) const
+{
+    const size_t D = _paddedDimension;
+    const int size = static_cast<int>(D*D);
+
+    // the rotations are cyclic on the D*D slots: the step of the smallest
+    // absolute value is kept
+    std::map<int, std::vector<uint64_t>> masks;
+    for (size_t l = 0; l < D*D; l++) {
+        int step = static_cast<int>(source(l/D, l%D)) - static_cast<int>(l);
+        step = (step + size) % size;
+        if (step > size/2) step -= size;
+        auto& mask = masks[step];
+        mask.resize(D*D, 0ULL);
+        mask[l] = 1ULL;
+    }
+
+    Permutation permutation;
+    for (auto& stepMask : masks) {
+        permutation.steps.push_back(stepMask.first);
+        permutation.masks.push_back(std::move(stepMask.second));
+    }
+    return permutation;
+}
+
+std::vector<int> MatrixProduct::RotationSteps() const
+{
+    std::set<int> steps;
+    for (const Permutation& permutation : _permutations)
+        for (int step : permutation.steps)
+            if (step) steps.insert(step);
+    return std::vector<int>(steps.begin(), steps.end());
+}
+
+void MatrixProduct::Rotate(Evaluator& eval, Ciphertext& encrypted, int step, GaloisKeys& gk) const
+{
+    if (IsCKKS())
+        eval.rotate_vector_inplace(encrypted, step, gk);
+    else
+        eval.rotate_rows_inplace(encrypted, step, gk);
+}
+
+const Plaintext& MatrixProduct::Mask(Evaluator& eval, size_t permutation, size_t r, const parms_id_type& parms_id)
+{
+    auto key = std::make_tuple(permutation, r, parms_id);
+    auto it = _masks.find(key);
+    if (it != _masks.end())
+        return it->second;
+
+    const std::vector<uint64_t>& mask = _permutations[permutation].masks[r];
+    Plaintext plain;
+    if (IsCKKS()) {
+        // rescaling by the last prime gives back the scale of the cipher
+        double scale = static_cast<double>(_context.get_context_data(parms_id)->parms().coeff_modulus().back().value());
+        std::vector<double> slots(_slotCount);
+        for (size_t t = 0; t < _slotCount; t++)
+            slots[t] = static_cast<double>(mask[t % mask.size()]);
+        _ckks_encoder->encode(slots, parms_id, scale, plain);
+    }
+    else {
+        std::vector<uint64_t> slots(_slotCount);
+        for (size_t t = 0; t < _slotCount; t++)
+            slots[t] = mask[t % mask.size()];
+        _batch_encoder->encode(slots, plain);
+        eval.transform_to_ntt_inplace(plain, parms_id);
+    }
+    return _masks.emplace(key, std::move(plain)).first->second;
+}
+
+Ciphertext MatrixProduct::Permute(Evaluator& eval, const Ciphertext& encrypted, size_t permutation, GaloisKeys& gk)
+{
+    const Permutation& perm = _permutations[permutation];
+    Ciphertext out;
+
+    // a single rotation: no mask (and no level in CKKS)
+    if (perm.steps.size() == 1) {
+        out = encrypted;
+        if (perm.steps[0]) Rotate(eval, out, perm.steps[0], gk);
+        return out;
+    }
+
+    // out = sum_r mask_r * rot(encrypted, steps[r]), sharing the key switching
+    // decomposition of encrypted
+    std::vector<Ciphertext> rotated;
+    eval.rotate_hoisted(encrypted, perm.steps, gk, rotated);
+    for (size_t r = 0; r < rotated.size(); r++) {
+        if (!IsCKKS()) eval.transform_to_ntt_inplace(rotated[r]);
+        eval.multiply_plain_inplace(rotated[r], Mask(eval, permutation, r, encrypted.parms_id()));
+        if (r == 0)
+            out = std::move(rotated[0]);
+        else
+            eval.add_inplace(out, rotated[r]);
+    }
+
+    if (IsCKKS())
+        eval.rescale_to_next_inplace(out);
+    else
+        eval.transform_from_ntt_inplace(out);
+    return out;
+}
+
+void MatrixProduct::AlignLevels(Evaluator& eval, Ciphertext& encrypted1, Ciphertext& encrypted2) const
+{
+    size_t level1 = _context.get_context_data(encrypted1.parms_id())->chain_index();
+    size_t level2 = _context.get_context_data(encrypted2.parms_id())->chain_index();
+    if (level1 > level2)
+        eval.mod_switch_to_inplace(encrypted1, encrypted2.parms_id());
+    else if (level2 > level1)
+        eval.mod_switch_to_inplace(encrypted2, encrypted1.parms_id());
+}
+
+Ciphertext MatrixProduct::Multiply(Evaluator& eval, const Ciphertext& A, const Ciphertext& B,
+                                   RelinKeys& rk, GaloisKeys& gk)
+{
+    const size_t D = _paddedDimension;
+
+    Ciphertext sigmaA = Permute(eval, A, 0, gk);
+    Ciphertext tauB = Permute(eval, B, 1, gk);
+
+    // sum_k phi^k(sigma(A)) * psi^k(tau(B))
+    Ciphertext out, term;
+    for (size_t k = 0; k < D; k++) {
+        Ciphertext Ak = k ? Permute(eval, sigmaA, 1 + k, gk) : sigmaA;
+        Ciphertext Bk = k ? Permute(eval, tauB, D + k, gk) : tauB;
+        AlignLevels(eval, Ak, Bk);
+
+        Ciphertext& dest = k ? term : out;
+        eval.multiply(Ak, Bk, dest);
+        if (k) {
+            AlignLevels(eval, out, term);
+            eval.add_inplace(out, term);
+        }
+    }
+
+    eval.relinearize_inplace(out, rk);
+    if (IsCKKS()) eval.rescale_to_next_inplace(out);
+    return out;
+}
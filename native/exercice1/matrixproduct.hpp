@@ -0,0 +1,120 @@
+#ifndef __MATRIXPRODUCT_HPP__
+#define __MATRIXPRODUCT_HPP__
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <tuple>
+#include "examples.h"
+
+using namespace seal;
+
+// Product of two encrypted d*d matrices, each packed in a single cipher
+// (Jiang-Kim-Lauter-Song). The matrices are padded to D*D, D being the power
+// of two >= d, packed row by row (slot D*i+j holds M[i][j]) and replicated
+// along the rows of the batching matrix, so that a rotation of the row is a
+// cyclic rotation of the D*D slots (D*D must be at most poly_modulus_degree/2).
+//
+// With the permutations of the slots
+//   sigma(A)[i][j] = A[i][i+j]      tau(B)[i][j] = B[i+j][j]
+//   phi(A)[i][j]   = A[i][j+1]      psi(B)[i][j] = B[i+1][j]
+// the product is
+//   A*B = sum_{k<D} phi^k(sigma(A)) * psi^k(tau(B))    (element-wise)
+//
+// Each permutation is a sum of masked rotations (the rotations of a same
+// cipher are hoisted, see Evaluator::rotate_hoisted): 2D-1 for sigma, D for
+// tau, 2 for phi^k and a single rotation (no mask) for psi^k. The product
+// then costs O(D) rotations and D multiplications, instead of the d^3 scalar
+// multiplications of one cipher per coefficient (see OuterProductV1).
+//
+// BFV (BatchEncoder) and CKKS (CKKSEncoder) are supported. In CKKS a mask is
+// encoded at the scale of the last prime of the level and rescaled: sigma/tau,
+// phi^k and the multiplication consume 3 levels.
+class MatrixProduct
+{
+public:
+    MatrixProduct(const SEALContext& context, size_t dimension);
+
+    // Rotation steps of Multiply, to create only their Galois keys
+    std::vector<int> RotationSteps() const;
+
+    // Slots of a packed matrix (d*d values, row by row): T is uint64_t for
+    // BFV and double for CKKS
+    template <typename T>
+    std::vector<T> Pack(const std::vector<T>& matrix) const;
+
+    // d*d matrix of the decoded slots of a packed matrix
+    template <typename T>
+    std::vector<T> Unpack(const std::vector<T>& slots) const;
+
+    // Packed A*B
+    Ciphertext Multiply(Evaluator& eval, const Ciphertext& A, const Ciphertext& B,
+                        RelinKeys& rk, GaloisKeys& gk);
+
+    inline size_t Dimension() const { return _dimension; }
+
+private:
+    // Linear transformation of the D*D slots: the slot l is moved from the
+    // slot l + steps[r] where masks[r][l] = 1
+    struct Permutation
+    {
+        std::vector<int> steps;
+        std::vector<std::vector<uint64_t>> masks;
+    };
+
+    // source(i, j): slot moved to the slot D*i+j
+    Permutation MakePermutation(const std::function<size_t(size_t, size_t)>& source) const;
+
+    Ciphertext Permute(Evaluator& eval, const Ciphertext& encrypted, size_t permutation, GaloisKeys& gk);
+
+    void Rotate(Evaluator& eval, Ciphertext& encrypted, int step, GaloisKeys& gk) const;
+
+    // The mask of the r-th rotation of a permutation, in NTT form at the level
+    // of parms_id (cached)
+    const Plaintext& Mask(Evaluator& eval, size_t permutation, size_t r, const parms_id_type& parms_id);
+
+    // Switch the upper of the two ciphers to the level of the other one
+    void AlignLevels(Evaluator& eval, Ciphertext& encrypted1, Ciphertext& encrypted2) const;
+
+    inline bool IsCKKS() const { return _ckks_encoder != nullptr; }
+
+    SEALContext _context;
+    size_t _dimension;
+    size_t _paddedDimension;
+    size_t _slotCount;
+    std::unique_ptr<BatchEncoder> _batch_encoder;
+    std::unique_ptr<CKKSEncoder> _ckks_encoder;
+    // sigma, tau, phi^1..phi^(D-1), psi^1..psi^(D-1)
+    std::vector<Permutation> _permutations;
+    std::map<std::tuple<size_t, size_t, parms_id_type>, Plaintext> _masks;
+};
+
+// Template Definitions
+//
+template <typename T>
+std::vector<T> MatrixProduct::Pack(const std::vector<T>& matrix) const
+{
+    if (matrix.size() != _dimension*_dimension)
+        throw "illegal size of matrix";
+
+    const size_t D = _paddedDimension;
+    std::vector<T> slots(_slotCount, T(0));
+    for (size_t t = 0; t < _slotCount; t++) {
+        size_t i = (t % (D*D))/D, j = t % D;
+        if (i < _dimension && j < _dimension)
+            slots[t] = matrix[i*_dimension + j];
+    }
+    return slots;
+}
+
+template <typename T>
+std::vector<T> MatrixProduct::Unpack(const std::vector<T>& slots) const
+{
+    std::vector<T> matrix(_dimension*_dimension);
+    for (size_t i = 0; i < _dimension; i++)
+        for (size_t j = 0; j < _dimension; j++)
+            matrix[i*_dimension + j] = slots[i*_paddedDimension + j];
+    return matrix;
+}
+
+#endif
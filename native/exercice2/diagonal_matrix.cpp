@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include "diagonal_matrix.hpp"
+
+namespace
+{
+    // rot(v, k) is a rotation of the replicated vector only if its first
+    // 2.dimension slots (at most) hold v twice in a row, or if the dimension
+    // divides the row size
+    size_t rowSizeFor(LinearAlgebraContext& la, size_t dimension)
+    {
+        size_t rowSize = la.slotCount()/2;
+        if (dimension == 0 || dimension > rowSize ||
+            (rowSize % dimension != 0 && 2*dimension > rowSize))
+            throw "illegal dimension of matrix";
+        return rowSize;
+    }
+
+    size_t babyStepsFor(size_t dimension)
+    {
+        size_t g = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(dimension))));
+        return std::max<size_t>(g, 1);
+    }
+}
+
+DiagonalMatrix::DiagonalMatrix(LinearAlgebraContext& la, const std::vector<uint64_t>& matrix, size_t dimension)
+    : _dimension(dimension), _babySteps(babyStepsFor(dimension)),
+      _giantSteps((dimension + _babySteps - 1)/_babySteps), _parms_id(la.context().first_parms_id())
+{
+    std::vector<std::vector<uint64_t>> diags = diagonals(matrix, rowSizeFor(la, dimension));
+    _plainDiagonals.resize(_dimension);
+    Evaluator eval(la.context());
+    for (size_t k = 0; k < _dimension; k++) {
+        la.batchEncoder().encode(diags[k], _plainDiagonals[k]);
+        eval.transform_to_ntt_inplace(_plainDiagonals[k], _parms_id);
+    }
+}
+
+DiagonalMatrix::DiagonalMatrix(LinearAlgebraContext& la, const std::vector<uint64_t>& matrix, size_t dimension,
+                               Encryptor& encryptor)
+    : _dimension(dimension), _babySteps(babyStepsFor(dimension)),
+      _giantSteps((dimension + _babySteps - 1)/_babySteps), _parms_id(la.context().first_parms_id())
+{
+    std::vector<std::vector<uint64_t>> diags = diagonals(matrix, rowSizeFor(la, dimension));
+    _cipherDiagonals.resize(_dimension);
+    Plaintext plain;
+    for (size_t k = 0; k < _dimension; k++) {
+        la.batchEncoder().encode(diags[k], plain);
+        encryptor.encrypt(plain, _cipherDiagonals[k]);
+    }
+}
+
+std::vector<std::vector<uint64_t>> DiagonalMatrix::diagonals(const std::vector<uint64_t>& matrix,
+                                                             size_t rowSize) const
+{
+    const size_t n = _dimension;
+    if (matrix.size() != n*n)
+        throw "illegal size of matrix";
+
+    // diag_k rotated by -g.j: slot t holds diag_k[(t - g.j) mod n], in both rows
+    std::vector<std::vector<uint64_t>> diags(n, std::vector<uint64_t>(2*rowSize));
+    for (size_t k = 0; k < n; k++) {
+        size_t shift = (k/_babySteps)*_babySteps;
+        for (size_t t = 0; t < rowSize; t++) {
+            size_t s = (t % n + n - shift) % n;
+            diags[k][t] = diags[k][t + rowSize] = matrix[s*n + (s + k) % n];
+        }
+    }
+    return diags;
+}
+
+std::vector<int> DiagonalMatrix::rotationSteps(size_t dimension)
+{
+    size_t g = babyStepsFor(dimension);
+    std::vector<int> steps;
+    for (size_t i = 1; i < g && i < dimension; i++)
+        steps.push_back(static_cast<int>(i));
+    for (size_t shift = g; shift < dimension; shift += g)
+        steps.push_back(static_cast<int>(shift));
+    return steps;
+}
+
+std::vector<uint64_t> DiagonalMatrix::packVector(LinearAlgebraContext& la, const std::vector<uint64_t>& vec)
+{
+    size_t rowSize = rowSizeFor(la, vec.size());
+    std::vector<uint64_t> packed(2*rowSize);
+    for (size_t t = 0; t < packed.size(); t++)
+        packed[t] = vec[(t % rowSize) % vec.size()];
+    return packed;
+}
+
+Ciphertext DiagonalMatrix::multiply(Evaluator& eval, const Ciphertext& vec, GaloisKeys& gk,
+                                    const RelinKeys* rk) const
+{
+    if (isEncrypted() && !rk)
+        throw "an encrypted matrix needs the relinearization keys";
+    if (vec.parms_id() != _parms_id)
+        throw "the matrix and the vector are not at the same level";
+
+    // Baby steps: rot(v, i) for i < g, sharing a single key switching
+    // decomposition of v
+    std::vector<int> steps(_babySteps);
+    std::iota(steps.begin(), steps.end(), 0);
+    std::vector<Ciphertext> rotated;
+    eval.rotate_hoisted(vec, steps, gk, rotated);
+    if (!isEncrypted())
+        for (Ciphertext& r : rotated)
+            eval.transform_to_ntt_inplace(r);
+
+    // Giant steps: rot(sum_i diag_{g.j+i} * rot(v, i), g.j)
+    Ciphertext out, inner, term;
+    for (size_t j = 0; j < _giantSteps; j++) {
+        for (size_t i = 0; i < _babySteps && j*_babySteps + i < _dimension; i++) {
+            size_t k = j*_babySteps + i;
+            Ciphertext& dest = i ? term : inner;
+            if (isEncrypted())
+                eval.multiply(_cipherDiagonals[k], rotated[i], dest);
+            else
+                eval.multiply_plain(rotated[i], _plainDiagonals[k], dest);
+            if (i) eval.add_inplace(inner, term);
+        }
+
+        if (isEncrypted())
+            eval.relinearize_inplace(inner, *rk);
+        else
+            eval.transform_from_ntt_inplace(inner);
+
+        if (j == 0) {
+            out = inner;
+            continue;
+        }
+        eval.rotate_rows_inplace(inner, static_cast<int>(j*_babySteps), gk);
+        eval.add_inplace(out, inner);
+    }
+    return out;
+}
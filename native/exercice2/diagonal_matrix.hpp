@@ -0,0 +1,65 @@
+#ifndef __DIAGONAL_MATRIX_HPP__
+#define __DIAGONAL_MATRIX_HPP__
+
+#include "examples.h"
+#include "linear_algebra_context.hpp"
+
+using namespace seal;
+
+// Square matrix (dimension n) packed by its generalized diagonals, for the
+// Halevi-Shoup matrix-vector product:
+//
+//   M.v = sum_k diag_k * rot(v, k)    with diag_k[t] = M[t][(t+k) mod n]
+//
+// The vector is replicated along the rows of the batching matrix (see
+// packVector) so that rot(v, k) is a single rotate_rows. The sum is split in
+// baby steps i and giant steps g.j (k = g.j + i, g ~ sqrt(n)):
+//
+//   M.v = sum_j rot( sum_i rot(diag_{g.j+i}, -g.j) * rot(v, i), g.j )
+//
+// The g-1 baby rotations of v are hoisted (Evaluator::rotate_hoisted) and the
+// diagonals are stored already rotated by -g.j, so the product costs about
+// 2.sqrt(n) rotations instead of n. A plaintext matrix keeps its diagonals
+// encoded once in NTT form: the baby rotations are transformed to NTT once
+// and each diagonal is a multiply_plain without any NTT. An encrypted matrix
+// relinearizes once per giant step.
+class DiagonalMatrix
+{
+public:
+    // Plaintext matrix (row-major, dimension*dimension values)
+    DiagonalMatrix(LinearAlgebraContext& la, const std::vector<uint64_t>& matrix, size_t dimension);
+
+    // Encrypted matrix
+    DiagonalMatrix(LinearAlgebraContext& la, const std::vector<uint64_t>& matrix, size_t dimension,
+                   Encryptor& encryptor);
+
+    // Rotation steps of the product, to create only their Galois keys
+    static std::vector<int> rotationSteps(size_t dimension);
+
+    // vec (of size dimension) replicated in each row of the batching matrix:
+    // slot t of a row holds vec[t mod dimension]
+    static std::vector<uint64_t> packVector(LinearAlgebraContext& la, const std::vector<uint64_t>& vec);
+
+    // M.vec in the first dimension slots of each row (the other slots are
+    // garbage), vec being packed by packVector. rk is only used by an
+    // encrypted matrix.
+    Ciphertext multiply(Evaluator& eval, const Ciphertext& vec, GaloisKeys& gk,
+                        const RelinKeys* rk = nullptr) const;
+
+    inline size_t dimension() const { return _dimension; }
+
+    inline bool isEncrypted() const { return !_cipherDiagonals.empty(); }
+
+private:
+    // Diagonals rotated by -g.j, as values of the slots
+    std::vector<std::vector<uint64_t>> diagonals(const std::vector<uint64_t>& matrix, size_t rowSize) const;
+
+    size_t _dimension;
+    size_t _babySteps;
+    size_t _giantSteps;
+    parms_id_type _parms_id;
+    std::vector<Plaintext> _plainDiagonals;
+    std::vector<Ciphertext> _cipherDiagonals;
+};
+
+#endif
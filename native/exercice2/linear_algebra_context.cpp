@@ -0,0 +1,33 @@
+#include "linear_algebra_context.hpp"
+
+LinearAlgebraContext::LinearAlgebraContext(const EncryptionParameters& parms)
+    : _parms(parms), _context(parms), _batch_encoder(_context), _evaluator(_context)
+{
+}
+
+const Plaintext& LinearAlgebraContext::mask(size_t NbOnes, const parms_id_type& parms_id, size_t stride)
+{
+    auto key = std::make_tuple(NbOnes, stride, parms_id);
+    auto it = _masks.find(key);
+    if (it != _masks.end())
+        return it->second;
+
+    if (stride == 0 || (NbOnes > 0 && (NbOnes - 1)*stride >= slotCount()))
+        throw "illegal size of mask";
+    std::vector<uint64_t> pod_matrix(slotCount(), 0ULL);
+    for (size_t i = 0; i < NbOnes; i++)
+        pod_matrix[i*stride] = 1ULL;
+
+    Plaintext mask;
+    _batch_encoder.encode(pod_matrix, mask);
+    _evaluator.transform_to_ntt_inplace(mask, parms_id);
+    return _masks.emplace(key, std::move(mask)).first->second;
+}
+
+void LinearAlgebraContext::applyMask(Ciphertext& encrypted, size_t NbOnes, size_t stride)
+{
+    const Plaintext& nttMask = mask(NbOnes, encrypted.parms_id(), stride);
+    _evaluator.transform_to_ntt_inplace(encrypted);
+    _evaluator.multiply_plain_inplace(encrypted, nttMask);
+    _evaluator.transform_from_ntt_inplace(encrypted);
+}
@@ -0,0 +1,50 @@
+#ifndef __LINEAR_ALGEBRA_CONTEXT_HPP__
+#define __LINEAR_ALGEBRA_CONTEXT_HPP__
+
+#include <map>
+#include <tuple>
+#include "examples.h"
+
+using namespace seal;
+
+// Context shared by the linear algebra kernels (InnerProductV2,
+// matrixVectorProduct, squareMatrixVectorProduct...). Building a SEALContext
+// validates the primes and generates the NTT tables: it is done once here
+// instead of at each mask generation. The masks are cached in NTT form, so
+// applying one is a multiply_plain on the NTT form of the cipher, without
+// converting the mask again.
+class LinearAlgebraContext
+{
+public:
+    explicit LinearAlgebraContext(const EncryptionParameters& parms);
+
+    // Mask keeping NbOnes slots every stride slots (the first NbOnes slots if
+    // stride = 1), in NTT form at the level of parms_id
+    // this gives us (NbOnes = 1) :
+    //  [ 1,  0,  0,  0,  0,  0, ...,  0 ]
+    //  [ 0,  0,  0,  0,  0,  0, ...,  0 ]
+    // and (NbOnes = 3, stride = 2) :
+    //  [ 1,  0,  1,  0,  1,  0, ...,  0 ]
+    //  [ 0,  0,  0,  0,  0,  0, ...,  0 ]
+    const Plaintext& mask(size_t NbOnes, const parms_id_type& parms_id, size_t stride = 1);
+
+    // encrypted = encrypted * mask(NbOnes, stride)
+    void applyMask(Ciphertext& encrypted, size_t NbOnes = 1, size_t stride = 1);
+
+    inline const EncryptionParameters& parms() const { return _parms; }
+
+    inline const SEALContext& context() const { return _context; }
+
+    inline BatchEncoder& batchEncoder() { return _batch_encoder; }
+
+    inline size_t slotCount() const { return _batch_encoder.slot_count(); }
+
+private:
+    EncryptionParameters _parms;
+    SEALContext _context;
+    BatchEncoder _batch_encoder;
+    Evaluator _evaluator;
+    std::map<std::tuple<size_t, size_t, parms_id_type>, Plaintext> _masks;
+};
+
+#endif
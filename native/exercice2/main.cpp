@@ -2,6 +2,7 @@
 #include "catch.hpp"
 
 #include "matrix_vector_product.hpp"
+#include "diagonal_matrix.hpp"
 
 TEST_CASE("Matrix Vector Multiplication", "Using the inner product")
 {
@@ -82,7 +83,8 @@ TEST_CASE("Matrix Vector Multiplication", "Using the inner product")
     encryptor.encrypt(plain_matrix_v3, matrix[2]);
     encryptor.encrypt(plain_matrix_v4, matrix[3]);
 
-    std::vector<Ciphertext> matrix_vector_product = matrixVectorProduct(parms, evaluator, matrix, encrypted_vec, galois_keys,relin_keys,4);
+    LinearAlgebraContext la(parms);
+    std::vector<Ciphertext> matrix_vector_product = matrixVectorProduct(la, evaluator, matrix, encrypted_vec, galois_keys,relin_keys,4);
 
     std::vector<Plaintext> issou(4);
     std::vector<std::vector<uint64_t>> out(4);
@@ -177,7 +179,8 @@ TEST_CASE("Second Matrix Vector Multiplication", "Efficient implementation")
 
     print_matrix(test, 4);
 
-    Ciphertext cp = squareMatrixVectorProduct(parms, 
+    LinearAlgebraContext la(parms);
+    Ciphertext cp = squareMatrixVectorProduct(la, 
                                               evaluator,
                                               cipher_matrix,
                                               encrypted_vec,
@@ -197,4 +200,115 @@ TEST_CASE("Second Matrix Vector Multiplication", "Efficient implementation")
                  out[1] << " " <<
                  out[2] << " " <<
                  out[3] << std::endl;
-}
\ No newline at end of file
+}
+
+TEST_CASE("Diagonal Matrix Vector Multiplication", "Halevi-Shoup with baby-step/giant-step rotations")
+{
+    EncryptionParameters parms(scheme_type::bfv);
+    size_t poly_modulus_degree = 8192;
+    parms.set_poly_modulus_degree(poly_modulus_degree);
+    parms.set_coeff_modulus(CoeffModulus::BFVDefault(poly_modulus_degree));
+    parms.set_plain_modulus(PlainModulus::Batching(poly_modulus_degree, 20));
+
+    LinearAlgebraContext la(parms);
+    KeyGenerator keygen(la.context());
+    PublicKey public_key;
+    RelinKeys relin_keys;
+    keygen.create_public_key(public_key);
+    keygen.create_relin_keys(relin_keys);
+
+    Encryptor encryptor(la.context(), public_key);
+    Evaluator evaluator(la.context());
+    Decryptor decryptor(la.context(), keygen.secret_key());
+
+    // 7 does not divide the row size (4096), 16 does
+    for (size_t n : { size_t(7), size_t(16) })
+    {
+        std::vector<uint64_t> matrix(n*n), vec(n), expected(n, 0ULL);
+        for (size_t i = 0; i < n; i++) {
+            vec[i] = i + 1;
+            for (size_t j = 0; j < n; j++)
+                matrix[i*n + j] = (3*i + j) % 11;
+        }
+        for (size_t i = 0; i < n; i++)
+            for (size_t j = 0; j < n; j++)
+                expected[i] += matrix[i*n + j]*vec[j];
+
+        // only the ~2.sqrt(n) rotations of the product
+        GaloisKeys galois_keys;
+        keygen.create_galois_keys(DiagonalMatrix::rotationSteps(n), galois_keys);
+
+        Plaintext plain_vec;
+        Ciphertext encrypted_vec;
+        la.batchEncoder().encode(DiagonalMatrix::packVector(la, vec), plain_vec);
+        encryptor.encrypt(plain_vec, encrypted_vec);
+
+        DiagonalMatrix plainMatrix(la, matrix, n);
+        DiagonalMatrix cipherMatrix(la, matrix, n, encryptor);
+
+        for (const DiagonalMatrix* m : { &plainMatrix, &cipherMatrix })
+        {
+            Ciphertext product = m->multiply(evaluator, encrypted_vec, galois_keys, &relin_keys);
+            Plaintext plain;
+            std::vector<uint64_t> out;
+            decryptor.decrypt(product, plain);
+            la.batchEncoder().decode(plain, out);
+            out.resize(n);
+            REQUIRE( out == expected );
+        }
+    }
+}
+
+TEST_CASE("Packed Matrix Vector Multiplication", "All the rows in a single cipher")
+{
+    EncryptionParameters parms(scheme_type::bfv);
+    size_t poly_modulus_degree = 8192;
+    parms.set_poly_modulus_degree(poly_modulus_degree);
+    parms.set_coeff_modulus(CoeffModulus::BFVDefault(poly_modulus_degree));
+    parms.set_plain_modulus(PlainModulus::Batching(poly_modulus_degree, 20));
+
+    LinearAlgebraContext la(parms);
+    KeyGenerator keygen(la.context());
+    PublicKey public_key;
+    RelinKeys relin_keys;
+    keygen.create_public_key(public_key);
+    keygen.create_relin_keys(relin_keys);
+
+    Encryptor encryptor(la.context(), public_key);
+    Evaluator evaluator(la.context());
+    Decryptor decryptor(la.context(), keygen.secret_key());
+
+    // 1000 rows of 7 columns (stride 8) fill both rows of the batching matrix
+    size_t NbRows = 1000, NbColumns = 7;
+    size_t stride = packedRowStride(NbColumns);
+    std::vector<uint64_t> matrix(NbRows*NbColumns), vec(NbColumns), expected(NbRows, 0ULL);
+    for (size_t j = 0; j < NbColumns; j++)
+        vec[j] = j + 1;
+    for (size_t i = 0; i < NbRows; i++)
+        for (size_t j = 0; j < NbColumns; j++) {
+            matrix[i*NbColumns + j] = (i + 5*j) % 13;
+            expected[i] += matrix[i*NbColumns + j]*vec[j];
+        }
+
+    // only the log2(stride) rotations of the sums
+    GaloisKeys galois_keys;
+    keygen.create_galois_keys(evaluator.sum_slots_steps(stride), galois_keys);
+
+    Plaintext plain;
+    Ciphertext encrypted_matrix, encrypted_vec;
+    la.batchEncoder().encode(packMatrixRows(la, matrix, NbRows, NbColumns), plain);
+    encryptor.encrypt(plain, encrypted_matrix);
+    la.batchEncoder().encode(packVectorRows(la, vec, NbRows), plain);
+    encryptor.encrypt(plain, encrypted_vec);
+
+    Ciphertext product = packedMatrixVectorProduct(la, evaluator, encrypted_matrix, encrypted_vec,
+                                                   NbRows, NbColumns, galois_keys, relin_keys);
+    std::vector<uint64_t> out;
+    decryptor.decrypt(product, plain);
+    la.batchEncoder().decode(plain, out);
+
+    std::vector<uint64_t> expectedSlots(la.slotCount(), 0ULL);
+    for (size_t i = 0; i < NbRows; i++)
+        expectedSlots[i*stride] = expected[i];
+    REQUIRE( out == expectedSlots );
+}
@@ -1,22 +1,11 @@
 #include "matrix_vector_product.hpp"
 
-static Plaintext CreateMaskBatch(EncryptionParameters& parms) {
-    SEALContext context(parms); BatchEncoder batch_encoder(context); Plaintext mask;
-    size_t slot_count = batch_encoder.slot_count();
-    std::vector<uint64_t> pod_matrix(slot_count, 0ULL);
-    // we only initialize the first value at one this gives us :
-    //  [ 1, 0, 0, 0, 0, 0, ..., 0 ] [ 0, 0, 0, 0, 0, 0, ..., 0 ]
-    pod_matrix[0] = 1ULL; 
-    batch_encoder.encode(pod_matrix, mask); 
-    return mask;
-}
-
-Ciphertext InnerProductV2(EncryptionParameters& parms, Evaluator & eval, const Ciphertext& vec1, const 
+Ciphertext InnerProductV2(LinearAlgebraContext& la, Evaluator & eval, const Ciphertext& vec1, const 
                           Ciphertext& vec2, GaloisKeys& gk, RelinKeys & rk, size_t NbElem = 0ULL)
 {
     // If the number of batched values is not given, we assume that the vector is at most of size 
     // poly_modulus_degree/2
-    if (NbElem == 0) NbElem = parms.poly_modulus_degree()/2;
+    if (NbElem == 0) NbElem = la.parms().poly_modulus_degree()/2;
 
     Ciphertext out;
     // SIMD types multiplication
@@ -25,36 +14,22 @@ Ciphertext InnerProductV2(EncryptionParameters& parms, Evaluator & eval, const C
     // the rotation could only be done if the size is equal to 2
     eval.relinearize_inplace(out, rk);
 
-    // Generate a "mask" batch
-    Plaintext mask = CreateMaskBatch(parms);
-
-    Ciphertext shiftedvector(out); Ciphertext temp;
-    
-    for (size_t i = 1; i < NbElem; i++) {
-        // (Example) first iteration : let shiftedvector, an arbitrary vector encoded in the batched 
-        // matrix shiftedvector = [ a, b, c, d, e, f, ..., z ]
-        //                        [ 0, 0, 0, 0, 0, 0, ..., 0 ]
-
-        // We shift the matrix by the rows (once at each iteration) 
-        // shiftedvector = [ b, c, d, e, f, g, ..., a ]
-        //                 [ 0, 0, 0, 0, 0, 0, ..., 0 ]
-        eval.rotate_rows_inplace(shiftedvector, 1, gk);
-        // The mask multiplication gives us temp = [ b, 0, 0, 0, 0, 0, ..., 0 ]
-        //                                         [ 0, 0, 0, 0, 0, 0, ..., 0 ]
-        eval.multiply_plain(shiftedvector, mask, temp);
-        // [ a, b, c, d, e, f, ..., z ] [ 0, 0, 0, 0, 0, 0, ..., 0 ]
-        //                 +
-        // [ b, 0, 0, 0, 0, 0, ..., 0 ] [ 0, 0, 0, 0, 0, 0, ..., 0 ]
-        //                 =
-        // [a+b, b, c, d, e, f, ..., z ] [ 0, 0, 0, 0, 0, 0, ..., 0 ]
-        eval.add_inplace(out, temp);
-        // We repeat this process until we have the sum a+b+c+...+z in 'out[0]'
-    }
-    // Finally, we mask the out cipher NOTE: we could do that before...
-    eval.multiply_plain_inplace(out, mask); return out;
+    // The slots are summed by blocks of a power of two: if NbElem is not one, the slots after the 
+    // vectors are masked first
+    size_t NbSummed = 1;
+    while (NbSummed < NbElem) NbSummed <<= 1;
+    if (NbSummed != NbElem) la.applyMask(out, NbElem);
+
+    // Each rotation doubles the number of slots summed (log2(NbElem) key switchings instead of 
+    // NbElem-1 rotations by one slot): [ a, b, c, d, ... ] + [ b, c, d, e, ... ] = [ a+b, b+c, ... ]
+    // then [ a+b, b+c, ... ] + [ c+d, d+e, ... ] = [ a+b+c+d, ... ] until the sum is in 'out[0]'
+    eval.sum_slots_inplace(out, NbSummed, gk);
+
+    // Finally, we mask the out cipher (the masks are those of the shared context, see LinearAlgebraContext)
+    la.applyMask(out); return out;
 }
 
-std::vector<Ciphertext> matrixVectorProduct(EncryptionParameters& parms, 
+std::vector<Ciphertext> matrixVectorProduct(LinearAlgebraContext& la, 
                                             Evaluator & eval, 
                                             const std::vector<Ciphertext>& matrix, 
                                             const Ciphertext& vec,
@@ -65,13 +40,71 @@ std::vector<Ciphertext> matrixVectorProduct(EncryptionParameters& parms,
 	std::vector<Ciphertext> out(matrix.size()); 
 	Ciphertext temp; 
 	for (size_t i=0; i<matrix.size(); i++) {
-		temp = InnerProductV2(parms, eval, matrix[i], vec, gk, rk, NbElem); 
+		temp = InnerProductV2(la, eval, matrix[i], vec, gk, rk, NbElem); 
 		out[i] = temp;
 	}
 	return out;
 
 }
 
+size_t packedRowStride(size_t NbColumns)
+{
+    size_t stride = 1;
+    while (stride < NbColumns) stride <<= 1;
+    return stride;
+}
+
+std::vector<uint64_t> packMatrixRows(LinearAlgebraContext& la,
+                                     const std::vector<uint64_t>& matrix,
+                                     size_t NbRows,
+                                     size_t NbColumns)
+{
+    if (matrix.size() != NbRows*NbColumns)
+        throw "illegal size of matrix";
+    size_t stride = packedRowStride(NbColumns);
+    // a row can't overlap the two rows of the batching matrix
+    if (NbRows*stride > la.slotCount() || stride > la.slotCount()/2)
+        throw "can't pack this matrix with these parameters";
+
+    std::vector<uint64_t> packed(la.slotCount(), 0ULL);
+    for (size_t i = 0; i < NbRows; i++)
+        std::copy(matrix.begin() + i*NbColumns, matrix.begin() + (i+1)*NbColumns, packed.begin() + i*stride);
+    return packed;
+}
+
+std::vector<uint64_t> packVectorRows(LinearAlgebraContext& la,
+                                     const std::vector<uint64_t>& vec,
+                                     size_t NbRows)
+{
+    std::vector<uint64_t> matrix;
+    matrix.reserve(NbRows*vec.size());
+    for (size_t i = 0; i < NbRows; i++)
+        matrix.insert(matrix.end(), vec.begin(), vec.end());
+    return packMatrixRows(la, matrix, NbRows, vec.size());
+}
+
+Ciphertext packedMatrixVectorProduct(LinearAlgebraContext& la,
+                                     Evaluator& eval,
+                                     const Ciphertext& packedMatrix,
+                                     const Ciphertext& packedVec,
+                                     size_t NbRows,
+                                     size_t NbColumns,
+                                     GaloisKeys& gk,
+                                     RelinKeys& rk)
+{
+    size_t stride = packedRowStride(NbColumns);
+    if (NbRows*stride > la.slotCount() || stride > la.slotCount()/2)
+        throw "can't execute this function with these parameters";
+
+    // [ aA, bB, cC, 0, dA, eB, fC, 0, ... ], the segments being summed in
+    // their first slot: the padding slots are 0, so no mask is needed first
+    Ciphertext out;
+    eval.inner_product(packedMatrix, packedVec, stride, rk, gk, out);
+
+    // Finally, only the first slot of each segment is kept
+    la.applyMask(out, NbRows, stride); return out;
+}
+
 // https://github.com/microsoft/SEAL-Demo/blob/master/CloudFunctionsDemo/ClientBasedFunctions/ClientBasedFunctions/MatrixProduct.md
 
 // Thinking: generalization of this method to non square matrix...
@@ -91,14 +124,14 @@ std::vector<Ciphertext> matrixVectorProduct(EncryptionParameters& parms,
 //
 // [ aA eB iC jA] + [ bB fC gA kB] + [ cC dA hB lC]
 // = [ aA+bB+cC eB+fC+dA iC+gD+hA jA+kB+lC]
-Ciphertext squareMatrixVectorProduct(EncryptionParameters& params,
+Ciphertext squareMatrixVectorProduct(LinearAlgebraContext& la,
                                      Evaluator& eval,
                                      const std::vector<Ciphertext>& cyclicDiagsMatrix,
                                      const Ciphertext& vec,
                                      size_t realVectorSize,
                                      GaloisKeys& gk)
 {
-    if (cyclicDiagsMatrix.size() > params.poly_modulus_degree()/2)
+    if (cyclicDiagsMatrix.size() > la.parms().poly_modulus_degree()/2)
         throw "can't execute this function with theses types of parameters";
 
     // cyclicDiagsMatrix.size() => number of line in the matrix
@@ -136,9 +169,8 @@ Ciphertext squareMatrixVectorProduct(EncryptionParameters& params,
         eval.multiply(cyclicDiagsMatrix[i], rotatedVector, multResult[i]);
         // [ A B C ] -> [ B C A ] -> [ C A B ] -> ...
 
-        Plaintext mask = CreateMaskBatch(params);
-        Ciphertext resultingCoeff;
-        eval.multiply_plain(rotatedVector, mask, resultingCoeff);
+        Ciphertext resultingCoeff(rotatedVector);
+        la.applyMask(resultingCoeff);
         eval.rotate_rows_inplace(resultingCoeff, static_cast<int>(i+1-realVectorSize), gk);
         eval.rotate_rows_inplace(rotatedVector, 1, gk);
         eval.add_inplace(rotatedVector, resultingCoeff);
@@ -2,11 +2,12 @@
 #define __MATRIX_VECTOR_PRODUCT_HPP__
 
 #include "examples.h"
+#include "linear_algebra_context.hpp"
 
 using namespace seal;
 
 // Using the Inner product
-std::vector<Ciphertext> matrixVectorProduct(EncryptionParameters& parms,
+std::vector<Ciphertext> matrixVectorProduct(LinearAlgebraContext& la,
                                             Evaluator  & eval,
                                             const std::vector<Ciphertext>& matrix, 
                                             const Ciphertext& vec,
@@ -14,10 +15,43 @@ std::vector<Ciphertext> matrixVectorProduct(EncryptionParameters& parms,
                                             RelinKeys  & rk,
                                             size_t NbElem);
 
+// Packing of a (m,n) matrix in a single cipher: the row i is in the slots
+// [i*stride, i*stride + n) where stride is the power of two >= n (the padding
+// slots are 0), so that m*stride <= poly_modulus_degree. For (2,3):
+//  [ a, b, c, 0, d, e, f, 0, 0, ..., 0 ]
+size_t packedRowStride(size_t NbColumns);
+
+std::vector<uint64_t> packMatrixRows(LinearAlgebraContext& la,
+                                     const std::vector<uint64_t>& matrix,
+                                     size_t NbRows,
+                                     size_t NbColumns);
+
+// The vector (of size n) is repeated for each row of the packed matrix:
+//  [ A, B, C, 0, A, B, C, 0, 0, ..., 0 ]
+std::vector<uint64_t> packVectorRows(LinearAlgebraContext& la,
+                                     const std::vector<uint64_t>& vec,
+                                     size_t NbRows);
+
+// All the inner products at once: a single multiplication of the packed
+// matrix by the packed vector, then the slots are summed by segments of
+// stride slots (log2(stride) rotations, see Evaluator::sum_slots_inplace).
+// The inner product of the row i is in the slot i*stride of the result (the
+// other slots are masked):
+//  [ aA+bB+cC, 0, 0, 0, dA+eB+fC, 0, 0, 0, 0, ..., 0 ]
+// gk needs the rotations Evaluator::sum_slots_steps(packedRowStride(n)).
+Ciphertext packedMatrixVectorProduct(LinearAlgebraContext& la,
+                                     Evaluator& eval,
+                                     const Ciphertext& packedMatrix,
+                                     const Ciphertext& packedVec,
+                                     size_t NbRows,
+                                     size_t NbColumns,
+                                     GaloisKeys& gk,
+                                     RelinKeys& rk);
+
 // Let's denote the dimensions of matrix as (m,n) and the dimensions of vec as
 // (n,1). Given N, the poly_mod_degree of eval/matrix/vec, we assume that 
 // m <= N/2. This hypothesis allow us to return directly a batched vector.
-Ciphertext squareMatrixVectorProduct(EncryptionParameters& params,
+Ciphertext squareMatrixVectorProduct(LinearAlgebraContext& la,
                                      Evaluator& eval,
                                      const std::vector<Ciphertext>& cyclicDiagsMatrix,
                                      const Ciphertext& vec,
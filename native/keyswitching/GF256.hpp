@@ -1,17 +1,215 @@
+#ifndef __GF256_HPP__
+#define __GF256_HPP__
+
 #include <iostream>
 #include "encryptionlayer.hpp"
+#include "linearlayer.hpp"
 
 
 uint8_t GFM_mul(uint8_t b0, uint8_t b1, unsigned int M);
 
 // Implementation of the multiplication operation performed on two elements
-// of the galois field GF(2^8) as a boolean circuit
+// of the galois field GF(2^8) as a boolean circuit (117 gates: 48 AND and
+// 69 XOR). The product of the polynomials is split in 4-bit halves
+// (Karatsuba): A_lo*B_lo, A_hi*B_hi and (A_lo+A_hi)*(B_lo+B_hi) are three
+// schoolbook 4x4 products of 16 ANDs, then the XORs recombine them and
+// reduce modulo X^8 + X^4 + X^3 + X + 1.
 //
-// See: http://www.cs.yale.edu/homes/peralta/CircuitStuff/SLP_AES_113.txt
+// (straight-line program in the format of the circuits of
+// http://www.cs.yale.edu/homes/peralta/CircuitStuff/SLP_AES_113.txt)
 uint8_t GF256_mul_circuit(uint8_t a, uint8_t b);
 
+// Same circuit on any bitset type exposing a bit_type (CryptoBitset<8>,
+// PackedCryptoBitset<8>...): its ANDs only take inputs or XORs of inputs,
+// i.e. a multiplicative depth of 1
+template <typename Bitset>
+Bitset GF256_Mul_Circuit(const Bitset& a, const Bitset& b);
+
+// XOR network of the multiplication by a constant (see gf256_mul_matrix)
+XorNetwork const& gf256_mul_network(uint8_t constant);
+
 
 CryptoBitset<8> HE_GF256_mul(CryptoBitset<8> b0, CryptoBitset<8> b1);
 
 CryptoBitset<8> HE_GF256_mul_circuit(const CryptoBitset<8>& a, const CryptoBitset<8>& b);
-CryptoBitset<8> HE_GF256_mul_circuit(const CryptoBitset<8>& a, const ClearBitset <8>& b);
\ No newline at end of file
+CryptoBitset<8> HE_GF256_mul_circuit(const CryptoBitset<8>& a, const ClearBitset <8>& b);
+
+// Template Definitions
+//
+template <typename Bitset>
+Bitset GF256_Mul_Circuit(const Bitset& a, const Bitset& b)
+{
+    using Bit = typename Bitset::bit_type;
+    Bitset res(a);
+
+    // input polynomials are: A0 + A1*X + A2*X^2 + ... + A7*X^7 
+    //                        B0 + B1*X + B2*X^2 + ... + B7*X^7
+    // output polynomial is:  C0 + C1*X + C2*X^2 + ... + C7*X^7
+    const Bit A0 = a[0];
+    const Bit A1 = a[1];
+    const Bit A2 = a[2];
+    const Bit A3 = a[3];
+    const Bit A4 = a[4];
+    const Bit A5 = a[5];
+    const Bit A6 = a[6];
+    const Bit A7 = a[7];
+
+    const Bit B0 = b[0];
+    const Bit B1 = b[1];
+    const Bit B2 = b[2];
+    const Bit B3 = b[3];
+    const Bit B4 = b[4];
+    const Bit B5 = b[5];
+    const Bit B6 = b[6];
+    const Bit B7 = b[7];
+
+    #define AND(T0, T1, T2) const Bit T0 = T1 & T2
+    #define XOR(T0, T1, T2) const Bit T0 = T1 ^ T2
+    #define ASSIGN(T0, T1)  const Bit T0 = T1
+
+    AND(T1, A0, B0);
+    AND(T2, A0, B1);
+    AND(T3, A1, B0);
+    AND(T4, A0, B2);
+    AND(T5, A1, B1);
+    AND(T6, A2, B0);
+    AND(T7, A0, B3);
+    AND(T8, A1, B2);
+    AND(T9, A2, B1);
+    AND(T10, A3, B0);
+    AND(T11, A1, B3);
+    AND(T12, A2, B2);
+    AND(T13, A3, B1);
+    AND(T14, A2, B3);
+    AND(T15, A3, B2);
+    AND(T16, A3, B3);
+    AND(T17, A4, B4);
+    AND(T18, A4, B5);
+    AND(T19, A5, B4);
+    AND(T20, A4, B6);
+    AND(T21, A5, B5);
+    AND(T22, A6, B4);
+    AND(T23, A4, B7);
+    AND(T24, A5, B6);
+    AND(T25, A6, B5);
+    AND(T26, A7, B4);
+    AND(T27, A5, B7);
+    AND(T28, A6, B6);
+    AND(T29, A7, B5);
+    AND(T30, A6, B7);
+    AND(T31, A7, B6);
+    AND(T32, A7, B7);
+
+    XOR(T33, A0, A4);
+    XOR(T34, A1, A5);
+    XOR(T35, A2, A6);
+    XOR(T36, A3, A7);
+    XOR(T37, B0, B4);
+    XOR(T38, B1, B5);
+    XOR(T39, B2, B6);
+    XOR(T40, B3, B7);
+
+    AND(T41, T40, T36);
+    AND(T42, T40, T35);
+    AND(T43, T40, T34);
+    AND(T44, T40, T33);
+    AND(T45, T39, T36);
+    AND(T46, T39, T35);
+    AND(T47, T39, T34);
+    AND(T48, T39, T33);
+    AND(T49, T38, T36);
+    AND(T50, T38, T35);
+    AND(T51, T38, T34);
+    AND(T52, T38, T33);
+    AND(T53, T37, T36);
+    AND(T54, T37, T35);
+    AND(T55, T37, T34);
+    AND(T56, T37, T33);
+
+    XOR(T57, T2, T3);
+    XOR(T58, T4, T5);
+    XOR(T59, T6, T32);
+    XOR(T60, T7, T8);
+    XOR(T61, T9, T10);
+    XOR(T62, T60, T61);
+    XOR(T63, T11, T12);
+    XOR(T64, T13, T63);
+    XOR(T65, T14, T15);
+    XOR(T66, T18, T19);
+    XOR(T67, T20, T21);
+    XOR(T68, T22, T67);
+    XOR(T69, T23, T24);
+    XOR(T70, T25, T26);
+    XOR(T71, T69, T70);
+    XOR(T72, T27, T28);
+    XOR(T73, T29, T32);
+    XOR(T74, T30, T31);
+    XOR(T75, T52, T55);
+    XOR(T76, T48, T51);
+    XOR(T77, T54, T76);
+    XOR(T78, T44, T47);
+    XOR(T79, T50, T53);
+    XOR(T80, T78, T79);
+    XOR(T81, T43, T46);
+    XOR(T82, T49, T81);
+    XOR(T83, T42, T45);
+    XOR(T84, T71, T74);
+    XOR(T85, T41, T16);
+    XOR(T86, T85, T68);
+    XOR(T87, T66, T65);
+    XOR(T88, T83, T87);
+    XOR(T89, T58, T59);
+    XOR(T90, T72, T73);
+    XOR(T91, T74, T17);
+    XOR(T92, T64, T91);
+    XOR(T93, T82, T92);
+    XOR(T94, T80, T62);
+    XOR(T95, T94, T90);
+    ASSIGN(C7, T95);
+    XOR(T96, T41, T77);
+    XOR(T97, T84, T89);
+    XOR(T98, T96, T97);
+    ASSIGN(C6, T98);
+    XOR(T99, T57, T74);
+    XOR(T100, T83, T75);
+    XOR(T101, T86, T90);
+    XOR(T102, T99, T100);
+    XOR(T103, T101, T102);
+    ASSIGN(C5, T103);
+    XOR(T104, T1, T56);
+    XOR(T105, T90, T104);
+    XOR(T106, T82, T84);
+    XOR(T107, T88, T105);
+    XOR(T108, T106, T107);
+    ASSIGN(C4, T108);
+    XOR(T109, T71, T62);
+    XOR(T110, T86, T109);
+    XOR(T111, T110, T93);
+    ASSIGN(C3, T111);
+    XOR(T112, T86, T88);
+    XOR(T113, T89, T112);
+    ASSIGN(C2, T113);
+    XOR(T114, T57, T32);
+    XOR(T115, T114, T88);
+    XOR(T116, T115, T93);
+    ASSIGN(C1, T116);
+    XOR(T117, T93, T1);
+    ASSIGN(C0, T117);
+
+    res[0] = C0;
+    res[1] = C1;
+    res[2] = C2;
+    res[3] = C3;
+    res[4] = C4;
+    res[5] = C5;
+    res[6] = C6;
+    res[7] = C7;
+
+    #undef XOR
+    #undef AND
+    #undef ASSIGN
+
+    return res;
+}
+
+#endif
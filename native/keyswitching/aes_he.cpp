@@ -12,143 +12,50 @@ CryptoBitset<128> SubBytes(CryptoBitset<128> const& currentBlock)
     std::vector<CryptoBitset<8>> blockByBytes = currentBlock.split<16>();
     BitEncryptionContext& ctxt = currentBlock.bit_encryption_context();
 
-    // apply the AES SBOX on each independent byte
-    for (auto& byte : blockByBytes)
-        byte = Sbox_AES128.apply(ctxt, byte);
+    // apply the AES SBOX on each independent byte (one task per byte)
+    default_scheduler().parallel_for(0, blockByBytes.size(), [&](size_t i) {
+        blockByBytes[i] = Sbox_AES128.apply(ctxt, blockByBytes[i]);
+    });
 
     return CryptoBitset<128>::move_and_join<8>(ctxt, blockByBytes);
 }
 
 CryptoBitset<128> InvSubBytes(CryptoBitset<128> const& currentBlock)
 {
-    std::array<std::future<CryptoBitset<8>>, 16> futurs;
     std::vector<CryptoBitset<8>> blockByBytes = currentBlock.split<16>();
     BitEncryptionContext& ctxt = currentBlock.bit_encryption_context();
 
-    for (auto& byte : blockByBytes)
-        byte = Sbox_AES128.reverse(ctxt, byte);
+    default_scheduler().parallel_for(0, blockByBytes.size(), [&](size_t i) {
+        blockByBytes[i] = Sbox_AES128.reverse(ctxt, blockByBytes[i]);
+    });
 
     return CryptoBitset<128>::move_and_join<8>(ctxt, blockByBytes);
 }
 
-CryptoBitset<128> SubBytesParallelv1(CryptoBitset<128> const& currentBlock)
-{
-    std::array<std::future<CryptoBitset<8>>, 16> futurs;
-    std::vector<CryptoBitset<8>> blockByBytes = currentBlock.split<16>();
-    BitEncryptionContext& ctxt = currentBlock.bit_encryption_context();
-
-    std::function<CryptoBitset<8>(CryptoBitset<8> const&)> ApplySbox = 
-    [](CryptoBitset<8> const& block) -> CryptoBitset<8> {
-        return Sbox_AES128.apply(block.bit_encryption_context(), block);
-    };
-
-    #define NUM_THREADS 4
-    #pragma omp parallel for num_threads(NUM_THREADS)
-    for (unsigned i = 0; i < 16; i++) {
-        blockByBytes[i] = Sbox_AES128.apply(blockByBytes[i].bit_encryption_context(), blockByBytes[i]);
-    }
-    /*
-    for (unsigned i = 0; i < 4; i++) {
-        ExecInParallel(
-            ApplySbox, futurs[i*4  ], blockByBytes[i*4  ], 
-            ApplySbox, futurs[i*4+1], blockByBytes[i*4+1],
-            ApplySbox, futurs[i*4+2], blockByBytes[i*4+2],
-            ApplySbox, futurs[i*4+3], blockByBytes[i*4+3]
-        );
-    }
-    
-    for (unsigned i = 0; i < 16; i++)
-        blockByBytes[i] = futurs[i].get();*/
-
-    return CryptoBitset<128>::move_and_join<8>(ctxt, blockByBytes);
-}
-
-CryptoBitset<128> SubBytesParallelv2(CryptoBitset<128> const& currentBlock)
-{
-    std::array<std::future<CryptoBitset<8>>, 16> futurs;
-    std::vector<CryptoBitset<8>> blockByBytes = currentBlock.split<16>();
-
-    auto f = [](CryptoBitset<8> const& block) {
-        return Sbox_AES128.apply(
-            block.bit_encryption_context(), block
-        );
-    };
-
-    for (size_t i = 0; i < 16; i++)
-        futurs[i] = std::async(std::launch::async, f, blockByBytes[i]);
-    
-    for (auto& ft : futurs) ft.wait();
-
-    for (unsigned i = 0; i < 16; i++)
-        blockByBytes[i] = futurs[i].get();
-
-    return CryptoBitset<128>::move_and_join<8>(
-        currentBlock.bit_encryption_context(),
-        blockByBytes
-    );
-}
-
 // The ShiftRows() function shifts the rows in the state to the left.
 // Each row is shifted with different offset.
+// (it is only a permutation of the bytes: no ciphertext is copied)
 CryptoBitset<128> ShiftRows(CryptoBitset<128> const& currentBlock)
 {
-    std::vector<CryptoBitset<8>> blockBytes = currentBlock.split<16>();
-
-    // Rotate first row 1 columns to right
-    CryptoBitset<8> tmp = blockBytes[1];
-    
-    blockBytes[ 1] = blockBytes[ 5];
-    blockBytes[ 5] = blockBytes[ 9];
-    blockBytes[ 9] = blockBytes[13];
-    blockBytes[13] = tmp;
-
-    // Rotate second row 2 columns to right
-    tmp = blockBytes[2];
-    blockBytes[ 2] = blockBytes[10];
-    blockBytes[10] = tmp;
-
-    tmp = blockBytes[6];
-    blockBytes[6] = blockBytes[14];
-    blockBytes[14] = tmp;
-  
-    // Rotate third row 3 columns to right
-    tmp = blockBytes[15];
-    blockBytes[15] = blockBytes[11];
-    blockBytes[11] = blockBytes[7];
-    blockBytes[ 7] = blockBytes[3];
-    blockBytes[ 3] = tmp;
-
-    return CryptoBitset<128>::move_and_join<8>(blockBytes[0].bit_encryption_context(), 
-                                      blockBytes);
+    // byte i of the result is byte shift_rows[i] of the state
+    static const std::array<size_t, 16> shift_rows = {
+         0,  5, 10, 15,
+         4,  9, 14,  3,
+         8, 13,  2,  7,
+        12,  1,  6, 11
+    };
+    return currentBlock.permute<8>(shift_rows);
 }
 
 CryptoBitset<128> InvShiftRows(CryptoBitset<128> const& currentBlock)
 {
-    std::vector<CryptoBitset<8>> blockBytes = currentBlock.split<16>();
-
-    CryptoBitset<8> tmp = blockBytes[13];
-    blockBytes[13] = blockBytes[ 9];
-    blockBytes[ 9] = blockBytes[ 5];
-    blockBytes[ 5] = blockBytes[ 1];
-    blockBytes[ 1] = tmp;
-
-    tmp = blockBytes[10];
-    blockBytes[10] = blockBytes[2];
-    blockBytes[ 2] = tmp;
-
-    tmp = blockBytes[14];
-    blockBytes[14] = blockBytes[6];
-    blockBytes[ 6] = tmp;
-  
-    // Rotate third row 3 columns to right
-    tmp = blockBytes[3];
-    blockBytes[ 3] = blockBytes[ 7];
-    blockBytes[ 7] = blockBytes[11];
-    blockBytes[11] = blockBytes[15];
-    blockBytes[15] = tmp;
-
-    return CryptoBitset<128>::move_and_join<8>(blockBytes[0].bit_encryption_context(), 
-                                      blockBytes);
+    static const std::array<size_t, 16> inv_shift_rows = {
+         0, 13, 10,  7,
+         4,  1, 14, 11,
+         8,  5,  2, 15,
+        12,  9,  6,  3
+    };
+    return currentBlock.permute<8>(inv_shift_rows);
 }
 
 // The round constant word array, round_const[i], contains the values given by  
@@ -244,17 +151,9 @@ std::vector<CryptoBitset<128>> KeyExpansionParallel(CryptoBitset<128> const& AES
                 );
             };
 
-            std::future<CryptoBitset<8>> futurs[4];
-    
-            futurs[0] = std::async(std::launch::async, f, blockByBytes[0]);
-            futurs[1] = std::async(std::launch::async, f, blockByBytes[1]);
-            futurs[2] = std::async(std::launch::async, f, blockByBytes[2]);
-            futurs[3] = std::async(std::launch::async, f, blockByBytes[3]);
-
-            for (unsigned j = 0; j < 4; j++) {
-                futurs[j].wait();
-                blockByBytes[j] = futurs[j].get();
-            }
+            default_scheduler().parallel_for(0, 4, [&](size_t j) {
+                blockByBytes[j] = f(blockByBytes[j]);
+            });
 
             // On the eight first bit, we XOR with the 8-bit Round Const
             blockByBytes[0] = blockByBytes[0] ^ ClearBitset<8>(round_const[i/Nk]);
@@ -292,57 +191,52 @@ std::vector<CryptoBitset<128>> KeyExpansionParallel(CryptoBitset<128> const& AES
     return finalizedKeys;
 }
 
-#define Multiply HE_GF256_mul_circuit
+// The columns are mixed independently by an XOR network (see XorNetwork)
+static CryptoBitset<128> MixEachColumn(XorNetwork const& network, CryptoBitset<128> const& currentBlock)
+{
+    std::vector<CryptoBitset<32>> columns = currentBlock.split<4>();
+
+    default_scheduler().parallel_for(0, 4, [&](size_t i) {
+        columns[i] = network.apply(columns[i]);
+    });
+
+    return CryptoBitset<128>::move_and_join<32>(currentBlock.bit_encryption_context(), columns);
+}
 
 // MixColumns function mixes the columns of the currentBlock
+// (the multiplications by the constants of GF(2^8) are linear: a column is
+// mixed by 108 XOR gates instead of 16 GF(2^8) multiplications)
 CryptoBitset<128> MixColumns(CryptoBitset<128> const& currentBlock)
 {
-    BitEncryptionContext& ctxt = currentBlock.bit_encryption_context();
-    CryptoBitset<8> a(ctxt), b(ctxt), c(ctxt), d(ctxt);
-    std::vector<CryptoBitset<8>> splittedBlock = currentBlock.split<16>();
-    
-    ClearBitset<8> cst1(0x01), cst2(0x02), cst3(0x03);
-
-    for (unsigned i = 0; i < 4; i++) {    
-        a = splittedBlock[i*4  ];
-        b = splittedBlock[i*4+1];
-        c = splittedBlock[i*4+2];
-        d = splittedBlock[i*4+3];
-
-        splittedBlock[i*4  ] = Multiply(a, cst2) ^ Multiply(b, cst3) ^ Multiply(c, cst1) ^ Multiply(d, cst1);
-        splittedBlock[i*4+1] = Multiply(a, cst1) ^ Multiply(b, cst2) ^ Multiply(c, cst3) ^ Multiply(d, cst1);
-        splittedBlock[i*4+2] = Multiply(a, cst1) ^ Multiply(b, cst1) ^ Multiply(c, cst2) ^ Multiply(d, cst3);
-        splittedBlock[i*4+3] = Multiply(a, cst3) ^ Multiply(b, cst1) ^ Multiply(c, cst1) ^ Multiply(d, cst2);
-    }
-
-    return CryptoBitset<128>::move_and_join<8>(ctxt, splittedBlock);
+    static const XorNetwork network = XorNetwork::synthesize(AES_MixColumns_Matrix);
+    return MixEachColumn(network, currentBlock);
 }
 
 CryptoBitset<128> InvMixColumns(CryptoBitset<128> const& currentBlock)
 {
-    BitEncryptionContext& ctxt = currentBlock.bit_encryption_context();
-    CryptoBitset<8> a(ctxt), b(ctxt), c(ctxt), d(ctxt);
-    std::vector<CryptoBitset<8>> splittedBlock = currentBlock.split<16>();
-
-    ClearBitset<8> cst9(0x09), cste(0x0e), cstb(0x0b), cstd(0x0d);
-
-    for (unsigned i = 0; i < 4; i++)
-    {    
-        a = splittedBlock[i*4  ];
-        b = splittedBlock[i*4+1];
-        c = splittedBlock[i*4+2];
-        d = splittedBlock[i*4+3];
-
-        splittedBlock[i*4  ] = Multiply(a, cste) ^ Multiply(b, cstb) ^ Multiply(c, cstd) ^ Multiply(d, cst9);
-        splittedBlock[i*4+1] = Multiply(a, cst9) ^ Multiply(b, cste) ^ Multiply(c, cstb) ^ Multiply(d, cstd);
-        splittedBlock[i*4+2] = Multiply(a, cstd) ^ Multiply(b, cst9) ^ Multiply(c, cste) ^ Multiply(d, cstb);
-        splittedBlock[i*4+3] = Multiply(a, cstb) ^ Multiply(b, cstd) ^ Multiply(c, cst9) ^ Multiply(d, cste);
-    }
+    static const XorNetwork network = XorNetwork::synthesize(AES_InvMixColumns_Matrix);
+    return MixEachColumn(network, currentBlock);
+}
 
-    return CryptoBitset<128>::move_and_join<8>(ctxt, splittedBlock);
+std::size_t SubBytes_depth()
+{
+    return std::max(Sbox_AES128.report().and_depth, Sbox_AES128.reverse_report().and_depth);
+}
+
+std::bitset<128> AES_CTR_CounterBlock(std::array<uint8_t, 16> const& initialCounter,
+                                      uint64_t index)
+{
+    // the counter is big-endian (byte 15 is the least significant one)
+    std::array<uint8_t, 16> counter = initialCounter;
+    uint64_t carry = index;
+    for (int k = 15; k >= 0 && carry; k--) {
+        carry += counter[k];
+        counter[k] = static_cast<uint8_t>(carry & 0xff);
+        carry >>= 8;
+    }
+    return arrayToBitset(counter);
 }
 
-#undef Multiply
 /*
 void f()
 {
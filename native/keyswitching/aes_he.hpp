@@ -1,7 +1,16 @@
+#ifndef __AES_HE_HPP__
+#define __AES_HE_HPP__
+
+#include <algorithm>
+#include <deque>
+#include <functional>
 #include <future>
+#include <stdexcept>
+#include <vector>
 
 #include "encryptionlayer.hpp"
 #include "GF256.hpp"
+#include "linearlayer.hpp"
 #include "sbox.hpp"
 #include "omp.h"
 
@@ -41,8 +50,6 @@ CryptoBitset<128> AddRoundKey(CryptoBitset<128> const& plainBlock,
                               CryptoBitset<128> const& currentKeys);
 
 CryptoBitset<128> SubBytes(CryptoBitset<128> const& currentBlock);
-CryptoBitset<128> SubBytesParallelv1(CryptoBitset<128> const& currentBlock);
-CryptoBitset<128> SubBytesParallelv2(CryptoBitset<128> const& currentBlock);
 CryptoBitset<128> InvSubBytes(CryptoBitset<128> const& currentBlock);
 
 CryptoBitset<128> ShiftRows(CryptoBitset<128> const& currentBlock);
@@ -53,6 +60,96 @@ CryptoBitset<128> InvMixColumns(CryptoBitset<128> const& currentBlock);
 
 std::vector<CryptoBitset<128>> KeyExpansionParallel(CryptoBitset<128> const& AESKey);
 
+// AND depth of a (Inv)SubBytes layer: the AES functions manage the noise
+// (see CryptoBitset::manage_noise) for one layer at a time
+std::size_t SubBytes_depth();
+
+// AND depth of the last round key expanded from a fresh key (see
+// KeyExpansion): the number of SubWord along the dependency chain of its
+// words, w[i] depending on w[i-Nk] and on SubWord(w[i-1]) if i % Nk == 0 or
+// (AES-256) i % Nk == 4
+template<AES_Mode key_size>
+std::size_t HE_AES_KeyExpansion_Depth() {
+    std::size_t Nk = key_size / 32, Nr = Nk + 6;
+    std::vector<std::size_t> nbSubWords(4*(Nr+1), 0);
+    for (std::size_t i = Nk; i < nbSubWords.size(); i++) {
+        bool subWord = (i % Nk == 0) || (Nk > 6 && i % Nk == 4);
+        nbSubWords[i] = std::max(nbSubWords[i-Nk], nbSubWords[i-1] + (subWord ? 1 : 0));
+    }
+    return nbSubWords.back() * SubBytes_depth();
+}
+
+// AND depth of a homomorphic AES encryption or decryption from a fresh key,
+// the round keys being expanded in the same chain (to plan the parameters of
+// the context, see plan_levels). The round key r has at most the depth of the
+// block it is added to in round r of the encryption, but the decryption
+// starts with the last round key.
+template<AES_Mode key_size>
+std::size_t HE_AES_Depth(bool decryption = false) {
+    std::size_t blockDepth = (key_size / 32 + 6) * SubBytes_depth();
+    return decryption ? HE_AES_KeyExpansion_Depth<key_size>() + blockDepth : blockDepth;
+}
+
+// Counter block i of AES-CTR: the 128-bit big-endian addition of the initial
+// counter block (nonce || counter) and i
+std::bitset<128> AES_CTR_CounterBlock(std::array<uint8_t, 16> const& initialCounter,
+                                      uint64_t index);
+
+// AES-CTR transciphering
+//
+// The client encrypts its data with AES-CTR under a key k, the server holds
+// the homomorphic encryption of k. As c_i = m_i XOR AES_k(ctr_i) and the
+// counter blocks ctr_i are public, Enc(m_i) = Enc(AES_k(ctr_i)) XOR c_i: only
+// the keystream needs a homomorphic AES encryption (no AES decryption at
+// all), and it does not depend on the data.
+// The keystream blocks are therefore computed ahead of time on the scheduler
+// ("lookahead" blocks in flight) and transcipher() only evaluates 128 XORs
+// with clear bits, once the keystream block is ready.
+template<AES_Mode key_size>
+class HE_AES_CTR_Transcipher
+{
+public:
+    // Homomorphic encryption of a (clear) counter block into a keystream block
+    using CounterEncryption = std::function<CryptoBitset<128>(std::bitset<128> const&)>;
+
+    // The keystream is HE_AES_Encrypt of the counter blocks with the round keys
+    HE_AES_CTR_Transcipher(std::vector<CryptoBitset<128>> const& roundKeys,
+                           std::array<uint8_t, 16> const& initialCounter,
+                           size_t lookahead = 2,
+                           TaskScheduler& scheduler = default_scheduler());
+
+    // The keystream is encryptCounter of the counter blocks
+    HE_AES_CTR_Transcipher(CounterEncryption encryptCounter,
+                           std::array<uint8_t, 16> const& initialCounter,
+                           size_t lookahead = 2,
+                           TaskScheduler& scheduler = default_scheduler());
+
+    // The keystream blocks not started yet are cancelled, the other ones
+    // are waited for
+    ~HE_AES_CTR_Transcipher();
+
+    HE_AES_CTR_Transcipher(HE_AES_CTR_Transcipher const&) = delete;
+    HE_AES_CTR_Transcipher& operator=(HE_AES_CTR_Transcipher const&) = delete;
+
+    // Return the encryption (under the bit encryption context) of the next
+    // AES-CTR block of the stream, given its AES ciphertext
+    CryptoBitset<128> transcipher(std::bitset<128> const& aesCipherBlock);
+
+    // Index of the next block of the stream
+    inline uint64_t position() const { return _next_block; }
+
+private:
+    void schedule_next();
+
+    const CounterEncryption _encrypt_counter;
+    const std::array<uint8_t, 16> _initial_counter;
+    TaskScheduler& _scheduler;
+    std::deque<std::future<CryptoBitset<128>>> _keystream;
+    std::atomic<bool> _cancelled{false};
+    uint64_t _next_block = 0;
+    uint64_t _next_scheduled = 0;
+};
+
 // Template Definitions
 //
 template<AES_Mode key_size>
@@ -60,11 +157,25 @@ CryptoBitset<128> HE_AES_Keyswitching(CryptoBitset<128> const& block_enc_with_k0
                                       CryptoBitset<key_size> const& k0,
                                       CryptoBitset<key_size> const& k1)
 {
-    std::vector<CryptoBitset<128>> keys_derived_k0 = KeyExpansion<key_size>(k0);
-    std::vector<CryptoBitset<128>> keys_derived_k1 = KeyExpansion<key_size>(k1);
-    CryptoBitset<128> he_plain_data = HE_AES_Decrypt<key_size>(block_enc_with_k0, keys_derived_k0);
-    he_plain_data.refresh();
-    return HE_AES_Encrypt<key_size>(he_plain_data, keys_derived_k1);
+    std::vector<CryptoBitset<128>> keys_derived_k0, keys_derived_k1;
+    CryptoBitset<128> he_plain_data(block_enc_with_k0);
+    CryptoBitset<128> he_result(block_enc_with_k0);
+
+    // The expansion of k1 is independent of the decryption with k0:
+    // both run concurrently on the scheduler
+    TaskGraph graph;
+    auto expand_k0 = graph.add_task([&]() { keys_derived_k0 = KeyExpansion<key_size>(k0); });
+    auto expand_k1 = graph.add_task([&]() { keys_derived_k1 = KeyExpansion<key_size>(k1); });
+    auto decrypt   = graph.add_task([&]() {
+        he_plain_data = HE_AES_Decrypt<key_size>(block_enc_with_k0, keys_derived_k0);
+        he_plain_data.manage_noise(SubBytes_depth());
+    }, { expand_k0 });
+    graph.add_task([&]() {
+        he_result = HE_AES_Encrypt<key_size>(he_plain_data, keys_derived_k1);
+    }, { decrypt, expand_k1 });
+    graph.run();
+
+    return he_result;
 }
 
 template<AES_Mode key_size>
@@ -84,11 +195,11 @@ CryptoBitset<128> HE_AES_Encrypt(CryptoBitset<128> const& plainBlock,
     for (round = 1; round < Nr; round++) {
         std::cout << "Round " << round << std::endl;
         currentBlock = SubBytes(currentBlock);
-        currentBlock.refresh();
+        currentBlock.manage_noise(SubBytes_depth());
         currentBlock = ShiftRows(currentBlock);
         currentBlock = MixColumns(currentBlock);
-        currentBlock.refresh();
         currentBlock = AddRoundKey(currentBlock, currentKeys[round]);
+        currentBlock.manage_noise(SubBytes_depth());
     }
 
     // The last round is given below:
@@ -112,10 +223,10 @@ CryptoBitset<128> HE_AES_Decrypt(CryptoBitset<128> const& cipherBlock,
         std::cout << "Round " << round << std::endl;
         currentBlock = InvShiftRows(currentBlock);
         currentBlock = InvSubBytes(currentBlock);
-        currentBlock.refresh();
+        currentBlock.manage_noise(SubBytes_depth());
         currentBlock = AddRoundKey(currentBlock, currentKeys[round]);
         currentBlock = InvMixColumns(currentBlock);
-        currentBlock.refresh();
+        currentBlock.manage_noise(SubBytes_depth());
     }
 
     currentBlock = InvShiftRows(currentBlock);
@@ -178,10 +289,9 @@ std::vector<CryptoBitset<128>> KeyExpansion(CryptoBitset<key_size> const& AESKey
             std::vector<CryptoBitset<8>> blockByBytes = rotatedWord.split<4>();
 
             // Apply the S-box to each of the four bytes to produce an output word
-            blockByBytes[0] = f(blockByBytes[0]);
-            blockByBytes[1] = f(blockByBytes[1]);
-            blockByBytes[2] = f(blockByBytes[2]);
-            blockByBytes[3] = f(blockByBytes[3]);
+            default_scheduler().parallel_for(0, 4, [&](size_t j) {
+                blockByBytes[j] = f(blockByBytes[j]);
+            });
 
             // On the eight first bit, we XOR with the 8-bit Round Const
             // As we use the BFV/BGV encryption scheme, we can mix encrypted
@@ -203,10 +313,9 @@ std::vector<CryptoBitset<128>> KeyExpansion(CryptoBitset<key_size> const& AESKey
         {
             std::vector<CryptoBitset<8>> blockByBytes = tmpWord.split<4>();
             
-            blockByBytes[0] = f(blockByBytes[0]);
-            blockByBytes[1] = f(blockByBytes[1]);
-            blockByBytes[2] = f(blockByBytes[2]);
-            blockByBytes[3] = f(blockByBytes[3]);
+            default_scheduler().parallel_for(0, 4, [&](size_t j) {
+                blockByBytes[j] = f(blockByBytes[j]);
+            });
 
             std::vector<CryptoBitset<8>> tmpVector = { blockByBytes[0], blockByBytes[1], 
                                                        blockByBytes[2], blockByBytes[3] };
@@ -220,7 +329,7 @@ std::vector<CryptoBitset<128>> KeyExpansion(CryptoBitset<key_size> const& AESKey
 
         // C_i = C_{i-Nk} XOR D_i
         expandedKey.push_back(expandedKey[i-Nk] ^ tmpWord);
-        expandedKey.back().refresh();
+        expandedKey.back().manage_noise(SubBytes_depth());
         i++;
     }
 
@@ -250,4 +359,76 @@ std::vector<CryptoBitset<128>> KeyExpansion(CryptoBitset<key_size> const& AESKey
     }
 
     return finalizedKeys;
-}
\ No newline at end of file
+}
+
+template<AES_Mode key_size>
+HE_AES_CTR_Transcipher<key_size>::HE_AES_CTR_Transcipher(std::vector<CryptoBitset<128>> const& roundKeys,
+                                                         std::array<uint8_t, 16> const& initialCounter,
+                                                         size_t lookahead,
+                                                         TaskScheduler& scheduler)
+    : HE_AES_CTR_Transcipher([roundKeys](std::bitset<128> const& counterBlock) {
+          assert(key_size / 32 + 7 == roundKeys.size());
+          BitEncryptionContext& ctxt = roundKeys[0].bit_encryption_context();
+          // (returned at the level of its last products: a lower level is
+          // obtained with CryptoBitset::mod_switch_to_level)
+          return HE_AES_Encrypt<key_size>(CryptoBitset<128>(ctxt, counterBlock), roundKeys);
+      }, initialCounter, lookahead, scheduler)
+{
+}
+
+template<AES_Mode key_size>
+HE_AES_CTR_Transcipher<key_size>::HE_AES_CTR_Transcipher(CounterEncryption encryptCounter,
+                                                         std::array<uint8_t, 16> const& initialCounter,
+                                                         size_t lookahead,
+                                                         TaskScheduler& scheduler)
+    : _encrypt_counter(std::move(encryptCounter)), _initial_counter(initialCounter), _scheduler(scheduler)
+{
+    assert(lookahead >= 1);
+
+    for (size_t i = 0; i < lookahead; i++)
+        schedule_next();
+}
+
+template<AES_Mode key_size>
+HE_AES_CTR_Transcipher<key_size>::~HE_AES_CTR_Transcipher()
+{
+    // the tasks refer to _encrypt_counter: they must be done before leaving
+    _cancelled = true;
+    for (auto& keystreamBlock : _keystream) {
+        try {
+            _scheduler.wait(keystreamBlock);
+        }
+        catch (...) {
+        }
+    }
+}
+
+template<AES_Mode key_size>
+void HE_AES_CTR_Transcipher<key_size>::schedule_next()
+{
+    const std::bitset<128> counterBlock = AES_CTR_CounterBlock(_initial_counter, _next_scheduled++);
+
+    _keystream.push_back(_scheduler.submit([this, counterBlock]() {
+        if (_cancelled)
+            throw std::runtime_error("keystream block cancelled");
+        return _encrypt_counter(counterBlock);
+    }));
+}
+
+template<AES_Mode key_size>
+CryptoBitset<128> HE_AES_CTR_Transcipher<key_size>::transcipher(std::bitset<128> const& aesCipherBlock)
+{
+    std::future<CryptoBitset<128>> keystreamBlock = std::move(_keystream.front());
+    _keystream.pop_front();
+    _next_block++;
+
+    const CryptoBitset<128> keystream = _scheduler.wait(keystreamBlock);
+
+    // keep "lookahead" blocks in flight (it is scheduled once the current
+    // block is done such that the waiting thread does not start it)
+    schedule_next();
+
+    return keystream ^ ClearBitset<128>(aesCipherBlock);
+}
+
+#endif
@@ -0,0 +1,527 @@
+#ifndef __AES_HE_KEYSCHEDULE_HPP__
+#define __AES_HE_KEYSCHEDULE_HPP__
+
+#include <cstdint>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "aes_he.hpp"
+#include "streampipeline.hpp"
+
+// Expanded (homomorphic) AES key
+//
+// The key expansion evaluates 4*(Nr+1)/Nk SubWord, i.e. as many S-boxes as
+// two AES rounds: it is computed once and then reused by all the
+// encryptions/decryptions with the same key. It can be saved and loaded back
+// (with the SEAL serialization of the underlying ciphertexts), e.g. to expand
+// the key of a client once and for all.
+template<AES_Mode key_size>
+class HE_AES_ExpandedKey
+{
+    BitEncryptionContext& _ctxt;
+    std::vector<CryptoBitset<128>> _round_keys;
+
+public:
+    static constexpr unsigned Nr = key_size / 32 + 6;
+
+    // Serialization header: "AESK" and the version of the format
+    static constexpr std::uint32_t magic   = 0x4B534541;
+    static constexpr std::uint32_t version = 1;
+
+    explicit HE_AES_ExpandedKey(CryptoBitset<key_size> const& AESKey)
+        : _ctxt(AESKey.bit_encryption_context()),
+          _round_keys(KeyExpansion<key_size>(AESKey))
+    {
+        compact();
+    }
+
+    // Key schedule previously saved with save()
+    HE_AES_ExpandedKey(BitEncryptionContext& ctxt, std::istream& stream);
+
+    inline std::vector<CryptoBitset<128>> const& round_keys() const {
+        return _round_keys;
+    }
+
+    inline BitEncryptionContext& bit_encryption_context() const {
+        return _ctxt;
+    }
+
+    // The first round keys are the AES key itself: return true iff they are
+    // the same encryption as AESKey (and not only the same key)
+    bool expands(CryptoBitset<key_size> const& AESKey) const;
+
+    // Format: magic, version, key size, number of round keys, then the
+    // round keys
+    std::streamoff save(std::ostream& stream,
+                        seal::compr_mode_type compr_mode = seal::Serialization::compr_mode_default) const;
+private:
+    // The round keys are idle between two uses (one XOR per round): they
+    // are kept compact (see CryptoBit::compact)
+    void compact() {
+        for (auto& key : _round_keys)
+            key.compact();
+    }
+};
+
+// Cache of the expanded keys indexed by the encryption of the AES key (two
+// encryptions of the same key are two different entries, see
+// CryptoBit::same_encryption)
+//
+// It holds at most "capacity" expanded keys: the least recently used one is
+// evicted first (an evicted key stays alive as long as it is used).
+template<AES_Mode key_size>
+class HE_AES_KeyScheduleCache
+{
+public:
+    using expanded_key_type = HE_AES_ExpandedKey<key_size>;
+
+    explicit HE_AES_KeyScheduleCache(std::size_t capacity = 16);
+
+    // Return the expanded key of AESKey (expanded on the first call only)
+    std::shared_ptr<const expanded_key_type> get(CryptoBitset<key_size> const& AESKey);
+
+    // Add a loaded expanded key to the cache
+    void insert(std::shared_ptr<const expanded_key_type> expandedKey);
+
+    std::size_t size() const;
+    inline std::size_t capacity() const { return _capacity; }
+    void clear();
+
+private:
+    using key_type = CryptoBitset<key_size>;
+    using entry_type = std::pair<key_type, std::shared_ptr<const expanded_key_type>>;
+
+    // (the whole encrypted key is compared, the hash only selects a bucket)
+    struct KeyHash {
+        std::size_t operator()(key_type const& AESKey) const;
+    };
+    struct KeyEqual {
+        bool operator()(key_type const& lhs, key_type const& rhs) const;
+    };
+
+    static key_type original_key(expanded_key_type const& expandedKey);
+
+    // Move the entry to the front (most recently used), with _mutex held
+    void touch(typename std::list<entry_type>::iterator it);
+    // Add the entry at the front and evict the least recently used ones
+    // beyond the capacity, with _mutex held
+    void push_front(key_type const& AESKey, std::shared_ptr<const expanded_key_type> expandedKey);
+
+    const std::size_t _capacity;
+    mutable std::mutex _mutex;
+    // (most recently used first)
+    std::list<entry_type> _entries;
+    std::unordered_map<key_type, typename std::list<entry_type>::iterator, KeyHash, KeyEqual> _index;
+};
+
+template<AES_Mode key_size>
+CryptoBitset<128> HE_AES_Encrypt(CryptoBitset<128> const& plainBlock,
+                                 HE_AES_ExpandedKey<key_size> const& key);
+
+template<AES_Mode key_size>
+CryptoBitset<128> HE_AES_Decrypt(CryptoBitset<128> const& cipherBlock,
+                                 HE_AES_ExpandedKey<key_size> const& key);
+
+// Key-switching without any key expansion (see HE_AES_Keyswitching)
+template<AES_Mode key_size>
+CryptoBitset<128> HE_AES_Keyswitching(CryptoBitset<128> const& block_enc,
+                                      HE_AES_ExpandedKey<key_size> const& k0,
+                                      HE_AES_ExpandedKey<key_size> const& k1);
+
+// Key-switching expanding k0 and k1 only if they are not already in the cache
+template<AES_Mode key_size>
+CryptoBitset<128> HE_AES_Keyswitching(CryptoBitset<128> const& block_enc,
+                                      CryptoBitset<key_size> const& k0,
+                                      CryptoBitset<key_size> const& k1,
+                                      HE_AES_KeyScheduleCache<key_size>& cache);
+
+// Key-switching of a stream of blocks from k0 to k1
+//
+// The expansion of k0 starts as soon as the stream is built, and run() hands
+// the blocks to the scheduler once it is done. The first run() expands k1
+// while the first "window" blocks are decrypted: their re-encryptions depend
+// on the expansion in a TaskGraph, so that no block task ever waits on a key
+// from inside the scheduler. The next blocks are key-switched in parallel, at
+// most "window" at a time (see StreamPipeline), while the caller serializes
+// the finished ones.
+template<AES_Mode key_size>
+class HE_AES_KeyswitchingStream
+{
+public:
+    using expanded_key_type = HE_AES_ExpandedKey<key_size>;
+
+    HE_AES_KeyswitchingStream(CryptoBitset<key_size> const& k0,
+                              CryptoBitset<key_size> const& k1,
+                              std::size_t window = 0,
+                              TaskScheduler& scheduler = default_scheduler());
+
+    // The keys are expanded through the cache (which must outlive the stream)
+    HE_AES_KeyswitchingStream(CryptoBitset<key_size> const& k0,
+                              CryptoBitset<key_size> const& k1,
+                              HE_AES_KeyScheduleCache<key_size>& cache,
+                              std::size_t window = 0,
+                              TaskScheduler& scheduler = default_scheduler());
+
+    // The expansion of k0, if still running, is waited for
+    ~HE_AES_KeyswitchingStream();
+
+    HE_AES_KeyswitchingStream(HE_AES_KeyswitchingStream const&) = delete;
+    HE_AES_KeyswitchingStream& operator=(HE_AES_KeyswitchingStream const&) = delete;
+
+    // Key-switch the blocks [first, last) (CryptoBitset<128> encrypted under
+    // k0) and call sink(block) on the results, in order
+    template <typename InputIt, typename Sink>
+    StreamStats run(InputIt first, InputIt last, Sink&& sink);
+
+    // Same, the results being saved one after another in "stream"
+    template <typename InputIt>
+    StreamStats run_and_save(InputIt first, InputIt last, std::ostream& stream,
+                    seal::compr_mode_type compr_mode = seal::Serialization::compr_mode_default);
+
+    // Statistics of all the runs so far
+    inline StreamStats const& total() const { return _total; }
+
+private:
+    using key_pointer = std::shared_ptr<const expanded_key_type>;
+    using key_future = std::shared_future<key_pointer>;
+
+    HE_AES_KeyswitchingStream(key_future k0, std::function<key_pointer()> expand_k1,
+                              std::size_t window, TaskScheduler& scheduler);
+
+    static CryptoBitset<128> decrypt(CryptoBitset<128> const& block, expanded_key_type const& k0);
+
+    TaskScheduler& _scheduler;
+    key_future _k0;
+    // (k1 is expanded by the first run())
+    std::function<key_pointer()> _expand_k1;
+    key_pointer _k1;
+    std::size_t _window;
+    StreamStats _total;
+};
+
+// Template Definitions
+//
+template<AES_Mode key_size>
+HE_AES_ExpandedKey<key_size>::HE_AES_ExpandedKey(BitEncryptionContext& ctxt, std::istream& stream)
+    : _ctxt(ctxt)
+{
+    std::uint32_t header[4];
+    stream.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!stream || header[0] != magic)
+        throw std::invalid_argument("stream does not hold an AES expanded key");
+    if (header[1] != version)
+        throw std::invalid_argument("unsupported version of AES expanded key");
+    if (header[2] != key_size || header[3] != Nr+1)
+        throw std::invalid_argument("stream does not hold an AES expanded key of this size");
+
+    _round_keys.reserve(Nr+1);
+    for (unsigned round = 0; round <= Nr; round++)
+        _round_keys.push_back(CryptoBitset<128>::load(ctxt, stream));
+    compact();
+}
+
+template<AES_Mode key_size>
+bool HE_AES_ExpandedKey<key_size>::expands(CryptoBitset<key_size> const& AESKey) const
+{
+    for (size_t i = 0; i < key_size; i++)
+        if (!_round_keys[i / 128][i % 128].same_encryption(AESKey[i]))
+            return false;
+    return true;
+}
+
+template<AES_Mode key_size>
+std::streamoff HE_AES_ExpandedKey<key_size>::save(std::ostream& stream,
+                                                  seal::compr_mode_type compr_mode) const
+{
+    const std::uint32_t header[4] = { magic, version, key_size, Nr+1 };
+    stream.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+    std::streamoff size = sizeof(header);
+    for (auto const& key : _round_keys)
+        size += key.save(stream, compr_mode);
+    return size;
+}
+
+template<AES_Mode key_size>
+HE_AES_KeyScheduleCache<key_size>::HE_AES_KeyScheduleCache(std::size_t capacity)
+    : _capacity(capacity)
+{
+    assert(capacity > 0);
+}
+
+template<AES_Mode key_size>
+std::size_t HE_AES_KeyScheduleCache<key_size>::KeyHash::operator()(key_type const& AESKey) const
+{
+    std::size_t hash = key_size;
+    for (size_t i = 0; i < key_size; i++)
+        hash ^= AESKey[i].encryption_hash() + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+template<AES_Mode key_size>
+bool HE_AES_KeyScheduleCache<key_size>::KeyEqual::operator()(key_type const& lhs, key_type const& rhs) const
+{
+    for (size_t i = 0; i < key_size; i++)
+        if (!lhs[i].same_encryption(rhs[i]))
+            return false;
+    return true;
+}
+
+template<AES_Mode key_size>
+CryptoBitset<key_size> HE_AES_KeyScheduleCache<key_size>::original_key(expanded_key_type const& expandedKey)
+{
+    std::vector<CryptoBit> bits;
+    bits.reserve(key_size);
+    for (size_t i = 0; i < key_size; i++)
+        bits.push_back(expandedKey.round_keys()[i / 128][i % 128]);
+    return CryptoBitset<key_size>(expandedKey.bit_encryption_context(), bits);
+}
+
+template<AES_Mode key_size>
+std::shared_ptr<const HE_AES_ExpandedKey<key_size>>
+HE_AES_KeyScheduleCache<key_size>::get(CryptoBitset<key_size> const& AESKey)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _index.find(AESKey);
+        if (it != _index.end()) {
+            touch(it->second);
+            return it->second->second;
+        }
+    }
+
+    // the expansion is done outside of the lock: it may be done twice by
+    // concurrent calls with the same key, the first inserted one is kept
+    auto expandedKey = std::make_shared<const expanded_key_type>(AESKey);
+    // (the entry keeps the compact bits of the expanded key, not AESKey)
+    const key_type key = original_key(*expandedKey);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _index.find(key);
+    if (it != _index.end()) {
+        touch(it->second);
+        return it->second->second;
+    }
+    push_front(key, expandedKey);
+    return expandedKey;
+}
+
+template<AES_Mode key_size>
+void HE_AES_KeyScheduleCache<key_size>::insert(std::shared_ptr<const expanded_key_type> expandedKey)
+{
+    assert(expandedKey);
+    const key_type key = original_key(*expandedKey);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _index.find(key);
+    if (it != _index.end()) {
+        it->second->second = std::move(expandedKey);
+        touch(it->second);
+        return;
+    }
+    push_front(key, std::move(expandedKey));
+}
+
+template<AES_Mode key_size>
+void HE_AES_KeyScheduleCache<key_size>::touch(typename std::list<entry_type>::iterator it)
+{
+    _entries.splice(_entries.begin(), _entries, it);
+}
+
+template<AES_Mode key_size>
+void HE_AES_KeyScheduleCache<key_size>::push_front(key_type const& AESKey,
+                                                   std::shared_ptr<const expanded_key_type> expandedKey)
+{
+    _entries.emplace_front(AESKey, std::move(expandedKey));
+    _index.emplace(AESKey, _entries.begin());
+
+    while (_entries.size() > _capacity) {
+        _index.erase(_entries.back().first);
+        _entries.pop_back();
+    }
+}
+
+template<AES_Mode key_size>
+std::size_t HE_AES_KeyScheduleCache<key_size>::size() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _entries.size();
+}
+
+template<AES_Mode key_size>
+void HE_AES_KeyScheduleCache<key_size>::clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _index.clear();
+    _entries.clear();
+}
+
+template<AES_Mode key_size>
+CryptoBitset<128> HE_AES_Encrypt(CryptoBitset<128> const& plainBlock,
+                                 HE_AES_ExpandedKey<key_size> const& key)
+{
+    return HE_AES_Encrypt<key_size>(plainBlock, key.round_keys());
+}
+
+template<AES_Mode key_size>
+CryptoBitset<128> HE_AES_Decrypt(CryptoBitset<128> const& cipherBlock,
+                                 HE_AES_ExpandedKey<key_size> const& key)
+{
+    return HE_AES_Decrypt<key_size>(cipherBlock, key.round_keys());
+}
+
+template<AES_Mode key_size>
+CryptoBitset<128> HE_AES_Keyswitching(CryptoBitset<128> const& block_enc_with_k0,
+                                      HE_AES_ExpandedKey<key_size> const& k0,
+                                      HE_AES_ExpandedKey<key_size> const& k1)
+{
+    CryptoBitset<128> he_plain_data = HE_AES_Decrypt<key_size>(block_enc_with_k0, k0);
+    he_plain_data.manage_noise(SubBytes_depth());
+    return HE_AES_Encrypt<key_size>(he_plain_data, k1);
+}
+
+template<AES_Mode key_size>
+CryptoBitset<128> HE_AES_Keyswitching(CryptoBitset<128> const& block_enc_with_k0,
+                                      CryptoBitset<key_size> const& k0,
+                                      CryptoBitset<key_size> const& k1,
+                                      HE_AES_KeyScheduleCache<key_size>& cache)
+{
+    std::shared_ptr<const HE_AES_ExpandedKey<key_size>> expanded_k0, expanded_k1;
+
+    // (see HE_AES_Keyswitching: k1 is expanded while decrypting with k0)
+    TaskGraph graph;
+    auto expand_k0 = graph.add_task([&]() { expanded_k0 = cache.get(k0); });
+    auto expand_k1 = graph.add_task([&]() { expanded_k1 = cache.get(k1); });
+    CryptoBitset<128> he_plain_data(block_enc_with_k0);
+    CryptoBitset<128> he_result(block_enc_with_k0);
+    auto decrypt   = graph.add_task([&]() {
+        he_plain_data = HE_AES_Decrypt<key_size>(block_enc_with_k0, *expanded_k0);
+        he_plain_data.manage_noise(SubBytes_depth());
+    }, { expand_k0 });
+    graph.add_task([&]() {
+        he_result = HE_AES_Encrypt<key_size>(he_plain_data, *expanded_k1);
+    }, { decrypt, expand_k1 });
+    graph.run();
+
+    return he_result;
+}
+
+template<AES_Mode key_size>
+HE_AES_KeyswitchingStream<key_size>::HE_AES_KeyswitchingStream(key_future k0,
+                                                               std::function<key_pointer()> expand_k1,
+                                                               std::size_t window,
+                                                               TaskScheduler& scheduler)
+    : _scheduler(scheduler), _k0(k0), _expand_k1(std::move(expand_k1)), _window(window)
+{
+}
+
+template<AES_Mode key_size>
+HE_AES_KeyswitchingStream<key_size>::HE_AES_KeyswitchingStream(CryptoBitset<key_size> const& k0,
+                                                               CryptoBitset<key_size> const& k1,
+                                                               std::size_t window,
+                                                               TaskScheduler& scheduler)
+    : HE_AES_KeyswitchingStream(
+          scheduler.submit([k0]() { return std::make_shared<const expanded_key_type>(k0); }).share(),
+          [k1]() { return std::make_shared<const expanded_key_type>(k1); },
+          window, scheduler)
+{
+}
+
+template<AES_Mode key_size>
+HE_AES_KeyswitchingStream<key_size>::HE_AES_KeyswitchingStream(CryptoBitset<key_size> const& k0,
+                                                               CryptoBitset<key_size> const& k1,
+                                                               HE_AES_KeyScheduleCache<key_size>& cache,
+                                                               std::size_t window,
+                                                               TaskScheduler& scheduler)
+    : HE_AES_KeyswitchingStream(
+          scheduler.submit([&cache, k0]() { return cache.get(k0); }).share(),
+          [&cache, k1]() { return cache.get(k1); },
+          window, scheduler)
+{
+}
+
+template<AES_Mode key_size>
+HE_AES_KeyswitchingStream<key_size>::~HE_AES_KeyswitchingStream()
+{
+    try {
+        _scheduler.wait(_k0);
+    }
+    catch (...) {
+        // (an expansion error is only reported by run())
+    }
+}
+
+template<AES_Mode key_size>
+CryptoBitset<128> HE_AES_KeyswitchingStream<key_size>::decrypt(CryptoBitset<128> const& block,
+                                                               expanded_key_type const& k0)
+{
+    CryptoBitset<128> he_plain_data = HE_AES_Decrypt<key_size>(block, k0);
+    he_plain_data.manage_noise(SubBytes_depth());
+    return he_plain_data;
+}
+
+template<AES_Mode key_size>
+template <typename InputIt, typename Sink>
+StreamStats HE_AES_KeyswitchingStream<key_size>::run(InputIt first, InputIt last, Sink&& sink)
+{
+    const auto start = std::chrono::steady_clock::now();
+    // (waited for by the caller, not by the block tasks)
+    key_pointer k0 = _scheduler.wait(_k0);
+    StreamStats stats;
+
+    if (!_k1) {
+        std::vector<CryptoBitset<128>> head;
+        const std::size_t window = StreamPipeline<CryptoBitset<128>>::window_size(_window, _scheduler);
+        for (; first != last && head.size() < window; ++first)
+            head.push_back(*first);
+
+        key_pointer k1;
+        TaskGraph graph;
+        auto expand_k1 = graph.add_task([&]() { k1 = _expand_k1(); });
+        for (auto& block : head) {
+            auto decrypt_block = graph.add_task([&block, &k0]() { block = decrypt(block, *k0); });
+            graph.add_task([&block, &k1]() { block = HE_AES_Encrypt<key_size>(block, *k1); },
+                           { decrypt_block, expand_k1 });
+        }
+        graph.run(_scheduler);
+        _k1 = k1;
+
+        for (auto& block : head) {
+            sink(block);
+            stats.blocks++;
+        }
+    }
+
+    if (first != last) {
+        key_pointer k1 = _k1;
+        StreamPipeline<CryptoBitset<128>> pipeline([k0, k1](CryptoBitset<128> const& block) {
+            return HE_AES_Encrypt<key_size>(decrypt(block, *k0), *k1);
+        }, _window, _scheduler);
+        stats.blocks += pipeline.run(first, last, sink).blocks;
+    }
+
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    _total += stats;
+    return stats;
+}
+
+template<AES_Mode key_size>
+template <typename InputIt>
+StreamStats HE_AES_KeyswitchingStream<key_size>::run_and_save(InputIt first, InputIt last,
+                                                              std::ostream& stream,
+                                                              seal::compr_mode_type compr_mode)
+{
+    std::size_t bytes = 0;
+    StreamStats stats = run(first, last, [&](CryptoBitset<128> const& block) {
+        bytes += static_cast<std::size_t>(block.save(stream, compr_mode));
+    });
+    stats.bytes = bytes;
+    _total.bytes += bytes;
+    return stats;
+}
+
+#endif
@@ -0,0 +1,303 @@
+#ifndef __AES_HE_SIMD_HPP__
+#define __AES_HE_SIMD_HPP__
+
+#include "aes_he.hpp"
+#include "encryptionlayerSIMD.hpp"
+
+// Bitsliced Homomorphic Evaluation of AES
+//
+// This is the batched counterpart of the functions of aes_he.hpp: a block is
+// a PackedCryptoBitset<128, pmd> whose j-th slot holds the j-th AES block, so
+// each gate of the circuit processes up to pmd blocks at once. One call to
+// HE_AES_Keyswitching on packed blocks thus transciphers a full batch for the
+// cost of a single (packed) evaluation.
+//
+// The same key can be broadcasted in all the slots (see the PackedCryptoBitset
+// broadcast ctor) or each block can come with its own key.
+//
+// NOTE: on packed bits, XOR is a multiplication (plain_modulus > 2), so a
+// round of AES goes through about 20 products (16 for the S-box) and the
+// full cipher about 200: more than the noise budget of any parameters (about
+// 22 products for pmd = 32768, see PackedBitsEncryptionContext). The layers
+// are thus run as circuits compiled by product depth (see Circuit::Depth and
+// run_layer), their operands being refreshed explicitly before a layer when
+// the context can run it without refresh, and between its waves otherwise
+// (see PackedCryptoBits::refresh_for). The round keys of KeyExpansion are
+// ready for one product.
+
+template<AES_Mode key_size, std::size_t pmd>
+PackedCryptoBitset<128, pmd> HE_AES_Keyswitching(PackedCryptoBitset<128, pmd> const& block_enc,
+                                                 PackedCryptoBitset<key_size, pmd> const& k0,
+                                                 PackedCryptoBitset<key_size, pmd> const& k1);
+
+template<AES_Mode key_size, std::size_t pmd>
+PackedCryptoBitset<128, pmd> HE_AES_Encrypt(PackedCryptoBitset<128, pmd> const& plainBlock,
+                                            std::vector<PackedCryptoBitset<128, pmd>> const& currentKeys);
+
+template<AES_Mode key_size, std::size_t pmd>
+PackedCryptoBitset<128, pmd> HE_AES_Decrypt(PackedCryptoBitset<128, pmd> const& cipherBlock,
+                                            std::vector<PackedCryptoBitset<128, pmd>> const& currentKeys);
+
+template<AES_Mode key_size, std::size_t pmd>
+std::vector<PackedCryptoBitset<128, pmd>> KeyExpansion(PackedCryptoBitset<key_size, pmd> const& AESKey);
+
+// Template Definitions
+//
+
+// Runs a layer of AES on packed bits: when the circuit fits in the depth
+// capacity of the context, the operands are refreshed once for its depth and
+// the circuit is checked not to need any other refresh (see prepare_product)
+template<std::size_t bitsize, std::size_t pmd>
+PackedCryptoBitset<bitsize, pmd> run_layer(Circuit const& circuit, PackedCryptoBitset<bitsize, pmd> bits)
+{
+    if (circuit.depth() > bits.bit_encryption_context().depth_capacity())
+        return circuit.run(bits, refresh_for_product<pmd>);
+
+    bits.refresh_for(circuit.depth());
+    return circuit.run(bits, prepare_product<pmd>);
+}
+
+template<std::size_t pmd>
+PackedCryptoBitset<128, pmd> AddRoundKey(PackedCryptoBitset<128, pmd> const& currentBlock,
+                                         PackedCryptoBitset<128, pmd> const& currentKeys)
+{
+    return currentBlock ^ currentKeys;
+}
+
+template<std::size_t pmd>
+PackedCryptoBitset<128, pmd> SubBytes(PackedCryptoBitset<128, pmd> const& currentBlock)
+{
+    Circuit const& sbox = AES128_SBox_Forward_Compiled(Circuit::Depth::product);
+    std::vector<PackedCryptoBitset<8, pmd>> blockByBytes = currentBlock.template split<16>();
+
+    for (auto& byte : blockByBytes)
+        byte = run_layer(sbox, std::move(byte));
+
+    return PackedCryptoBitset<128, pmd>::template move_and_join<8>(
+        currentBlock.bit_encryption_context(), blockByBytes);
+}
+
+template<std::size_t pmd>
+PackedCryptoBitset<128, pmd> InvSubBytes(PackedCryptoBitset<128, pmd> const& currentBlock)
+{
+    Circuit const& sbox = AES128_SBox_Reverse_Compiled(Circuit::Depth::product);
+    std::vector<PackedCryptoBitset<8, pmd>> blockByBytes = currentBlock.template split<16>();
+
+    for (auto& byte : blockByBytes)
+        byte = run_layer(sbox, std::move(byte));
+
+    return PackedCryptoBitset<128, pmd>::template move_and_join<8>(
+        currentBlock.bit_encryption_context(), blockByBytes);
+}
+
+// ShiftRows() and InvShiftRows() only reorder the bytes, i.e. the ciphertexts
+// of the bitset: no homomorphic operation is performed.
+// The byte (row r, column c) is located at the index 4*c + r.
+template<std::size_t pmd>
+PackedCryptoBitset<128, pmd> ShiftRows(PackedCryptoBitset<128, pmd> const& currentBlock)
+{
+    std::vector<PackedCryptoBitset<8, pmd>> blockBytes = currentBlock.template split<16>();
+    std::vector<PackedCryptoBitset<8, pmd>> shiftedBytes;
+    shiftedBytes.reserve(16);
+
+    // row r is rotated r columns to the left
+    for (unsigned c = 0; c < 4; c++)
+        for (unsigned r = 0; r < 4; r++)
+            shiftedBytes.push_back(blockBytes[4*((c + r) % 4) + r]);
+
+    return PackedCryptoBitset<128, pmd>::template move_and_join<8>(
+        currentBlock.bit_encryption_context(), shiftedBytes);
+}
+
+template<std::size_t pmd>
+PackedCryptoBitset<128, pmd> InvShiftRows(PackedCryptoBitset<128, pmd> const& currentBlock)
+{
+    std::vector<PackedCryptoBitset<8, pmd>> blockBytes = currentBlock.template split<16>();
+    std::vector<PackedCryptoBitset<8, pmd>> shiftedBytes;
+    shiftedBytes.reserve(16);
+
+    // row r is rotated r columns to the right
+    for (unsigned c = 0; c < 4; c++)
+        for (unsigned r = 0; r < 4; r++)
+            shiftedBytes.push_back(blockBytes[4*((c + 4 - r) % 4) + r]);
+
+    return PackedCryptoBitset<128, pmd>::template move_and_join<8>(
+        currentBlock.bit_encryption_context(), shiftedBytes);
+}
+
+// ShiftRows() and InvShiftRows() on blocks packed in the slots: the bytes
+// of each row move by the same offset, i.e. by one rotation of the slots
+// (see SlotPackedCryptoBitset::permute)
+template<std::size_t pmd>
+SlotPackedCryptoBitset<128, pmd> ShiftRows(SlotPackedCryptoBitset<128, pmd> const& currentBlock)
+{
+    // row r is rotated r columns to the left
+    std::array<size_t, 16> source;
+    for (unsigned c = 0; c < 4; c++)
+        for (unsigned r = 0; r < 4; r++)
+            source[4*c + r] = 4*((c + r) % 4) + r;
+    return currentBlock.template permute<8>(source);
+}
+
+template<std::size_t pmd>
+SlotPackedCryptoBitset<128, pmd> InvShiftRows(SlotPackedCryptoBitset<128, pmd> const& currentBlock)
+{
+    // row r is rotated r columns to the right
+    std::array<size_t, 16> source;
+    for (unsigned c = 0; c < 4; c++)
+        for (unsigned r = 0; r < 4; r++)
+            source[4*c + r] = 4*((c + 4 - r) % 4) + r;
+    return currentBlock.template permute<8>(source);
+}
+
+// MixColumns() and InvMixColumns() on packed bytes: each column is mixed
+// by the XOR network of the bit layer (see MixColumns in aes_he.cpp), run
+// as a circuit
+template<std::size_t pmd>
+PackedCryptoBitset<128, pmd> MixEachColumn(Circuit const& network,
+                                           PackedCryptoBitset<128, pmd> const& currentBlock)
+{
+    std::vector<PackedCryptoBitset<32, pmd>> columns = currentBlock.template split<4>();
+
+    for (auto& column : columns)
+        column = run_layer(network, std::move(column));
+
+    return PackedCryptoBitset<128, pmd>::template move_and_join<32>(
+        currentBlock.bit_encryption_context(), columns);
+}
+
+template<std::size_t pmd>
+PackedCryptoBitset<128, pmd> MixColumns(PackedCryptoBitset<128, pmd> const& currentBlock)
+{
+    static const Circuit network = XorNetwork::synthesize(AES_MixColumns_Matrix).circuit(Circuit::Depth::product);
+    return MixEachColumn(network, currentBlock);
+}
+
+template<std::size_t pmd>
+PackedCryptoBitset<128, pmd> InvMixColumns(PackedCryptoBitset<128, pmd> const& currentBlock)
+{
+    static const Circuit network = XorNetwork::synthesize(AES_InvMixColumns_Matrix).circuit(Circuit::Depth::product);
+    return MixEachColumn(network, currentBlock);
+}
+
+template<AES_Mode key_size, std::size_t pmd>
+PackedCryptoBitset<128, pmd> HE_AES_Keyswitching(PackedCryptoBitset<128, pmd> const& block_enc_with_k0,
+                                                 PackedCryptoBitset<key_size, pmd> const& k0,
+                                                 PackedCryptoBitset<key_size, pmd> const& k1)
+{
+    std::vector<PackedCryptoBitset<128, pmd>> keys_derived_k0 = KeyExpansion<key_size>(k0);
+    std::vector<PackedCryptoBitset<128, pmd>> keys_derived_k1 = KeyExpansion<key_size>(k1);
+    PackedCryptoBitset<128, pmd> he_plain_data = HE_AES_Decrypt<key_size>(block_enc_with_k0, keys_derived_k0);
+    return HE_AES_Encrypt<key_size>(he_plain_data, keys_derived_k1);
+}
+
+template<AES_Mode key_size, std::size_t pmd>
+PackedCryptoBitset<128, pmd> HE_AES_Encrypt(PackedCryptoBitset<128, pmd> const& plainBlock,
+                                            std::vector<PackedCryptoBitset<128, pmd>> const& currentKeys)
+{
+    unsigned int round = 0;
+    unsigned int Nr = key_size / 32 + 6;
+    assert(Nr+1 == currentKeys.size());
+
+    PackedCryptoBitset<128, pmd> currentBlock(plainBlock);
+    currentBlock.refresh_for(1);
+    currentBlock = AddRoundKey(currentBlock, currentKeys[round]);
+
+    for (round = 1; round < Nr; round++) {
+        currentBlock = SubBytes(currentBlock);
+        currentBlock = ShiftRows(currentBlock);
+        currentBlock = MixColumns(currentBlock);
+        currentBlock.refresh_for(1);
+        currentBlock = AddRoundKey(currentBlock, currentKeys[round]);
+    }
+
+    // (Note that MixColumns isn't in the last round)
+    currentBlock = SubBytes(currentBlock);
+    currentBlock = ShiftRows(currentBlock);
+    currentBlock.refresh_for(1);
+    return AddRoundKey(currentBlock, currentKeys[Nr]);
+}
+
+template<AES_Mode key_size, std::size_t pmd>
+PackedCryptoBitset<128, pmd> HE_AES_Decrypt(PackedCryptoBitset<128, pmd> const& cipherBlock,
+                                            std::vector<PackedCryptoBitset<128, pmd>> const& currentKeys)
+{
+    unsigned int round = 0;
+    unsigned int Nr = key_size / 32 + 6;
+    assert(Nr+1 == currentKeys.size());
+
+    PackedCryptoBitset<128, pmd> currentBlock(cipherBlock);
+    currentBlock.refresh_for(1);
+    currentBlock = AddRoundKey(currentBlock, currentKeys[Nr]);
+
+    for (round = Nr-1; round > 0; round--) {
+        currentBlock = InvShiftRows(currentBlock);
+        currentBlock = InvSubBytes(currentBlock);
+        currentBlock.refresh_for(1);
+        currentBlock = AddRoundKey(currentBlock, currentKeys[round]);
+        currentBlock = InvMixColumns(currentBlock);
+    }
+
+    currentBlock = InvShiftRows(currentBlock);
+    currentBlock = InvSubBytes(currentBlock);
+    currentBlock.refresh_for(1);
+    return AddRoundKey(currentBlock, currentKeys[0]);
+}
+
+template<AES_Mode key_size, std::size_t pmd>
+std::vector<PackedCryptoBitset<128, pmd>> KeyExpansion(PackedCryptoBitset<key_size, pmd> const& AESKey)
+{
+    const unsigned Nk = key_size / 32;
+    const unsigned Nr = Nk + 6;
+
+    PackedBitsEncryptionContext<pmd>& ctxt = AESKey.bit_encryption_context();
+
+    // Same algorithm as the one of KeyExpansion() on CryptoBitset, see aes_he.hpp
+    std::vector<PackedCryptoBitset<32, pmd>> expandedKey = AESKey.template split<Nk>();
+    expandedKey.reserve(4*(Nr+1));
+
+    auto SubWord = [&ctxt](PackedCryptoBitset<32, pmd> const& word) {
+        Circuit const& sbox = AES128_SBox_Forward_Compiled(Circuit::Depth::product);
+        std::vector<PackedCryptoBitset<8, pmd>> wordBytes = word.template split<4>();
+        for (auto& byte : wordBytes)
+            byte = run_layer(sbox, std::move(byte));
+        return PackedCryptoBitset<32, pmd>::template move_and_join<8>(ctxt, wordBytes);
+    };
+
+    for (unsigned long int i = Nk; i < 4*(Nr+1); i++)
+    {
+        PackedCryptoBitset<32, pmd> tmpWord = expandedKey.back();
+
+        if (i % Nk == 0) {
+            // D_i = SubWord(RotWord(C_{i-1})) XOR Rcst_{(i)/Nk}
+            // (the round constant is only XORed on the first byte)
+            tmpWord = SubWord(tmpWord.rotate_right(8)) ^ ClearBitset<32>(round_const[i/Nk]);
+        }
+        else if (Nk > 6 && i % Nk == 4) {
+            // (AES-256) D_i = SubWord(C_{i-1})
+            tmpWord = SubWord(tmpWord);
+        }
+
+        // C_i = C_{i-Nk} XOR D_i
+        expandedKey[i-Nk].refresh_for(1);
+        tmpWord.refresh_for(1);
+        expandedKey.push_back(expandedKey[i-Nk] ^ tmpWord);
+    }
+
+    std::vector<PackedCryptoBitset<128, pmd>> finalizedKeys;
+    finalizedKeys.reserve(Nr+1);
+
+    // Merge each group of 4x32-bit words in full 128-bit key
+    for (unsigned k = 0; k < 4*(Nr+1); k += 4) {
+        std::vector<PackedCryptoBitset<32, pmd>> acc_vec(
+            std::make_move_iterator(expandedKey.begin() + k),
+            std::make_move_iterator(expandedKey.begin() + k + 4));
+        finalizedKeys.push_back(PackedCryptoBitset<128, pmd>::template move_and_join<32>(ctxt, acc_vec));
+        // (ready for AddRoundKey)
+        finalizedKeys.back().refresh_for(1);
+    }
+
+    return finalizedKeys;
+}
+
+#endif
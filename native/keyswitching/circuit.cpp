@@ -0,0 +1,246 @@
+#include <algorithm>
+#include <limits>
+#include "circuit.hpp"
+
+Circuit::Circuit(std::size_t nb_inputs)
+    : _nb_inputs(nb_inputs)
+{
+    _nodes.reserve(nb_inputs);
+    for (std::size_t i = 0; i < nb_inputs; i++)
+        _nodes.push_back({ Op::input, 0, 0 });
+}
+
+Circuit::node_id Circuit::add_node(Op op, node_id lhs, node_id rhs)
+{
+    // (XOR and AND are commutative)
+    if (lhs > rhs && op != Op::NOT)
+        std::swap(lhs, rhs);
+    const std::uint64_t key = (static_cast<std::uint64_t>(op) << 62) |
+                              (static_cast<std::uint64_t>(lhs) << 31) | rhs;
+
+    auto it = _unique.find(key);
+    if (it != _unique.end())
+        return it->second;
+
+    assert(_nodes.size() < (node_id(1) << 31) && "too many gates");
+    const node_id id = static_cast<node_id>(_nodes.size());
+    _nodes.push_back({ op, lhs, rhs });
+    _unique.emplace(key, id);
+    _compiled = false;
+    return id;
+}
+
+Circuit::node_id Circuit::add_gate(Op op, node_id lhs, node_id rhs)
+{
+    assert(lhs < _nodes.size() && (op == Op::NOT || rhs < _nodes.size()));
+
+    switch (op) {
+    case Op::NOT:
+        // !!x = x
+        if (_nodes[lhs].op == Op::NOT)
+            return _nodes[lhs].lhs;
+        return add_node(Op::NOT, lhs, 0);
+
+    case Op::XOR: {
+        // !x ^ y = !(x ^ y) and !x ^ !y = x ^ y
+        bool negated = false;
+        if (_nodes[lhs].op == Op::NOT) {
+            lhs = _nodes[lhs].lhs;
+            negated = !negated;
+        }
+        if (_nodes[rhs].op == Op::NOT) {
+            rhs = _nodes[rhs].lhs;
+            negated = !negated;
+        }
+        const node_id res = add_node(Op::XOR, lhs, rhs);
+        return negated ? add_gate(Op::NOT, res) : res;
+    }
+
+    case Op::AND:
+        // x & x = x
+        if (lhs == rhs)
+            return lhs;
+        return add_node(Op::AND, lhs, rhs);
+
+    default:
+        assert(false && "not a gate");
+        return lhs;
+    }
+}
+
+void Circuit::add_output(node_id node)
+{
+    assert(node < _nodes.size());
+    _outputs.push_back(node);
+    _compiled = false;
+}
+
+std::size_t Circuit::nb_gates() const
+{
+    if (_compiled)
+        return _steps.size();
+    return _nodes.size() - _nb_inputs;
+}
+
+CircuitReport Circuit::report() const
+{
+    assert(_compiled && "the circuit must be compiled");
+    return _report;
+}
+
+void Circuit::compile(Depth depth_model)
+{
+    const std::size_t nb_nodes = _nodes.size();
+    constexpr std::size_t never = std::numeric_limits<std::size_t>::max();
+
+    // Dead gate removal (the nodes are in topological order)
+    std::vector<bool> live(nb_nodes, false);
+    for (node_id out : _outputs)
+        live[out] = true;
+    for (std::size_t id = nb_nodes; id-- > _nb_inputs; ) {
+        if (!live[id])
+            continue;
+        live[_nodes[id].lhs] = true;
+        if (_nodes[id].op != Op::NOT)
+            live[_nodes[id].rhs] = true;
+    }
+
+    // Depth of each node (see Depth): the products of depth d only depend
+    // on nodes of depth < d, the free gates of depth d on products of depth
+    // <= d. The AND depth is kept for the report.
+    auto is_product = [depth_model](Op op) {
+        return op == Op::AND || (op == Op::XOR && depth_model == Depth::product);
+    };
+    std::vector<std::size_t> depth(nb_nodes, 0);
+    std::vector<std::size_t> and_depth(nb_nodes, 0);
+    std::size_t max_depth = 0;
+    for (std::size_t id = _nb_inputs; id < nb_nodes; id++) {
+        if (!live[id])
+            continue;
+        const Node& node = _nodes[id];
+        depth[id] = depth[node.lhs];
+        and_depth[id] = and_depth[node.lhs];
+        if (node.op != Op::NOT) {
+            depth[id] = std::max(depth[id], depth[node.rhs]);
+            and_depth[id] = std::max(and_depth[id], and_depth[node.rhs]);
+        }
+        if (is_product(node.op))
+            depth[id]++;
+        if (node.op == Op::AND)
+            and_depth[id]++;
+        max_depth = std::max(max_depth, depth[id]);
+    }
+
+    // Order of evaluation: wave by wave, the products then the other gates
+    std::vector<node_id> order;
+    std::vector<Wave> waves;
+    for (std::size_t d = 0; d <= max_depth; d++) {
+        Wave wave;
+        wave.begin = order.size();
+        for (std::size_t id = _nb_inputs; id < nb_nodes; id++)
+            if (live[id] && depth[id] == d && is_product(_nodes[id].op))
+                order.push_back(static_cast<node_id>(id));
+        wave.parallel_end = order.size();
+        for (std::size_t id = _nb_inputs; id < nb_nodes; id++)
+            if (live[id] && depth[id] == d && !is_product(_nodes[id].op))
+                order.push_back(static_cast<node_id>(id));
+        wave.end = order.size();
+        if (wave.end > wave.begin)
+            waves.push_back(wave);
+    }
+
+    // Last step reading each node (the outputs are read at the end)
+    std::vector<std::size_t> last_use(nb_nodes, 0);
+    for (std::size_t s = 0; s < order.size(); s++) {
+        const Node& node = _nodes[order[s]];
+        last_use[node.lhs] = s;
+        if (node.op != Op::NOT)
+            last_use[node.rhs] = s;
+    }
+    for (node_id out : _outputs)
+        last_use[out] = never;
+
+    // Register allocation: the input i is in the register i, a register is
+    // released after the last step reading it (after the whole parallel part
+    // of a wave)
+    std::vector<std::uint32_t> reg(nb_nodes, 0);
+    std::vector<std::uint32_t> free_registers;
+    std::size_t nb_registers = _nb_inputs;
+    for (std::size_t i = 0; i < _nb_inputs; i++) {
+        reg[i] = static_cast<std::uint32_t>(i);
+        if (!live[i])
+            free_registers.push_back(reg[i]);
+    }
+    auto allocate = [&]() {
+        if (free_registers.empty())
+            return static_cast<std::uint32_t>(nb_registers++);
+        const std::uint32_t r = free_registers.back();
+        free_registers.pop_back();
+        return r;
+    };
+
+    _steps.clear();
+    _steps.reserve(order.size());
+    std::vector<std::uint32_t> released;
+    auto schedule = [&](std::size_t s) {
+        const node_id id = order[s];
+        const Node& node = _nodes[id];
+        reg[id] = allocate();
+        _steps.push_back({ node.op, reg[id], reg[node.lhs], reg[node.rhs] });
+        if (last_use[node.lhs] == s)
+            released.push_back(reg[node.lhs]);
+        if (node.op != Op::NOT && node.rhs != node.lhs && last_use[node.rhs] == s)
+            released.push_back(reg[node.rhs]);
+    };
+    auto release = [&]() {
+        free_registers.insert(free_registers.end(), released.begin(), released.end());
+        released.clear();
+    };
+
+    for (auto const& wave : waves) {
+        for (std::size_t s = wave.begin; s < wave.parallel_end; s++)
+            schedule(s);
+        release();
+        for (std::size_t s = wave.parallel_end; s < wave.end; s++) {
+            schedule(s);
+            release();
+        }
+    }
+
+    // Registers live at the beginning of each wave: the values computed
+    // before it (or inputs) and read by it or later (or outputs)
+    std::vector<std::size_t> computed_at(nb_nodes, 0);
+    for (std::size_t s = 0; s < order.size(); s++)
+        computed_at[order[s]] = s + 1;
+    _live_registers.clear();
+    for (auto& wave : waves) {
+        wave.live_begin = _live_registers.size();
+        for (std::size_t id = 0; id < nb_nodes; id++)
+            if (live[id] && computed_at[id] <= wave.begin && last_use[id] >= wave.begin)
+                _live_registers.push_back(reg[id]);
+        wave.live_end = _live_registers.size();
+    }
+    _waves = std::move(waves);
+    _nb_registers = nb_registers;
+
+    _output_registers.clear();
+    for (node_id out : _outputs)
+        _output_registers.push_back(reg[out]);
+
+    _report = CircuitReport();
+    for (node_id id : order) {
+        switch (_nodes[id].op) {
+        case Op::AND: _report.and_count++; break;
+        case Op::XOR: _report.xor_count++; break;
+        case Op::NOT: _report.not_count++; break;
+        default: break;
+        }
+    }
+    _depth = 0;
+    for (node_id out : _outputs) {
+        _report.and_depth = std::max(_report.and_depth, and_depth[out]);
+        _depth = std::max(_depth, depth[out]);
+    }
+
+    _compiled = true;
+}
@@ -0,0 +1,293 @@
+#ifndef __CIRCUIT_HPP__
+#define __CIRCUIT_HPP__
+
+#include <assert.h>
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include "circuitstats.hpp"
+#include "taskscheduler.hpp"
+
+// Boolean circuit recorded symbolically
+//
+// A circuit written once for any bitset type (e.g. the S-box circuits) can be
+// run on a SymbolicBitset: its gates are then recorded instead of being
+// evaluated. While recording, the identical gates are merged (common
+// subexpression elimination) and the NOT gates are pushed through the XOR
+// gates (!x ^ y = !(x ^ y)). compile() then drops the gates which do not
+// lead to an output and schedules the other ones:
+// (*) in waves of depth: the products of a wave are independent (they are
+//     evaluated in parallel) and followed by the free gates depending on
+//     them,
+// (*) in a few registers, each one reused as soon as its value is dead.
+// run() evaluates the schedule on any bitset type (CryptoBitset,
+// PackedCryptoBitset...) without building any intermediate bitset.
+class Circuit
+{
+public:
+    enum class Op : std::uint8_t { input, XOR, AND, NOT };
+    using node_id = std::uint32_t;
+
+    // Gates counted as products in the depth of the waves: the ANDs only
+    // (XOR is an addition, e.g. on CryptoBit) or the ANDs and the XORs (on
+    // packed bits, XOR is a multiplication too, see PackedCryptoBits)
+    enum class Depth : std::uint8_t { AND, product };
+
+    explicit Circuit(std::size_t nb_inputs);
+
+    node_id input(std::size_t i) const {
+        assert(i < _nb_inputs);
+        return static_cast<node_id>(i);
+    }
+
+    // Node computing "op" (the rhs of a NOT is ignored), an existing one if
+    // any
+    node_id add_gate(Op op, node_id lhs, node_id rhs = 0);
+
+    // The outputs are added in order (the same node may be several outputs)
+    void add_output(node_id node);
+
+    // Dead gate removal and scheduling: needed before run()
+    void compile(Depth depth = Depth::AND);
+
+    std::size_t nb_inputs() const { return _nb_inputs; }
+    std::size_t nb_outputs() const { return _outputs.size(); }
+    // Number of gates of the compiled circuit (recorded gates if not compiled)
+    std::size_t nb_gates() const;
+    std::size_t nb_registers() const { return _nb_registers; }
+
+    // Gate count and AND depth of the compiled circuit
+    CircuitReport report() const;
+
+    // Depth of the compiled circuit, counted as compiled (see Depth): with
+    // Depth::product, the products an input goes through up to an output
+    std::size_t depth() const {
+        assert(_compiled && "the circuit must be compiled");
+        return _depth;
+    }
+
+    // Evaluate the circuit on a bitset with as many bits as inputs and outputs
+    template <typename Bitset>
+    Bitset run(Bitset const& input) const;
+
+    // Same evaluation, calling prepare(bit) before each wave on the registers
+    // read by this wave or a later one, e.g. to manage their noise: with
+    // Depth::product, each of them then goes through at most one product
+    // until the next call. prepare() is called in parallel on distinct bits
+    // (nullptr: no call).
+    template <typename Bitset, typename Prepare>
+    Bitset run(Bitset const& input, Prepare prepare) const;
+
+private:
+    struct Node
+    {
+        Op op;
+        node_id lhs;
+        node_id rhs;
+    };
+
+    // A gate of the schedule, on registers
+    struct Step
+    {
+        Op op;
+        std::uint32_t dst;
+        std::uint32_t lhs;
+        std::uint32_t rhs;
+    };
+
+    // The steps [begin, parallel_end) are the independent products of the
+    // wave, the steps [parallel_end, end) the free gates after them. The
+    // registers [live_begin, live_end) of _live_registers hold the values
+    // read by this wave or a later one.
+    struct Wave
+    {
+        std::size_t begin;
+        std::size_t parallel_end;
+        std::size_t end;
+        std::size_t live_begin;
+        std::size_t live_end;
+    };
+
+    node_id add_node(Op op, node_id lhs, node_id rhs);
+
+    std::size_t _nb_inputs;
+    std::vector<Node> _nodes;
+    std::vector<node_id> _outputs;
+    std::unordered_map<std::uint64_t, node_id> _unique;
+
+    bool _compiled = false;
+    std::vector<Step> _steps;
+    std::vector<Wave> _waves;
+    std::vector<std::uint32_t> _live_registers;
+    std::vector<std::uint32_t> _output_registers;
+    std::size_t _nb_registers = 0;
+    std::size_t _depth = 0;
+    CircuitReport _report;
+};
+
+// Bit recording the gates applied to it in a Circuit
+class SymbolicBit
+{
+    Circuit* _circuit;
+    Circuit::node_id _node;
+
+public:
+    SymbolicBit(Circuit& circuit, Circuit::node_id node)
+        : _circuit(&circuit), _node(node)
+    {
+    }
+
+    Circuit::node_id node() const { return _node; }
+
+    inline SymbolicBit and_op(const SymbolicBit& rhs) const {
+        return SymbolicBit(*_circuit, _circuit->add_gate(Circuit::Op::AND, _node, rhs._node));
+    }
+
+    inline SymbolicBit xor_op(const SymbolicBit& rhs) const {
+        return SymbolicBit(*_circuit, _circuit->add_gate(Circuit::Op::XOR, _node, rhs._node));
+    }
+
+    inline SymbolicBit not_op() const {
+        return SymbolicBit(*_circuit, _circuit->add_gate(Circuit::Op::NOT, _node));
+    }
+
+    // x | y = x ^ y ^ xy
+    inline SymbolicBit or_op(const SymbolicBit& rhs) const {
+        return xor_op(rhs).xor_op(and_op(rhs));
+    }
+
+    inline SymbolicBit xnor_op(const SymbolicBit& rhs) const {
+        return xor_op(rhs).not_op();
+    }
+
+    inline SymbolicBit operator&(const SymbolicBit& rhs) const { return and_op(rhs); }
+    inline SymbolicBit operator|(const SymbolicBit& rhs) const { return or_op(rhs); }
+    inline SymbolicBit operator^(const SymbolicBit& rhs) const { return xor_op(rhs); }
+    inline SymbolicBit operator==(const SymbolicBit& rhs) const { return xnor_op(rhs); }
+    inline SymbolicBit operator!() const { return not_op(); }
+};
+
+template <std::size_t bitsize>
+class SymbolicBitset
+{
+    std::vector<SymbolicBit> _container;
+
+public:
+    using bit_type = SymbolicBit;
+
+    // The inputs of the circuit
+    explicit SymbolicBitset(Circuit& circuit)
+        : SymbolicBitset(circuit, 0)
+    {
+        assert(circuit.nb_inputs() == bitsize);
+    }
+
+    // The inputs [first_input, first_input + bitsize) of the circuit
+    SymbolicBitset(Circuit& circuit, std::size_t first_input)
+    {
+        _container.reserve(bitsize);
+        for (std::size_t i = 0; i < bitsize; i++)
+            _container.push_back(SymbolicBit(circuit, circuit.input(first_input + i)));
+    }
+
+    SymbolicBit& operator[](std::size_t i) {
+        return _container[i];
+    }
+
+    SymbolicBit const& operator[](std::size_t i) const {
+        return _container[i];
+    }
+};
+
+// Record and compile "circuit" (a callable taking and returning a bitset),
+// e.g.: record_circuit<8>(AES_SBox_Forward_Circuit<SymbolicBitset<8>>)
+template <std::size_t bitsize, typename F>
+Circuit record_circuit(F circuit, Circuit::Depth depth = Circuit::Depth::AND)
+{
+    Circuit recorded(bitsize);
+    const SymbolicBitset<bitsize> output = circuit(SymbolicBitset<bitsize>(recorded));
+    for (std::size_t i = 0; i < bitsize; i++)
+        recorded.add_output(output[i].node());
+    recorded.compile(depth);
+    return recorded;
+}
+
+// Same for a circuit of two operands "circuit(a, b)": the inputs are the bits
+// of a then the ones of b, and so are the outputs, the result of the circuit
+// taking the place of a (run() needs a square circuit)
+template <std::size_t bitsize, typename F>
+Circuit record_binary_circuit(F circuit, Circuit::Depth depth = Circuit::Depth::AND)
+{
+    Circuit recorded(2*bitsize);
+    const SymbolicBitset<bitsize> output = circuit(SymbolicBitset<bitsize>(recorded, 0),
+                                                   SymbolicBitset<bitsize>(recorded, bitsize));
+    for (std::size_t i = 0; i < bitsize; i++)
+        recorded.add_output(output[i].node());
+    for (std::size_t i = 0; i < bitsize; i++)
+        recorded.add_output(recorded.input(bitsize + i));
+    recorded.compile(depth);
+    return recorded;
+}
+
+// Template Definitions
+//
+template <typename Bitset>
+Bitset Circuit::run(Bitset const& input) const
+{
+    return run(input, nullptr);
+}
+
+template <typename Bitset, typename Prepare>
+Bitset Circuit::run(Bitset const& input, Prepare prepare) const
+{
+    using Bit = typename Bitset::bit_type;
+    assert(_compiled && "the circuit must be compiled");
+    assert(_nb_inputs == _outputs.size() && "the circuit must be square");
+
+    std::vector<std::optional<Bit>> registers(_nb_registers);
+    for (std::size_t i = 0; i < _nb_inputs; i++)
+        registers[i].emplace(input[i]);
+
+    auto execute = [&registers](Step const& step) {
+        switch (step.op) {
+        case Op::XOR:
+            registers[step.dst].emplace(*registers[step.lhs] ^ *registers[step.rhs]);
+            break;
+        case Op::AND:
+            registers[step.dst].emplace(*registers[step.lhs] & *registers[step.rhs]);
+            break;
+        case Op::NOT:
+            registers[step.dst].emplace(!*registers[step.lhs]);
+            break;
+        default:
+            assert(false && "not a gate");
+        }
+    };
+
+    for (auto const& wave : _waves) {
+        if constexpr (!std::is_null_pointer_v<Prepare>)
+            default_scheduler().parallel_for(wave.live_begin, wave.live_end, [&](std::size_t l) {
+                prepare(*registers[_live_registers[l]]);
+            });
+
+        if (wave.parallel_end - wave.begin > 1)
+            default_scheduler().parallel_for(wave.begin, wave.parallel_end, [&](std::size_t s) {
+                execute(_steps[s]);
+            });
+        else
+            for (std::size_t s = wave.begin; s < wave.parallel_end; s++)
+                execute(_steps[s]);
+
+        for (std::size_t s = wave.parallel_end; s < wave.end; s++)
+            execute(_steps[s]);
+    }
+
+    Bitset output(input);
+    for (std::size_t i = 0; i < _output_registers.size(); i++)
+        output[i] = *registers[_output_registers[i]];
+    return output;
+}
+
+#endif
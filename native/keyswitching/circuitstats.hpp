@@ -0,0 +1,125 @@
+#ifndef __CIRCUIT_STATS_HPP__
+#define __CIRCUIT_STATS_HPP__
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+// Static cost report of a boolean circuit
+//
+// On encrypted bits, the cost of a circuit is driven by its AND gates (one
+// ciphertext multiplication + relinearization each) and the noise budget it
+// consumes by its multiplicative depth (the number of AND gates on the
+// longest path). XOR/NOT gates are additions and are almost free.
+struct CircuitReport
+{
+    std::size_t and_count = 0;
+    std::size_t xor_count = 0;
+    std::size_t not_count = 0;
+    std::size_t and_depth = 0;
+};
+
+inline std::ostream& operator<<(std::ostream& os, CircuitReport const& report)
+{
+    return os << "AND: "    << report.and_count
+              << ", XOR: "  << report.xor_count
+              << ", NOT: "  << report.not_count
+              << ", depth: " << report.and_depth;
+}
+
+// Bit used to trace a circuit without any encryption: it only records the
+// gates applied on it (in the CircuitReport it is attached to) and its own
+// multiplicative depth.
+class TracedBit
+{
+    CircuitReport* _report;
+    std::size_t _depth;
+
+    TracedBit(CircuitReport* report, std::size_t depth)
+        : _report(report), _depth(depth)
+    {
+    }
+
+public:
+    explicit TracedBit(CircuitReport& report)
+        : _report(&report), _depth(0)
+    {
+    }
+
+    inline TracedBit and_op(const TracedBit& rhs) const {
+        _report->and_count++;
+        return TracedBit(_report, std::max(_depth, rhs._depth) + 1);
+    }
+
+    // x | y = x ^ y ^ xy
+    inline TracedBit or_op(const TracedBit& rhs) const {
+        _report->xor_count += 2;
+        return and_op(rhs);
+    }
+
+    inline TracedBit xor_op(const TracedBit& rhs) const {
+        _report->xor_count++;
+        return TracedBit(_report, std::max(_depth, rhs._depth));
+    }
+
+    inline TracedBit not_op() const {
+        _report->not_count++;
+        return TracedBit(_report, _depth);
+    }
+
+    inline TracedBit xnor_op(const TracedBit& rhs) const {
+        return xor_op(rhs).not_op();
+    }
+
+    inline TracedBit operator&(const TracedBit& rhs) const { return and_op(rhs); }
+    inline TracedBit operator|(const TracedBit& rhs) const { return or_op(rhs); }
+    inline TracedBit operator^(const TracedBit& rhs) const { return xor_op(rhs); }
+    inline TracedBit operator==(const TracedBit& rhs) const { return xnor_op(rhs); }
+    inline TracedBit operator!() const { return not_op(); }
+
+    std::size_t depth() const { return _depth; }
+};
+
+template <std::size_t bitsize>
+class TracedBitset
+{
+    std::vector<TracedBit> _container;
+
+public:
+    using bit_type = TracedBit;
+
+    explicit TracedBitset(CircuitReport& report)
+        : _container(bitsize, TracedBit(report))
+    {
+    }
+
+    TracedBit& operator[](std::size_t i) {
+        return _container[i];
+    }
+
+    TracedBit const& operator[](std::size_t i) const {
+        return _container[i];
+    }
+
+    std::size_t depth() const {
+        std::size_t depth = 0;
+        for (auto const& bit : _container)
+            depth = std::max(depth, bit.depth());
+        return depth;
+    }
+};
+
+// Evaluate "circuit" (a callable taking and returning a bitset) on traced
+// bits and return its gate count and multiplicative depth, e.g.:
+// trace_circuit<8>(AES_SBox_Forward_Circuit<TracedBitset<8>>)
+template <std::size_t bitsize, typename Circuit>
+CircuitReport trace_circuit(Circuit circuit)
+{
+    CircuitReport report;
+    TracedBitset<bitsize> input(report);
+    const TracedBitset<bitsize> output = circuit(input);
+    report.and_depth = output.depth();
+    return report;
+}
+
+#endif
@@ -0,0 +1,66 @@
+#include <assert.h>
+#include "compactciphertext.hpp"
+
+namespace
+{
+    // Bit count of each RNS component of a ciphertext at "parms_id"
+    std::vector<int> component_bits(seal::SEALContext const& context, seal::parms_id_type const& parms_id)
+    {
+        auto context_data = context.get_context_data(parms_id);
+        assert(context_data && "the ciphertext is not valid for the context");
+        std::vector<int> bits;
+        for (auto const& prime : context_data->parms().coeff_modulus())
+            bits.push_back(prime.bit_count());
+        return bits;
+    }
+}
+
+CompactCiphertext::CompactCiphertext(seal::SEALContext const& context, seal::Ciphertext const& encrypted)
+    : _parms_id(encrypted.parms_id()), _size(encrypted.size()),
+      _is_ntt_form(encrypted.is_ntt_form()), _scale(encrypted.scale())
+{
+    const std::vector<int> bits = component_bits(context, _parms_id);
+    const std::size_t coeff_count = encrypted.poly_modulus_degree();
+
+    std::size_t total_bits = 0;
+    for (int b : bits)
+        total_bits += b * coeff_count;
+    _packed.assign((total_bits * _size + 63) / 64, 0);
+
+    // the components are packed one after the other in a stream of bits
+    const std::uint64_t* coeff = encrypted.data();
+    std::size_t position = 0;
+    for (std::size_t poly = 0; poly < _size; poly++)
+        for (int b : bits)
+            for (std::size_t i = 0; i < coeff_count; i++, coeff++) {
+                const std::size_t word = position / 64, shift = position % 64;
+                _packed[word] |= *coeff << shift;
+                if (shift + b > 64)
+                    _packed[word + 1] |= *coeff >> (64 - shift);
+                position += b;
+            }
+}
+
+void CompactCiphertext::expand(seal::SEALContext const& context, seal::Ciphertext& destination) const
+{
+    const std::vector<int> bits = component_bits(context, _parms_id);
+    destination.resize(context, _parms_id, _size);
+    destination.is_ntt_form() = _is_ntt_form;
+    destination.scale() = _scale;
+
+    const std::size_t coeff_count = destination.poly_modulus_degree();
+    std::uint64_t* coeff = destination.data();
+    std::size_t position = 0;
+    for (std::size_t poly = 0; poly < _size; poly++)
+        for (int b : bits) {
+            const std::uint64_t mask = (b == 64) ? ~std::uint64_t(0) : (std::uint64_t(1) << b) - 1;
+            for (std::size_t i = 0; i < coeff_count; i++, coeff++) {
+                const std::size_t word = position / 64, shift = position % 64;
+                std::uint64_t value = _packed[word] >> shift;
+                if (shift + b > 64)
+                    value |= _packed[word + 1] << (64 - shift);
+                *coeff = value & mask;
+                position += b;
+            }
+        }
+}
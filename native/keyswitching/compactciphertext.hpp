@@ -0,0 +1,38 @@
+#ifndef __COMPACT_CIPHERTEXT_HPP__
+#define __COMPACT_CIPHERTEXT_HPP__
+
+#include <cstdint>
+#include <vector>
+#include "seal_include.hpp"
+
+// Compact (lossless) form of a ciphertext
+//
+// The coefficients of a ciphertext are stored on 64 bits whereas they are
+// reduced modulo primes of 40 to 60 bits (e.g. 43-44 bits for the default
+// coefficient modulus at n = 8192): the compact form packs the coefficients
+// of each RNS component on the bit count of its prime, a third smaller at
+// n = 8192. An idle ciphertext (e.g. a round key) can be kept in this form
+// and expanded only when it is used.
+class CompactCiphertext
+{
+public:
+    CompactCiphertext(seal::SEALContext const& context, seal::Ciphertext const& encrypted);
+
+    // Expand the ciphertext in "destination" (and in its memory pool)
+    void expand(seal::SEALContext const& context, seal::Ciphertext& destination) const;
+
+    seal::parms_id_type const& parms_id() const { return _parms_id; }
+    std::size_t size() const { return _size; }
+
+    // Memory held by the compact form
+    std::size_t byte_count() const { return _packed.size() * sizeof(std::uint64_t); }
+
+private:
+    seal::parms_id_type _parms_id;
+    std::size_t _size;
+    bool _is_ntt_form;
+    double _scale;
+    std::vector<std::uint64_t> _packed;
+};
+
+#endif
@@ -2,13 +2,36 @@
 #define __ENCRYPTION_LAYER_HPP__
 
 #include <assert.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <bitset>
+#include <iterator>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 #include "seal_include.hpp"
+#include "compactciphertext.hpp"
+#include "noiseplanner.hpp"
+#include "taskscheduler.hpp"
 
 class ClearBit;
 class CryptoBit;
 
+// Allocations of the ciphertexts of the bits of a context
+struct BitMemoryStats
+{
+    // number of threads which built bits (one pool each)
+    std::size_t nb_pools = 0;
+    std::size_t nb_ciphertexts = 0;
+    // memory allocated by the pools (SEAL pools keep the released memory)
+    std::size_t alloc_byte_count = 0;
+    // memory held by the ciphertexts of the live bits (full or compact,
+    // see CryptoBit::compact) and its peak since the last reset_peak_bytes()
+    std::size_t live_bytes = 0;
+    std::size_t peak_bytes = 0;
+};
+
 class BitEncryptionContext
 {
     seal::EncryptionParameters _parms;
@@ -19,17 +42,58 @@ class BitEncryptionContext
     std::shared_ptr<seal::SEALContext> _context; 
     std::shared_ptr<seal::Encryptor  > _encryptor;
     std::shared_ptr<seal::Evaluator  > _evaluator;
-    std::shared_ptr<seal::Decryptor  > _decryptor;
+
+    // Live bytes of the ciphertexts (see share()), owned with the
+    // ciphertexts: a bit may outlive its context
+    struct ByteCount
+    {
+        std::atomic<std::size_t> live{0};
+        std::atomic<std::size_t> peak{0};
+    };
+    std::shared_ptr<ByteCount> _byte_count = std::make_shared<ByteCount>();
 
     std::shared_ptr<const CryptoBit> _c0;
     std::shared_ptr<const CryptoBit> _c1;
-
-public:
-    explicit BitEncryptionContext(std::size_t poly_modulus_degree = 4096)
-        : _parms(seal::scheme_type::bfv)
+    // encodings of 0 and 1, shared by all the encryptions and NOT gates
+    std::array<seal::Plaintext, 2> _plain_bits;
+
+    bool _lazy_relin = false;
+    std::atomic<std::size_t> _relin_count{0};
+
+    // Noise management (see CryptoBit::manage_noise), with the constants
+    // at each level of the modulus chain
+    std::shared_ptr<const LevelPlan> _plan;
+    std::vector<std::shared_ptr<const CryptoBit>> _c0_levels;
+    std::vector<std::shared_ptr<const CryptoBit>> _c1_levels;
+    bool _auto_mod_switch = true;
+    // number of ciphertext multiplications at each level
+    std::vector<std::atomic<std::size_t>> _mult_count;
+
+    // What a thread needs to build bits: a memory pool for the ciphertexts
+    // (thread-safe, as a bit may be released by another thread, but never
+    // contended) and a decryptor (a SEAL decryptor allocates from its own
+    // pool, shared by all the threads using it)
+    struct ThreadState
+    {
+        seal::MemoryPoolHandle pool;
+        std::unique_ptr<seal::Decryptor> decryptor;
+        std::atomic<std::size_t> nb_ciphertexts{0};
+    };
+
+    // identifies the context in the thread-local states (unlike its
+    // address, it is never reused)
+    inline static std::atomic<std::uint64_t> _next_id{0};
+    const std::uint64_t _id = _next_id++;
+    mutable std::mutex _threads_mutex;
+    mutable std::vector<std::unique_ptr<ThreadState>> _threads;
+
+    ThreadState& thread_state() const;
+
+    BitEncryptionContext(std::size_t poly_modulus_degree, const std::vector<seal::Modulus>& coeff_modulus)
+        : _parms(seal::scheme_type::bfv), _mult_count(coeff_modulus.size())
     {
         _parms.set_poly_modulus_degree(poly_modulus_degree);
-        _parms.set_coeff_modulus(seal::CoeffModulus::BFVDefault(_parms.poly_modulus_degree()));
+        _parms.set_coeff_modulus(coeff_modulus);
         // very important
         _parms.set_plain_modulus(2);
         _context = std::make_shared<seal::SEALContext>(_parms);
@@ -39,27 +103,148 @@ public:
         _secret_key = keygen.secret_key();
         _encryptor = std::make_shared<seal::Encryptor>(*_context, _public_key);
         _evaluator = std::make_shared<seal::Evaluator>(*_context);
-        _decryptor = std::make_shared<seal::Decryptor>(*_context, _secret_key);
+        _plain_bits = { seal::Plaintext("0"), seal::Plaintext("1") };
         _c0 = std::make_shared<const CryptoBit>(*this, 0b0);
         _c1 = std::make_shared<const CryptoBit>(*this, 0b1);
     }
 
+    void init_levels();
+
+public:
+    explicit BitEncryptionContext(std::size_t poly_modulus_degree = 4096)
+        : BitEncryptionContext(poly_modulus_degree, seal::CoeffModulus::BFVDefault(poly_modulus_degree))
+    {
+    }
+
+    // Parameters (and noise management) given by the noise planner
+    explicit BitEncryptionContext(const LevelPlan& plan)
+        : BitEncryptionContext(plan.poly_modulus_degree,
+                               seal::CoeffModulus::Create(plan.poly_modulus_degree, plan.coeff_modulus_bits))
+    {
+        _plan = std::make_shared<const LevelPlan>(plan);
+        init_levels();
+    }
+
+    // Level plan of the current coefficient modulus (e.g. BFVDefault),
+    // see plan_for_modulus
+    void enable_modulus_switching(const NoiseModel& model, int margin = 10) {
+        std::vector<int> coeff_modulus_bits;
+        for (auto const& prime : _parms.coeff_modulus())
+            coeff_modulus_bits.push_back(prime.bit_count());
+        _plan = std::make_shared<const LevelPlan>(plan_for_modulus(coeff_modulus_bits, model, margin));
+        init_levels();
+    }
+
+    // nullptr if the noise is managed by refresh only
+    inline const LevelPlan* level_plan() const {
+        return _plan.get();
+    }
+
+    // With a level plan, the result of a multiplication is switched down
+    // to the lowest level allowed by its depth. Enabled by default.
+    inline void set_auto_mod_switch(bool enabled) { _auto_mod_switch = enabled; }
+    inline bool auto_mod_switch() const { return _plan && _auto_mod_switch; }
+
+    // Number of ciphertext multiplications at a given level: their cost
+    // (NTTs, relinearization) is proportional to the number of primes left
+    inline void count_multiplication(std::size_t level) { _mult_count[level]++; }
+    inline std::size_t mult_count(std::size_t level) const { return _mult_count[level]; }
+    inline void reset_mult_count() {
+        for (auto& count : _mult_count)
+            count = 0;
+    }
+
+    // Level of a ciphertext: number of primes dropped by modulus switching
+    inline std::size_t level(const seal::parms_id_type& parms_id) const {
+        return _context->first_context_data()->chain_index() - 
+               _context->get_context_data(parms_id)->chain_index();
+    }
+
+    inline std::size_t level(const seal::Ciphertext& encrypted) const {
+        return level(encrypted.parms_id());
+    }
+
     inline const seal::Modulus& plain_modulus() const {
         return _parms.plain_modulus();
     }
 
+    inline const seal::SEALContext& seal_context() const {
+        return *_context.get();
+    }
+
     inline const seal::Encryptor& encryptor() const {
         return *_encryptor.get();
     }
 
+    // Decryptor of the calling thread
     inline seal::Decryptor& decryptor() {
-        return *_decryptor.get();
+        return *thread_state().decryptor;
+    }
+
+    // Empty ciphertext allocated from the pool of the calling thread: the
+    // threads evaluating gates in parallel never contend on the global pool
+    // NOTE: the temporaries of a gate, which never leave their thread, use
+    // the (unsynchronized) thread-local pool of SEAL instead
+    inline seal::Ciphertext new_ciphertext() const {
+        ThreadState& state = thread_state();
+        state.nb_ciphertexts.fetch_add(1, std::memory_order_relaxed);
+        return seal::Ciphertext(state.pool);
+    }
+
+    // Copy of a ciphertext in the pool of the calling thread
+    inline seal::Ciphertext new_ciphertext(const seal::Ciphertext& copy) const {
+        ThreadState& state = thread_state();
+        state.nb_ciphertexts.fetch_add(1, std::memory_order_relaxed);
+        return seal::Ciphertext(copy, state.pool);
+    }
+
+    BitMemoryStats memory_stats() const {
+        std::lock_guard<std::mutex> lock(_threads_mutex);
+        BitMemoryStats stats;
+        for (auto const& state : _threads) {
+            stats.nb_pools++;
+            stats.nb_ciphertexts += state->nb_ciphertexts.load(std::memory_order_relaxed);
+            stats.alloc_byte_count += state->pool.alloc_byte_count();
+        }
+        stats.live_bytes = _byte_count->live;
+        stats.peak_bytes = _byte_count->peak;
+        return stats;
+    }
+
+    inline void reset_peak_bytes() { _byte_count->peak = _byte_count->live.load(); }
+
+    // Ciphertext (or compact ciphertext) shared by the copies of a bit,
+    // counted in the live bytes of the memory stats while it is alive
+    template <typename T>
+    std::shared_ptr<const T> share(T encrypted) {
+        const std::size_t bytes = byte_count(encrypted);
+        const std::size_t live = _byte_count->live += bytes;
+        std::size_t peak = _byte_count->peak;
+        while (live > peak && !_byte_count->peak.compare_exchange_weak(peak, live))
+            ;
+        return std::shared_ptr<const T>(new T(std::move(encrypted)),
+                                        [byte_count = _byte_count, bytes](const T* released) {
+            byte_count->live -= bytes;
+            delete released;
+        });
+    }
+
+    static std::size_t byte_count(const seal::Ciphertext& encrypted) {
+        return encrypted.dyn_array().size() * sizeof(std::uint64_t);
+    }
+
+    static std::size_t byte_count(const CompactCiphertext& compact) {
+        return compact.byte_count();
     }
 
     inline const std::shared_ptr<seal::Evaluator>& evaluator() const {
         return _evaluator;
     }
 
+    inline const seal::Plaintext& plain_bit(uint8_t bit) const {
+        return _plain_bits[bit & 0b1];
+    }
+
     inline const CryptoBit& c0() const {
         return *_c0.get();
     }
@@ -68,76 +253,207 @@ public:
         return *_c1.get();
     }
 
+    // Encryption of 0 (or 1) at the given level
+    inline const CryptoBit& c0(std::size_t level) const {
+        return level ? *_c0_levels[level - 1] : c0();
+    }
+
+    inline const CryptoBit& c1(std::size_t level) const {
+        return level ? *_c1_levels[level - 1] : c1();
+    }
+
     inline const seal::RelinKeys& relin_keys() const {
         return _relin_keys;
     }
+
+    // With the lazy relinearization, the product of two CryptoBit is kept as
+    // a size-3 ciphertext: it is only relinearized when it feeds another
+    // multiplication (XOR and NOT work on any size). Disabled by default.
+    inline void set_lazy_relinearization(bool lazy) { _lazy_relin = lazy; }
+    inline bool lazy_relinearization() const { return _lazy_relin; }
+
+    // Relinearize (in place) and count the relinearizations
+    inline void relinearize_inplace(seal::Ciphertext& encrypted) {
+        _relin_count++;
+        _evaluator->relinearize_inplace(encrypted, _relin_keys, seal::MemoryPoolHandle::ThreadLocal());
+    }
+
+    inline std::size_t relin_count() const { return _relin_count; }
+    inline void reset_relin_count() { _relin_count = 0; }
 };
 
 #define RELIN_ENABLE 1
 
+// Clear (constant) bit
+// It is never encoded: the gates with a clear operand are folded (see
+// CryptoBit::and_op_on_clear and CryptoBit::xor_op_on_clear)
 class ClearBit
 {
-    friend class CryptoBit;
-    seal::Plaintext _encodedBit;
+    uint8_t _bit;
 public:
     explicit ClearBit(uint8_t bit)
-        : _encodedBit(uint64_to_hex_string(bit & 0b1) == "0" ? 
-                      seal::Plaintext(4096, 1) : seal::Plaintext("1"))
+        : _bit(bit & 0b1)
     {
     }
 
     bool is_zero() const {
-        return _encodedBit.is_zero();
+        return _bit == 0;
     }
 
     uint8_t decode() const {
-        return static_cast<uint8_t>(std::stoul(_encodedBit.to_string(), nullptr, 16)) & 0b1;
+        return _bit;
+    }
+
+    // (the gates of a circuit, see XorNetwork and Circuit, on clear bits)
+    ClearBit operator^(const ClearBit& rhs) const {
+        return ClearBit(_bit ^ rhs._bit);
+    }
+
+    ClearBit operator&(const ClearBit& rhs) const {
+        return ClearBit(_bit & rhs._bit);
+    }
+
+    ClearBit operator!() const {
+        return ClearBit(_bit ^ 1);
+    }
+
+    ClearBit& set_to_0() {
+        _bit = 0;
+        return *this;
     }
 };
 
 class CryptoBit 
 {
-    friend class ClearBit;
+    friend class BitEncryptionContext;
     BitEncryptionContext& _ctxt;
-    seal::Ciphertext _encryptedBit;
+    // The ciphertext is never modified once the bit is built: the copies of
+    // a bit share it (a copy of a bit, e.g. in a shift or a split, is only a
+    // wiring) and the bit operations which change it (refresh, modulus
+    // switching) replace it by a new one
+    std::shared_ptr<const seal::Ciphertext> _encryptedBit;
+    // compact form of the ciphertext of an idle bit (see compact()), in
+    // which case _encryptedBit is null
+    std::shared_ptr<const CompactCiphertext> _compactBit;
     const bool _relin = RELIN_ENABLE;
+    // relinearized version of _encryptedBit when it is a size-3 ciphertext
+    // (lazy relinearization), computed at most once per bit
+    mutable std::shared_ptr<const seal::Ciphertext> _relinearized;
+    // AND depth since the encryption (or the last refresh)
+    std::size_t _depth = 0;
     
-    CryptoBit(BitEncryptionContext& ctxt, const seal::Ciphertext& cipherbit)
-        : _ctxt(ctxt), _encryptedBit(cipherbit)
+    CryptoBit(BitEncryptionContext& ctxt, seal::Ciphertext cipherbit, std::size_t depth = 0)
+        : _ctxt(ctxt), _encryptedBit(ctxt.share(std::move(cipherbit))), _depth(depth)
     {
     }
 
+    // Ciphertext of the bit, expanded for the time of a gate if the bit is
+    // compact
+    std::shared_ptr<const seal::Ciphertext> ciphertext() const
+    {
+        if (_encryptedBit)
+            return _encryptedBit;
+        seal::Ciphertext expanded(_ctxt.new_ciphertext());
+        _compactBit->expand(_ctxt.seal_context(), expanded);
+        return _ctxt.share(std::move(expanded));
+    }
+
+    // Bit holding the product just computed (which is counted): with the
+    // automatic modulus switching, it is switched down as soon as its depth
+    // allows it
+    CryptoBit product(seal::Ciphertext& res, std::size_t depth, std::size_t level) const
+    {
+        _ctxt.count_multiplication(level);
+        CryptoBit bit(_ctxt, std::move(res), depth);
+        if (_ctxt.auto_mod_switch())
+            bit.mod_switch_to_level(_ctxt.level_plan()->level_for_depth(depth));
+        return bit;
+    }
+
+    // The operands of a gate must be at the same level: "encrypted" is
+    // switched down (in "tmp") to the level of "other" if it is above it
+    const seal::Ciphertext& at_level_of(const seal::Ciphertext& encrypted,
+                                        const seal::Ciphertext& other,
+                                        seal::Ciphertext& tmp) const
+    {
+        if (encrypted.parms_id() == other.parms_id() || _ctxt.level(encrypted) > _ctxt.level(other))
+            return encrypted;
+        _ctxt.evaluator()->mod_switch_to(encrypted, other.parms_id(), tmp, seal::MemoryPoolHandle::ThreadLocal());
+        return tmp;
+    }
+
+    // Ciphertext to use as an operand of a multiplication ("encrypted" being
+    // the ciphertext of the bit, a compact bit is never a size-3 ciphertext)
+    // NOTE: the same bit may be an operand in several threads: the first
+    // relinearization computed is kept and the other ones are dropped
+    const seal::Ciphertext& mult_operand(const seal::Ciphertext& encrypted) const
+    {
+        if (encrypted.size() <= 2)
+            return encrypted;
+
+        std::shared_ptr<const seal::Ciphertext> cached = std::atomic_load(&_relinearized);
+        if (!cached) {
+            seal::Ciphertext relinearized(_ctxt.new_ciphertext(encrypted));
+            _ctxt.relinearize_inplace(relinearized);
+            std::shared_ptr<const seal::Ciphertext> desired = _ctxt.share(std::move(relinearized));
+            if (std::atomic_compare_exchange_strong(&_relinearized, &cached, desired))
+                cached = desired;
+        }
+        return *cached;
+    }
+
+    // Relinearize the product just computed, unless it is done lazily
+    void relinearize_product(seal::Ciphertext& product) const
+    {
+        if (_relin && !_ctxt.lazy_relinearization())
+            _ctxt.relinearize_inplace(product);
+    }
+
 public:
     explicit CryptoBit(BitEncryptionContext& ctxt, uint8_t bit)
         : _ctxt(ctxt)
     {
         if (_ctxt.plain_modulus() != 2)
             assert("plain_modulus must be of value 2!");
-        _ctxt.encryptor().encrypt(uint64_to_hex_string(bit & 0b1), _encryptedBit);
+        seal::Ciphertext encrypted(_ctxt.new_ciphertext());
+        _ctxt.encryptor().encrypt(_ctxt.plain_bit(bit), encrypted, seal::MemoryPoolHandle::ThreadLocal());
+        _encryptedBit = _ctxt.share(std::move(encrypted));
     }
 
     CryptoBit(CryptoBit const& ref)
-        : _ctxt(ref._ctxt), _encryptedBit(ref._encryptedBit)
+        : _ctxt(ref._ctxt), _encryptedBit(ref._encryptedBit), _compactBit(ref._compactBit),
+          _relinearized(std::atomic_load(&ref._relinearized)), _depth(ref._depth)
     {
     }
 
     CryptoBit(CryptoBit&& cbit)
-        : _ctxt(cbit._ctxt)
+        : _ctxt(cbit._ctxt), _depth(cbit._depth)
     {
         std::swap(_encryptedBit, cbit._encryptedBit);
+        std::swap(_compactBit, cbit._compactBit);
+        std::swap(_relinearized, cbit._relinearized);
     }
 
     CryptoBit& operator=(const CryptoBit& cbit)
     {
         assert(std::addressof(_ctxt) == std::addressof(cbit._ctxt));
         _encryptedBit = cbit._encryptedBit;
+        _compactBit = cbit._compactBit;
+        _relinearized = std::atomic_load(&cbit._relinearized);
+        _depth = cbit._depth;
         return *this;
     }
 
     CryptoBit& operator=(CryptoBit&& cbit)
     {
-        std::swap(_ctxt, cbit._ctxt);
+        // NOTE: swapping _ctxt would swap the contexts themselves (it is a
+        // reference), which is a data race as soon as bits are moved from
+        // several threads
+        assert(std::addressof(_ctxt) == std::addressof(cbit._ctxt));
         std::swap(_encryptedBit, cbit._encryptedBit);
+        std::swap(_compactBit, cbit._compactBit);
+        std::swap(_relinearized, cbit._relinearized);
+        _depth = cbit._depth;
         return *this;
     }
 
@@ -148,24 +464,23 @@ public:
     // 1 * 0 = 0
     // 1 * 1 = 1
     inline CryptoBit and_op(const CryptoBit& rhs) const {
-        seal::Ciphertext res;
-        _ctxt.evaluator()->multiply(_encryptedBit, rhs._encryptedBit, res, seal::MemoryPoolHandle::ThreadLocal());
-        if (_relin)
-            _ctxt.evaluator()->relinearize_inplace(res, _ctxt.relin_keys(), seal::MemoryPoolHandle::ThreadLocal());
-        return CryptoBit(_ctxt, res);
-    }
-
+        const auto lhs_ct = ciphertext(), rhs_ct = rhs.ciphertext();
+        seal::Ciphertext res(_ctxt.new_ciphertext());
+        seal::Ciphertext lhs_tmp(seal::MemoryPoolHandle::ThreadLocal()), rhs_tmp(seal::MemoryPoolHandle::ThreadLocal());
+        _ctxt.evaluator()->multiply(at_level_of(mult_operand(*lhs_ct), *rhs_ct, lhs_tmp),
+                                    at_level_of(rhs.mult_operand(*rhs_ct), *lhs_ct, rhs_tmp),
+                                    res, seal::MemoryPoolHandle::ThreadLocal());
+        relinearize_product(res);
+        return product(res, std::max(_depth, rhs._depth) + 1, _ctxt.level(res));
+    }
+
+    // x & 0 = 0 and x & 1 = x: no homomorphic operation is needed
+    // NOTE: a multiplication by a "0" plaintext would result in a transparent
+    // cipher, the (fresh) encryption of 0 of the context is used instead
     inline CryptoBit and_op_on_clear(const ClearBit& rhs) const {
-        seal::Ciphertext res;
         if (rhs.is_zero())
-            // equivalent to a multiplication by "0" plaintext
-            // NOTE: we can't call multiply_plain with a "0" plaintext because it will result in a transparent cipher
-            _ctxt.evaluator()->multiply(_encryptedBit, _ctxt.c0()._encryptedBit, res);
-        else
-            _ctxt.evaluator()->multiply_plain(_encryptedBit, rhs._encodedBit, res);
-        if (_relin)
-            _ctxt.evaluator()->relinearize_inplace(res, _ctxt.relin_keys());
-        return CryptoBit(_ctxt, res);
+            return _ctxt.c0(level());
+        return *this;
     }
 
     // OR operation on encrypted bit
@@ -175,13 +490,17 @@ public:
     // 1 | 0 = 1
     // 1 | 1 = 1
     inline CryptoBit or_op(const CryptoBit& rhs) const {
-        seal::Ciphertext res;
-        _ctxt.evaluator()->multiply(_encryptedBit, rhs._encryptedBit, res, seal::MemoryPoolHandle::ThreadLocal());
-        if (_relin)
-            _ctxt.evaluator()->relinearize_inplace(res, _ctxt.relin_keys(), seal::MemoryPoolHandle::ThreadLocal());
-        _ctxt.evaluator()->add_inplace(res, _encryptedBit);
-        _ctxt.evaluator()->add_inplace(res, rhs._encryptedBit);
-        return CryptoBit(_ctxt, res);
+        const auto lhs_ct = ciphertext(), rhs_ct = rhs.ciphertext();
+        seal::Ciphertext res(_ctxt.new_ciphertext());
+        seal::Ciphertext lhs_tmp(seal::MemoryPoolHandle::ThreadLocal()), rhs_tmp(seal::MemoryPoolHandle::ThreadLocal());
+        _ctxt.evaluator()->multiply(at_level_of(mult_operand(*lhs_ct), *rhs_ct, lhs_tmp),
+                                    at_level_of(rhs.mult_operand(*rhs_ct), *lhs_ct, rhs_tmp),
+                                    res, seal::MemoryPoolHandle::ThreadLocal());
+        relinearize_product(res);
+        const std::size_t level = _ctxt.level(res);
+        _ctxt.evaluator()->add_inplace(res, at_level_of(*lhs_ct, res, lhs_tmp));
+        _ctxt.evaluator()->add_inplace(res, at_level_of(*rhs_ct, res, rhs_tmp));
+        return product(res, std::max(_depth, rhs._depth) + 1, level);
     }
 
     // XOR operation on encrypted bit
@@ -190,35 +509,39 @@ public:
     // 1 + 0 = 1
     // 1 + 1 = 0
     inline CryptoBit xor_op(const CryptoBit& rhs) const {
-        seal::Ciphertext res;
-        _ctxt.evaluator()->add(_encryptedBit, rhs._encryptedBit, res);
-        return CryptoBit(_ctxt, res);
+        const auto lhs_ct = ciphertext(), rhs_ct = rhs.ciphertext();
+        seal::Ciphertext res(_ctxt.new_ciphertext());
+        seal::Ciphertext lhs_tmp(seal::MemoryPoolHandle::ThreadLocal()), rhs_tmp(seal::MemoryPoolHandle::ThreadLocal());
+        _ctxt.evaluator()->add(at_level_of(*lhs_ct, *rhs_ct, lhs_tmp),
+                               at_level_of(*rhs_ct, *lhs_ct, rhs_tmp), res);
+        return CryptoBit(_ctxt, std::move(res), std::max(_depth, rhs._depth));
     }
 
+    // x ^ 0 = x and x ^ 1 = !x
     inline CryptoBit xor_op_on_clear(const ClearBit& rhs) const {
-        seal::Ciphertext res;
-        _ctxt.evaluator()->add_plain(_encryptedBit, rhs._encodedBit, res);
-        return CryptoBit(_ctxt, res);
+        if (rhs.is_zero())
+            return *this;
+        return not_op();
     }
 
     // NOT (bit flip) operation on encrypted bit
     // 0 + 1 = 1
     // 1 + 1 = 0
+    // (the addition of the shared plaintext "1" adds no noise, unlike the
+    // addition of an encryption of 1)
     inline CryptoBit not_op() const {
-        seal::Ciphertext res;
-        _ctxt.evaluator()->add(_encryptedBit, _ctxt.c1()._encryptedBit, res);
-        return CryptoBit(_ctxt, res);
+        seal::Ciphertext res(_ctxt.new_ciphertext());
+        _ctxt.evaluator()->add_plain(*ciphertext(), _ctxt.plain_bit(1), res);
+        return CryptoBit(_ctxt, std::move(res), _depth);
     }
 
     inline CryptoBit& set_to_0() {
-        _ctxt.evaluator()->multiply_inplace(_encryptedBit, _ctxt.c0()._encryptedBit);
-        if (_relin)
-            _ctxt.evaluator()->relinearize_inplace(_encryptedBit, _ctxt.relin_keys());
+        *this = _ctxt.c0(level());
         return *this;
     }
 
     inline CryptoBit& set_to_1() {
-        _ctxt.evaluator()->add_inplace(_encryptedBit, not_op()._encryptedBit);
+        *this = _ctxt.c1(level());
         return *this;
     }
 
@@ -258,13 +581,13 @@ public:
     inline CryptoBit operator!() const { return not_op(); }
 
     int noise_budget() const {
-        return _ctxt.decryptor().invariant_noise_budget(_encryptedBit);
+        return _ctxt.decryptor().invariant_noise_budget(*ciphertext());
     }
 
     uint8_t decrypt() {
-        seal::Plaintext decryptedBit;
-        _ctxt.decryptor().decrypt(_encryptedBit, decryptedBit);
-        return static_cast<uint8_t>(std::stoul(decryptedBit.to_string(), nullptr, 16)) & 0b1;
+        seal::Plaintext decryptedBit(seal::MemoryPoolHandle::ThreadLocal());
+        _ctxt.decryptor().decrypt(*ciphertext(), decryptedBit);
+        return decryptedBit.is_zero() ? 0 : static_cast<uint8_t>(decryptedBit[0] & 0b1);
     }
 
     BitEncryptionContext& bit_encryption_context() { return _ctxt; }
@@ -272,13 +595,166 @@ public:
     // This function should be replaced by a bootstrapping procedure as it is 
     // illegal in this form (a decryption procedure couldn't be executed by the server).
     void refresh() {
-        _ctxt.encryptor().encrypt(uint64_to_hex_string(decrypt() & 0b1), _encryptedBit);
+        seal::Ciphertext encrypted(_ctxt.new_ciphertext());
+        _ctxt.encryptor().encrypt(_ctxt.plain_bit(decrypt()), encrypted, seal::MemoryPoolHandle::ThreadLocal());
+        _encryptedBit = _ctxt.share(std::move(encrypted));
+        _compactBit.reset();
+        _relinearized.reset();
+        _depth = 0;
+    }
+
+    // AND depth since the encryption (or the last refresh)
+    std::size_t depth() const { return _depth; }
+
+    std::size_t level() const {
+        return _ctxt.level(_encryptedBit ? _encryptedBit->parms_id() : _compactBit->parms_id());
+    }
+
+    // Switch the bit down to a lower level (no-op if it is already below)
+    void mod_switch_to_level(std::size_t level) {
+        if (this->level() >= level)
+            return;
+        seal::Ciphertext switched(_ctxt.new_ciphertext());
+        _ctxt.evaluator()->mod_switch_to_next(*ciphertext(), switched, seal::MemoryPoolHandle::ThreadLocal());
+        while (_ctxt.level(switched) < level)
+            _ctxt.evaluator()->mod_switch_to_next_inplace(switched, seal::MemoryPoolHandle::ThreadLocal());
+        _encryptedBit = _ctxt.share(std::move(switched));
+        _compactBit.reset();
+        _relinearized.reset();
+    }
+
+    // Prepare the bit for "next_depth" levels of AND gates
+    // Without level plan, it is a refresh. Otherwise, the bit is refreshed
+    // only if the plan capacity would be exceeded and else it is switched
+    // down to the lowest level allowed by its depth.
+    void manage_noise(std::size_t next_depth) {
+        const LevelPlan* plan = _ctxt.level_plan();
+        if (!plan || _depth + next_depth > plan->depth_capacity)
+            refresh();
+        else
+            mod_switch_to_level(plan->level_for_depth(_depth));
+    }
+
+    // Size of the underlying ciphertext (3 for a lazily relinearized product)
+    std::size_t ciphertext_size() const {
+        return _encryptedBit ? _encryptedBit->size() : _compactBit->size();
+    }
+
+    // Keep the bit in its compact form (see CompactCiphertext) until it is
+    // expanded: a gate on a compact bit expands it for the time of the gate
+    // only, which suits the bits used seldom (e.g. the round keys)
+    // NOTE: a size-3 ciphertext is relinearized first, as for an AND gate
+    void compact() {
+        if (_compactBit)
+            return;
+        _compactBit = _ctxt.share(CompactCiphertext(_ctxt.seal_context(), mult_operand(*_encryptedBit)));
+        _encryptedBit.reset();
+        _relinearized.reset();
+    }
+
+    // Back to the full form
+    void expand() {
+        if (!_compactBit)
+            return;
+        _encryptedBit = ciphertext();
+        _compactBit.reset();
+    }
+
+    bool is_compact() const { return static_cast<bool>(_compactBit); }
+
+    // Serialization of the underlying ciphertext (see seal::Ciphertext::save)
+    std::streamoff save(std::ostream& stream, 
+                        seal::compr_mode_type compr_mode = seal::Serialization::compr_mode_default) const {
+        return ciphertext()->save(stream, compr_mode);
+    }
+
+    static CryptoBit load(BitEncryptionContext& ctxt, std::istream& stream) {
+        seal::Ciphertext cipherbit(ctxt.new_ciphertext());
+        cipherbit.load(ctxt.seal_context(), stream);
+        return CryptoBit(ctxt, std::move(cipherbit));
+    }
+
+    // Two bits are the same encryption iff their ciphertexts are identical
+    // (as the encryption is randomized, it identifies a given encryption and
+    // not the encrypted value)
+    bool same_encryption(const CryptoBit& rhs) const {
+        if (shares_encryption(rhs))
+            return true;
+        if (level() != rhs.level() || ciphertext_size() != rhs.ciphertext_size())
+            return false;
+        const auto lhs_ct = ciphertext(), rhs_ct = rhs.ciphertext();
+        const auto& lhs_data = lhs_ct->dyn_array();
+        const auto& rhs_data = rhs_ct->dyn_array();
+        return lhs_ct->parms_id() == rhs_ct->parms_id() &&
+               lhs_data.size() == rhs_data.size() &&
+               std::equal(lhs_data.cbegin(), lhs_data.cend(), rhs_data.cbegin());
+    }
+
+    // Hash of the ciphertext, consistent with same_encryption()
+    std::size_t encryption_hash() const {
+        const auto encrypted = ciphertext();
+        std::size_t hash = encrypted->dyn_array().size();
+        for (auto coeff : encrypted->dyn_array())
+            hash ^= std::hash<std::uint64_t>()(coeff) + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+        return hash;
+    }
+
+    // True iff both bits are copies of the same bit, i.e. share the same
+    // ciphertext (or compact ciphertext) in memory
+    bool shares_encryption(const CryptoBit& rhs) const {
+        return _encryptedBit == rhs._encryptedBit && _compactBit == rhs._compactBit;
+    }
+
+    // Address of the ciphertext (or compact ciphertext) in memory, the same
+    // for the bits which share it
+    const void* shared_encryption() const {
+        return _encryptedBit ? static_cast<const void*>(_encryptedBit.get())
+                             : static_cast<const void*>(_compactBit.get());
     }
 };
 
+inline BitEncryptionContext::ThreadState& BitEncryptionContext::thread_state() const
+{
+    // (the states of the contexts destroyed since are never looked up again)
+    thread_local std::unordered_map<std::uint64_t, ThreadState*> states;
+    auto it = states.find(_id);
+    if (it != states.end())
+        return *it->second;
+
+    auto state = std::make_unique<ThreadState>();
+    state->pool = seal::MemoryPoolHandle::New();
+    state->decryptor = std::make_unique<seal::Decryptor>(*_context, _secret_key);
+    ThreadState* created = state.get();
+    {
+        std::lock_guard<std::mutex> lock(_threads_mutex);
+        _threads.push_back(std::move(state));
+    }
+    states.emplace(_id, created);
+    return *created;
+}
+
+// Switch the constants c0/c1 down to each level of the plan
+inline void BitEncryptionContext::init_levels()
+{
+    _c0_levels.clear();
+    _c1_levels.clear();
+    seal::Ciphertext encrypted0 = new_ciphertext(*c0().ciphertext());
+    seal::Ciphertext encrypted1 = new_ciphertext(*c1().ciphertext());
+    for (std::size_t level = 1; level <= _plan->nb_levels(); level++) {
+        _evaluator->mod_switch_to_next_inplace(encrypted0);
+        _evaluator->mod_switch_to_next_inplace(encrypted1);
+        _c0_levels.push_back(std::shared_ptr<const CryptoBit>(new CryptoBit(*this, new_ciphertext(encrypted0))));
+        _c1_levels.push_back(std::shared_ptr<const CryptoBit>(new CryptoBit(*this, new_ciphertext(encrypted1))));
+    }
+}
+
 template <size_t bitsize>
 class ClearBitset;
 
+// A CryptoBitset is a vector of bits sharing their ciphertexts (see
+// CryptoBit): the wiring operations (shifts, rotations, slices, split and
+// join) only copy the references to the ciphertexts, never the ciphertexts
+// themselves.
 template <size_t bitsize>
 class CryptoBitset
 {
@@ -286,17 +762,17 @@ class CryptoBitset
     std::vector<CryptoBit> _container;
 
 public:
+    using bit_type       = CryptoBit;
     using iterator       = std::vector<CryptoBit>::iterator;
     using const_iterator = std::vector<CryptoBit>::const_iterator;
 
-    CryptoBitset(BitEncryptionContext& ctxt, std::vector<CryptoBit>& container)
-        : _ctxt(ctxt), _container(container)
+    CryptoBitset(BitEncryptionContext& ctxt, std::vector<CryptoBit> container)
+        : _ctxt(ctxt), _container(std::move(container))
     {
-        assert(container.size() <= bitsize && "Insufficient bitsize");
-        if (container.size() < bitsize)
-            // fill the underlying container with extra zeros
-            for (size_t i = container.size(); i < bitsize; i++)
-                _container.insert(_container.cend(), _ctxt.c0());
+        assert(_container.size() <= bitsize && "Insufficient bitsize");
+        // fill the underlying container with extra zeros
+        if (_container.size() < bitsize)
+            _container.resize(bitsize, _ctxt.c0());
     }
 
 public:
@@ -327,8 +803,7 @@ public:
              the value without loss");
 
         // fill the underlying container with extra zeros
-        for (size_t i = _container.size(); i < bitsize; i++)
-            _container.insert(_container.cend(), _ctxt.c0());
+        _container.resize(bitsize, _ctxt.c0());
     }
 
     CryptoBitset(CryptoBitset&& cbitfield)
@@ -339,7 +814,8 @@ public:
 
     CryptoBitset& operator=(CryptoBitset&& cbitfield)
     {
-        std::swap(_ctxt, cbitfield._ctxt);
+        assert(&_ctxt == &cbitfield._ctxt && 
+            "cannot move an encrypted bitset using different encryption parameters");
         std::swap(_container, cbitfield._container);
         return *this;
     }
@@ -378,10 +854,30 @@ public:
         return CryptoBitset(ctxt, container);
     }
 
+    // Evaluate the bits f(0), ..., f(bitsize-1) in parallel on the default
+    // scheduler (each gate is an independent task)
+    template <typename F>
+    static std::vector<CryptoBit> parallel_bitwise(F&& f)
+    {
+        std::vector<std::unique_ptr<CryptoBit>> bits(bitsize);
+        default_scheduler().parallel_for(0, bitsize, [&bits, &f](size_t i) {
+            bits[i] = std::make_unique<CryptoBit>(f(i));
+        });
+
+        std::vector<CryptoBit> res;
+        res.reserve(bitsize);
+        for (auto& bit : bits)
+            res.push_back(std::move(*bit));
+        return res;
+    }
+
     // Apply an unary boolean operator on every bit of the CryptoBitset
+    // (the only one is the NOT, a plaintext addition: too cheap to be run in
+    // parallel)
     CryptoBitset apply_bitwise_unop(std::function<CryptoBit(const CryptoBit&)> op) const
     {
         std::vector<CryptoBit> res;
+        res.reserve(bitsize);
         for (size_t i = 0; i < bitsize; i++)
             res.push_back(op(_container[i]));
         return CryptoBitset(_ctxt, res);
@@ -389,22 +885,39 @@ public:
 
     // Apply an binary boolean operator between every x_i and y_i of the lhs and rhs
     // Cryptobitsets
+    // (for the gates with a ciphertext multiplication, i.e. the AND and OR,
+    // each gate being a task: see apply_bitwise_addition for the others)
     CryptoBitset apply_bitwise_binop(std::function<CryptoBit(const CryptoBit&, 
                                                              const CryptoBit&)> op, 
                                      const CryptoBitset& rhs) const
+    {
+        std::vector<CryptoBit> res = parallel_bitwise([&](size_t i) {
+            return op(_container[i], rhs[i]);
+        });
+        return CryptoBitset(_ctxt, res);
+    }
+
+    // Same for the gates made of ciphertext additions only (XOR and XNOR):
+    // too cheap to be run in parallel, a task would cost more than the gate
+    CryptoBitset apply_bitwise_addition(std::function<CryptoBit(const CryptoBit&,
+                                                                const CryptoBit&)> op,
+                                        const CryptoBitset& rhs) const
     {
         std::vector<CryptoBit> res;
+        res.reserve(bitsize);
         for (size_t i = 0; i < bitsize; i++)
             res.push_back(op(_container[i], rhs[i]));
         return CryptoBitset(_ctxt, res);
     }
 
-
+    // (the operations with a clear bit are folded into copies or plaintext
+    // additions: they are too cheap to be run in parallel)
     CryptoBitset apply_bitwise_binop_clear(std::function<CryptoBit(const CryptoBit&, 
                                                                    const ClearBit &)> op, 
                                            const ClearBitset<bitsize>& rhs) const
     {
         std::vector<CryptoBit> res;
+        res.reserve(bitsize);
         for (size_t i = 0; i < bitsize; i++)
             res.push_back(op(_container[i], rhs[i]));
         return CryptoBitset(_ctxt, res);
@@ -416,87 +929,98 @@ public:
     inline CryptoBitset shift_left(size_t shamt) const {
         // a left shift (shift towards the MSB) corresponds to a right shift
         // in our vector encoding
-        std::vector<CryptoBit> vec(this->_container);
-
-        for (size_t i = 0; i < std::min(shamt, vec.size()); i++) {
-            vec.insert(vec.begin(), _ctxt.c0());
-            vec.pop_back();
-        }
-        return CryptoBitset(_ctxt, vec);
+        const size_t n = std::min(shamt, bitsize);
+        std::vector<CryptoBit> vec;
+        vec.reserve(bitsize);
+        vec.insert(vec.end(), n, _ctxt.c0());
+        vec.insert(vec.end(), _container.cbegin(), _container.cend() - n);
+        return CryptoBitset(_ctxt, std::move(vec));
     }
 
     inline CryptoBitset shift_right(size_t shamt) const {
         // a right shift (towards the LSB) corresponds to a left shift
         // in our vector encoding
-        std::vector<CryptoBit> vec(this->_container);
-
-        for (size_t i = 0; i < std::min(shamt, vec.size()); i++) {
-            vec.insert(vec.end(), _ctxt.c0());
-            vec.erase(vec.begin());
-        }
-        return CryptoBitset(_ctxt, vec);
+        const size_t n = std::min(shamt, bitsize);
+        std::vector<CryptoBit> vec;
+        vec.reserve(bitsize);
+        vec.insert(vec.end(), _container.cbegin() + n, _container.cend());
+        vec.insert(vec.end(), n, _ctxt.c0());
+        return CryptoBitset(_ctxt, std::move(vec));
     }
 
-    // TODO: use std::rotate
+    // (towards the MSB)
     inline CryptoBitset rotate_left(size_t shamt) const {
-        std::vector<CryptoBit> vec(_container);
-        // std::rotate(myvector.begin(),myvector.begin()+3,myvector.end());
-        for (size_t i = 0; i < shamt; i++) {
-            vec.insert(vec.begin(), vec.back());
-            vec.pop_back();
-        }
-        return CryptoBitset(_ctxt, vec);
+        std::vector<CryptoBit> vec;
+        vec.reserve(bitsize);
+        std::rotate_copy(_container.cbegin(), _container.cend() - shamt % bitsize,
+                         _container.cend(), std::back_inserter(vec));
+        return CryptoBitset(_ctxt, std::move(vec));
     }
 
+    // (towards the LSB)
     inline CryptoBitset rotate_right(size_t shamt) const {
-        std::vector<CryptoBit> vec(_container);
+        std::vector<CryptoBit> vec;
+        vec.reserve(bitsize);
+        std::rotate_copy(_container.cbegin(), _container.cbegin() + shamt % bitsize,
+                         _container.cend(), std::back_inserter(vec));
+        return CryptoBitset(_ctxt, std::move(vec));
+    }
 
-        for (size_t i = 0; i < shamt; i++) {
-            vec.insert(vec.end(), vec.front());
-            vec.erase(vec.begin());
+    // The bits [offset, offset + slice_size) of the bitset
+    template <size_t slice_size>
+    CryptoBitset<slice_size> slice(size_t offset) const
+    {
+        assert(offset + slice_size <= bitsize && "slice out of the bitset");
+        return CryptoBitset<slice_size>(_ctxt, std::vector<CryptoBit>(
+            _container.cbegin() + offset, _container.cbegin() + offset + slice_size));
+    }
+
+    // Permutation of the groups of "unit" bits (e.g. of the bytes): the
+    // group i of the result is the group source[i] of the bitset
+    template <size_t unit>
+    CryptoBitset permute(std::array<size_t, bitsize/unit> const& source) const
+    {
+        static_assert(bitsize % unit == 0, "the bitset must be made of whole groups");
+        std::vector<CryptoBit> vec;
+        vec.reserve(bitsize);
+        for (size_t group : source) {
+            assert(group < bitsize/unit);
+            vec.insert(vec.end(), _container.cbegin() + group*unit,
+                                  _container.cbegin() + (group+1)*unit);
         }
-        return CryptoBitset(_ctxt, vec);
+        return CryptoBitset(_ctxt, std::move(vec));
     }
 
+    // Split into nb bitsets of bitsize/nb bits (the last one gets the
+    // remaining bits, if any, padded with zeros)
     template <unsigned nb>
     auto split() const
     {
-        std::vector<CryptoBitset<bitsize/nb>> rtn;
-        const_iterator it = _container.cbegin();
-        const_iterator end = _container.cend();
-
-        while (it != end) {
-            std::vector<CryptoBit> v;
-            v.reserve(bitsize/nb);
-            const auto num_to_copy = std::min(static_cast<long unsigned>(
-                std::distance(it, end)), bitsize/nb);
-            std::copy(it, it + num_to_copy, std::back_inserter(v));
-            rtn.push_back(CryptoBitset<bitsize/nb>(_ctxt, v));
-            std::advance(it, num_to_copy);
+        constexpr size_t part_size = bitsize/nb;
+        std::vector<CryptoBitset<part_size>> rtn;
+        rtn.reserve(nb + 1);
+        for (size_t offset = 0; offset < bitsize; offset += part_size) {
+            const size_t num_to_copy = std::min(bitsize - offset, part_size);
+            rtn.push_back(CryptoBitset<part_size>(_ctxt, std::vector<CryptoBit>(
+                _container.cbegin() + offset, _container.cbegin() + offset + num_to_copy)));
         }
         return rtn;
     }
 
     template <unsigned U>
     static CryptoBitset<bitsize> join(BitEncryptionContext& ctxt, 
-                                      std::vector<CryptoBitset<U>>& bitsetVec) 
+                                      std::vector<CryptoBitset<U>> const& bitsetVec) 
     {
-        unsigned long int size = std::min(U*bitsetVec.size(), bitsize);
-
-        for (auto& e : bitsetVec) 
-            assert(&ctxt == &e.bit_encryption_context());
+        const size_t size = std::min(U*bitsetVec.size(), bitsize);
 
         std::vector<CryptoBit> newvec;
         newvec.reserve(size);
-
-        size_t index = 0;
-        for (typename std::vector<CryptoBitset<U>>::iterator it_cbset = bitsetVec.begin();
-            it_cbset != bitsetVec.end() && index < size; it_cbset++)
-            for (typename CryptoBitset<U>::iterator it_cbit = it_cbset->begin();
-                it_cbit != it_cbset->end() && index < size; it_cbit++, index++)
-                newvec.push_back(*it_cbit);
-
-        return CryptoBitset<bitsize>(ctxt, newvec);
+        for (auto const& bitset : bitsetVec) {
+            assert(&ctxt == &bitset.bit_encryption_context());
+            const size_t num_to_copy = std::min(size - newvec.size(), size_t(U));
+            newvec.insert(newvec.end(), bitset.cbegin(), bitset.cbegin() + num_to_copy);
+        }
+        return CryptoBitset<bitsize>(ctxt, std::move(newvec));
     }
 
     // Same as the join() method but with a move semantic
@@ -506,22 +1030,16 @@ public:
     static CryptoBitset<bitsize> move_and_join(BitEncryptionContext& ctxt, 
                                                std::vector<CryptoBitset<U>>& bitsetVec) 
     {
-        unsigned long int size = std::min(U*bitsetVec.size(), bitsize);
-
-        for (auto& e : bitsetVec) 
-            assert(&ctxt == &e.bit_encryption_context());
+        const size_t size = std::min(U*bitsetVec.size(), bitsize);
 
         std::vector<CryptoBit> newvec;
         newvec.reserve(size);
-
-        size_t index = 0;
-        for (typename std::vector<CryptoBitset<U>>::iterator it_cbset = bitsetVec.begin();
-            it_cbset != bitsetVec.end() && index < size; it_cbset++)
-            for (typename CryptoBitset<U>::iterator it_cbit = it_cbset->begin();
-                it_cbit != it_cbset->end() && index < size; it_cbit++, index++)
-                newvec.push_back(std::move(*it_cbit));
-
-        return CryptoBitset<bitsize>(ctxt, newvec);
+        for (auto& bitset : bitsetVec) {
+            assert(&ctxt == &bitset.bit_encryption_context());
+            const size_t num_to_copy = std::min(size - newvec.size(), size_t(U));
+            std::move(bitset.begin(), bitset.begin() + num_to_copy, std::back_inserter(newvec));
+        }
+        return CryptoBitset<bitsize>(ctxt, std::move(newvec));
     }
 
     CryptoBitset apply_seq_AND() const
@@ -532,6 +1050,30 @@ public:
         return CryptoBitset::broadcast(_ctxt, acc);
     }
 
+    // AND of all the bits evaluated as a balanced tree: the multiplicative
+    // depth is ceil(log2(bitsize)) instead of bitsize-1 for the same number
+    // of AND gates.
+    CryptoBit tree_AND() const
+    {
+        std::vector<CryptoBit> level(_container);
+        while (level.size() > 1) {
+            std::vector<CryptoBit> next;
+            next.reserve((level.size() + 1) / 2);
+            for (size_t i = 0; i + 1 < level.size(); i += 2)
+                next.push_back(level[i] & level[i+1]);
+            if (level.size() % 2)
+                next.push_back(level.back());
+            level = std::move(next);
+        }
+        return level[0];
+    }
+
+    // Same result as apply_seq_AND(), see tree_AND()
+    CryptoBitset apply_tree_AND() const
+    {
+        return CryptoBitset::broadcast(_ctxt, tree_AND());
+    }
+
     inline CryptoBitset operator&(const CryptoBitset& rhs) const
     {
         return apply_bitwise_binop(&CryptoBit::and_op, rhs);
@@ -549,12 +1091,12 @@ public:
 
     inline CryptoBitset operator==(const CryptoBitset& rhs) const
     {
-        return apply_bitwise_binop(&CryptoBit::xnor_op, rhs);
+        return apply_bitwise_addition(&CryptoBit::xnor_op, rhs);
     }
 
     inline CryptoBitset operator^(const CryptoBitset& rhs) const
     {
-        return apply_bitwise_binop(&CryptoBit::xor_op, rhs);
+        return apply_bitwise_addition(&CryptoBit::xor_op, rhs);
     }
 
     inline CryptoBitset operator^(const ClearBitset<bitsize>& rhs) const
@@ -579,10 +1121,9 @@ public:
 
     inline CryptoBitset& operator<<=(size_t shamt) 
     {
-        for (size_t i = 0; i < std::min(shamt, _container.size()); i++) {
-            _container.insert(_container.begin(), _ctxt.c0());
-            _container.pop_back();
-        }
+        const size_t n = std::min(shamt, bitsize);
+        std::move_backward(_container.begin(), _container.end() - n, _container.end());
+        std::fill(_container.begin(), _container.begin() + n, _ctxt.c0());
         return *this;
     }
 
@@ -590,6 +1131,14 @@ public:
         return shift_right(shamt);
     }
 
+    inline CryptoBitset& operator>>=(size_t shamt) 
+    {
+        const size_t n = std::min(shamt, bitsize);
+        std::move(_container.begin() + n, _container.end(), _container.begin());
+        std::fill(_container.end() - n, _container.end(), _ctxt.c0());
+        return *this;
+    }
+
     // Return the minimal noise budget of the bitfield, i.e. the noise budget 
     // of the most altered bit
     int min_noise_budget() const {
@@ -604,10 +1153,27 @@ public:
         return _ctxt;
     }
 
-    inline std::vector<CryptoBit> underlying_container() const {
+    inline std::vector<CryptoBit> const& underlying_container() const {
         return _container;
     }
 
+    // Serialization of the bitset: the bitsize ciphertexts one after another
+    std::streamoff save(std::ostream& stream, 
+                        seal::compr_mode_type compr_mode = seal::Serialization::compr_mode_default) const {
+        std::streamoff size = 0;
+        for (auto const& bit : _container)
+            size += bit.save(stream, compr_mode);
+        return size;
+    }
+
+    static CryptoBitset load(BitEncryptionContext& ctxt, std::istream& stream) {
+        std::vector<CryptoBit> container;
+        container.reserve(bitsize);
+        for (size_t i = 0; i < bitsize; i++)
+            container.push_back(CryptoBit::load(ctxt, stream));
+        return CryptoBitset(ctxt, container);
+    }
+
     CryptoBit& operator[](size_t i) {
         return _container[i];
     }
@@ -621,6 +1187,63 @@ public:
             e.refresh();
     }
 
+    // See CryptoBit::manage_noise
+    void manage_noise(std::size_t next_depth) {
+        default_scheduler().parallel_for(0, bitsize, [&](size_t i) {
+            _container[i].manage_noise(next_depth);
+        });
+    }
+
+    // See CryptoBit::mod_switch_to_level
+    void mod_switch_to_level(std::size_t level) {
+        default_scheduler().parallel_for(0, bitsize, [&](size_t i) {
+            _container[i].mod_switch_to_level(level);
+        });
+    }
+
+    // See CryptoBit::compact
+    // (the copies of a bit, e.g. the constants, share their ciphertext: it
+    // is compacted once and the copies share the compact form)
+    void compact() {
+        std::unordered_map<const void*, size_t> first;
+        std::vector<size_t> source(bitsize), distinct;
+        for (size_t i = 0; i < bitsize; i++) {
+            const auto inserted = first.emplace(_container[i].shared_encryption(), i);
+            source[i] = inserted.first->second;
+            if (inserted.second)
+                distinct.push_back(i);
+        }
+
+        default_scheduler().parallel_for(0, distinct.size(), [&](size_t k) {
+            _container[distinct[k]].compact();
+        });
+        for (size_t i = 0; i < bitsize; i++)
+            if (source[i] != i)
+                _container[i] = _container[source[i]];
+    }
+
+    void expand() {
+        for (auto& bit : _container)
+            bit.expand();
+    }
+
+    // Maximal AND depth of the bits
+    std::size_t depth() const {
+        std::size_t depth = 0;
+        for (auto const& bit : _container)
+            depth = std::max(depth, bit.depth());
+        return depth;
+    }
+
+    // Highest level index of the bits (0 being the top of the chain), i.e.
+    // the level of the lowest bit
+    std::size_t level() const {
+        std::size_t level = 0;
+        for (auto const& bit : _container)
+            level = std::max(level, bit.level());
+        return level;
+    }
+
     iterator begin() { return _container.begin(); }
     iterator   end() { return _container.end()  ; }
 
@@ -709,6 +1332,7 @@ class ClearBitset
     std::vector<ClearBit> _container;
 
 public:
+    using bit_type       = ClearBit;
     using iterator       = std::vector<ClearBit>::iterator;
     using const_iterator = std::vector<ClearBit>::const_iterator;
 
@@ -718,10 +1342,9 @@ public:
         assert(bitsize >= 1);
         assert(bitsize <= inputData.size());
         
-        for (size_t i = 0; i < bitsize; i++) {
+        _container.reserve(bitsize);
+        for (size_t i = 0; i < bitsize; i++)
             _container.push_back(ClearBit(inputData[i]));
-            _container[i].decode();
-        }
     }
 
     std::bitset<bitsize> decode() const {
@@ -2,9 +2,15 @@
 #define __ENCRYPTION_LAYER_SIMD_HPP__
 
 #include <assert.h>
+#include <atomic>
 #include <bitset>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
 #include "encryptionlayer.hpp"
+#include "noiseplanner.hpp"
 #include "seal_include.hpp"
 
 template <std::size_t pmd>
@@ -27,13 +33,29 @@ class PackedBitsEncryptionContext
     std::unique_ptr<const PackedCryptoBits<pmd>> _v0;
     std::unique_ptr<const PackedCryptoBits<pmd>> _v1;
 
-public:
-    explicit PackedBitsEncryptionContext()
+    // Galois keys of the row rotations (see PackedCryptoBits::rotate_rows),
+    // generated by the first rotation as the bitsliced circuits never rotate
+    std::unique_ptr<seal::GaloisKeys> _galois_keys;
+    std::once_flag _galois_keys_once;
+
+    // Number of products a fresh encryption can go through (see
+    // PackedCryptoBits::manage_noise())
+    std::size_t _depth_capacity;
+    // Plan of the coefficient modulus (see the constructor from a depth),
+    // nullptr with the default one
+    std::shared_ptr<const LevelPlan> _plan;
+    // Refreshes of packed bits encrypted under this context (see
+    // PackedCryptoBits::refresh)
+    std::atomic<std::size_t> _refresh_count{0};
+
+    static constexpr int plain_modulus_bits = 20;
+
+    explicit PackedBitsEncryptionContext(std::vector<seal::Modulus> const& coeff_modulus)
         : _parms(seal::scheme_type::bfv)
     {
         _parms.set_poly_modulus_degree(pmd);
-        _parms.set_coeff_modulus(seal::CoeffModulus::BFVDefault(pmd));
-        _parms.set_plain_modulus(seal::PlainModulus::Batching(pmd, 20));
+        _parms.set_coeff_modulus(coeff_modulus);
+        _parms.set_plain_modulus(seal::PlainModulus::Batching(pmd, plain_modulus_bits));
 
         _context = std::make_unique<seal::SEALContext>(_parms);
         _batch_encoder = std::make_unique<seal::BatchEncoder>(*_context);
@@ -51,8 +73,50 @@ public:
 
         _v0 = std::make_unique<const PackedCryptoBits<pmd>>(*this, 0b0);
         _v1 = std::make_unique<const PackedCryptoBits<pmd>>(*this, 0b1);
+
+        // As XOR is a multiplication on packed bits, a bitsliced circuit goes
+        // much deeper than with CryptoBit (see the constructor from a depth).
+        // The capacity is measured by repeated squarings, with a few bits of
+        // margin (the gates add and scale their operands too).
+        seal::Ciphertext probe = _v1->_encryptedPackedBits;
+        _depth_capacity = 0;
+        while (true) {
+            _evaluator->square_inplace(probe);
+            _evaluator->relinearize_inplace(probe, _relin_keys);
+            if (_decryptor->invariant_noise_budget(probe) <= 4)
+                break;
+            _depth_capacity++;
+        }
+    }
+
+public:
+    // Largest noise budget for pmd (CoeffModulus::BFVDefault)
+    explicit PackedBitsEncryptionContext()
+        : PackedBitsEncryptionContext(seal::CoeffModulus::BFVDefault(pmd))
+    {
+    }
+
+    // Parameters planned for a circuit of "product_depth" products (see
+    // plan_levels and measure_packed_noise_model): the smallest coefficient
+    // modulus running it without refresh. Throws std::invalid_argument if no
+    // coefficient modulus allowed for pmd can.
+    explicit PackedBitsEncryptionContext(std::size_t product_depth)
+        : PackedBitsEncryptionContext(plan_levels(product_depth,
+            { measure_packed_noise_model(pmd, plain_modulus_bits) }), product_depth)
+    {
     }
 
+private:
+    PackedBitsEncryptionContext(LevelPlan const& plan, std::size_t product_depth)
+        : PackedBitsEncryptionContext(seal::CoeffModulus::Create(pmd, plan.coeff_modulus_bits))
+    {
+        // the plan extrapolates the measured model, the capacity is measured
+        if (plan.depth_capacity < product_depth || _depth_capacity < product_depth)
+            throw std::invalid_argument("product depth beyond the noise budget of the packed parameters");
+        _plan = std::make_shared<const LevelPlan>(plan);
+    }
+
+public:
     inline const seal::Modulus& plain_modulus() const {
         return _parms.plain_modulus();
     }
@@ -84,21 +148,74 @@ public:
     inline const seal::RelinKeys& relin_keys() const {
         return _relin_keys;
     }
+
+    // Keys of the rotations by a power of two (in both directions): a
+    // rotation by any number of steps costs at most log2(slot_count()/2)
+    // key switchings
+    const seal::GaloisKeys& galois_keys() {
+        std::call_once(_galois_keys_once, [this] {
+            seal::KeyGenerator keygen(*_context, _secret_key);
+            _galois_keys = std::make_unique<seal::GaloisKeys>();
+            keygen.create_galois_keys(*_galois_keys);
+        });
+        return *_galois_keys.get();
+    }
+
+    inline std::size_t slot_count() const {
+        return _batch_encoder->slot_count();
+    }
+
+    inline std::size_t depth_capacity() const {
+        return _depth_capacity;
+    }
+
+    inline const LevelPlan* level_plan() const {
+        return _plan.get();
+    }
+
+    inline std::size_t refresh_count() const {
+        return _refresh_count.load(std::memory_order_relaxed);
+    }
+
+    inline void count_refresh() {
+        _refresh_count.fetch_add(1, std::memory_order_relaxed);
+    }
 };
 
 template <std::size_t pmd = 4096>
 class PackedCryptoBits
 {
     // friend class PackedClearBit;
+    friend class PackedBitsEncryptionContext<pmd>;
     PackedBitsEncryptionContext<pmd>& _ctxt;
     seal::Ciphertext _encryptedPackedBits;
+    // products since the encryption (or the last refresh), a plaintext
+    // product being counted as one
+    std::size_t _depth = 0;
     
     PackedCryptoBits(PackedBitsEncryptionContext<pmd>& ctxt, 
-                     const seal::Ciphertext& packedCipherbits)
-        : _ctxt(ctxt), _encryptedPackedBits(packedCipherbits)
+                     const seal::Ciphertext& packedCipherbits,
+                     std::size_t depth)
+        : _ctxt(ctxt), _encryptedPackedBits(packedCipherbits), _depth(depth)
     {
     }
 
+    // Gate f(x,y) = c + sign.(x + y) + factor.xy (c = 1 if sign < 0, else 0),
+    // the product being accumulated into the linear part in place (see
+    // seal::Evaluator::multiply_add_inplace) and relinearized once
+    PackedCryptoBits fused_gate(const PackedCryptoBits& rhs, int sign, std::int64_t factor) const {
+        seal::Ciphertext res;
+        if (sign > 0) {
+            _ctxt.evaluator().add(_encryptedPackedBits, rhs._encryptedPackedBits, res);
+        } else {
+            _ctxt.evaluator().sub(_ctxt.v1()._encryptedPackedBits, _encryptedPackedBits, res);
+            _ctxt.evaluator().sub_inplace(res, rhs._encryptedPackedBits);
+        }
+        _ctxt.evaluator().multiply_add_inplace(res, _encryptedPackedBits, rhs._encryptedPackedBits, factor);
+        _ctxt.evaluator().relinearize_inplace(res, _ctxt.relin_keys());
+        return PackedCryptoBits(_ctxt, res, std::max(_depth, rhs._depth) + 1);
+    }
+
 public:
     explicit PackedCryptoBits(PackedBitsEncryptionContext<pmd>& ctxt, 
                               std::vector<uint64_t>& bits)
@@ -126,12 +243,12 @@ public:
     }
 
     PackedCryptoBits(PackedCryptoBits const& ref)
-        : _ctxt(ref._ctxt), _encryptedPackedBits(ref._encryptedPackedBits)
+        : _ctxt(ref._ctxt), _encryptedPackedBits(ref._encryptedPackedBits), _depth(ref._depth)
     {
     }
 
     PackedCryptoBits(PackedCryptoBits&& cbits)
-        : _ctxt(cbits._ctxt)
+        : _ctxt(cbits._ctxt), _depth(cbits._depth)
     {
         std::swap(_encryptedPackedBits, cbits._encryptedPackedBits);
     }
@@ -140,13 +257,16 @@ public:
     {
         assert(std::addressof(_ctxt) == std::addressof(cbits._ctxt));
         _encryptedPackedBits = cbits._encryptedPackedBits;
+        _depth = cbits._depth;
         return *this;
     }
 
     PackedCryptoBits& operator=(PackedCryptoBits&& cbits)
     {
-        std::swap(_ctxt, cbits._ctxt);
+        // (see CryptoBit: _ctxt is a reference and must not be swapped)
+        assert(std::addressof(_ctxt) == std::addressof(cbits._ctxt));
         std::swap(_encryptedPackedBits, cbits._encryptedPackedBits);
+        std::swap(_depth, cbits._depth);
         return *this;
     }
 
@@ -156,53 +276,40 @@ public:
         seal::Ciphertext res;
         _ctxt.evaluator().multiply(_encryptedPackedBits, rhs._encryptedPackedBits, res);
         _ctxt.evaluator().relinearize_inplace(res, _ctxt.relin_keys());
-        return PackedCryptoBits(_ctxt, res);
+        return PackedCryptoBits(_ctxt, res, std::max(_depth, rhs._depth) + 1);
     }
 
-    /*
-    inline PackedCryptoBit and_op_on_clear(const ClearBit& rhs) const {
-        seal::Ciphertext res;
+    // AND with the same clear bit on every slot
+    // x & 0 = 0 and x & 1 = x, so no homomorphic operation is needed
+    inline PackedCryptoBits and_op_on_clear(const ClearBit& rhs) const {
         if (rhs.is_zero())
-            // equivalent to a multiplication by "0" plaintext
-            // NOTE: we can't call multiply_plain with a "0" plaintext because it will result in a transparent cipher
-            _ctxt.evaluator()->multiply(_encryptedBit, _ctxt.c0()._encryptedBit, res);
-        else
-            _ctxt.evaluator()->multiply_plain(_encryptedBit, rhs._encodedBit, res);
-        if (_relin)
-            _ctxt.evaluator()->relinearize_inplace(res, _ctxt.relin_keys());
-        return CryptoBit(_ctxt, res);
-    }*/
+            return _ctxt.v0();
+        return *this;
+    }
 
     // Simultaneous OR operation applied on packed bits
     // [ 0, 0, 1, 1 ] | [ 0, 1, 0, 1 ] = [ 0, 1, 1, 1 ]
     // f(x,y) = x + y - xy
     inline PackedCryptoBits or_op(PackedCryptoBits const& rhs) const {
-        seal::Ciphertext res, mul;
-        _ctxt.evaluator().add(_encryptedPackedBits, rhs._encryptedPackedBits, res);
-        _ctxt.evaluator().multiply(_encryptedPackedBits, rhs._encryptedPackedBits, mul);
-        _ctxt.evaluator().relinearize_inplace(mul, _ctxt.relin_keys());
-        _ctxt.evaluator().sub_inplace(res, mul);
-        return PackedCryptoBits(_ctxt, res);
+        return fused_gate(rhs, 1, -1);
     }
 
     // Simultaneous XOR operation applied on packed bits
     // [ 0, 0, 1, 1 ] + [ 0, 1, 0, 1 ] = [ 0, 1, 1, 0 ]
-    // f(x,y) = (x-y)^2
+    // f(x,y) = x + y - 2xy
     // As a side note, we can't use the addition modulo 2 as the polynome
     // modulus cannot be set to 2 (when batching).
     inline PackedCryptoBits xor_op(const PackedCryptoBits& rhs) const {
-        seal::Ciphertext res;
-        _ctxt.evaluator().sub(_encryptedPackedBits, rhs._encryptedPackedBits, res);
-        _ctxt.evaluator().square_inplace(res);
-        return PackedCryptoBits(_ctxt, res);
+        return fused_gate(rhs, 1, -2);
     }
 
-    /*
-    inline CryptoBit xor_op_on_clear(const ClearBit& rhs) const {
-        seal::Ciphertext res;
-        _ctxt.evaluator()->add_plain(_encryptedBit, rhs._encodedBit, res);
-        return CryptoBit(_ctxt, res);
-    }*/
+    // XOR with the same clear bit on every slot
+    // x ^ 0 = x and x ^ 1 = !x
+    inline PackedCryptoBits xor_op_on_clear(const ClearBit& rhs) const {
+        if (rhs.is_zero())
+            return *this;
+        return not_op();
+    }
 
     // Simultaneous NOT (bit flip) operation applied on packed bits
     // [ 0, 1 ] => [ 1, 0 ]
@@ -210,13 +317,14 @@ public:
     inline PackedCryptoBits not_op() const {
         seal::Ciphertext res;
         _ctxt.evaluator().sub(_ctxt.v1()._encryptedPackedBits, _encryptedPackedBits, res);
-        return PackedCryptoBits(_ctxt, res);
+        return PackedCryptoBits(_ctxt, res, _depth);
     }
 
     // [ x_0, x_1, ..., x_n ] => [ 0, 0, ..., 0 ]
     inline PackedCryptoBits& set_to_0() {
         _ctxt.evaluator().multiply_inplace(_encryptedPackedBits, _ctxt.v0()._encryptedPackedBits);
         _ctxt.evaluator().relinearize_inplace(_encryptedPackedBits, _ctxt.relin_keys());
+        _depth++;
         return *this;
     }
 
@@ -228,18 +336,18 @@ public:
 
     // Simultaneous XNOR operation applied on packed bits
     // [ 0, 0, 1, 1 ] + [ 0, 1, 0, 1 ] = [ 1, 0, 0, 1 ]
+    // f(x,y) = 1 - x - y + 2xy
     inline PackedCryptoBits xnor_op(const PackedCryptoBits& rhs) const {
-        return xor_op(rhs).not_op();
+        return fused_gate(rhs, -1, 2);
     }
 
     inline PackedCryptoBits operator&(const PackedCryptoBits& rhs) const {
         return and_op(rhs);
     }
 
-    /*
-    inline PackedCryptoBit operator&(const ClearBit& rhs) const {
+    inline PackedCryptoBits operator&(const ClearBit& rhs) const {
         return and_op_on_clear(rhs);
-    }*/
+    }
     
     inline PackedCryptoBits operator|(const PackedCryptoBits& rhs) const {
         return or_op(rhs);
@@ -249,17 +357,59 @@ public:
         return xor_op(rhs);
     }
 
-/*
-    inline PackedCryptoBits operator^(const PackedCryptoBits& rhs) const {
+    inline PackedCryptoBits operator^(const ClearBit& rhs) const {
         return xor_op_on_clear(rhs);
     }
-*/
+
     inline PackedCryptoBits operator==(const PackedCryptoBits& rhs) const {
         return xnor_op(rhs);
     }
 
     inline PackedCryptoBits operator!() const { return not_op(); }
 
+    // Rotation of the two rows of slots (slot_count()/2 slots each): the
+    // slot i of the result is the slot i + steps of its row
+    inline PackedCryptoBits rotate_rows(int steps) const {
+        if (steps % static_cast<int>(nb_elements() / 2) == 0)
+            return *this;
+        seal::Ciphertext res;
+        _ctxt.evaluator().rotate_rows(_encryptedPackedBits, steps, _ctxt.galois_keys(), res);
+        return PackedCryptoBits(_ctxt, res, _depth);
+    }
+
+    // Keep the slots where mask is 1 and set the other ones to 0
+    // NOTE: the mask is a plaintext multiplication, whose noise is close to
+    // the one of a multiplication (see manage_noise())
+    inline PackedCryptoBits select(std::vector<uint64_t> const& mask) const {
+        seal::Plaintext plainMask;
+        seal::Ciphertext res;
+        _ctxt.batch_encoder().encode(mask, plainMask);
+        _ctxt.evaluator().multiply_plain(_encryptedPackedBits, plainMask, res);
+        return PackedCryptoBits(_ctxt, res, _depth + 1);
+    }
+
+    // XOR with a clear bit per slot: f(x,c) = x.(1 - 2c) + c
+    inline PackedCryptoBits xor_op_on_slots(std::vector<uint64_t> const& bits) const {
+        std::vector<uint64_t> factors(bits.size());
+        for (size_t i = 0; i < bits.size(); i++)
+            factors[i] = bits[i] ? _ctxt.plain_modulus().value() - 1 : 1;
+        seal::Plaintext plainFactors, plainBits;
+        seal::Ciphertext res;
+        _ctxt.batch_encoder().encode(factors, plainFactors);
+        _ctxt.batch_encoder().encode(bits, plainBits);
+        _ctxt.evaluator().multiply_plain(_encryptedPackedBits, plainFactors, res);
+        _ctxt.evaluator().add_plain_inplace(res, plainBits);
+        return PackedCryptoBits(_ctxt, res, _depth + 1);
+    }
+
+    // OR of packed bits set in disjoint slots (e.g. selected by
+    // complementary masks), i.e. their sum: no multiplication is needed
+    inline PackedCryptoBits merge(PackedCryptoBits const& rhs) const {
+        seal::Ciphertext res;
+        _ctxt.evaluator().add(_encryptedPackedBits, rhs._encryptedPackedBits, res);
+        return PackedCryptoBits(_ctxt, res, std::max(_depth, rhs._depth));
+    }
+
     int noise_budget() const {
         return _ctxt.decryptor().invariant_noise_budget(_encryptedPackedBits);
     }
@@ -276,7 +426,7 @@ public:
         return res;
     }
 
-    PackedBitsEncryptionContext<pmd>& encryption_context() { return _ctxt; }
+    PackedBitsEncryptionContext<pmd>& encryption_context() const { return _ctxt; }
 
     // This function should be replaced by a bootstrapping procedure as it is 
     // illegal in this form (a decryption procedure couldn't be executed by the server).
@@ -284,325 +434,328 @@ public:
         seal::Plaintext plaintext;
         _ctxt.batch_encoder().encode(decrypt(), plaintext);
         _ctxt.encryptor().encrypt(plaintext, _encryptedPackedBits);
+        _depth = 0;
+        _ctxt.count_refresh();
+    }
+
+    std::size_t depth() const { return _depth; }
+
+    // Check that the packed bits can go through "next_depth" more products:
+    // throws std::runtime_error if the depth capacity of the context would be
+    // exceeded, the parameters being too small for the circuit (see the
+    // constructor of PackedBitsEncryptionContext from a depth)
+    void manage_noise(std::size_t next_depth) const {
+        if (_depth + next_depth > _ctxt.depth_capacity())
+            throw std::runtime_error("packed bits beyond the depth capacity of their context");
+    }
+
+    // Explicit refresh (same restriction as above) if the packed bits could
+    // not go through "next_depth" more products, for the circuits deeper than
+    // any noise budget (see CryptoBit::manage_noise)
+    void refresh_for(std::size_t next_depth) {
+        if (_depth + next_depth > _ctxt.depth_capacity())
+            refresh();
     }
 };
-/*
-template <size_t bitsize>
-class ClearBitset;
 
-template <size_t bitsize>
-class CryptoBitset
+// Noise management of a circuit run on packed bits (see Circuit::run, with
+// Circuit::Depth::product): before each wave, checks that the operands can
+// go through one more product
+template <std::size_t pmd>
+void prepare_product(PackedCryptoBits<pmd>& bits)
+{
+    bits.manage_noise(1);
+}
+
+// Same, for the circuits deeper than the depth capacity: the operands which
+// could not go through one more product are refreshed
+template <std::size_t pmd>
+void refresh_for_product(PackedCryptoBits<pmd>& bits)
+{
+    bits.refresh_for(1);
+}
+
+// Bitsliced set of packed bits
+//
+// Contrary to CryptoBitset, which holds one encrypted bit per ciphertext, the
+// i-th element of a PackedCryptoBitset holds the bit i of up to slot_count()
+// independent values, one per slot. In other words, the j-th slot of the i-th
+// ciphertext is the i-th bit of the j-th value:
+//
+//      container[0] = [ x0_0, x1_0, x2_0, ..., xn_0 ]  <- LSB of every value
+//      container[1] = [ x0_1, x1_1, x2_1, ..., xn_1 ]
+//      ...
+//
+// Every gate is thus applied simultaneously on all the values, and the
+// wiring operations (shifts, rotations, split and join) don't cost any
+// homomorphic operation as they only move ciphertexts around.
+template <std::size_t bitsize, std::size_t pmd = 4096>
+class PackedCryptoBitset
 {
-    BitEncryptionContext& _ctxt;
-    std::vector<CryptoBit> _container;
+    PackedBitsEncryptionContext<pmd>& _ctxt;
+    std::vector<PackedCryptoBits<pmd>> _container;
 
 public:
-    using iterator       = std::vector<CryptoBit>::iterator;
-    using const_iterator = std::vector<CryptoBit>::const_iterator;
+    using bit_type       = PackedCryptoBits<pmd>;
+    using iterator       = typename std::vector<PackedCryptoBits<pmd>>::iterator;
+    using const_iterator = typename std::vector<PackedCryptoBits<pmd>>::const_iterator;
 
-    CryptoBitset(BitEncryptionContext& ctxt, std::vector<CryptoBit>& container)
+    PackedCryptoBitset(PackedBitsEncryptionContext<pmd>& ctxt, 
+                       std::vector<PackedCryptoBits<pmd>>& container)
         : _ctxt(ctxt), _container(container)
     {
         assert(container.size() <= bitsize && "Insufficient bitsize");
-        if (container.size() < bitsize)
-            // fill the underlying container with extra zeros
-            for (size_t i = container.size(); i < bitsize; i++)
-                _container.insert(_container.cend(), _ctxt.c0());
+        // fill the underlying container with extra zeros
+        for (size_t i = container.size(); i < bitsize; i++)
+            _container.push_back(_ctxt.v0());
     }
 
-public:
-    CryptoBitset(BitEncryptionContext& ctxt, std::bitset<bitsize> inputData = std::bitset<bitsize>())
+    // Encrypt the same value in all the slots
+    PackedCryptoBitset(PackedBitsEncryptionContext<pmd>& ctxt, 
+                       std::bitset<bitsize> broadcastedData = std::bitset<bitsize>())
         : _ctxt(ctxt)
     {
-        assert(bitsize >= 1);
-        assert(bitsize <= inputData.size() && 
-               "dataType size will not be enough to store the decrypted value without loss");
-        // Little endian encoding (the first digit read is the LSB) i.e.
-        // 0101 means 5 in decimal and the four bits are located as follow: 
-        // ('1') container[0], ('0') container[1], ('1') container[2] and ('0') container[3]
+        _container.reserve(bitsize);
         for (size_t i = 0; i < bitsize; i++)
-            _container.push_back(CryptoBit(_ctxt, inputData[i]));
+            _container.push_back(PackedCryptoBits<pmd>(_ctxt, broadcastedData[i]));
     }
 
-    CryptoBitset(CryptoBitset const& cbitfield)
-        : _ctxt(cbitfield._ctxt), _container(cbitfield._container)
+    // Encrypt values[j] in the j-th slot (the unused slots are set to 0)
+    PackedCryptoBitset(PackedBitsEncryptionContext<pmd>& ctxt, 
+                       std::vector<std::bitset<bitsize>> const& values)
+        : _ctxt(ctxt)
     {
+        assert(values.size() <= _ctxt.slot_count() && "too much values to pack");
+        _container.reserve(bitsize);
+        for (size_t i = 0; i < bitsize; i++) {
+            std::vector<uint64_t> slots(_ctxt.slot_count(), 0ULL);
+            for (size_t j = 0; j < values.size(); j++)
+                slots[j] = values[j][i];
+            _container.push_back(PackedCryptoBits<pmd>(_ctxt, slots));
+        }
     }
 
-    template<size_t other_bitsize>
-    CryptoBitset(CryptoBitset<other_bitsize> const& cbitfield)
-        : _ctxt(cbitfield.bit_encryption_context()), _container(cbitfield.underlying_container())
+    PackedCryptoBitset(PackedCryptoBitset const& cbitset)
+        : _ctxt(cbitset._ctxt), _container(cbitset._container)
     {
-        assert(bitsize >= other_bitsize && 
-            "conversion isn't allowed as the dest bitsize isn't enough to store\
-             the value without loss");
-
-        // fill the underlying container with extra zeros
-        for (size_t i = _container.size(); i < bitsize; i++)
-            _container.insert(_container.cend(), _ctxt.c0());
     }
 
-    CryptoBitset(CryptoBitset&& cbitfield)
-        : _ctxt(cbitfield._ctxt)
+    PackedCryptoBitset(PackedCryptoBitset&& cbitset)
+        : _ctxt(cbitset._ctxt)
     {
-        std::swap(_container, cbitfield._container);
+        std::swap(_container, cbitset._container);
     }
 
-    CryptoBitset& operator=(CryptoBitset&& cbitfield)
+    PackedCryptoBitset& operator=(PackedCryptoBitset const& cbitset)
     {
-        std::swap(_ctxt, cbitfield._ctxt);
-        std::swap(_container, cbitfield._container);
+        assert(&_ctxt == &cbitset._ctxt && 
+            "cannot copy an encrypted bitset using different encryption parameters");
+        _container = cbitset._container;
         return *this;
     }
 
-    CryptoBitset& operator=(CryptoBitset& cbitfield)
+    PackedCryptoBitset& operator=(PackedCryptoBitset&& cbitset)
     {
-        assert(&_ctxt == &cbitfield._ctxt && 
-            "cannot copy an encrypted bitset using different encryption parameters");
-        _container = cbitfield._container;
+        assert(&_ctxt == &cbitset._ctxt && 
+            "cannot move an encrypted bitset using different encryption parameters");
+        std::swap(_container, cbitset._container);
         return *this;
     }
 
-    std::bitset<bitsize> decrypt() {
-        std::bitset<bitsize> decryptedValue = 0;
-        for (size_t i = 0; i < bitsize; i++)
-            decryptedValue[i] = _container[i].decrypt();
-        return decryptedValue;
+    // Decrypt all the slots, the j-th returned value being the one of the j-th slot
+    std::vector<std::bitset<bitsize>> decrypt() {
+        std::vector<std::bitset<bitsize>> values(_ctxt.slot_count());
+        for (size_t i = 0; i < bitsize; i++) {
+            std::vector<uint64_t> slots = _container[i].decrypt();
+            for (size_t j = 0; j < values.size(); j++)
+                values[j][i] = slots[j] & 0b1;
+        }
+        return values;
     }
 
-#define AND &
-#define XOR ^
-#define NOT !
-
-    CryptoBitset select(const CryptoBitset& cond, const CryptoBitset& a, 
-                          const CryptoBitset& b) const
-    {
-        return (cond AND a) XOR ((NOT cond) AND b);
+    // Number of values processed simultaneously by each gate
+    std::size_t nb_values() const {
+        return _ctxt.slot_count();
     }
 
-#undef AND
-#undef XOR
-#undef NOT
-
-    static CryptoBitset broadcast(BitEncryptionContext& ctxt, const CryptoBit& cbit) {
-        std::vector<CryptoBit> container(bitsize, cbit);
-        return CryptoBitset(ctxt, container);
+    static PackedCryptoBitset broadcast(PackedBitsEncryptionContext<pmd>& ctxt, 
+                                        PackedCryptoBits<pmd> const& cbits) {
+        std::vector<PackedCryptoBits<pmd>> container(bitsize, cbits);
+        return PackedCryptoBitset(ctxt, container);
     }
 
-    // Apply an unary boolean operator on every bit of the CryptoBitset
-    CryptoBitset apply_bitwise_unop(std::function<CryptoBit(const CryptoBit&)> op) const
+    PackedCryptoBitset apply_bitwise_unop(
+        std::function<PackedCryptoBits<pmd>(PackedCryptoBits<pmd> const&)> op) const
     {
-        std::vector<CryptoBit> res;
+        std::vector<PackedCryptoBits<pmd>> res;
+        res.reserve(bitsize);
         for (size_t i = 0; i < bitsize; i++)
             res.push_back(op(_container[i]));
-        return CryptoBitset(_ctxt, res);
+        return PackedCryptoBitset(_ctxt, res);
     }
 
-    // Apply an binary boolean operator between every x_i and y_i of the lhs and rhs
-    // Cryptobitsets
-    CryptoBitset apply_bitwise_binop(std::function<CryptoBit(const CryptoBit&, 
-                                                             const CryptoBit&)> op, 
-                                     const CryptoBitset& rhs) const
+    PackedCryptoBitset apply_bitwise_binop(
+        std::function<PackedCryptoBits<pmd>(PackedCryptoBits<pmd> const&, 
+                                            PackedCryptoBits<pmd> const&)> op,
+        PackedCryptoBitset const& rhs) const
     {
-        std::vector<CryptoBit> res;
+        std::vector<PackedCryptoBits<pmd>> res;
+        res.reserve(bitsize);
         for (size_t i = 0; i < bitsize; i++)
             res.push_back(op(_container[i], rhs[i]));
-        return CryptoBitset(_ctxt, res);
+        return PackedCryptoBitset(_ctxt, res);
     }
 
-
-    CryptoBitset apply_bitwise_binop_clear(std::function<CryptoBit(const CryptoBit&, 
-                                                                   const ClearBit &)> op, 
-                                           const ClearBitset<bitsize>& rhs) const
+    PackedCryptoBitset apply_bitwise_binop_clear(
+        std::function<PackedCryptoBits<pmd>(PackedCryptoBits<pmd> const&, 
+                                            ClearBit const&)> op,
+        ClearBitset<bitsize> const& rhs) const
     {
-        std::vector<CryptoBit> res;
+        std::vector<PackedCryptoBits<pmd>> res;
+        res.reserve(bitsize);
         for (size_t i = 0; i < bitsize; i++)
             res.push_back(op(_container[i], rhs[i]));
-        return CryptoBitset(_ctxt, res);
+        return PackedCryptoBitset(_ctxt, res);
     }
 
-    // Shifting a bitfield shift times on the left
-    // If 0111010 is the internal value, 
-    // the 2-shift will be 1101000
-    inline CryptoBitset shift_left(size_t shamt) const {
-        // a left shift (shift towards the MSB) corresponds to a right shift
-        // in our vector encoding
-        std::vector<CryptoBit> vec(this->_container);
-
-        for (size_t i = 0; i < std::min(shamt, vec.size()); i++) {
-            vec.insert(vec.begin(), _ctxt.c0());
-            vec.pop_back();
-        }
-        return CryptoBitset(_ctxt, vec);
+    // Same semantic as CryptoBitset::shift_left (towards the MSB)
+    inline PackedCryptoBitset shift_left(size_t shamt) const {
+        std::vector<PackedCryptoBits<pmd>> vec;
+        vec.reserve(bitsize);
+        shamt = std::min(shamt, bitsize);
+        vec.insert(vec.end(), shamt, _ctxt.v0());
+        vec.insert(vec.end(), _container.cbegin(), _container.cend() - shamt);
+        return PackedCryptoBitset(_ctxt, vec);
     }
 
-    inline CryptoBitset shift_right(size_t shamt) const {
-        // a right shift (towards the LSB) corresponds to a left shift
-        // in our vector encoding
-        std::vector<CryptoBit> vec(this->_container);
-
-        for (size_t i = 0; i < std::min(shamt, vec.size()); i++) {
-            vec.insert(vec.end(), _ctxt.c0());
-            vec.erase(vec.begin());
-        }
-        return CryptoBitset(_ctxt, vec);
+    // Same semantic as CryptoBitset::shift_right (towards the LSB)
+    inline PackedCryptoBitset shift_right(size_t shamt) const {
+        std::vector<PackedCryptoBits<pmd>> vec;
+        vec.reserve(bitsize);
+        shamt = std::min(shamt, bitsize);
+        vec.insert(vec.end(), _container.cbegin() + shamt, _container.cend());
+        vec.insert(vec.end(), shamt, _ctxt.v0());
+        return PackedCryptoBitset(_ctxt, vec);
     }
 
-    // TODO: use std::rotate
-    inline CryptoBitset rotate_left(size_t shamt) const {
-        std::vector<CryptoBit> vec(_container);
-        // std::rotate(myvector.begin(),myvector.begin()+3,myvector.end());
-        for (size_t i = 0; i < shamt; i++) {
-            vec.insert(vec.begin(), vec.back());
-            vec.pop_back();
-        }
-        return CryptoBitset(_ctxt, vec);
+    inline PackedCryptoBitset rotate_left(size_t shamt) const {
+        std::vector<PackedCryptoBits<pmd>> vec(_container);
+        std::rotate(vec.rbegin(), vec.rbegin() + shamt % bitsize, vec.rend());
+        return PackedCryptoBitset(_ctxt, vec);
     }
 
-    inline CryptoBitset rotate_right(size_t shamt) const {
-        std::vector<CryptoBit> vec(_container);
-
-        for (size_t i = 0; i < shamt; i++) {
-            vec.insert(vec.end(), vec.front());
-            vec.erase(vec.begin());
-        }
-        return CryptoBitset(_ctxt, vec);
+    inline PackedCryptoBitset rotate_right(size_t shamt) const {
+        std::vector<PackedCryptoBits<pmd>> vec(_container);
+        std::rotate(vec.begin(), vec.begin() + shamt % bitsize, vec.end());
+        return PackedCryptoBitset(_ctxt, vec);
     }
 
-    // TODO: remplacer par une logique de move ou pas ?
     template <unsigned nb>
     auto split() const
     {
-        std::vector<CryptoBitset<bitsize/nb>> rtn;
-        const_iterator it = _container.cbegin();
+        std::vector<PackedCryptoBitset<bitsize/nb, pmd>> rtn;
+        const_iterator it  = _container.cbegin();
         const_iterator end = _container.cend();
 
         while (it != end) {
-            std::vector<CryptoBit> v;
-            v.reserve(bitsize/nb);
             const auto num_to_copy = std::min(static_cast<long unsigned>(
                 std::distance(it, end)), bitsize/nb);
-            std::copy(it, it + num_to_copy, std::back_inserter(v));
-            rtn.push_back(CryptoBitset<bitsize/nb>(_ctxt, v));
+            std::vector<PackedCryptoBits<pmd>> v(it, it + num_to_copy);
+            rtn.push_back(PackedCryptoBitset<bitsize/nb, pmd>(_ctxt, v));
             std::advance(it, num_to_copy);
         }
         return rtn;
     }
 
-    // move logic
     template <unsigned U>
-    static CryptoBitset<bitsize> join(BitEncryptionContext& ctxt, 
-                                      std::vector<CryptoBitset<U>> bitsetVec) 
+    static PackedCryptoBitset join(PackedBitsEncryptionContext<pmd>& ctxt, 
+                                   std::vector<PackedCryptoBitset<U, pmd>>& bitsetVec)
     {
-        unsigned long int size = std::min(U*bitsetVec.size(), bitsize);
-
-        for (auto& e : bitsetVec) 
-            assert(&ctxt == &e.bit_encryption_context());
-
-        std::vector<CryptoBit> newvec;
-        newvec.reserve(size);
-
-        size_t index = 0;
-        // TODO: voir pour remplacer avec std::copy and std::copyn et move_iterator ? 
-        for (typename std::vector<CryptoBitset<U>>::iterator it_cbset = bitsetVec.begin();
-            it_cbset != bitsetVec.end() && index < size; it_cbset++)
-            for (typename CryptoBitset<U>::iterator it_cbit = it_cbset->begin();
-                it_cbit != it_cbset->end() && index < size; it_cbit++, index++)
-                newvec.push_back(std::move(*it_cbit));
+        std::vector<PackedCryptoBits<pmd>> newvec;
+        newvec.reserve(bitsize);
 
-        // std::copy_n(std::make_move_iterator(vec.begin()), N, arr.begin());
-        return CryptoBitset<bitsize>(ctxt, newvec);
+        for (auto& bitset : bitsetVec) {
+            assert(&ctxt == &bitset.bit_encryption_context());
+            for (auto it = bitset.begin(); it != bitset.end() && newvec.size() < bitsize; it++)
+                newvec.push_back(*it);
+        }
+        return PackedCryptoBitset(ctxt, newvec);
     }
 
-    CryptoBitset apply_seq_AND() const
+    // Same as the join() method but with a move semantic
+    template <unsigned U>
+    static PackedCryptoBitset move_and_join(PackedBitsEncryptionContext<pmd>& ctxt, 
+                                            std::vector<PackedCryptoBitset<U, pmd>>& bitsetVec)
     {
-        CryptoBit acc = _container[0];
-        for (size_t i = 1; i < bitsize; i++)
-            acc = _container[i] & acc;
-        return CryptoBitset::broadcast(_ctxt, acc);
-    }
+        std::vector<PackedCryptoBits<pmd>> newvec;
+        newvec.reserve(bitsize);
 
-    inline CryptoBitset operator&(const CryptoBitset& rhs) const
-    {
-        return apply_bitwise_binop(&CryptoBit::and_op, rhs);
+        for (auto& bitset : bitsetVec) {
+            assert(&ctxt == &bitset.bit_encryption_context());
+            for (auto it = bitset.begin(); it != bitset.end() && newvec.size() < bitsize; it++)
+                newvec.push_back(std::move(*it));
+        }
+        return PackedCryptoBitset(ctxt, newvec);
     }
 
-    inline CryptoBitset operator&(const ClearBitset<bitsize>& rhs) const
-    {
-        return apply_bitwise_binop_clear(&CryptoBit::and_op_on_clear, rhs);
+    inline PackedCryptoBitset operator&(PackedCryptoBitset const& rhs) const {
+        return apply_bitwise_binop(&PackedCryptoBits<pmd>::and_op, rhs);
     }
 
-    inline CryptoBitset operator|(const CryptoBitset& rhs) const
-    {
-        return apply_bitwise_binop(&CryptoBit::or_op, rhs);
+    inline PackedCryptoBitset operator&(ClearBitset<bitsize> const& rhs) const {
+        return apply_bitwise_binop_clear(&PackedCryptoBits<pmd>::and_op_on_clear, rhs);
     }
 
-    inline CryptoBitset operator==(const CryptoBitset& rhs) const
-    {
-        return apply_bitwise_binop(&CryptoBit::xnor_op, rhs);
+    inline PackedCryptoBitset operator|(PackedCryptoBitset const& rhs) const {
+        return apply_bitwise_binop(&PackedCryptoBits<pmd>::or_op, rhs);
     }
 
-    inline CryptoBitset operator^(const CryptoBitset& rhs) const
-    {
-        return apply_bitwise_binop(&CryptoBit::xor_op, rhs);
+    inline PackedCryptoBitset operator==(PackedCryptoBitset const& rhs) const {
+        return apply_bitwise_binop(&PackedCryptoBits<pmd>::xnor_op, rhs);
     }
 
-    inline CryptoBitset operator^(const ClearBitset<bitsize>& rhs) const
-    {
-        return apply_bitwise_binop_clear(&CryptoBit::xor_op_on_clear, rhs);
+    inline PackedCryptoBitset operator^(PackedCryptoBitset const& rhs) const {
+        return apply_bitwise_binop(&PackedCryptoBits<pmd>::xor_op, rhs);
     }
 
-    inline CryptoBitset operator^=(const ClearBitset<bitsize>& rhs) const
-    {
-        for (size_t i = 0; i < bitsize; i++)
-            _container[i] = _container[i].xor_op_on_clear(rhs[i]);
+    inline PackedCryptoBitset operator^(ClearBitset<bitsize> const& rhs) const {
+        return apply_bitwise_binop_clear(&PackedCryptoBits<pmd>::xor_op_on_clear, rhs);
     }
 
-    inline CryptoBitset operator!() const
-    {
-        return apply_bitwise_unop(&CryptoBit::not_op);
+    inline PackedCryptoBitset operator!() const {
+        return apply_bitwise_unop(&PackedCryptoBits<pmd>::not_op);
     }
 
-    inline CryptoBitset operator<<(size_t shamt) const {
+    inline PackedCryptoBitset operator<<(size_t shamt) const {
         return shift_left(shamt);
     }
 
-    inline CryptoBitset& operator<<=(size_t shamt) 
-    {
-        for (size_t i = 0; i < std::min(shamt, _container.size()); i++) {
-            _container.insert(_container.begin(), _ctxt.c0());
-            _container.pop_back();
-        }
-        return *this;
-    }
-
-    inline CryptoBitset operator>>(size_t shamt) const {
+    inline PackedCryptoBitset operator>>(size_t shamt) const {
         return shift_right(shamt);
     }
 
-    // Return the minimal noise budget of the bitfield, i.e. the noise budget 
-    // of the most altered bit
+    // Return the minimal noise budget of the bitset, i.e. the noise budget 
+    // of the most altered packed bits
     int min_noise_budget() const {
         int min = _container[0].noise_budget();
         for (size_t i = 1; i < bitsize; i++)
-            if (min > _container[i].noise_budget())
-                min = _container[i].noise_budget();
-       return min;
+            min = std::min(min, _container[i].noise_budget());
+        return min;
     }
 
-    inline BitEncryptionContext& bit_encryption_context() const {
+    inline PackedBitsEncryptionContext<pmd>& bit_encryption_context() const {
         return _ctxt;
     }
 
-    inline std::vector<CryptoBit> underlying_container() const {
+    inline std::vector<PackedCryptoBits<pmd>> underlying_container() const {
         return _container;
     }
 
-    CryptoBit& operator[](size_t i) {
+    PackedCryptoBits<pmd>& operator[](size_t i) {
         return _container[i];
     }
 
-    CryptoBit const& operator[](size_t i) const {
+    PackedCryptoBits<pmd> const& operator[](size_t i) const {
         return _container[i];
     }
 
@@ -611,6 +764,19 @@ public:
             e.refresh();
     }
 
+    // See PackedCryptoBits::manage_noise
+    void manage_noise(std::size_t next_depth) const {
+        for (auto const& e : _container)
+            e.manage_noise(next_depth);
+    }
+
+    // See PackedCryptoBits::refresh_for
+    void refresh_for(std::size_t next_depth) {
+        default_scheduler().parallel_for(0, bitsize, [&](size_t i) {
+            _container[i].refresh_for(next_depth);
+        });
+    }
+
     iterator begin() { return _container.begin(); }
     iterator   end() { return _container.end()  ; }
 
@@ -618,78 +784,229 @@ public:
     const_iterator   cend() const { return _container.cend()  ; }
 };
 
-template <typename T, size_t nbElement>
-std::bitset<nbElement*8*sizeof(T)> arrayToBitset(std::array<T, nbElement> tab) 
+// Bitset packed in the slots of a single ciphertext
+//
+// Unlike PackedCryptoBitset (a ciphertext per bit position), all the bits of
+// a value are in the slots of the same ciphertext: the bit i of the j-th
+// value is in the slot j*bitsize + i, so each row of slot_count()/2 slots
+// holds several values (16 AES blocks per row for pmd = 4096). A gate is
+// thus a single homomorphic operation on all the bits of all the values,
+// whereas the wiring is no longer free: the bits moving by the same offset
+// are moved by one rotation of the rows (see PackedCryptoBits::rotate_rows)
+// and a mask, the results of each offset being merged. A shift is then one
+// rotation, a rotation two, and ShiftRows six (see aes_he_simd.hpp), each
+// of at most log2(slot_count()/2) key switchings, instead of one copy per
+// bit position.
+template <std::size_t bitsize, std::size_t pmd = 4096>
+class SlotPackedCryptoBitset
 {
-    std::bitset<nbElement*8*sizeof(T)> bits;
-    bits = tab[nbElement-1];
-    for (size_t i = 1; i < nbElement; i++) {
-        bits <<= (sizeof(T))*8;
-        bits |= tab[nbElement-1 - i];
+    static_assert((pmd / 2) % bitsize == 0, "the values must not straddle the rows of slots");
+
+    PackedBitsEncryptionContext<pmd>& _ctxt;
+    PackedCryptoBits<pmd> _bits;
+
+    SlotPackedCryptoBitset(PackedBitsEncryptionContext<pmd>& ctxt, PackedCryptoBits<pmd> bits)
+        : _ctxt(ctxt), _bits(std::move(bits))
+    {
     }
-    return bits;
-}
 
-// Warning : It may not works when T are non POD types, because of the use of memcpy()
-template <typename T, size_t bitsize>
-std::array<T, bitsize/8*sizeof(T)> bitsetToArray(std::bitset<bitsize> bits) 
-{
-    std::array<T, bitsize/8*sizeof(T)> bitarray;
+    // Slots of the values given their bits (the same for every value)
+    std::vector<uint64_t> slots_of(std::bitset<bitsize> const& value) const {
+        std::vector<uint64_t> slots(_ctxt.slot_count());
+        for (size_t j = 0; j < slots.size(); j++)
+            slots[j] = value[j % bitsize];
+        return slots;
+    }
 
-    size_t i;
-    unsigned long long c;
-    constexpr unsigned chunk_size = sizeof(unsigned long long);
-    std::bitset<bitsize> mask64 = -1ULL;
+    // The bit i of the result is the bit source[i] of the value, or 0 if
+    // source[i] >= bitsize
+    SlotPackedCryptoBitset permute_bits(std::array<size_t, bitsize> const& source) const
+    {
+        std::map<int, std::bitset<bitsize>> moves;
+        for (size_t i = 0; i < bitsize; i++)
+            if (source[i] < bitsize)
+                moves[static_cast<int>(source[i]) - static_cast<int>(i)].set(i);
+
+        std::optional<PackedCryptoBits<pmd>> res;
+        for (auto const& [offset, selected] : moves) {
+            PackedCryptoBits<pmd> moved = _bits.rotate_rows(offset);
+            if (!selected.all())
+                moved = moved.select(slots_of(selected));
+            res = res ? res->merge(moved) : moved;
+        }
+        return SlotPackedCryptoBitset(_ctxt, res ? *res : _ctxt.v0());
+    }
 
-    for (i = chunk_size; i < bitsize/8*sizeof(T); i+=chunk_size) {
-        c = (bits & mask64).to_ullong();
-        std::memcpy(&bitarray.data()[i-chunk_size], &c, chunk_size);
-        bits >>= 8*chunk_size;
+public:
+    // Encrypt the same value in all the places
+    SlotPackedCryptoBitset(PackedBitsEncryptionContext<pmd>& ctxt,
+                           std::bitset<bitsize> broadcastedData = std::bitset<bitsize>())
+        : _ctxt(ctxt), _bits(ctxt.v0())
+    {
+        std::vector<uint64_t> slots = slots_of(broadcastedData);
+        _bits = PackedCryptoBits<pmd>(_ctxt, slots);
     }
-    c = (bits & mask64).to_ullong();
-    long unsigned delta = bitsize/8*sizeof(T) - (i - chunk_size);
-    std::memcpy(&bitarray.data()[i-chunk_size], &c, delta);
 
-    return bitarray;
-}
+    // Encrypt values[j] as the j-th value (the unused places are set to 0)
+    SlotPackedCryptoBitset(PackedBitsEncryptionContext<pmd>& ctxt,
+                           std::vector<std::bitset<bitsize>> const& values)
+        : _ctxt(ctxt), _bits(ctxt.v0())
+    {
+        assert(values.size() <= nb_values() && "too much values to pack");
+        std::vector<uint64_t> slots(_ctxt.slot_count(), 0ULL);
+        for (size_t j = 0; j < values.size(); j++)
+            for (size_t i = 0; i < bitsize; i++)
+                slots[j*bitsize + i] = values[j][i];
+        _bits = PackedCryptoBits<pmd>(_ctxt, slots);
+    }
 
-template <size_t bitsize>
-class ClearBitset
-{
-    std::vector<ClearBit> _container;
+    SlotPackedCryptoBitset(SlotPackedCryptoBitset const& cbitset)
+        : _ctxt(cbitset._ctxt), _bits(cbitset._bits)
+    {
+    }
 
-public:
-    using iterator       = std::vector<ClearBit>::iterator;
-    using const_iterator = std::vector<ClearBit>::const_iterator;
+    SlotPackedCryptoBitset& operator=(SlotPackedCryptoBitset const& cbitset)
+    {
+        assert(&_ctxt == &cbitset._ctxt && 
+            "cannot copy an encrypted bitset using different encryption parameters");
+        _bits = cbitset._bits;
+        return *this;
+    }
 
-public:
-    ClearBitset(std::bitset<bitsize> inputData = std::bitset<bitsize>())
+    // Decrypt all the values, the j-th returned value being the j-th packed one
+    std::vector<std::bitset<bitsize>> decrypt() {
+        std::vector<std::bitset<bitsize>> values(nb_values());
+        std::vector<uint64_t> slots = _bits.decrypt();
+        for (size_t j = 0; j < values.size(); j++)
+            for (size_t i = 0; i < bitsize; i++)
+                values[j][i] = slots[j*bitsize + i] & 0b1;
+        return values;
+    }
+
+    // Number of values processed simultaneously by each gate
+    std::size_t nb_values() const {
+        return _ctxt.slot_count() / bitsize;
+    }
+
+    inline SlotPackedCryptoBitset operator&(SlotPackedCryptoBitset const& rhs) const {
+        return SlotPackedCryptoBitset(_ctxt, _bits & rhs._bits);
+    }
+
+    // x & 0 = 0 and x & 1 = x: a mask
+    inline SlotPackedCryptoBitset operator&(ClearBitset<bitsize> const& rhs) const {
+        std::bitset<bitsize> value;
+        for (size_t i = 0; i < bitsize; i++)
+            value[i] = !rhs[i].is_zero();
+        if (value.all())
+            return *this;
+        if (value.none())
+            return SlotPackedCryptoBitset(_ctxt, _ctxt.v0());
+        return SlotPackedCryptoBitset(_ctxt, _bits.select(slots_of(value)));
+    }
+
+    inline SlotPackedCryptoBitset operator|(SlotPackedCryptoBitset const& rhs) const {
+        return SlotPackedCryptoBitset(_ctxt, _bits | rhs._bits);
+    }
+
+    inline SlotPackedCryptoBitset operator==(SlotPackedCryptoBitset const& rhs) const {
+        return SlotPackedCryptoBitset(_ctxt, _bits == rhs._bits);
+    }
+
+    inline SlotPackedCryptoBitset operator^(SlotPackedCryptoBitset const& rhs) const {
+        return SlotPackedCryptoBitset(_ctxt, _bits ^ rhs._bits);
+    }
+
+    inline SlotPackedCryptoBitset operator^(ClearBitset<bitsize> const& rhs) const {
+        std::bitset<bitsize> value;
+        for (size_t i = 0; i < bitsize; i++)
+            value[i] = !rhs[i].is_zero();
+        if (value.none())
+            return *this;
+        if (value.all())
+            return !*this;
+        return SlotPackedCryptoBitset(_ctxt, _bits.xor_op_on_slots(slots_of(value)));
+    }
+
+    inline SlotPackedCryptoBitset operator!() const {
+        return SlotPackedCryptoBitset(_ctxt, !_bits);
+    }
+
+    // Same semantic as CryptoBitset::shift_left (towards the MSB)
+    SlotPackedCryptoBitset shift_left(size_t shamt) const {
+        std::array<size_t, bitsize> source;
+        for (size_t i = 0; i < bitsize; i++)
+            source[i] = i >= shamt ? i - shamt : bitsize;
+        return permute_bits(source);
+    }
+
+    // Same semantic as CryptoBitset::shift_right (towards the LSB)
+    SlotPackedCryptoBitset shift_right(size_t shamt) const {
+        std::array<size_t, bitsize> source;
+        for (size_t i = 0; i < bitsize; i++)
+            source[i] = i + shamt < bitsize ? i + shamt : bitsize;
+        return permute_bits(source);
+    }
+
+    SlotPackedCryptoBitset rotate_left(size_t shamt) const {
+        std::array<size_t, bitsize> source;
+        for (size_t i = 0; i < bitsize; i++)
+            source[i] = (i + bitsize - shamt % bitsize) % bitsize;
+        return permute_bits(source);
+    }
+
+    SlotPackedCryptoBitset rotate_right(size_t shamt) const {
+        std::array<size_t, bitsize> source;
+        for (size_t i = 0; i < bitsize; i++)
+            source[i] = (i + shamt) % bitsize;
+        return permute_bits(source);
+    }
+
+    inline SlotPackedCryptoBitset operator<<(size_t shamt) const {
+        return shift_left(shamt);
+    }
+
+    inline SlotPackedCryptoBitset operator>>(size_t shamt) const {
+        return shift_right(shamt);
+    }
+
+    // Same semantic as CryptoBitset::permute: the group i of the result is
+    // the group source[i] of the bitset
+    template <size_t unit>
+    SlotPackedCryptoBitset permute(std::array<size_t, bitsize/unit> const& source) const
     {
-        assert(bitsize >= 1);
-        assert(bitsize <= inputData.size());
-        
-        for (size_t i = 0; i < bitsize; i++) {
-            _container.push_back(ClearBit(inputData[i]));
-            _container[i].decode();
+        static_assert(bitsize % unit == 0, "the bitset must be made of whole groups");
+        std::array<size_t, bitsize> bitSource;
+        for (size_t group = 0; group < bitsize/unit; group++) {
+            assert(source[group] < bitsize/unit);
+            for (size_t i = 0; i < unit; i++)
+                bitSource[group*unit + i] = source[group]*unit + i;
         }
+        return permute_bits(bitSource);
     }
 
-    std::bitset<bitsize> decode() {
-        std::bitset<bitsize> decodedValue = 0;
-        for (size_t i = 0; i < bitsize; i++)
-            decodedValue[i] = _container[i].decode();
-        return decodedValue;
+    int min_noise_budget() const {
+        return _bits.noise_budget();
     }
 
-    ClearBit& operator[](size_t i) {
-        return _container[i];
+    inline PackedBitsEncryptionContext<pmd>& bit_encryption_context() const {
+        return _ctxt;
     }
 
-    ClearBit const& operator[](size_t i) const {
-        return _container[i];
+    inline PackedCryptoBits<pmd> const& packed_bits() const {
+        return _bits;
+    }
+
+    void refresh() {
+        _bits.refresh();
+    }
+
+    void manage_noise(std::size_t next_depth) const {
+        _bits.manage_noise(next_depth);
     }
-};
-*/
 
+    void refresh_for(std::size_t next_depth) {
+        _bits.refresh_for(next_depth);
+    }
+};
 
 #endif
\ No newline at end of file
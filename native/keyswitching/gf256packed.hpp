@@ -0,0 +1,166 @@
+#ifndef __GF256_PACKED_HPP__
+#define __GF256_PACKED_HPP__
+
+#include <assert.h>
+#include <vector>
+#include "GF256.hpp"
+#include "encryptionlayerSIMD.hpp"
+#include "linearlayer.hpp"
+#include "sbox.hpp"
+
+// Batched arithmetic in GF(2^8)
+//
+// A PackedGF256 holds one element of GF(2^8) per slot: its 8 bits are packed
+// bit-sliced in a PackedCryptoBitset<8> (the bit i of the j-th element is in
+// the j-th slot of the i-th ciphertext). Each operation thus processes
+// slot_count() bytes at once (4096 for the default parameters):
+// (*) the addition is an XOR of the bits,
+// (*) the multiplication by a constant and the squaring are linear over GF(2)
+//     and go through an XOR network (no AND gate),
+// (*) the multiplication is the bitsliced circuit of GF256_Mul_Circuit (a
+//     Karatsuba split of the carry-less product and its reduction: 48 ANDs
+//     of multiplicative depth 1),
+// (*) the inverse and the S-box go through the bitsliced S-boxes of sbox.hpp.
+//
+// NOTE: on packed bits, XOR is a multiplication (see PackedCryptoBits), so
+// the circuits are run by product depth and never refresh their operands
+// (see prepare_product): the context must be sized for the depth of the
+// operations (see mul_depth, inverse_depth and sbox_depth). x^254 would be
+// about 40 products deep (4 multiplications and 7 squarings), beyond any
+// noise budget, whereas the S-boxes are 16 products deep.
+template <std::size_t pmd = 4096>
+class PackedGF256
+{
+    PackedCryptoBitset<8, pmd> _bits;
+
+    // The bits of a linear map over GF(2), i.e. an XOR network
+    static PackedGF256 apply_network(Circuit const& network, PackedCryptoBitset<8, pmd> const& bits) {
+        return PackedGF256(network.run(bits, prepare_product<pmd>));
+    }
+
+    static Circuit const& mul_circuit() {
+        static const Circuit circuit = record_binary_circuit<8>(
+            GF256_Mul_Circuit<SymbolicBitset<8>>, Circuit::Depth::product);
+        return circuit;
+    }
+
+    // Affine map of the AES S-box, without its constant (a NOT on packed bits)
+    static Circuit const& affine_circuit() {
+        static const Circuit network = XorNetwork::synthesize(AES_SBox_Affine_Matrix).circuit(Circuit::Depth::product);
+        return network;
+    }
+
+    // The networks of the multiplications by the constants 1..255, compiled
+    // once (e.g. MixColumns multiplies by 2 and 3 over and over)
+    static Circuit const& mul_circuit(uint8_t constant) {
+        assert(constant != 0 && "the multiplication by 0 has no network");
+        static const std::vector<Circuit> circuits = []() {
+            std::vector<Circuit> res;
+            res.reserve(255);
+            for (unsigned c = 1; c < 256; c++)
+                res.push_back(gf256_mul_network(static_cast<uint8_t>(c)).circuit(Circuit::Depth::product));
+            return res;
+        }();
+        return circuits[constant - 1];
+    }
+
+public:
+    explicit PackedGF256(PackedCryptoBitset<8, pmd> bits)
+        : _bits(std::move(bits))
+    {
+    }
+
+    // Encrypt bytes[j] in the j-th slot (the unused slots are set to 0)
+    PackedGF256(PackedBitsEncryptionContext<pmd>& ctxt, std::vector<uint8_t> const& bytes)
+        : _bits(ctxt, std::vector<std::bitset<8>>(bytes.cbegin(), bytes.cend()))
+    {
+    }
+
+    // Encrypt the same byte in all the slots
+    PackedGF256(PackedBitsEncryptionContext<pmd>& ctxt, uint8_t broadcastedByte)
+        : _bits(ctxt, std::bitset<8>(broadcastedByte))
+    {
+    }
+
+    // Decrypt all the slots, the j-th returned byte being the one of the j-th slot
+    std::vector<uint8_t> decrypt() {
+        std::vector<uint8_t> bytes;
+        bytes.reserve(nb_values());
+        for (auto const& value : _bits.decrypt())
+            bytes.push_back(static_cast<uint8_t>(value.to_ulong()));
+        return bytes;
+    }
+
+    // Number of bytes processed by each operation
+    std::size_t nb_values() const { return _bits.nb_values(); }
+
+    // Product depths of the operations (see PackedBitsEncryptionContext)
+    static std::size_t mul_depth() { return mul_circuit().depth(); }
+    static std::size_t inverse_depth() {
+        return affine_circuit().depth() + AES128_SBox_Reverse_Compiled(Circuit::Depth::product).depth();
+    }
+    static std::size_t sbox_depth() { return AES128_SBox_Forward_Compiled(Circuit::Depth::product).depth(); }
+
+    PackedCryptoBitset<8, pmd> const& bits() const { return _bits; }
+
+    inline PackedGF256 operator+(PackedGF256 const& rhs) const {
+        _bits.manage_noise(1);
+        rhs._bits.manage_noise(1);
+        return PackedGF256(_bits ^ rhs._bits);
+    }
+
+    inline PackedGF256 operator+(uint8_t rhs) const {
+        return PackedGF256(_bits ^ ClearBitset<8>(rhs));
+    }
+
+    // The operands are joined in a PackedCryptoBitset<16>, as the circuit
+    // is recorded with record_binary_circuit
+    inline PackedGF256 operator*(PackedGF256 const& rhs) const {
+        std::vector<PackedCryptoBitset<8, pmd>> operands = { _bits, rhs._bits };
+        PackedCryptoBitset<16, pmd> joined = PackedCryptoBitset<16, pmd>::template move_and_join<8>(
+            _bits.bit_encryption_context(), operands);
+        return PackedGF256(mul_circuit().run(joined, prepare_product<pmd>).template split<2>()[0]);
+    }
+
+    inline PackedGF256 operator*(uint8_t rhs) const {
+        if (rhs == 0)
+            return PackedGF256(_bits.bit_encryption_context(), uint8_t(0));
+        return apply_network(mul_circuit(rhs), _bits);
+    }
+
+    inline PackedGF256 square() const {
+        static const Circuit network = XorNetwork::synthesize(gf256_square_matrix()).circuit(Circuit::Depth::product);
+        return apply_network(network, _bits);
+    }
+
+    // x^(2^k)
+    inline PackedGF256 square(unsigned k) const {
+        PackedGF256 res(*this);
+        for (unsigned i = 0; i < k; i++)
+            res = res.square();
+        return res;
+    }
+
+    // Inverse (0 for 0): the reverse S-box undoes the affine map of the
+    // S-box, i.e. InvSBox(A.x + 0x63) = x^-1
+    PackedGF256 inverse() const {
+        Circuit const& sbox = AES128_SBox_Reverse_Compiled(Circuit::Depth::product);
+        const PackedGF256 mapped = apply_network(affine_circuit(), _bits) + AES_SBox_Affine_Constant;
+        return PackedGF256(sbox.run(mapped.bits(), prepare_product<pmd>));
+    }
+
+    int min_noise_budget() const { return _bits.min_noise_budget(); }
+
+    void refresh() { _bits.refresh(); }
+};
+
+// Batched AES S-box: the affine map of the AES applied to the inverse in
+// GF(2^8), on all the slots at once (see PackedGF256::sbox_depth)
+template <std::size_t pmd>
+PackedGF256<pmd> HE_GF256_SBox_Forward(PackedGF256<pmd> const& x)
+{
+    Circuit const& sbox = AES128_SBox_Forward_Compiled(Circuit::Depth::product);
+    return PackedGF256<pmd>(sbox.run(x.bits(), prepare_product<pmd>));
+}
+
+#endif
@@ -0,0 +1,70 @@
+#include <algorithm>
+#include <map>
+#include "linearlayer.hpp"
+
+XorNetwork XorNetwork::synthesize(std::vector<std::uint64_t> const& matrix, std::size_t nb_inputs)
+{
+    assert(nb_inputs <= 64);
+    XorNetwork network;
+    network._nb_inputs = nb_inputs;
+
+    // signals still to be XORed in each output (in increasing order)
+    std::vector<std::vector<std::size_t>> rows(matrix.size());
+    for (std::size_t i = 0; i < matrix.size(); i++)
+        for (std::size_t j = 0; j < nb_inputs; j++)
+            if ((matrix[i] >> j) & 1)
+                rows[i].push_back(j);
+
+    while (true) {
+        // the pair of signals shared by the most rows (the first one found
+        // on a tie, such that the network is deterministic)
+        std::map<std::pair<std::size_t, std::size_t>, std::size_t> pair_count;
+        for (auto const& row : rows)
+            for (std::size_t a = 0; a < row.size(); a++)
+                for (std::size_t b = a + 1; b < row.size(); b++)
+                    pair_count[{ row[a], row[b] }]++;
+        if (pair_count.empty())
+            break;
+
+        auto best = pair_count.cbegin();
+        for (auto it = pair_count.cbegin(); it != pair_count.cend(); ++it)
+            if (it->second > best->second)
+                best = it;
+
+        const std::size_t signal = nb_inputs + network._gates.size();
+        network._gates.push_back(best->first);
+        for (auto& row : rows) {
+            auto second = std::find(row.begin(), row.end(), best->first.second);
+            if (second == row.end() ||
+                std::find(row.begin(), row.end(), best->first.first) == row.end())
+                continue;
+            // (the rows stay sorted: the new signal is the last one)
+            row.erase(second);
+            row.erase(std::find(row.begin(), row.end(), best->first.first));
+            row.push_back(signal);
+        }
+    }
+
+    network._outputs.reserve(rows.size());
+    for (auto const& row : rows)
+        network._outputs.push_back(row.empty() ? zero : row[0]);
+    return network;
+}
+
+Circuit XorNetwork::circuit(Circuit::Depth depth) const
+{
+    Circuit res(_nb_inputs);
+    std::vector<Circuit::node_id> signals;
+    signals.reserve(_nb_inputs + _gates.size());
+    for (std::size_t i = 0; i < _nb_inputs; i++)
+        signals.push_back(res.input(i));
+    for (auto const& gate : _gates)
+        signals.push_back(res.add_gate(Circuit::Op::XOR, signals[gate.first], signals[gate.second]));
+
+    for (std::size_t output : _outputs) {
+        assert(output != zero && "a null row has no circuit");
+        res.add_output(signals[output]);
+    }
+    res.compile(depth);
+    return res;
+}
@@ -0,0 +1,177 @@
+#ifndef __LINEAR_LAYER_HPP__
+#define __LINEAR_LAYER_HPP__
+
+#include <assert.h>
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "circuit.hpp"
+#include "circuitstats.hpp"
+
+// Linear maps over GF(2)
+//
+// A map of the bits of a bitset which is linear over GF(2) (e.g. the
+// multiplication by a constant in GF(2^8), MixColumns...) only needs XOR
+// gates: it is described by a matrix and compiled into an XOR network. On
+// encrypted bits, it costs a few ciphertext additions and no multiplication.
+
+// Matrix over GF(2): the bit j of row i is the coefficient of the input bit j
+// in the output bit i (at most 64 inputs)
+template <std::size_t nb_rows>
+using GF2Matrix = std::array<std::uint64_t, nb_rows>;
+
+// Multiplication in GF(2^8) modulo the AES polynomial (0x11b)
+constexpr std::uint8_t gf256_mul(std::uint8_t a, std::uint8_t b)
+{
+    std::uint8_t product = 0;
+    for (unsigned i = 0; i < 8; i++) {
+        if (b & 1)
+            product ^= a;
+        b >>= 1;
+        a = static_cast<std::uint8_t>((a << 1) ^ ((a & 0x80) ? 0x1b : 0x00));
+    }
+    return product;
+}
+
+// Multiplication of a byte by a constant of GF(2^8)
+constexpr GF2Matrix<8> gf256_mul_matrix(std::uint8_t constant)
+{
+    GF2Matrix<8> matrix{};
+    for (unsigned m = 0; m < 8; m++) {
+        const std::uint8_t column = gf256_mul(constant, static_cast<std::uint8_t>(1u << m));
+        for (unsigned k = 0; k < 8; k++)
+            if ((column >> k) & 1)
+                matrix[k] |= std::uint64_t(1) << m;
+    }
+    return matrix;
+}
+
+// Squaring in GF(2^8) (Frobenius map)
+constexpr GF2Matrix<8> gf256_square_matrix()
+{
+    GF2Matrix<8> matrix{};
+    for (unsigned m = 0; m < 8; m++) {
+        const std::uint8_t x = static_cast<std::uint8_t>(1u << m);
+        const std::uint8_t column = gf256_mul(x, x);
+        for (unsigned k = 0; k < 8; k++)
+            if ((column >> k) & 1)
+                matrix[k] |= std::uint64_t(1) << m;
+    }
+    return matrix;
+}
+
+// Linear part of the affine map of the AES S-box (applied to the inverse in
+// GF(2^8)): b_i = x_i ^ x_{i+4} ^ x_{i+5} ^ x_{i+6} ^ x_{i+7} (indices mod 8),
+// the constant being AES_SBox_Affine_Constant
+constexpr GF2Matrix<8> aes_sbox_affine_matrix()
+{
+    GF2Matrix<8> matrix{};
+    for (unsigned i = 0; i < 8; i++)
+        for (unsigned k : { 0u, 4u, 5u, 6u, 7u })
+            matrix[i] |= std::uint64_t(1) << ((i + k) % 8);
+    return matrix;
+}
+
+constexpr GF2Matrix<8> AES_SBox_Affine_Matrix = aes_sbox_affine_matrix();
+constexpr std::uint8_t AES_SBox_Affine_Constant = 0x63;
+
+// Multiplication of a column of 4 bytes by the circulant matrix of GF(2^8)
+// whose first row is "coefficients" (little endian: the byte r of the column
+// is made of the bits 8r to 8r+7)
+constexpr GF2Matrix<32> mix_columns_matrix(std::array<std::uint8_t, 4> const& coefficients)
+{
+    GF2Matrix<32> matrix{};
+    for (unsigned r = 0; r < 4; r++)
+        for (unsigned j = 0; j < 4; j++) {
+            const GF2Matrix<8> block = gf256_mul_matrix(coefficients[(j + 4 - r) % 4]);
+            for (unsigned k = 0; k < 8; k++)
+                matrix[r*8 + k] |= block[k] << (j*8);
+        }
+    return matrix;
+}
+
+constexpr GF2Matrix<32> AES_MixColumns_Matrix    = mix_columns_matrix({ 0x02, 0x03, 0x01, 0x01 });
+constexpr GF2Matrix<32> AES_InvMixColumns_Matrix = mix_columns_matrix({ 0x0e, 0x0b, 0x0d, 0x09 });
+
+// Number of XOR gates of the naive evaluation of a matrix (each row on its own)
+template <std::size_t nb_rows>
+constexpr std::size_t naive_xor_count(GF2Matrix<nb_rows> const& matrix)
+{
+    std::size_t count = 0;
+    for (std::uint64_t row : matrix)
+        for (; row; row &= row - 1)
+            count++;
+    for (std::uint64_t row : matrix)
+        if (row)
+            count--;
+    return count;
+}
+
+// Straight-line XOR program computing a linear map
+//
+// The signals 0 to nb_inputs-1 are the input bits, the signal nb_inputs+g is
+// the output of the gate g (XOR of two previous signals) and each output bit
+// is one of the signals (or 0 for a null row of the matrix).
+class XorNetwork
+{
+public:
+    static constexpr std::size_t zero = static_cast<std::size_t>(-1);
+
+    // Greedy factorization of the pairs of signals shared by the most rows
+    // (Paar's algorithm): the XORs common to several outputs are only
+    // computed once
+    template <std::size_t nb_rows>
+    static XorNetwork synthesize(GF2Matrix<nb_rows> const& matrix, std::size_t nb_inputs = nb_rows)
+    {
+        return synthesize(std::vector<std::uint64_t>(matrix.cbegin(), matrix.cend()), nb_inputs);
+    }
+
+    static XorNetwork synthesize(std::vector<std::uint64_t> const& matrix, std::size_t nb_inputs);
+
+    std::size_t nb_inputs() const { return _nb_inputs; }
+    std::size_t nb_outputs() const { return _outputs.size(); }
+    std::size_t xor_count() const { return _gates.size(); }
+
+    CircuitReport report() const {
+        CircuitReport report;
+        report.xor_count = xor_count();
+        return report;
+    }
+
+    // The network as a compiled Circuit (no null row allowed), e.g. to be
+    // run on packed bits with Depth::product
+    Circuit circuit(Circuit::Depth depth = Circuit::Depth::AND) const;
+
+    // Evaluate the network on any bitset type exposing a bit_type (see the
+    // S-box circuits) with as many inputs as outputs
+    template <typename Bitset>
+    Bitset apply(Bitset const& input) const
+    {
+        using Bit = typename Bitset::bit_type;
+        assert(_nb_inputs == _outputs.size() && "the map must be square");
+
+        std::vector<Bit> signals;
+        signals.reserve(_nb_inputs + _gates.size());
+        for (std::size_t i = 0; i < _nb_inputs; i++)
+            signals.push_back(input[i]);
+        for (auto const& gate : _gates)
+            signals.push_back(signals[gate.first] ^ signals[gate.second]);
+
+        Bitset output(input);
+        for (std::size_t i = 0; i < _outputs.size(); i++) {
+            if (_outputs[i] == zero)
+                output[i].set_to_0();
+            else
+                output[i] = signals[_outputs[i]];
+        }
+        return output;
+    }
+
+private:
+    std::size_t _nb_inputs = 0;
+    std::vector<std::pair<std::size_t, std::size_t>> _gates;
+    std::vector<std::size_t> _outputs;
+};
+
+#endif
@@ -0,0 +1,194 @@
+#include <algorithm>
+#include "lutpolynomial.hpp"
+#include "seal/util/uintarithsmallmod.h"
+
+using namespace seal::util;
+
+IntegerEncryptionContext::IntegerEncryptionContext(std::size_t poly_modulus_degree,
+                                                   std::uint64_t plain_modulus)
+    : _parms(seal::scheme_type::bfv)
+{
+    _parms.set_poly_modulus_degree(poly_modulus_degree);
+    _parms.set_coeff_modulus(seal::CoeffModulus::BFVDefault(poly_modulus_degree));
+    _parms.set_plain_modulus(plain_modulus);
+    _context = std::make_shared<seal::SEALContext>(_parms);
+    // batching needs a prime plain_modulus = 1 mod 2.poly_modulus_degree
+    assert(_context->first_context_data()->qualifiers().using_batching);
+
+    seal::KeyGenerator keygen(*_context);
+    seal::PublicKey public_key;
+    keygen.create_public_key(public_key);
+    keygen.create_relin_keys(_relin_keys);
+    _batch_encoder = std::make_shared<seal::BatchEncoder>(*_context);
+    _encryptor = std::make_shared<seal::Encryptor>(*_context, public_key);
+    _evaluator = std::make_shared<seal::Evaluator>(*_context);
+    _decryptor = std::make_shared<seal::Decryptor>(*_context, keygen.secret_key());
+}
+
+seal::Ciphertext IntegerEncryptionContext::encrypt(std::vector<std::uint64_t> const& values) const
+{
+    assert(values.size() <= slot_count() && "too much values to pack");
+    std::vector<std::uint64_t> slots(values);
+    slots.resize(slot_count(), 0);
+
+    seal::Plaintext plain;
+    seal::Ciphertext encrypted;
+    _batch_encoder->encode(slots, plain);
+    _encryptor->encrypt(plain, encrypted);
+    return encrypted;
+}
+
+seal::Ciphertext IntegerEncryptionContext::encrypt(std::uint64_t broadcastedValue) const
+{
+    return encrypt(std::vector<std::uint64_t>(slot_count(), broadcastedValue));
+}
+
+std::vector<std::uint64_t> IntegerEncryptionContext::decrypt(seal::Ciphertext const& encrypted)
+{
+    seal::Plaintext plain;
+    std::vector<std::uint64_t> values;
+    _decryptor->decrypt(encrypted, plain);
+    _batch_encoder->decode(plain, values);
+    return values;
+}
+
+LUTPolynomial::LUTPolynomial(std::vector<std::uint64_t> const& table, seal::Modulus const& plain_modulus)
+    : _plain_modulus(plain_modulus)
+{
+    std::vector<std::uint64_t> inputs(table.size());
+    for (std::size_t x = 0; x < table.size(); x++)
+        inputs[x] = x;
+    interpolate(inputs, table);
+}
+
+// Newton interpolation: the divided differences give P in the Newton basis
+// (x - x_0)(x - x_1)...(x - x_{i-1}), which is then expanded (Horner)
+void LUTPolynomial::interpolate(std::vector<std::uint64_t> const& inputs,
+                                std::vector<std::uint64_t> const& outputs)
+{
+    assert(inputs.size() == outputs.size() && !inputs.empty());
+    const std::size_t n = inputs.size();
+    const seal::Modulus& p = _plain_modulus;
+
+    std::vector<std::uint64_t> x(n), a(n);
+    for (std::size_t i = 0; i < n; i++) {
+        x[i] = barrett_reduce_64(inputs[i], p);
+        a[i] = barrett_reduce_64(outputs[i], p);
+    }
+
+    for (std::size_t j = 1; j < n; j++)
+        for (std::size_t i = n - 1; i >= j; i--) {
+            std::uint64_t inverse = 0;
+            const bool distinct = try_invert_uint_mod(sub_uint_mod(x[i], x[i - j], p), p, inverse);
+            assert(distinct && "the inputs of the LUT must be distinct");
+            (void)distinct;
+            a[i] = multiply_uint_mod(sub_uint_mod(a[i], a[i - 1], p), inverse, p);
+        }
+
+    // P = a_{n-1}, then P = P.(X - x_i) + a_i
+    _coefficients.assign(1, a[n - 1]);
+    for (std::size_t i = n - 1; i-- > 0; ) {
+        _coefficients.insert(_coefficients.begin(), 0);
+        for (std::size_t d = 0; d + 1 < _coefficients.size(); d++)
+            _coefficients[d] = sub_uint_mod(_coefficients[d], multiply_uint_mod(_coefficients[d + 1], x[i], p), p);
+        _coefficients[0] = add_uint_mod(_coefficients[0], a[i], p);
+    }
+
+    while (_coefficients.size() > 1 && _coefficients.back() == 0)
+        _coefficients.pop_back();
+
+    // degree < k.2^l with k ~ 2^l (a power of two as the baby steps are
+    // computed by halves)
+    std::size_t log_size = 0;
+    while ((std::size_t(1) << log_size) < _coefficients.size())
+        log_size++;
+    _baby_steps = std::size_t(1) << ((log_size + 1) / 2);
+    _giant_steps = log_size - (log_size + 1) / 2;
+}
+
+std::uint64_t LUTPolynomial::evaluate(std::uint64_t x) const
+{
+    x = barrett_reduce_64(x, _plain_modulus);
+    std::uint64_t res = 0;
+    for (auto it = _coefficients.crbegin(); it != _coefficients.crend(); ++it)
+        res = add_uint_mod(multiply_uint_mod(res, x, _plain_modulus), *it, _plain_modulus);
+    return res;
+}
+
+namespace
+{
+    // (a constant plaintext is the same constant in all the slots)
+    seal::Plaintext constant_plaintext(std::uint64_t c)
+    {
+        seal::Plaintext plain(1);
+        plain[0] = c;
+        return plain;
+    }
+
+    // Homomorphic operations of the Paterson-Stockmeyer evaluation
+    struct CiphertextOps
+    {
+        using value = seal::Ciphertext;
+        IntegerEncryptionContext& ctxt;
+
+        value multiply(value const& lhs, value const& rhs) const {
+            value res;
+            if (&lhs == &rhs)
+                ctxt.evaluator().square(lhs, res);
+            else
+                ctxt.evaluator().multiply(lhs, rhs, res);
+            ctxt.evaluator().relinearize_inplace(res, ctxt.relin_keys());
+            return res;
+        }
+
+        value multiply_scalar(value const& term, std::uint64_t c) const {
+            value res;
+            ctxt.evaluator().multiply_plain(term, constant_plaintext(c), res);
+            return res;
+        }
+
+        void add_inplace(value& acc, value const& term) const {
+            ctxt.evaluator().add_inplace(acc, term);
+        }
+
+        void add_scalar_inplace(value& acc, std::uint64_t c) const {
+            ctxt.evaluator().add_plain_inplace(acc, constant_plaintext(c));
+        }
+
+        value constant(value const&, std::uint64_t c) const {
+            return ctxt.encrypt(c);
+        }
+    };
+
+    // Cost of the same evaluation: the value is the multiplicative depth
+    struct CostOps
+    {
+        using value = std::size_t;
+        CircuitReport& report;
+
+        value multiply(value lhs, value rhs) const {
+            report.and_count++;
+            return std::max(lhs, rhs) + 1;
+        }
+
+        value multiply_scalar(value term, std::uint64_t) const { return term; }
+        void add_inplace(value& acc, value term) const { acc = std::max(acc, term); }
+        void add_scalar_inplace(value&, std::uint64_t) const {}
+        value constant(value, std::uint64_t) const { return 0; }
+    };
+}
+
+seal::Ciphertext LUTPolynomial::evaluate(IntegerEncryptionContext& ctxt, seal::Ciphertext const& x) const
+{
+    assert(ctxt.plain_modulus() == _plain_modulus);
+    CiphertextOps ops{ ctxt };
+    return paterson_stockmeyer(ops, x);
+}
+
+CircuitReport LUTPolynomial::report() const
+{
+    CircuitReport report;
+    CostOps ops{ report };
+    report.and_depth = paterson_stockmeyer(ops, 0);
+    return report;
+}
@@ -0,0 +1,211 @@
+#ifndef __LUT_POLYNOMIAL_HPP__
+#define __LUT_POLYNOMIAL_HPP__
+
+#include <assert.h>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+#include "circuitstats.hpp"
+#include "lut.hpp"
+#include "seal_include.hpp"
+
+// Encryption of integers modulo a prime plain_modulus, one value per slot
+//
+// Unlike the bit layer (plain_modulus == 2), a byte is encrypted as a single
+// integer: a LUT on bytes is then a polynomial of degree < 256 over Z_p (see
+// LUTPolynomial) and is evaluated on all the slots at once. The default
+// plain_modulus 65537 allows batching for any poly_modulus_degree, and
+// 16384 leaves enough noise budget for the depth of a 8-bit LUT.
+class IntegerEncryptionContext
+{
+    seal::EncryptionParameters _parms;
+    seal::RelinKeys _relin_keys;
+
+    std::shared_ptr<seal::SEALContext > _context;
+    std::shared_ptr<seal::BatchEncoder> _batch_encoder;
+    std::shared_ptr<seal::Encryptor   > _encryptor;
+    std::shared_ptr<seal::Evaluator   > _evaluator;
+    std::shared_ptr<seal::Decryptor   > _decryptor;
+
+public:
+    explicit IntegerEncryptionContext(std::size_t poly_modulus_degree = 16384,
+                                      std::uint64_t plain_modulus = 65537);
+
+    // Encrypt values[j] in the j-th slot (the unused slots are set to 0)
+    seal::Ciphertext encrypt(std::vector<std::uint64_t> const& values) const;
+
+    // Encrypt the same value in all the slots
+    seal::Ciphertext encrypt(std::uint64_t broadcastedValue) const;
+
+    std::vector<std::uint64_t> decrypt(seal::Ciphertext const& encrypted);
+
+    int noise_budget(seal::Ciphertext const& encrypted) {
+        return _decryptor->invariant_noise_budget(encrypted);
+    }
+
+    inline const seal::Modulus& plain_modulus() const {
+        return _parms.plain_modulus();
+    }
+
+    inline std::size_t slot_count() const {
+        return _batch_encoder->slot_count();
+    }
+
+    inline const seal::Evaluator& evaluator() const {
+        return *_evaluator.get();
+    }
+
+    inline const seal::RelinKeys& relin_keys() const {
+        return _relin_keys;
+    }
+};
+
+// LUT interpolated as a polynomial over Z_p
+//
+// The polynomial P of degree < n takes the output of the LUT on each of its
+// n inputs. It is evaluated by the Paterson-Stockmeyer algorithm: with
+// n <= k.2^l, P is split into 2^l polynomials of degree < k in x, combined
+// by the powers x^k, x^2k, x^4k... (P = Q.x^(k.2^(l-1)) + R, recursively).
+// It costs k-1 multiplications for the baby steps x^2..x^k, l-1 for the
+// giant steps and 2^l-1 for the recursion, i.e. about 2.sqrt(n) nonscalar
+// multiplications: 33 for a 8-bit LUT instead of thousands of AND gates.
+// The other operations are multiplications by constants (multiply_plain)
+// and additions.
+class LUTPolynomial
+{
+public:
+    // Interpolate the LUT table[x] for x in [0, table.size())
+    LUTPolynomial(std::vector<std::uint64_t> const& table, seal::Modulus const& plain_modulus);
+
+    // Interpolate the LUT entries (the other inputs give any value)
+    template <typename dataType>
+    LUTPolynomial(std::vector<LUTEntry<dataType>> const& entries, seal::Modulus const& plain_modulus);
+
+    // Coefficients in increasing degree (without the null leading ones)
+    std::vector<std::uint64_t> const& coefficients() const { return _coefficients; }
+
+    std::size_t degree() const {
+        return _coefficients.empty() ? 0 : _coefficients.size() - 1;
+    }
+
+    // Clear evaluation (Horner)
+    std::uint64_t evaluate(std::uint64_t x) const;
+
+    // Homomorphic evaluation on each slot of "x"
+    seal::Ciphertext evaluate(IntegerEncryptionContext& ctxt, seal::Ciphertext const& x) const;
+
+    // Nonscalar multiplications (and_count) and multiplicative depth
+    // (and_depth) of the homomorphic evaluation
+    CircuitReport report() const;
+
+private:
+    void interpolate(std::vector<std::uint64_t> const& inputs, std::vector<std::uint64_t> const& outputs);
+
+    template <typename Ops>
+    typename Ops::value paterson_stockmeyer(Ops& ops, typename Ops::value const& x) const;
+
+    seal::Modulus _plain_modulus;
+    std::vector<std::uint64_t> _coefficients;
+    // Paterson-Stockmeyer parameters: degree < k.2^l
+    std::size_t _baby_steps = 1;
+    std::size_t _giant_steps = 0;
+};
+
+// Template Definitions
+//
+template <typename dataType>
+LUTPolynomial::LUTPolynomial(std::vector<LUTEntry<dataType>> const& entries,
+                             seal::Modulus const& plain_modulus)
+    : _plain_modulus(plain_modulus)
+{
+    std::vector<std::uint64_t> inputs, outputs;
+    inputs.reserve(entries.size());
+    outputs.reserve(entries.size());
+    for (auto const& entry : entries) {
+        inputs.push_back(static_cast<std::uint64_t>(entry.getInput()));
+        outputs.push_back(static_cast<std::uint64_t>(entry.getOutput()));
+    }
+    interpolate(inputs, outputs);
+}
+
+// P = sum(Q_i(x).x^(k.i)) where each Q_i is of degree < k
+//
+// The operations (Ops) are either the homomorphic ones or their cost only
+// (see report()). A partial result is kept as "encrypted + constant" so the
+// constants are only added (add_plain) once, at the end.
+template <typename Ops>
+typename Ops::value LUTPolynomial::paterson_stockmeyer(Ops& ops, typename Ops::value const& x) const
+{
+    using value = typename Ops::value;
+    struct Partial
+    {
+        std::optional<value> encrypted;
+        std::uint64_t constant = 0;
+    };
+
+    const std::size_t k = _baby_steps;
+
+    // Baby steps: x^i = x^(i/2).x^(i - i/2), of depth ceil(log2(i))
+    std::vector<std::optional<value>> powers(k + 1);
+    powers[1] = x;
+    for (std::size_t i = 2; i <= k; i++)
+        powers[i] = ops.multiply(*powers[i / 2], *powers[i - i / 2]);
+
+    // Giant steps: x^k, x^2k, x^4k...
+    std::vector<value> giants;
+    if (_giant_steps > 0) {
+        giants.push_back(*powers[k]);
+        for (std::size_t j = 1; j < _giant_steps; j++)
+            giants.push_back(ops.multiply(giants.back(), giants.back()));
+    }
+
+    // acc += c.term
+    auto accumulate = [&ops](std::optional<value>& acc, value const& term, std::uint64_t c) {
+        if (c == 0)
+            return;
+        value scaled = ops.multiply_scalar(term, c);
+        if (acc)
+            ops.add_inplace(*acc, scaled);
+        else
+            acc = std::move(scaled);
+    };
+
+    // Evaluation of the coefficients [begin, begin + k.2^level)
+    auto evaluate = [&](auto& self, std::size_t begin, std::size_t level) -> Partial {
+        Partial res;
+        if (level == 0) {
+            res.constant = _coefficients[begin];
+            for (std::size_t i = 1; i < k && begin + i < _coefficients.size(); i++)
+                accumulate(res.encrypted, *powers[i], _coefficients[begin + i]);
+            return res;
+        }
+
+        const std::size_t half = k << (level - 1);
+        res = self(self, begin, level - 1);
+        if (begin + half >= _coefficients.size())
+            return res;
+
+        // res += high.x^half
+        Partial high = self(self, begin + half, level - 1);
+        value const& giant = giants[level - 1];
+        if (high.encrypted) {
+            value product = ops.multiply(*high.encrypted, giant);
+            if (res.encrypted)
+                ops.add_inplace(*res.encrypted, product);
+            else
+                res.encrypted = std::move(product);
+        }
+        accumulate(res.encrypted, giant, high.constant);
+        return res;
+    };
+
+    Partial res = evaluate(evaluate, 0, _giant_steps);
+    if (!res.encrypted)
+        return ops.constant(x, res.constant);
+    if (res.constant)
+        ops.add_scalar_inplace(*res.encrypted, res.constant);
+    return *res.encrypted;
+}
+
+#endif
@@ -0,0 +1,172 @@
+#include <assert.h>
+#include <algorithm>
+#include "noiseplanner.hpp"
+
+namespace
+{
+    // (a third of the modulus for the smallest degrees, as BFVDefault)
+    int special_prime_bits(std::size_t poly_modulus_degree)
+    {
+        return std::min(60, seal::CoeffModulus::MaxBitCount(poly_modulus_degree) / 3);
+    }
+
+    std::size_t depth_capacity(int data_bits, NoiseModel const& model, int margin)
+    {
+        const int budget = data_bits - model.fresh_gap - margin;
+        return (budget > 0) ? budget / model.bits_per_and : 0;
+    }
+
+    // Plan with the least data primes covering the depth (or with all the
+    // modulus allowed by the security level if "force")
+    bool try_plan(std::size_t and_depth, NoiseModel const& model, int margin, bool force, LevelPlan& plan)
+    {
+        const std::size_t n = model.poly_modulus_degree;
+        const int special = special_prime_bits(n);
+        const int max_data_bits = seal::CoeffModulus::MaxBitCount(n) - special;
+
+        const int needed = std::min(max_data_bits,
+            model.fresh_gap + static_cast<int>(and_depth) * model.bits_per_and + margin);
+        const int nb_primes = (needed + special - 1) / special;
+        int prime_bits = std::max((needed + nb_primes - 1) / nb_primes, 30);
+        if (prime_bits * nb_primes > max_data_bits)
+            prime_bits = max_data_bits / nb_primes;
+
+        const std::size_t capacity = depth_capacity(prime_bits * nb_primes, model, margin);
+        if (capacity == 0 || (capacity < and_depth && !force))
+            return false;
+
+        plan.poly_modulus_degree = n;
+        plan.coeff_modulus_bits.assign(nb_primes, prime_bits);
+        plan.coeff_modulus_bits.push_back(special);
+        plan.model = model;
+        plan.margin = margin;
+        plan.and_depth = and_depth;
+        plan.depth_capacity = capacity;
+        return true;
+    }
+
+    // (see measure_noise_model and measure_packed_noise_model)
+    NoiseModel measure(std::size_t poly_modulus_degree, seal::Modulus const& plain_modulus)
+    {
+        seal::EncryptionParameters parms(seal::scheme_type::bfv);
+        parms.set_poly_modulus_degree(poly_modulus_degree);
+        parms.set_coeff_modulus(seal::CoeffModulus::BFVDefault(poly_modulus_degree));
+        parms.set_plain_modulus(plain_modulus);
+
+        seal::SEALContext context(parms);
+        assert(context.using_keyswitching() && "at least two primes are needed");
+        seal::KeyGenerator keygen(context);
+        seal::PublicKey public_key;
+        seal::RelinKeys relin_keys;
+        keygen.create_public_key(public_key);
+        keygen.create_relin_keys(relin_keys);
+
+        seal::Encryptor encryptor(context, public_key);
+        seal::Decryptor decryptor(context, keygen.secret_key());
+        seal::Evaluator evaluator(context);
+
+        auto data_bits = [&](seal::Ciphertext const& encrypted) {
+            return context.get_context_data(encrypted.parms_id())->total_coeff_modulus_bit_count();
+        };
+
+        NoiseModel model;
+        model.poly_modulus_degree = poly_modulus_degree;
+
+        seal::Ciphertext encrypted;
+        encryptor.encrypt(seal::Plaintext("1"), encrypted);
+        model.fresh_gap = data_bits(encrypted) - decryptor.invariant_noise_budget(encrypted);
+
+        seal::Ciphertext switched(encrypted);
+        evaluator.mod_switch_to_next_inplace(switched);
+        model.fresh_gap = std::max(model.fresh_gap,
+                                   data_bits(switched) - decryptor.invariant_noise_budget(switched));
+
+        // (the worst of a few AND levels)
+        for (int i = 0; i < 3; i++) {
+            const int budget = decryptor.invariant_noise_budget(encrypted);
+            evaluator.multiply_inplace(encrypted, encrypted);
+            evaluator.relinearize_inplace(encrypted, relin_keys);
+            model.bits_per_and = std::max(model.bits_per_and,
+                                          budget - decryptor.invariant_noise_budget(encrypted));
+        }
+        return model;
+    }
+}
+
+NoiseModel measure_noise_model(std::size_t poly_modulus_degree)
+{
+    return measure(poly_modulus_degree, 2);
+}
+
+NoiseModel measure_packed_noise_model(std::size_t poly_modulus_degree, int plain_modulus_bits)
+{
+    return measure(poly_modulus_degree, seal::PlainModulus::Batching(poly_modulus_degree, plain_modulus_bits));
+}
+
+int LevelPlan::data_bits(std::size_t level) const
+{
+    assert(level <= nb_levels());
+    int bits = 0;
+    for (std::size_t i = 0; i + level < coeff_modulus_bits.size() - 1; i++)
+        bits += coeff_modulus_bits[i];
+    return bits;
+}
+
+std::size_t LevelPlan::level_for_depth(std::size_t depth) const
+{
+    const int budget = data_bits(0) - model.fresh_gap - static_cast<int>(depth) * model.bits_per_and;
+
+    std::size_t level = 0;
+    while (level < nb_levels() && data_bits(level + 1) - model.fresh_gap >= budget)
+        level++;
+    return level;
+}
+
+std::ostream& operator<<(std::ostream& os, LevelPlan const& plan)
+{
+    os << "poly_modulus_degree: " << plan.poly_modulus_degree << ", coeff_modulus: {";
+    for (std::size_t i = 0; i < plan.coeff_modulus_bits.size(); i++)
+        os << (i ? ", " : "") << plan.coeff_modulus_bits[i];
+    return os << "}, AND depth: " << plan.and_depth
+              << ", capacity: " << plan.depth_capacity
+              << ", refresh: " << plan.refresh_count();
+}
+
+LevelPlan plan_levels(std::size_t and_depth, std::vector<NoiseModel> const& models, int margin)
+{
+    assert(!models.empty());
+    LevelPlan plan;
+    for (auto const& model : models)
+        if (try_plan(and_depth, model, margin, false, plan))
+            return plan;
+
+    // no parameters without refresh: the largest ones
+    try_plan(and_depth, models.back(), margin, true, plan);
+    return plan;
+}
+
+LevelPlan plan_levels(std::size_t and_depth, int margin, std::vector<std::size_t> const& degrees)
+{
+    // (the models are only measured up to the first degree large enough)
+    std::vector<NoiseModel> models;
+    LevelPlan plan;
+    for (std::size_t n : degrees) {
+        models.push_back(measure_noise_model(n));
+        if (try_plan(and_depth, models.back(), margin, false, plan))
+            return plan;
+    }
+    return plan_levels(and_depth, models, margin);
+}
+
+LevelPlan plan_for_modulus(std::vector<int> const& coeff_modulus_bits, NoiseModel const& model, int margin)
+{
+    assert(coeff_modulus_bits.size() >= 2);
+    LevelPlan plan;
+    plan.poly_modulus_degree = model.poly_modulus_degree;
+    plan.coeff_modulus_bits = coeff_modulus_bits;
+    plan.model = model;
+    plan.margin = margin;
+    plan.depth_capacity = depth_capacity(plan.data_bits(0), model, margin);
+    plan.and_depth = plan.depth_capacity;
+    return plan;
+}
@@ -0,0 +1,86 @@
+#ifndef __NOISE_PLANNER_HPP__
+#define __NOISE_PLANNER_HPP__
+
+#include <iostream>
+#include <vector>
+#include "seal_include.hpp"
+
+// Noise growth of the bit encryption (BFV with plain_modulus == 2) for a
+// given poly_modulus_degree, in bits of noise budget
+struct NoiseModel
+{
+    std::size_t poly_modulus_degree = 0;
+    // log2(q) - noise budget of a fresh ciphertext (or of a ciphertext just
+    // switched to a smaller modulus, which is capped the same way)
+    int fresh_gap = 0;
+    // noise budget consumed by one level of AND gates (mult. + relin.)
+    int bits_per_and = 0;
+};
+
+// Measure the noise model on actual ciphertexts (encryption, squarings and
+// modulus switchings with the default coefficient modulus)
+NoiseModel measure_noise_model(std::size_t poly_modulus_degree);
+
+// Same for the packed bits (see PackedBitsEncryptionContext): the plain
+// modulus is a batching prime of plain_modulus_bits bits, and a product
+// (i.e. any gate but NOT, XOR being x + y - 2xy) stands for an AND level
+NoiseModel measure_packed_noise_model(std::size_t poly_modulus_degree, int plain_modulus_bits = 20);
+
+// Parameters of a BitEncryptionContext for a circuit of a given AND depth
+//
+// The coefficient modulus is a chain of data primes followed by the special
+// prime (used by the relinearization only). A fresh ciphertext has
+// data_bits(0) - fresh_gap bits of budget and each AND level consumes
+// bits_per_and of it. Once the remaining budget fits under the cap of a
+// smaller modulus, the ciphertext is switched down (mod_switch_to_next):
+// the noise budget is kept while the next gates run on less RNS primes.
+//
+// The circuit runs without refresh iff its depth fits in depth_capacity: as
+// a refresh needs the secret key, the planner picks the smallest parameters
+// (i.e. the fastest ones) without refresh, and otherwise the largest ones
+// (i.e. the least refresh).
+struct LevelPlan
+{
+    std::size_t poly_modulus_degree = 0;
+    // the data primes then the special prime
+    std::vector<int> coeff_modulus_bits;
+    NoiseModel model;
+    int margin = 0;
+    // AND depth of the planned circuit
+    std::size_t and_depth = 0;
+    // AND depth a fresh ciphertext can go through before a refresh
+    std::size_t depth_capacity = 0;
+
+    // Number of primes which can be dropped (modulus switchings)
+    inline std::size_t nb_levels() const { return coeff_modulus_bits.size() - 2; }
+
+    // Total size of the data primes at a level (0 is the top one)
+    int data_bits(std::size_t level) const;
+
+    // Lowest level at which a ciphertext of the given AND depth (since its
+    // last encryption/refresh) can be without any loss of noise budget
+    std::size_t level_for_depth(std::size_t depth) const;
+
+    // Number of refresh the circuit needs
+    inline std::size_t refresh_count() const {
+        if (and_depth == 0 || depth_capacity == 0)
+            return 0;
+        return (and_depth + depth_capacity - 1) / depth_capacity - 1;
+    }
+};
+
+std::ostream& operator<<(std::ostream& os, LevelPlan const& plan);
+
+// Plan the parameters for a circuit of AND depth "and_depth" (see
+// trace_circuit), trying the poly_modulus_degree in increasing order
+LevelPlan plan_levels(std::size_t and_depth, int margin = 10,
+                      std::vector<std::size_t> const& degrees = { 4096, 8192, 16384, 32768 });
+
+// Same with already measured noise models (in increasing poly_modulus_degree)
+LevelPlan plan_levels(std::size_t and_depth, std::vector<NoiseModel> const& models, int margin = 10);
+
+// Plan of an existing coefficient modulus (e.g. CoeffModulus::BFVDefault):
+// the circuit depth is the capacity of the modulus
+LevelPlan plan_for_modulus(std::vector<int> const& coeff_modulus_bits, NoiseModel const& model, int margin = 10);
+
+#endif
@@ -3,18 +3,32 @@
 
 #include <future>
 #include <iostream>
+#include "circuit.hpp"
+#include "circuitstats.hpp"
 #include "encryptionlayer.hpp"
 #include "lut.hpp"
 
+// Evaluation strategy of a S-box given by value (LUT):
+// (*) sequential: each LUT entry is matched by a chain of bitsize-1 ANDs and
+//     its (encrypted) output is selected by a last AND, i.e. a multiplicative
+//     depth of bitsize per entry.
+// (*) depth_optimized: each entry is matched by a balanced tree of ANDs on
+//     (input XOR ~lutin) and the match is XORed in the output bits set in
+//     lutout. The LUT is kept in clear: the depth is ceil(log2(bitsize)).
+enum class S_BoxCircuit { sequential, depth_optimized };
+
 template <typename dataType, size_t bitsize>
 class S_Box
 {
     enum class S_BoxType { by_value, by_functions } _type;
+    S_BoxCircuit _circuit = S_BoxCircuit::sequential;
     std::function<CryptoBitset<bitsize>
                   (const CryptoBitset<bitsize>&)> _operations;
         std::function<CryptoBitset<bitsize>
                   (const CryptoBitset<bitsize>&)> _operations_reverse;
     std::vector<LUTEntry<dataType>> _entries;
+    CircuitReport _report;
+    CircuitReport _report_reverse;
 public:
     template<typename... T>
     S_Box(const LUTEntry<dataType>& first, const T&... s) 
@@ -24,13 +38,35 @@ public:
         _entries.insert(_entries.begin(), first);
     }
 
+    // The reports of the circuits (see trace_circuit()) are only informative
     S_Box(std::function<CryptoBitset<bitsize>
                        (const CryptoBitset<bitsize>&)> operations,
           std::function<CryptoBitset<bitsize>
-                       (const CryptoBitset<bitsize>&)> operations_reverse)
+                       (const CryptoBitset<bitsize>&)> operations_reverse,
+          CircuitReport report = CircuitReport(),
+          CircuitReport report_reverse = CircuitReport())
         : _type(S_BoxType::by_functions), _operations(operations), 
-          _operations_reverse(operations_reverse)
+          _operations_reverse(operations_reverse),
+          _report(report), _report_reverse(report_reverse)
+    {
+    }
+
+    // Select how a S-box given by value is evaluated (no effect on a S-box
+    // given by functions: the depth is then the one of the functions)
+    void select_circuit(S_BoxCircuit circuit) { _circuit = circuit; }
+
+    S_BoxCircuit circuit() const { return _circuit; }
+
+    // AND count and multiplicative depth of apply()
+    CircuitReport report() const
     {
+        return (_type == S_BoxType::by_value) ? lut_report(true) : _report;
+    }
+
+    // AND count and multiplicative depth of reverse()
+    CircuitReport reverse_report() const
+    {
+        return (_type == S_BoxType::by_value) ? lut_report(false) : _report_reverse;
     }
 
 #define AND   &
@@ -41,7 +77,10 @@ public:
     CryptoBitset<bitsize>
     apply(BitEncryptionContext& ctxt, const CryptoBitset<bitsize>& input) const
     {
-        if (_type == S_BoxType::by_value) {
+        if (_type == S_BoxType::by_value && _circuit == S_BoxCircuit::depth_optimized) {
+            return apply_depth_optimized(ctxt, input, true);
+        }
+        else if (_type == S_BoxType::by_value) {
             CryptoBitset<bitsize> lutin (ctxt, _entries[0].getInput() );
             CryptoBitset<bitsize> lutout(ctxt, _entries[0].getOutput());
             CryptoBitset<bitsize> output((lutin XNOR input).apply_seq_AND() AND lutout);
@@ -61,7 +100,10 @@ public:
     CryptoBitset<bitsize>
     reverse(BitEncryptionContext& ctxt, const CryptoBitset<bitsize>& input) const
     {
-        if (_type == S_BoxType::by_value) {
+        if (_type == S_BoxType::by_value && _circuit == S_BoxCircuit::depth_optimized) {
+            return apply_depth_optimized(ctxt, input, false);
+        }
+        else if (_type == S_BoxType::by_value) {
             CryptoBitset<bitsize> lutout(ctxt, _entries[0].getInput() );
             CryptoBitset<bitsize> lutin (ctxt, _entries[0].getOutput());
             CryptoBitset<bitsize> output((lutin XNOR input).apply_seq_AND() AND lutout);
@@ -82,8 +124,382 @@ public:
 #undef XNOR
 #undef XOR
 
+private:
+    CryptoBitset<bitsize>
+    apply_depth_optimized(BitEncryptionContext& ctxt, const CryptoBitset<bitsize>& input,
+                          bool forward) const
+    {
+        CryptoBitset<bitsize> output(ctxt);
+        std::vector<std::unique_ptr<CryptoBit>> matches(_entries.size());
+
+        // the entries are matched independently (one task per entry)
+        default_scheduler().parallel_for(0, _entries.size(), [&](size_t k) {
+            const std::bitset<bitsize> lutin(forward ? _entries[k].getInput() : _entries[k].getOutput());
+            // input ^ ~lutin is all ones iff input == lutin
+            matches[k] = std::make_unique<CryptoBit>(
+                (input ^ ClearBitset<bitsize>(~lutin)).tree_AND());
+        });
+
+        for (size_t k = 0; k < _entries.size(); k++) {
+            const std::bitset<bitsize> lutout(forward ? _entries[k].getOutput() : _entries[k].getInput());
+            for (size_t i = 0; i < bitsize; i++)
+                if (lutout[i])
+                    output[i] = output[i] ^ *matches[k];
+        }
+        return output;
+    }
+
+    CircuitReport lut_report(bool forward) const
+    {
+        CircuitReport report;
+        size_t tree_depth = 0;
+        while ((size_t(1) << tree_depth) < bitsize)
+            tree_depth++;
+
+        for (size_t k = 0; k < _entries.size(); k++) {
+            const std::bitset<bitsize> lutin (forward ? _entries[k].getInput()  : _entries[k].getOutput());
+            const std::bitset<bitsize> lutout(forward ? _entries[k].getOutput() : _entries[k].getInput());
+
+            if (_circuit == S_BoxCircuit::depth_optimized) {
+                // XOR with the clear ~lutin (a NOT where lutin is 0), tree of
+                // ANDs and XOR of the match in the output bits set in lutout
+                report.and_count += bitsize - 1;
+                report.not_count += bitsize - lutin.count();
+                report.xor_count += lutout.count();
+            }
+            else {
+                // XNOR with lutin, chain of ANDs, AND with lutout and XOR in
+                // the output (the first entry is the output itself)
+                report.and_count += 2*bitsize - 1;
+                report.xor_count += k ? 2*bitsize : bitsize;
+                report.not_count += bitsize;
+            }
+        }
+        report.and_depth = (_circuit == S_BoxCircuit::depth_optimized) ? tree_depth : bitsize;
+        return report;
+    }
 };
 
+// Bit-sliced circuits of the AES S-box (and of its inverse)
+//
+// These circuits are written once for any bitset type exposing a bit_type
+// (CryptoBitset<8>, PackedCryptoBitset<8, pmd>...) such that the same gates
+// can be evaluated either on one encrypted byte or on a whole batch of bytes
+// packed in the slots of the ciphertexts.
+template <typename Bitset>
+Bitset AES_SBox_Forward_Circuit(const Bitset& input)
+{
+    using Bit = typename Bitset::bit_type;
+
+    Bitset output(input);
+    // Top linear transform in forward direction
+    // Note: little endian encoding needs some tweaks
+    Bit U0 = input[7];
+    Bit U1 = input[6];
+    Bit U2 = input[5];
+    Bit U3 = input[4];
+    Bit U4 = input[3];
+    Bit U5 = input[2];
+    Bit U6 = input[1];
+    Bit U7 = input[0];
+
+#define XOR(R0, R1, R2) const Bit R0 = R1 ^ R2
+#define AND(R0, R1, R2) const Bit R0 = R1 & R2
+
+    XOR( T1,  U0,  U3);
+    XOR( T2,  U0,  U5);
+    XOR( T3,  U0,  U6);
+    XOR( T4,  U3,  U5);
+    XOR( T5,  U4,  U6);
+    XOR( T6,  T1,  T5);
+    XOR( T7,  U1,  U2);
+    XOR( T8,  U7,  T6);
+    XOR( T9,  U7,  T7);
+    XOR(T10,  T6,  T7);
+    XOR(T11,  U1,  U5);
+    XOR(T12,  U2,  U5);
+    XOR(T13,  T3,  T4);
+    XOR(T14,  T6, T11);
+    XOR(T15,  T5, T11);
+    XOR(T16,  T5, T12);
+    XOR(T17,  T9, T16);
+    XOR(T18,  U3,  U7);
+    XOR(T19,  T7, T18);
+    XOR(T20,  T1, T19);
+    XOR(T21,  U6,  U7);
+    XOR(T22,  T7, T21);
+    XOR(T23,  T2, T22);
+    XOR(T24,  T2, T10);
+    XOR(T25, T20, T17);
+    XOR(T26,  T3, T16);
+    XOR(T27,  T1, T12);
+
+    // Shared part of AES S-box circuit
+    Bit D = U7;
+    AND(M1,  T13,  T6);
+    AND(M2,  T23,  T8);
+    XOR(M3,  T14,  M1);
+    AND(M4,  T19,   D);
+    XOR(M5,   M4,  M1);
+    AND(M6,   T3, T16);
+    AND(M7,  T22,  T9);
+    XOR(M8,  T26,  M6);
+    AND(M9,  T20, T17);
+    XOR(M10,  M9,  M6);
+    AND(M11,  T1, T15);
+    AND(M12,  T4, T27);
+    XOR(M13, M12, M11);
+    AND(M14,  T2, T10);
+    XOR(M15, M14, M11);
+    XOR(M16,  M3,  M2);
+    XOR(M17,  M5, T24);
+    XOR(M18,  M8,  M7);
+    XOR(M19, M10, M15);
+    XOR(M20, M16, M13);
+    XOR(M21, M17, M15);
+    XOR(M22, M18, M13);
+    XOR(M23, M19, T25);
+    XOR(M24, M22, M23);
+    AND(M25, M22, M20);
+    XOR(M26, M21, M25);
+    XOR(M27, M20, M21);
+    XOR(M28, M23, M25);
+    AND(M29, M28, M27);
+    AND(M30, M26, M24);
+    AND(M31, M20, M23);
+    AND(M32, M27, M31);
+    XOR(M33, M27, M25);
+    AND(M34, M21, M22);
+    AND(M35, M24, M34);
+    XOR(M36, M24, M25);
+    XOR(M37, M21, M29);
+    XOR(M38, M32, M33);
+    XOR(M39, M23, M30);
+    XOR(M40, M35, M36);
+    XOR(M41, M38, M40);
+    XOR(M42, M37, M39);
+    XOR(M43, M37, M38);
+    XOR(M44, M39, M40);
+    XOR(M45, M42, M41);
+    AND(M46, M44,  T6);
+    AND(M47, M40,  T8);
+    AND(M48, M39,   D);
+    AND(M49, M43, T16);
+    AND(M50, M38,  T9);
+    AND(M51, M37, T17);
+    AND(M52, M42, T15);
+    AND(M53, M45, T27);
+    AND(M54, M41, T10);
+    AND(M55, M44, T13);
+    AND(M56, M40, T23);
+    AND(M57, M39, T19);
+    AND(M58, M43,  T3);
+    AND(M59, M38, T22);
+    AND(M60, M37, T20);
+    AND(M61, M42,  T1);
+    AND(M62, M45,  T4);
+    AND(M63, M41,  T2);
+
+    // Bottom linear transform in forward direction
+    XOR( L0, M61, M62);
+    XOR( L1, M50, M56);
+    XOR( L2, M46, M48);
+    XOR( L3, M47, M55);
+    XOR( L4, M54, M58);
+    XOR( L5, M49, M61);
+    XOR( L6, M62,  L5);
+    XOR( L7, M46,  L3);
+    XOR( L8, M51, M59);
+    XOR( L9, M52, M53);
+    XOR(L10, M53,  L4);
+    XOR(L11, M60,  L2);
+    XOR(L12, M48, M51);
+    XOR(L13, M50,  L0);
+    XOR(L14, M52, M61);
+    XOR(L15, M55,  L1);
+    XOR(L16, M56,  L0);
+    XOR(L17, M57,  L1);
+    XOR(L18, M58,  L8);
+    XOR(L19, M63,  L4);
+    XOR(L20,  L0,  L1);
+    XOR(L21,  L1,  L7);
+    XOR(L22,  L3, L12);
+    XOR(L23, L18,  L2);
+    XOR(L24, L15,  L9);
+    XOR(L25,  L6, L10);
+    XOR(L26,  L7,  L9);
+    XOR(L27,  L8, L10);
+    XOR(L28, L11, L14);
+    XOR(L29, L11, L17);
+
+#undef XOR
+#undef AND
+
+    output[7] = L6 ^ L24;
+    output[6] = L16.xnor_op(L26);
+    output[5] = L19.xnor_op(L28);
+    output[4] = L6 ^ L21;
+    output[3] = L20 ^ L22;
+    output[2] = L25 ^ L29;
+    output[1] = L13.xnor_op(L27);
+    output[0] = L6.xnor_op(L23);
+    return output;
+}
+
+template <typename Bitset>
+Bitset AES_SBox_Reverse_Circuit(const Bitset& input)
+{
+    using Bit = typename Bitset::bit_type;
+
+    Bitset output(input);
+
+    // Top linear transform in reverse direction
+    Bit U0 = input[7];
+    Bit U1 = input[6];
+    Bit U2 = input[5];
+    Bit U3 = input[4];
+    Bit U4 = input[3];
+    Bit U5 = input[2];
+    Bit U6 = input[1];
+    Bit U7 = input[0];
+
+    Bit T23 = U0 ^ U3;
+    Bit T22 = U1.xnor_op(U3);
+    Bit T2 = U0.xnor_op(U1);
+    Bit T1 = U3 ^ U4;
+    Bit T24 = U4.xnor_op(U7);
+    Bit R5 = U6 ^ U7;
+    Bit T8 = U1.xnor_op(T23);
+    Bit T19 = T22 ^ R5;
+    Bit T9 = U7.xnor_op(T1);
+    Bit T10 = T2 ^ T24;
+    Bit T13 = T2 ^ R5;
+    Bit T3 = T1 ^ R5;
+    Bit T25 = U2.xnor_op(T1);
+    Bit R13 = U1 ^ U6;
+    Bit T17 = U2.xnor_op(T19);
+    Bit T20 = T24 ^ R13;
+    Bit T4 = U4 ^ T8;
+    Bit R17 = U2.xnor_op(U5);
+    Bit R18 = U5.xnor_op(U6);
+    Bit R19 = U2.xnor_op(U4);
+    Bit Y5 = U0 ^ R17;
+    Bit T6 = T22 ^ R17;
+    Bit T16 = R13 ^ R19;
+    Bit T27 = T1 ^ R18;
+    Bit T15 = T10 ^ T27;
+    Bit T14 = T10 ^ R18;
+    Bit T26 = T3 ^ T16;
+
+    // Shared part of AES S-box circuit
+    Bit D = Y5;
+    Bit M1 = T13 & T6;
+    Bit M2 = T23 & T8;
+    Bit M3 = T14 ^ M1;
+    Bit M4 = T19 & D;
+    Bit M5 = M4 ^ M1;
+    Bit M6 = T3 & T16;
+    Bit M7 = T22 & T9;
+    Bit M8 = T26 ^ M6;
+    Bit M9 = T20 & T17;
+    Bit M10 = M9 ^ M6;
+    Bit M11 = T1 & T15;
+    Bit M12 = T4 & T27;
+    Bit M13 = M12 ^ M11;
+    Bit M14 = T2 & T10;
+    Bit M15 = M14 ^ M11;
+    Bit M16 = M3 ^ M2;
+    Bit M17 = M5 ^ T24;
+    Bit M18 = M8 ^ M7;
+    Bit M19 = M10 ^ M15;
+    Bit M20 = M16 ^ M13;
+    Bit M21 = M17 ^ M15;
+    Bit M22 = M18 ^ M13;
+    Bit M23 = M19 ^ T25;
+    Bit M24 = M22 ^ M23;
+    Bit M25 = M22 & M20;
+    Bit M26 = M21 ^ M25;
+    Bit M27 = M20 ^ M21;
+    Bit M28 = M23 ^ M25;
+    Bit M29 = M28 & M27;
+    Bit M30 = M26 & M24;
+    Bit M31 = M20 & M23;
+    Bit M32 = M27 & M31;
+    Bit M33 = M27 ^ M25;
+    Bit M34 = M21 & M22;
+    Bit M35 = M24 & M34;
+    Bit M36 = M24 ^ M25;
+    Bit M37 = M21 ^ M29;
+    Bit M38 = M32 ^ M33;
+    Bit M39 = M23 ^ M30;
+    Bit M40 = M35 ^ M36;
+    Bit M41 = M38 ^ M40;
+    Bit M42 = M37 ^ M39;
+    Bit M43 = M37 ^ M38;
+    Bit M44 = M39 ^ M40;
+    Bit M45 = M42 ^ M41;
+    Bit M46 = M44 & T6;
+    Bit M47 = M40 & T8;
+    Bit M48 = M39 & D;
+    Bit M49 = M43 & T16;
+    Bit M50 = M38 & T9;
+    Bit M51 = M37 & T17;
+    Bit M52 = M42 & T15;
+    Bit M53 = M45 & T27;
+    Bit M54 = M41 & T10;
+    Bit M55 = M44 & T13;
+    Bit M56 = M40 & T23;
+    Bit M57 = M39 & T19;
+    Bit M58 = M43 & T3;
+    Bit M59 = M38 & T22;
+    Bit M60 = M37 & T20;
+    Bit M61 = M42 & T1;
+    Bit M62 = M45 & T4;
+    Bit M63 = M41 & T2;
+
+    // Bottom linear transform in reverse direction
+    Bit P0 = M52 ^ M61;
+    Bit P1 = M58 ^ M59;
+    Bit P2 = M54 ^ M62;
+    Bit P3 = M47 ^ M50;
+    Bit P4 = M48 ^ M56;
+    Bit P5 = M46 ^ M51;
+    Bit P6 = M49 ^ M60;
+    Bit P7 = P0 ^ P1;
+    Bit P8 = M50 ^ M53;
+    Bit P9 = M55 ^ M63;
+    Bit P10 = M57 ^ P4;
+    Bit P11 = P0 ^ P3;
+    Bit P12 = M46 ^ M48;
+    Bit P13 = M49 ^ M51;
+    Bit P14 = M49 ^ M62;
+    Bit P15 = M54 ^ M59;
+    Bit P16 = M57 ^ M61;
+    Bit P17 = M58 ^ P2;
+    Bit P18 = M63 ^ P5;
+    Bit P19 = P2 ^ P3;
+    Bit P20 = P4 ^ P6;
+    Bit P22 = P2 ^ P7;
+    Bit P23 = P7 ^ P8;
+    Bit P24 = P5 ^ P7;
+    Bit P25 = P6 ^ P10;
+    Bit P26 = P9 ^ P11;
+    Bit P27 = P10 ^ P18;
+    Bit P28 = P11 ^ P25;
+    Bit P29 = P15 ^ P20;
+
+    output[7] = P13 ^ P22;
+    output[6] = P26 ^ P29;
+    output[5] = P17 ^ P28;
+    output[4] = P12 ^ P22;
+    output[3] = P23 ^ P27;
+    output[2] = P19 ^ P24;
+    output[1] = P14 ^ P23;
+    output[0] = P9  ^ P16;
+
+    return output;
+}
+
 extern std::function<CryptoBitset<8>
               (const CryptoBitset<8>&)>
     AES128_SBox_Forward;
@@ -98,6 +514,11 @@ extern std::function<CryptoBitset<8>
 
 extern S_Box<uint8_t, 8> Sbox_AES128; 
 
+// The S-box circuits recorded and compiled once for each depth (see
+// Circuit::compile), e.g. Depth::product for packed bits
+Circuit const& AES128_SBox_Forward_Compiled(Circuit::Depth depth = Circuit::Depth::AND);
+Circuit const& AES128_SBox_Reverse_Compiled(Circuit::Depth depth = Circuit::Depth::AND);
+
 template<class None = void>
 void ExecInParallel()
 {
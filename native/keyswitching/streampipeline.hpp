@@ -0,0 +1,117 @@
+#ifndef __STREAM_PIPELINE_HPP__
+#define __STREAM_PIPELINE_HPP__
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include "taskscheduler.hpp"
+
+// Throughput of a stream of blocks
+struct StreamStats
+{
+    std::size_t blocks = 0;
+    // bytes written by the sink (if it serializes the blocks)
+    std::size_t bytes = 0;
+    double seconds = 0;
+
+    inline double blocks_per_second() const {
+        return (seconds > 0) ? blocks / seconds : 0;
+    }
+
+    inline StreamStats& operator+=(StreamStats const& rhs) {
+        blocks  += rhs.blocks;
+        bytes   += rhs.bytes;
+        seconds += rhs.seconds;
+        return *this;
+    }
+};
+
+inline std::ostream& operator<<(std::ostream& os, StreamStats const& stats)
+{
+    return os << stats.blocks << " blocks in " << stats.seconds << " s ("
+              << stats.blocks_per_second() << " blocks/s)";
+}
+
+// Bounded pipeline over a stream of blocks
+//
+// Each block is transformed by its own task on the scheduler, with at most
+// "window" blocks in flight. The caller hands the transformed blocks to the
+// sink in the order of the stream (e.g. to serialize them) while the next
+// blocks are being transformed: the sink overlaps with the computations, and
+// the memory is bounded whatever the length of the stream.
+template <typename Block>
+class StreamPipeline
+{
+public:
+    using Transform = std::function<Block(Block const&)>;
+
+    // window == 0 means two blocks per thread of the scheduler
+    StreamPipeline(Transform transform, std::size_t window = 0,
+                   TaskScheduler& scheduler = default_scheduler())
+        : _transform(std::move(transform)),
+          _window(window_size(window, scheduler)),
+          _scheduler(scheduler)
+    {
+    }
+
+    static std::size_t window_size(std::size_t window, TaskScheduler const& scheduler) {
+        return window ? window : 2 * (scheduler.nb_workers() + 1);
+    }
+
+    std::size_t window() const { return _window; }
+
+    // Transform the blocks [first, last) and call sink(block) on each
+    // result, in order. An exception raised by a transformation or by the
+    // sink is rethrown once the blocks still in flight are done (their
+    // results are dropped), so no task outlives the call.
+    template <typename InputIt, typename Sink>
+    StreamStats run(InputIt first, InputIt last, Sink&& sink)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        StreamStats stats;
+        std::deque<std::future<Block>> in_flight;
+
+        // (the tasks own a copy of the transformation and of their block)
+        auto submit_next = [&]() {
+            in_flight.push_back(_scheduler.submit([transform = _transform, block = Block(*first)]() {
+                return transform(block);
+            }));
+            ++first;
+        };
+
+        while (first != last && in_flight.size() < _window)
+            submit_next();
+
+        try {
+            while (!in_flight.empty()) {
+                Block done = _scheduler.wait(in_flight.front());
+                in_flight.pop_front();
+                // keep the window full while the sink runs
+                if (first != last)
+                    submit_next();
+                sink(done);
+                stats.blocks++;
+            }
+        } catch (...) {
+            for (auto& ft : in_flight) {
+                try {
+                    _scheduler.wait(ft);
+                } catch (...) {
+                    // only the first failure is reported
+                }
+            }
+            throw;
+        }
+
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return stats;
+    }
+
+private:
+    Transform _transform;
+    std::size_t _window;
+    TaskScheduler& _scheduler;
+};
+
+#endif
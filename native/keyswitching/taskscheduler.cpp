@@ -0,0 +1,197 @@
+#include "taskscheduler.hpp"
+
+namespace
+{
+    // scheduler (and index of the queue) of the current worker thread
+    thread_local const TaskScheduler* current_scheduler = nullptr;
+    thread_local std::size_t current_index = 0;
+
+    // default scheduler set by a DefaultSchedulerOverride (if any)
+    std::atomic<TaskScheduler*> overridden_default{nullptr};
+}
+
+TaskScheduler::TaskScheduler(std::size_t nb_workers)
+    : _stop(false), _pending(0)
+{
+    // one queue per worker plus one shared by the non-worker threads
+    for (std::size_t i = 0; i < nb_workers + 1; i++)
+        _queues.push_back(std::make_unique<WorkQueue>());
+
+    _workers.reserve(nb_workers);
+    for (std::size_t i = 0; i < nb_workers; i++)
+        _workers.emplace_back(&TaskScheduler::worker_loop, this, i);
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(_sleep_mutex);
+        _stop = true;
+    }
+    _sleep_cv.notify_all();
+    for (auto& worker : _workers)
+        worker.join();
+}
+
+void TaskScheduler::push(Task task)
+{
+    // a worker pushes in its own queue, the other threads in the shared one
+    // (_pending is incremented first such that it never underflows)
+    const std::size_t index = (current_scheduler == this) ? current_index : _workers.size();
+    {
+        std::lock_guard<std::mutex> lock(_sleep_mutex);
+        _pending++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_queues[index]->mutex);
+        _queues[index]->tasks.push_back(std::move(task));
+    }
+    _sleep_cv.notify_one();
+}
+
+bool TaskScheduler::run_one()
+{
+    if (_pending == 0)
+        return false;
+
+    const std::size_t nb_queues = _queues.size();
+    const std::size_t home = (current_scheduler == this) ? current_index : _workers.size();
+    Task task;
+
+    // own queue first (most recent task), then steal the oldest task of the others
+    for (std::size_t k = 0; k < nb_queues && !task; k++) {
+        WorkQueue& queue = *_queues[(home + k) % nb_queues];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+            continue;
+        if (k == 0) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+        else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+    }
+
+    if (!task)
+        return false;
+
+    _pending--;
+    task();
+    return true;
+}
+
+void TaskScheduler::worker_loop(std::size_t index)
+{
+    current_scheduler = this;
+    current_index = index;
+
+    while (!_stop) {
+        if (run_one())
+            continue;
+        std::unique_lock<std::mutex> lock(_sleep_mutex);
+        _sleep_cv.wait(lock, [this]() { return _stop || _pending > 0; });
+    }
+}
+
+TaskScheduler& default_scheduler()
+{
+    if (TaskScheduler* scheduler = overridden_default.load())
+        return *scheduler;
+    static TaskScheduler scheduler;
+    return scheduler;
+}
+
+DefaultSchedulerOverride::DefaultSchedulerOverride(TaskScheduler& scheduler)
+    : _previous(overridden_default.exchange(&scheduler))
+{
+}
+
+DefaultSchedulerOverride::~DefaultSchedulerOverride()
+{
+    overridden_default.store(_previous);
+}
+
+TaskGraph::node_id TaskGraph::add_task(TaskScheduler::Task task,
+                                       std::vector<node_id> const& dependencies)
+{
+    const node_id id = _nodes.size();
+    _nodes.emplace_back();
+    _nodes.back().task = std::move(task);
+    _nodes.back().nb_dependencies = dependencies.size();
+
+    for (node_id dep : dependencies) {
+        assert(dep < id && "a task can only depend on previously added tasks");
+        _nodes[dep].successors.push_back(id);
+    }
+    return id;
+}
+
+// State of a run of the graph, shared by all its tasks (it must outlive the
+// caller of run() as the last task may still be returning)
+struct TaskGraph::RunState
+{
+    TaskGraph& graph;
+    TaskScheduler& scheduler;
+    std::atomic<std::size_t> nb_done{0};
+    std::promise<void> all_done;
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    RunState(TaskGraph& g, TaskScheduler& s) : graph(g), scheduler(s) {}
+};
+
+// Run a node then release its successors: the nodes depending on a failed
+// node are skipped (but counted as done)
+void TaskGraph::execute(std::shared_ptr<RunState> state, node_id id)
+{
+    Node& node = state->graph._nodes[id];
+    bool failed = node.failed;
+
+    if (!failed) {
+        try {
+            node.task();
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(state->error_mutex);
+            if (!state->error)
+                state->error = std::current_exception();
+            failed = true;
+        }
+    }
+
+    for (node_id succ : node.successors) {
+        Node& successor = state->graph._nodes[succ];
+        if (failed)
+            successor.failed = true;
+        if (--successor.remaining == 0)
+            state->scheduler.submit([state, succ]() { execute(state, succ); });
+    }
+
+    if (++state->nb_done == state->graph._nodes.size())
+        state->all_done.set_value();
+}
+
+void TaskGraph::run(TaskScheduler& scheduler)
+{
+    if (_nodes.empty())
+        return;
+
+    for (auto& node : _nodes) {
+        node.remaining = node.nb_dependencies;
+        node.failed = false;
+    }
+
+    auto state = std::make_shared<RunState>(*this, scheduler);
+    std::future<void> all_done = state->all_done.get_future();
+
+    for (node_id id = 0; id < _nodes.size(); id++)
+        if (_nodes[id].nb_dependencies == 0)
+            scheduler.submit([state, id]() { execute(state, id); });
+
+    scheduler.wait(all_done);
+
+    if (state->error)
+        std::rethrow_exception(state->error);
+}
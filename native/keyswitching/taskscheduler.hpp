@@ -0,0 +1,206 @@
+#ifndef __TASK_SCHEDULER_HPP__
+#define __TASK_SCHEDULER_HPP__
+
+#include <assert.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing scheduler
+//
+// Each worker owns a deque of tasks: it pops the most recent task of its own
+// deque (LIFO, good locality for nested tasks) and, when it is empty, steals
+// the oldest task of another worker (FIFO). A thread waiting for a task (see
+// wait()) executes pending tasks meanwhile, so nested parallelism (e.g. a
+// SubBytes task whose S-box evaluates CryptoBitset operators in parallel)
+// never deadlocks and the threads are reused across all the AES stages.
+class TaskScheduler
+{
+public:
+    using Task = std::function<void()>;
+
+    // nb_workers == 0 means that all the tasks are executed by the threads
+    // waiting for them (sequential execution)
+    explicit TaskScheduler(std::size_t nb_workers = std::thread::hardware_concurrency());
+    ~TaskScheduler();
+
+    TaskScheduler(TaskScheduler const&) = delete;
+    TaskScheduler& operator=(TaskScheduler const&) = delete;
+
+    std::size_t nb_workers() const { return _workers.size(); }
+
+    template <typename F>
+    auto submit(F&& f) -> std::future<decltype(f())>;
+
+    // Wait for the future while executing the pending tasks (when there is
+    // none, block on the future for at most steal_interval, then try again)
+    template <typename T>
+    T wait(std::future<T>& ft);
+
+    // Same for a future shared by several tasks (e.g. a key schedule)
+    template <typename T>
+    T const& wait(std::shared_future<T> const& ft);
+
+    // Call f(i) for each i in [begin, end): the range is cut in (at most)
+    // nb_workers()+1 chunks, one of them being executed by the caller
+    template <typename F>
+    void parallel_for(std::size_t begin, std::size_t end, F&& f);
+
+private:
+    static constexpr std::chrono::milliseconds steal_interval{1};
+
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void push(Task task);
+    bool run_one();
+    void worker_loop(std::size_t index);
+
+    std::vector<std::unique_ptr<WorkQueue>> _queues;
+    std::vector<std::thread> _workers;
+    std::atomic<bool> _stop;
+    std::atomic<std::size_t> _pending;
+    std::mutex _sleep_mutex;
+    std::condition_variable _sleep_cv;
+};
+
+// Scheduler shared by the whole keyswitching layer (one worker per core)
+TaskScheduler& default_scheduler();
+
+// Replace the default scheduler while the object lives (e.g. to run the AES
+// stages on a given number of threads). The replacements are nested: the
+// previous default scheduler is restored at destruction.
+class DefaultSchedulerOverride
+{
+public:
+    explicit DefaultSchedulerOverride(TaskScheduler& scheduler);
+    ~DefaultSchedulerOverride();
+
+    DefaultSchedulerOverride(DefaultSchedulerOverride const&) = delete;
+    DefaultSchedulerOverride& operator=(DefaultSchedulerOverride const&) = delete;
+
+private:
+    TaskScheduler* _previous;
+};
+
+// Graph of tasks: a task is run once all the tasks it depends on are done.
+// The dependencies are given at insertion and must be already inserted
+// tasks, i.e. the graph is acyclic by construction.
+class TaskGraph
+{
+public:
+    using node_id = std::size_t;
+
+    node_id add_task(TaskScheduler::Task task, std::vector<node_id> const& dependencies = {});
+
+    // Run all the tasks of the graph and return when they are all done.
+    // The first exception raised by a task (if any) is rethrown: the tasks
+    // depending on a failed task are not run.
+    void run(TaskScheduler& scheduler = default_scheduler());
+
+    std::size_t size() const { return _nodes.size(); }
+
+private:
+    struct Node
+    {
+        TaskScheduler::Task task;
+        std::vector<node_id> successors;
+        std::size_t nb_dependencies = 0;
+        std::atomic<std::size_t> remaining{0};
+        std::atomic<bool> failed{false};
+    };
+
+    struct RunState;
+    static void execute(std::shared_ptr<RunState> state, node_id id);
+
+    // (std::deque: the nodes are never moved, as required by std::atomic)
+    std::deque<Node> _nodes;
+};
+
+// Template Definitions
+//
+template <typename F>
+auto TaskScheduler::submit(F&& f) -> std::future<decltype(f())>
+{
+    using result_type = decltype(f());
+    auto task = std::make_shared<std::packaged_task<result_type()>>(std::forward<F>(f));
+    std::future<result_type> ft = task->get_future();
+    push([task]() { (*task)(); });
+    return ft;
+}
+
+template <typename T>
+T TaskScheduler::wait(std::future<T>& ft)
+{
+    while (ft.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        if (!run_one())
+            ft.wait_for(steal_interval);
+    return ft.get();
+}
+
+template <typename T>
+T const& TaskScheduler::wait(std::shared_future<T> const& ft)
+{
+    while (ft.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        if (!run_one())
+            ft.wait_for(steal_interval);
+    return ft.get();
+}
+
+template <typename F>
+void TaskScheduler::parallel_for(std::size_t begin, std::size_t end, F&& f)
+{
+    if (begin >= end)
+        return;
+
+    const std::size_t nb_chunks = std::min(end - begin, nb_workers() + 1);
+    const std::size_t chunk_size = (end - begin + nb_chunks - 1) / nb_chunks;
+
+    auto run_chunk = [&f, end](std::size_t from, std::size_t to) {
+        for (std::size_t i = from; i < std::min(to, end); i++)
+            f(i);
+    };
+
+    std::vector<std::future<void>> futures;
+    futures.reserve(nb_chunks);
+    for (std::size_t from = begin + chunk_size; from < end; from += chunk_size)
+        futures.push_back(submit([&run_chunk, from, chunk_size]() {
+            run_chunk(from, from + chunk_size);
+        }));
+
+    // the first chunk is executed by the caller
+    std::exception_ptr error;
+    try {
+        run_chunk(begin, begin + chunk_size);
+    }
+    catch (...) {
+        error = std::current_exception();
+    }
+
+    // all the chunks must be done before leaving (they capture f by reference)
+    for (auto& ft : futures) {
+        try {
+            wait(ft);
+        }
+        catch (...) {
+            if (!error)
+                error = std::current_exception();
+        }
+    }
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+#endif
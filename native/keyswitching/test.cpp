@@ -4,6 +4,14 @@
 #include "aes_he.hpp"
 #include "sbox.hpp"
 #include "GF256.hpp"
+#include "encryptionlayerSIMD.hpp"
+#include "aes_he_simd.hpp"
+#include "aes_he_keyschedule.hpp"
+#include "gf256packed.hpp"
+#include "lutpolynomial.hpp"
+
+#include <algorithm>
+#include <sstream>
 
 using namespace seal;
 using namespace std;
@@ -1048,4 +1056,1128 @@ TEST_CASE("Packed Vectors", "[Test25]")
     for (size_t i = 0; i < 2047; i++) REQUIRE ( res[i] == 0 );
     REQUIRE (( res[2047] == 1 && res[2048] == 1 ));
     for (size_t i = 2049; i < 4096; i++) REQUIRE ( res[i] == 0 );
-}*/
\ No newline at end of file
+}*/
+
+TEST_CASE("Bitsliced AES-128 rounds on packed blocks", "[Test26]")
+{
+    PackedBitsEncryptionContext<4096> ctxt;
+
+    // 16 blocks in 16 slots: the i-th block contains the bytes i*16, ..., i*16+15
+    std::vector<std::bitset<128>> blocks;
+    for (unsigned i = 0; i < 16; i++) {
+        std::array<uint8_t, 16> block;
+        for (unsigned j = 0; j < 16; j++)
+            block[j] = static_cast<uint8_t>(i*16+j);
+        blocks.push_back(arrayToBitset(block));
+    }
+
+    PackedCryptoBitset<128, 4096> packedBlocks(ctxt, blocks);
+
+    // clear AES S-box: multiplicative inverse in GF(2^8) followed by the affine map
+    auto sbox = [](uint8_t x) {
+        uint8_t inv = 0;
+        for (unsigned y = 1; y < 256 && x != 0; y++)
+            if (GFM_mul(x, static_cast<uint8_t>(y), 0x11b) == 1)
+                inv = static_cast<uint8_t>(y);
+        uint8_t res = 0x63 ^ inv;
+        for (unsigned k = 1; k < 5; k++)
+            res ^= static_cast<uint8_t>((inv << k) | (inv >> (8 - k)));
+        return res;
+    };
+
+    // SubBytes & InvSubBytes: each slot goes through the S-box independently
+    PackedCryptoBitset<128, 4096> substituted = SubBytes(packedBlocks);
+    std::vector<std::bitset<128>> res = substituted.decrypt();
+
+    for (unsigned i = 0; i < 16; i++) {
+        std::array<uint8_t, 16> array = bitsetToArray<uint8_t, 128>(res[i]);
+        for (unsigned j = 0; j < 16; j++)
+            REQUIRE ( array[j] == sbox(static_cast<uint8_t>(i*16+j)) );
+    }
+    // the unused slots (set to 0) are substituted too
+    REQUIRE ( bitsetToArray<uint8_t, 128>(res[16])[0] == 0x63 );
+
+    res = InvSubBytes(substituted).decrypt();
+    for (unsigned i = 0; i < 16; i++)
+        REQUIRE ( res[i] == blocks[i] );
+
+    // ShiftRows & InvShiftRows (same vectors as Test17, broadcasted)
+    std::array<uint8_t, 16> test_array = { 
+        0x2a, 0x64, 0xd5, 0xca, 0xe4, 0x4c, 0xaa, 0xed, 
+        0x1f, 0x35, 0x5a, 0x37, 0x94, 0x4e, 0xf0, 0x84 
+    };
+    std::array<uint8_t, 16> verif_shift = {
+        0x2a, 0x4c, 0x5a, 0x84, 0xe4, 0x35, 0xf0, 0xca, 
+        0x1f, 0x4e, 0xd5, 0xed, 0x94, 0x64, 0xaa, 0x37
+    };
+
+    PackedCryptoBitset<128, 4096> broadcasted(ctxt, arrayToBitset(test_array));
+    PackedCryptoBitset<128, 4096> shifted = ShiftRows(broadcasted);
+    REQUIRE ( shifted.decrypt()[42] == arrayToBitset(verif_shift) );
+    REQUIRE ( InvShiftRows(shifted).decrypt()[42] == arrayToBitset(test_array) );
+
+    // MixColumns & InvMixColumns (same vectors as Test20)
+    std::array<uint8_t, 16> originalArray = { 
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 
+        0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f 
+    };
+    std::array<uint8_t, 16> verif_mix = {
+        0x02, 0x07, 0x00, 0x05, 0x06, 0x03, 0x04, 0x01, 
+        0x0a, 0x0f, 0x08, 0x0d, 0x0e, 0x0b, 0x0c, 0x09
+    };
+
+    PackedCryptoBitset<128, 4096> mixed = MixColumns(PackedCryptoBitset<128, 4096>(ctxt, arrayToBitset(originalArray)));
+    REQUIRE ( mixed.decrypt()[0] == arrayToBitset(verif_mix) );
+    REQUIRE ( InvMixColumns(mixed).decrypt()[0] == arrayToBitset(originalArray) );
+
+    // Parameters sized for MixColumns (see PackedBitsEncryptionContext): the
+    // layer runs without refresh, and a product beyond the depth capacity
+    // fails instead of refreshing
+    const std::size_t mix_depth = XorNetwork::synthesize(AES_MixColumns_Matrix).circuit(Circuit::Depth::product).depth();
+    PackedBitsEncryptionContext<8192> sized(mix_depth);
+    std::cout << "[Test26] MixColumns depth: " << mix_depth << ", " << *sized.level_plan() << std::endl;
+    REQUIRE ( sized.depth_capacity() >= mix_depth );
+
+    PackedCryptoBitset<128, 8192> sized_mixed = MixColumns(PackedCryptoBitset<128, 8192>(sized, arrayToBitset(originalArray)));
+    REQUIRE ( sized.refresh_count() == 0 );
+    REQUIRE ( sized_mixed.decrypt()[0] == arrayToBitset(verif_mix) );
+    REQUIRE_THROWS_AS ( sized_mixed.manage_noise(sized.depth_capacity()), std::runtime_error );
+    REQUIRE ( sized.refresh_count() == 0 );
+
+    // (no coefficient modulus of pmd = 4096 runs a round of AES)
+    REQUIRE_THROWS_AS ( PackedBitsEncryptionContext<4096>(20), std::invalid_argument );
+}
+
+// Hidden (about 8.5 minutes on one core): run it with "sealkeyswitching [Test27]"
+TEST_CASE("Bitsliced Homomorphic AES-128 on packed blocks", "[Test27][.]")
+{
+    PackedBitsEncryptionContext<4096> ctxt;
+
+    std::array<uint8_t, 16> data = { 
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 
+        0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f 
+    };
+
+    std::array<uint8_t, 16> key = {
+        0x47, 0x2D, 0x4B, 0x61, 0x50, 0x64, 0x53, 0x67,
+        0x56, 0x6B, 0x58, 0x70, 0x32, 0x73, 0x35, 0x76
+    };
+
+    std::array<uint8_t, 16> verif_enc = { 
+        0x09, 0xec, 0x3a, 0x97, 0xe8, 0x27, 0x51, 0xb4, 
+        0x2a, 0x77, 0x3f, 0x7d, 0x92, 0x5f, 0xfc, 0x4b
+    };
+
+    // the same block is encrypted in every slot with the same (broadcasted) key
+    PackedCryptoBitset<128, 4096> he_clear_data(ctxt, arrayToBitset(data));
+    PackedCryptoBitset<128, 4096> he_clear_key (ctxt, arrayToBitset(key ));
+    std::vector<PackedCryptoBitset<128, 4096>> current_keys = KeyExpansion<AES_128>(he_clear_key);
+    PackedCryptoBitset<128, 4096> he_enc_data = HE_AES_Encrypt<AES_128>(he_clear_data, current_keys);
+    std::cout << "[Test27] (min) error on packed AES-128 encrypted data: " << he_enc_data.min_noise_budget() << std::endl;
+
+    std::vector<std::bitset<128>> enc_data = he_enc_data.decrypt();
+    for (size_t slot = 0; slot < enc_data.size(); slot++)
+        REQUIRE ( enc_data[slot] == arrayToBitset(verif_enc) );
+
+    std::vector<std::bitset<128>> orig_data = HE_AES_Decrypt<AES_128>(he_enc_data, current_keys).decrypt();
+    for (size_t slot = 0; slot < orig_data.size(); slot++)
+        REQUIRE ( orig_data[slot] == arrayToBitset(data) );
+}
+
+TEST_CASE("S-Box circuit reports and depth-optimized LUT", "[Test28]")
+{
+    BitEncryptionContext ctxt;
+
+    // Boyar-Peralta circuits of the AES S-box
+    CircuitReport forward = trace_circuit<8>(AES_SBox_Forward_Circuit<TracedBitset<8>>);
+    CircuitReport reverse = trace_circuit<8>(AES_SBox_Reverse_Circuit<TracedBitset<8>>);
+    std::cout << "[Test28] AES S-box forward: " << forward << std::endl;
+    std::cout << "[Test28] AES S-box reverse: " << reverse << std::endl;
+
+    REQUIRE ( forward.and_count == 34 );
+    REQUIRE ( forward.and_depth == 4  );
+    REQUIRE ( reverse.and_count == 34 );
+    REQUIRE ( reverse.and_depth == 4  );
+    REQUIRE ( Sbox_AES128.report().and_depth == 4 );
+
+    // PRESENT S-box (4-bit)
+    S_Box<uint32_t, 4> sbox(
+        LUTInput(0x0) ->* LUTOutput(0xc), LUTInput(0x1) ->* LUTOutput(0x5),
+        LUTInput(0x2) ->* LUTOutput(0x6), LUTInput(0x3) ->* LUTOutput(0xb),
+        LUTInput(0x4) ->* LUTOutput(0x9), LUTInput(0x5) ->* LUTOutput(0x0),
+        LUTInput(0x6) ->* LUTOutput(0xa), LUTInput(0x7) ->* LUTOutput(0xd),
+        LUTInput(0x8) ->* LUTOutput(0x3), LUTInput(0x9) ->* LUTOutput(0xe),
+        LUTInput(0xa) ->* LUTOutput(0xf), LUTInput(0xb) ->* LUTOutput(0x8),
+        LUTInput(0xc) ->* LUTOutput(0x4), LUTInput(0xd) ->* LUTOutput(0x7),
+        LUTInput(0xe) ->* LUTOutput(0x1), LUTInput(0xf) ->* LUTOutput(0x2)
+    );
+    const std::array<uint8_t, 16> present = {
+        0xc, 0x5, 0x6, 0xb, 0x9, 0x0, 0xa, 0xd, 0x3, 0xe, 0xf, 0x8, 0x4, 0x7, 0x1, 0x2
+    };
+
+    REQUIRE ( sbox.report().and_depth == 4 );
+    REQUIRE ( sbox.report().and_count == 16*7 );
+    REQUIRE ( sbox.report().xor_count == 16*4 + 15*4 );
+    REQUIRE ( sbox.report().not_count == 16*4 );
+    std::cout << "[Test28] 4-bit LUT (sequential): " << sbox.report() << std::endl;
+
+    sbox.select_circuit(S_BoxCircuit::depth_optimized);
+    REQUIRE ( sbox.report().and_depth == 2 );
+    REQUIRE ( sbox.report().and_count == 16*3 );
+    // (a bijection: each bit is set in half of the inputs and of the outputs)
+    REQUIRE ( sbox.report().xor_count == 16*4/2 );
+    REQUIRE ( sbox.report().not_count == 16*4/2 );
+    std::cout << "[Test28] 4-bit LUT (depth optimized): " << sbox.report() << std::endl;
+
+    for (unsigned val = 0; val < 16; val++) {
+        CryptoBitset<4> input(ctxt, val);
+        CryptoBitset<4> output = sbox.apply(ctxt, input);
+        REQUIRE ( output.decrypt().to_ulong() == present[val] );
+        REQUIRE ( sbox.reverse(ctxt, output).decrypt().to_ulong() == val );
+    }
+}
+
+TEST_CASE("Task scheduler and task graph", "[Test29]")
+{
+    TaskScheduler scheduler(3);
+
+    // parallel_for (with nested parallel_for in the tasks)
+    std::vector<int> values(100, 0);
+    scheduler.parallel_for(0, 10, [&](size_t i) {
+        scheduler.parallel_for(0, 10, [&](size_t j) {
+            values[i*10+j] = static_cast<int>(i*10+j);
+        });
+    });
+    for (size_t i = 0; i < values.size(); i++)
+        REQUIRE ( values[i] == static_cast<int>(i) );
+
+    // a task is run after all its dependencies
+    std::mutex mutex;
+    std::vector<int> order;
+    auto record = [&](int id) {
+        return [&, id]() {
+            std::lock_guard<std::mutex> lock(mutex);
+            order.push_back(id);
+        };
+    };
+
+    TaskGraph graph;
+    auto t0 = graph.add_task(record(0));
+    auto t1 = graph.add_task(record(1));
+    auto t2 = graph.add_task(record(2), { t0 });
+    auto t3 = graph.add_task(record(3), { t1, t2 });
+    graph.add_task(record(4), { t3 });
+    graph.run(scheduler);
+
+    auto pos = [&](int id) { return std::find(order.begin(), order.end(), id) - order.begin(); };
+    REQUIRE ( order.size() == 5 );
+    REQUIRE ( pos(0) < pos(2) );
+    REQUIRE ( pos(1) < pos(3) );
+    REQUIRE ( pos(2) < pos(3) );
+    REQUIRE ( pos(3) < pos(4) );
+
+    // an exception is forwarded and the dependent tasks are skipped
+    TaskGraph failing;
+    bool dependent_run = false;
+    auto f0 = failing.add_task([]() { throw std::runtime_error("task failure"); });
+    failing.add_task([&]() { dependent_run = true; }, { f0 });
+    REQUIRE_THROWS_AS ( failing.run(scheduler), std::runtime_error );
+    REQUIRE ( !dependent_run );
+
+    // gates of a CryptoBitset operator are evaluated on the default scheduler
+    BitEncryptionContext ctxt;
+    CryptoBitset<8> a(ctxt, 0xa5), b(ctxt, 0x3c);
+    REQUIRE ( (a & b).decrypt().to_ulong() == (0xa5 & 0x3c) );
+    REQUIRE ( (a ^ b).decrypt().to_ulong() == (0xa5 ^ 0x3c) );
+    REQUIRE ( (a | b).decrypt().to_ulong() == (0xa5 | 0x3c) );
+}
+
+TEST_CASE("Lazy relinearization", "[Test30]")
+{
+    std::array<uint8_t, 16> data = { 
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 
+        0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f 
+    };
+    std::array<uint8_t, 16> verifMix = {
+        0x02, 0x07, 0x00, 0x05, 0x06, 0x03, 0x04, 0x01, 
+        0x0a, 0x0f, 0x08, 0x0d, 0x0e, 0x0b, 0x0c, 0x09
+    };
+
+    std::size_t relin_count[2];
+    for (bool lazy : { false, true })
+    {
+        BitEncryptionContext ctxt;
+        ctxt.set_lazy_relinearization(lazy);
+        ctxt.reset_relin_count();
+
+        // S-box: the products are only relinearized when they feed an AND
+        CryptoBitset<8> byte(ctxt, 0x53);
+        CryptoBitset<8> substituted = Sbox_AES128.apply(ctxt, byte);
+        REQUIRE ( substituted.decrypt().to_ulong() == 0xed );
+
+        // MixColumns: no product feeds another multiplication
+        CryptoBitset<128> mixed = MixColumns(CryptoBitset<128>(ctxt, arrayToBitset(data)));
+        std::array<uint8_t, 16> mixedArray = bitsetToArray<uint8_t, 128>(mixed.decrypt());
+        for (unsigned i = 0; i < 16; i++)
+            REQUIRE ( mixedArray[i] == verifMix[i] );
+
+        relin_count[lazy] = ctxt.relin_count();
+        std::cout << "[Test30] relinearizations (" << (lazy ? "lazy" : "eager") << "): "
+                  << relin_count[lazy] << ", min noise budget: " << mixed.min_noise_budget() << std::endl;
+    }
+    REQUIRE ( relin_count[1] < relin_count[0] );
+}
+
+TEST_CASE("Cached and serialized AES key schedule", "[Test31]")
+{
+    BitEncryptionContext ctxt;
+
+    std::array<uint8_t, 16> key = {
+        0x47, 0x2D, 0x4B, 0x61, 0x50, 0x64, 0x53, 0x67,
+        0x56, 0x6B, 0x58, 0x70, 0x32, 0x73, 0x35, 0x76
+    };
+
+    CryptoBitset<128> he_key(ctxt, arrayToBitset(key));
+    CryptoBitset<128> he_key_copy(he_key);
+    CryptoBitset<128> he_key_reencrypted(ctxt, arrayToBitset(key));
+
+    // The key is expanded once: a copy of the encrypted key is the same entry
+    HE_AES_KeyScheduleCache<AES_128> cache;
+    auto expanded = cache.get(he_key);
+    REQUIRE ( cache.get(he_key_copy) == expanded );
+    REQUIRE ( cache.size() == 1 );
+    REQUIRE ( expanded->round_keys().size() == 11 );
+    REQUIRE ( expanded->expands(he_key) );
+    REQUIRE ( !expanded->expands(he_key_reencrypted) );
+
+    // Save/load round trip
+    std::stringstream stream;
+    std::streamoff size = expanded->save(stream);
+    REQUIRE ( size == stream.tellp() );
+
+    auto loaded = std::make_shared<const HE_AES_ExpandedKey<AES_128>>(ctxt, stream);
+    REQUIRE ( loaded->expands(he_key) );
+    for (unsigned round = 0; round < 11; round++) {
+        CryptoBitset<128> expected(expanded->round_keys()[round]);
+        CryptoBitset<128> actual(loaded->round_keys()[round]);
+        REQUIRE ( actual.decrypt() == expected.decrypt() );
+    }
+
+    // A loaded schedule is found from the original encrypted key
+    HE_AES_KeyScheduleCache<AES_128> other_cache;
+    other_cache.insert(loaded);
+    REQUIRE ( other_cache.get(he_key_copy) == loaded );
+
+    // A stream holding another key size is rejected
+    std::stringstream wrong_stream;
+    expanded->save(wrong_stream);
+    REQUIRE_THROWS_AS ( HE_AES_ExpandedKey<AES_256>(ctxt, wrong_stream), std::invalid_argument );
+
+    // So is a stream without the magic word or of another version
+    for (std::size_t offset : { 0, 4 }) {
+        std::string saved = stream.str();
+        saved[offset] ^= 0x01;
+        std::stringstream corrupted_stream(saved);
+        REQUIRE_THROWS_AS ( HE_AES_ExpandedKey<AES_128>(ctxt, corrupted_stream), std::invalid_argument );
+    }
+
+    // The least recently used key is evicted beyond the capacity
+    HE_AES_KeyScheduleCache<AES_128> small_cache(1);
+    small_cache.insert(expanded);
+    REQUIRE ( small_cache.get(he_key) == expanded );
+    auto reencrypted = small_cache.get(he_key_reencrypted);
+    REQUIRE ( reencrypted != expanded );
+    REQUIRE ( small_cache.size() == 1 );
+    REQUIRE ( small_cache.get(he_key_reencrypted) == reencrypted );
+    small_cache.insert(expanded);
+    REQUIRE ( small_cache.size() == 1 );
+    REQUIRE ( small_cache.get(he_key_copy) == expanded );
+}
+
+TEST_CASE("AES-CTR counter blocks", "[Test32]")
+{
+    std::array<uint8_t, 16> iv = {
+        0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 
+        0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff
+    };
+
+    REQUIRE ( AES_CTR_CounterBlock(iv, 0) == arrayToBitset(iv) );
+
+    // big-endian increment with carries
+    std::array<uint8_t, 16> ctr1 = bitsetToArray<uint8_t, 128>(AES_CTR_CounterBlock(iv, 1));
+    std::array<uint8_t, 16> ctr2 = bitsetToArray<uint8_t, 128>(AES_CTR_CounterBlock(iv, 0x0102));
+    for (unsigned k = 0; k < 13; k++) {
+        REQUIRE ( ctr1[k] == iv[k] );
+        REQUIRE ( ctr2[k] == iv[k] );
+    }
+    REQUIRE ( ctr1[13] == 0xfd );
+    REQUIRE ( ctr1[14] == 0xff );
+    REQUIRE ( ctr1[15] == 0x00 );
+    REQUIRE ( ctr2[13] == 0xfe );
+    REQUIRE ( ctr2[14] == 0x00 );
+    REQUIRE ( ctr2[15] == 0x01 );
+}
+
+// Hidden (a homomorphic AES per block, see Test48 for the stream logic)
+TEST_CASE("Homomorphic AES-128 CTR transciphering", "[Test33][.]")
+{
+    BitEncryptionContext ctxt;
+
+    std::array<uint8_t, 16> key = {
+        0x47, 0x2D, 0x4B, 0x61, 0x50, 0x64, 0x53, 0x67,
+        0x56, 0x6B, 0x58, 0x70, 0x32, 0x73, 0x35, 0x76
+    };
+    std::array<uint8_t, 16> iv = { 
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 
+        0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f 
+    };
+
+    // "Transciphering!!AES-CTR block 2." encrypted with AES-128-CTR
+    std::array<std::array<uint8_t, 16>, 2> data = {{
+        { 'T', 'r', 'a', 'n', 's', 'c', 'i', 'p', 'h', 'e', 'r', 'i', 'n', 'g', '!', '!' },
+        { 'A', 'E', 'S', '-', 'C', 'T', 'R', ' ', 'b', 'l', 'o', 'c', 'k', ' ', '2', '.' }
+    }};
+    std::array<std::array<uint8_t, 16>, 2> aes_ctr_data = {{
+        { 0x5d, 0x9e, 0x5b, 0xf9, 0x9b, 0x44, 0x38, 0xc4, 
+          0x42, 0x12, 0x4d, 0x14, 0xfc, 0x38, 0xdd, 0x6a },
+        { 0xd3, 0xce, 0x2c, 0x6b, 0x1a, 0x11, 0xa5, 0xef, 
+          0xf3, 0x67, 0xae, 0x53, 0x63, 0x8c, 0x93, 0x27 }
+    }};
+
+    CryptoBitset<128> he_key(ctxt, arrayToBitset(key));
+    HE_AES_CTR_Transcipher<AES_128> transcipher(KeyExpansion<AES_128>(he_key), iv);
+
+    for (unsigned block = 0; block < 2; block++) {
+        CryptoBitset<128> he_data = transcipher.transcipher(arrayToBitset(aes_ctr_data[block]));
+        std::cout << "[Test33] (min) error on transciphered data: " << he_data.min_noise_budget() << std::endl;
+        std::array<uint8_t, 16> result = bitsetToArray<uint8_t, 128>(he_data.decrypt());
+        for (unsigned k = 0; k < 16; k++)
+            REQUIRE ( result[k] == data[block][k] );
+    }
+    REQUIRE ( transcipher.position() == 2 );
+}
+
+TEST_CASE("Noise planner and modulus switching", "[Test34]")
+{
+    // (noise models measured with the default coefficient modulus)
+    std::vector<NoiseModel> models = {
+        { 4096, 9, 13 }, { 8192, 9, 14 }, { 16384, 10, 15 }, { 32768, 10, 16 }
+    };
+
+    // The smallest parameters without refresh
+    LevelPlan plan3 = plan_levels(3, models);
+    REQUIRE ( plan3.poly_modulus_degree == 4096 );
+    REQUIRE ( plan3.refresh_count() == 0 );
+
+    LevelPlan plan40 = plan_levels(40, models);
+    std::cout << "[Test34] " << plan40 << std::endl;
+    REQUIRE ( plan40.poly_modulus_degree == 32768 );
+    REQUIRE ( plan40.depth_capacity >= 40 );
+    REQUIRE ( plan40.refresh_count() == 0 );
+    REQUIRE ( plan40.level_for_depth(0) == 0 );
+    REQUIRE ( plan40.level_for_depth(40) > plan40.level_for_depth(20) );
+
+    // Too deep: the largest parameters, with the least refresh
+    LevelPlan plan120 = plan_levels(120, models);
+    REQUIRE ( plan120.poly_modulus_degree == 32768 );
+    REQUIRE ( plan120.refresh_count() == 2 );
+
+    // Two S-boxes without refresh on planned (and measured) parameters
+    LevelPlan plan = plan_levels(2 * SubBytes_depth(), { measure_noise_model(8192) });
+    std::cout << "[Test34] " << plan << std::endl;
+    REQUIRE ( plan.refresh_count() == 0 );
+
+    BitEncryptionContext ctxt(plan);
+    CryptoBitset<8> byte(ctxt, 0x53);
+    CryptoBitset<8> substituted = Sbox_AES128.apply(ctxt, byte);
+    REQUIRE ( substituted.depth() == SubBytes_depth() );
+
+    substituted.manage_noise(SubBytes_depth());
+    REQUIRE ( substituted.depth() == SubBytes_depth() );
+    REQUIRE ( substituted.level() == plan.level_for_depth(SubBytes_depth()) );
+    REQUIRE ( substituted.level() > 0 );
+
+    // (the NOT gates and the constants work at the lower level)
+    CryptoBitset<8> twice = Sbox_AES128.apply(ctxt, substituted ^ byte);
+    std::cout << "[Test34] noise budget after 2 S-boxes: " << twice.min_noise_budget()
+              << " (level " << twice.level() << ")" << std::endl;
+    REQUIRE ( twice.min_noise_budget() > 0 );
+    REQUIRE ( twice.decrypt().to_ulong() == 0xae );
+
+    // (the key schedule only adds to the depth of the decryption)
+    REQUIRE ( HE_AES_KeyExpansion_Depth<AES_128>() == 10 * SubBytes_depth() );
+    REQUIRE ( HE_AES_KeyExpansion_Depth<AES_192>() ==  8 * SubBytes_depth() );
+    REQUIRE ( HE_AES_KeyExpansion_Depth<AES_256>() == 13 * SubBytes_depth() );
+    REQUIRE ( HE_AES_Depth<AES_128>() == 10 * SubBytes_depth() );
+    REQUIRE ( HE_AES_Depth<AES_128>(true) == 20 * SubBytes_depth() );
+}
+
+TEST_CASE("Automatic modulus switching", "[Test35]")
+{
+    // Default parameters (BFVDefault(4096): two data primes)
+    BitEncryptionContext ctxt;
+    ctxt.enable_modulus_switching(measure_noise_model(4096));
+    std::cout << "[Test35] " << *ctxt.level_plan() << std::endl;
+    REQUIRE ( ctxt.level_plan()->nb_levels() == 1 );
+
+    std::size_t mult_count[2][2];
+    for (bool enabled : { false, true })
+    {
+        ctxt.set_auto_mod_switch(enabled);
+        ctxt.reset_mult_count();
+
+        CryptoBitset<8> byte(ctxt, 0x53);
+        CryptoBitset<8> substituted = Sbox_AES128.apply(ctxt, byte);
+        REQUIRE ( substituted.decrypt().to_ulong() == 0xed );
+        REQUIRE ( substituted.level() == (enabled ? 1 : 0) );
+        REQUIRE ( substituted.min_noise_budget() > 0 );
+
+        mult_count[enabled][0] = ctxt.mult_count(0);
+        mult_count[enabled][1] = ctxt.mult_count(1);
+        std::cout << "[Test35] multiplications (" << (enabled ? "auto" : "no") << " mod switch): "
+                  << mult_count[enabled][0] << " + " << mult_count[enabled][1] << " on the smaller modulus, "
+                  << "min noise budget: " << substituted.min_noise_budget() << std::endl;
+    }
+    REQUIRE ( mult_count[0][1] == 0 );
+    REQUIRE ( mult_count[1][1] > 0 );
+    REQUIRE ( mult_count[1][0] + mult_count[1][1] == mult_count[0][0] );
+}
+
+TEST_CASE("Constant folding of clear bits", "[Test36]")
+{
+    BitEncryptionContext ctxt;
+    ctxt.reset_mult_count();
+    ctxt.reset_relin_count();
+
+    for (uint8_t bit : { 0, 1 })
+    {
+        CryptoBit x(ctxt, bit);
+
+        REQUIRE ( (x & ClearBit(0)).decrypt() == 0 );
+        REQUIRE ( (x & ClearBit(1)).same_encryption(x) );
+        REQUIRE ( (x ^ ClearBit(0)).same_encryption(x) );
+        REQUIRE ( (x ^ ClearBit(1)).decrypt() == (bit ^ 1) );
+        // (no noise added by the NOT)
+        REQUIRE ( (x ^ ClearBit(1)).noise_budget() == x.noise_budget() );
+        REQUIRE ( CryptoBit(x).set_to_0().decrypt() == 0 );
+        REQUIRE ( CryptoBit(x).set_to_1().decrypt() == 1 );
+    }
+
+    CryptoBitset<8> byte(ctxt, 0x3c);
+    REQUIRE ( (byte ^ ClearBitset<8>(0xa5)).decrypt().to_ulong() == 0x99 );
+    REQUIRE ( (byte & ClearBitset<8>(0xa5)).decrypt().to_ulong() == 0x24 );
+    REQUIRE ( (!byte).decrypt().to_ulong() == 0xc3 );
+
+    // no homomorphic multiplication at all
+    REQUIRE ( ctxt.mult_count(0) == 0 );
+    REQUIRE ( ctxt.relin_count() == 0 );
+}
+
+TEST_CASE("Wiring-only shifts, rotations, split and join", "[Test37]")
+{
+    BitEncryptionContext ctxt;
+
+    CryptoBitset<8> byte(ctxt, 0b10110010);
+    REQUIRE ( (byte << 3).decrypt().to_ulong() == 0b10010000 );
+    REQUIRE ( (byte >> 3).decrypt().to_ulong() == 0b00010110 );
+    REQUIRE ( (byte << 9).decrypt().to_ulong() == 0 );
+    REQUIRE ( byte.rotate_left(3).decrypt().to_ulong() == 0b10010101 );
+    REQUIRE ( byte.rotate_right(3).decrypt().to_ulong() == 0b01010110 );
+    REQUIRE ( byte.rotate_right(11).decrypt().to_ulong() == 0b01010110 );
+
+    // the bits are not re-encrypted nor copied but shared
+    CryptoBitset<8> rotated = byte.rotate_left(3);
+    for (size_t i = 0; i < 8; i++)
+        REQUIRE ( rotated[(i + 3) % 8].shares_encryption(byte[i]) );
+
+    CryptoBitset<8> shifted(byte);
+    shifted <<= 2;
+    REQUIRE ( shifted.decrypt().to_ulong() == 0b11001000 );
+    REQUIRE ( shifted[7].shares_encryption(byte[5]) );
+    shifted >>= 4;
+    REQUIRE ( shifted.decrypt().to_ulong() == 0b00001100 );
+    REQUIRE ( shifted[0].shares_encryption(byte[2]) );
+
+    CryptoBitset<32> word(ctxt, 0x12345678);
+    std::vector<CryptoBitset<8>> bytes = word.split<4>();
+    REQUIRE ( bytes.size() == 4 );
+    REQUIRE ( bytes[0].decrypt().to_ulong() == 0x78 );
+    REQUIRE ( bytes[3].decrypt().to_ulong() == 0x12 );
+    REQUIRE ( bytes[2][5].shares_encryption(word[21]) );
+    REQUIRE ( word.slice<16>(8).decrypt().to_ulong() == 0x3456 );
+
+    CryptoBitset<32> joined = CryptoBitset<32>::join<8>(ctxt, bytes);
+    REQUIRE ( joined.decrypt().to_ulong() == 0x12345678 );
+    for (size_t i = 0; i < 32; i++)
+        REQUIRE ( joined[i].shares_encryption(word[i]) );
+
+    // a copy-on-write: refreshing a copy leaves the original bits untouched
+    joined.refresh();
+    REQUIRE ( !joined[0].shares_encryption(word[0]) );
+    REQUIRE ( word[0].shares_encryption(bytes[0][0]) );
+
+    // ShiftRows is a permutation of the bytes
+    std::array<uint8_t, 16> state;
+    for (size_t i = 0; i < 16; i++)
+        state[i] = i;
+    CryptoBitset<128> block(ctxt, arrayToBitset(state));
+    std::array<uint8_t, 16> shifted_rows = bitsetToArray<uint8_t>(ShiftRows(block).decrypt());
+    const std::array<uint8_t, 16> expected = { 0, 5, 10, 15, 4, 9, 14, 3, 8, 13, 2, 7, 12, 1, 6, 11 };
+    REQUIRE ( shifted_rows == expected );
+
+    CryptoBitset<128> back = InvShiftRows(ShiftRows(block));
+    for (size_t i = 0; i < 128; i++)
+        REQUIRE ( back[i].shares_encryption(block[i]) );
+}
+
+TEST_CASE("MixColumns as an XOR network", "[Test38]")
+{
+    // FIPS-197, 4.2
+    static_assert(gf256_mul(0x57, 0x83) == 0xc1, "GF(2^8) multiplication");
+    static_assert(gf256_mul(0x57, 0x13) == 0xfe, "GF(2^8) multiplication");
+
+    const XorNetwork mix    = XorNetwork::synthesize(AES_MixColumns_Matrix);
+    const XorNetwork invmix = XorNetwork::synthesize(AES_InvMixColumns_Matrix);
+    std::cout << "[Test38] MixColumns: "    << mix.xor_count()    << " XOR (naive: "
+              << naive_xor_count(AES_MixColumns_Matrix)    << "), InvMixColumns: "
+              << invmix.xor_count() << " XOR (naive: "
+              << naive_xor_count(AES_InvMixColumns_Matrix) << ")" << std::endl;
+    REQUIRE ( mix.xor_count() < naive_xor_count(AES_MixColumns_Matrix) );
+    REQUIRE ( invmix.xor_count() < naive_xor_count(AES_InvMixColumns_Matrix) );
+    REQUIRE ( mix.report().and_count == 0 );
+
+    // (the networks evaluated on clear bits: every column of GF(2^8)^4 is
+    // too many, the image of each input bit and of a few random columns)
+    auto mix_clear = [](std::array<uint8_t, 4> const& col, std::array<uint8_t, 4> const& coefficients) {
+        std::array<uint8_t, 4> res{};
+        for (unsigned r = 0; r < 4; r++)
+            for (unsigned j = 0; j < 4; j++)
+                res[r] ^= gf256_mul(coefficients[(j + 4 - r) % 4], col[j]);
+        return res;
+    };
+    auto column_value = [](std::array<uint8_t, 4> const& col) {
+        return uint32_t(col[0]) | uint32_t(col[1]) << 8 | uint32_t(col[2]) << 16 | uint32_t(col[3]) << 24;
+    };
+    std::srand(38);
+    for (unsigned k = 0; k < 64; k++)
+    {
+        std::array<uint8_t, 4> col;
+        for (auto& byte : col)
+            byte = (k < 32) ? 0 : static_cast<uint8_t>(std::rand());
+        if (k < 32)
+            col[k / 8] = static_cast<uint8_t>(1u << (k % 8));
+
+        ClearBitset<32> input(column_value(col));
+        REQUIRE ( mix.apply(input).decode().to_ulong() == column_value(mix_clear(col, { 0x02, 0x03, 0x01, 0x01 })) );
+        REQUIRE ( invmix.apply(input).decode().to_ulong() == column_value(mix_clear(col, { 0x0e, 0x0b, 0x0d, 0x09 })) );
+    }
+
+    BitEncryptionContext ctxt;
+    ctxt.reset_mult_count();
+
+    // FIPS-197 test vector of the first column of the round 1 of C.1
+    std::array<uint8_t, 16> state = {
+        0x63, 0x53, 0xe0, 0x8c, 0x09, 0x60, 0xe1, 0x04,
+        0xcd, 0x70, 0xb7, 0x51, 0xba, 0xca, 0xd0, 0xe7
+    };
+    std::array<uint8_t, 16> expected = {
+        0x5f, 0x72, 0x64, 0x15, 0x57, 0xf5, 0xbc, 0x92,
+        0xf7, 0xbe, 0x3b, 0x29, 0x1d, 0xb9, 0xf9, 0x1a
+    };
+    CryptoBitset<128> block(ctxt, arrayToBitset(state));
+    CryptoBitset<128> mixed = MixColumns(block);
+    REQUIRE ( bitsetToArray<uint8_t, 128>(mixed.decrypt()) == expected );
+    REQUIRE ( InvMixColumns(mixed).decrypt() == arrayToBitset(state) );
+
+    // multiplication by the clear constants of GF(2^8)
+    for (unsigned constant : { 0x00, 0x01, 0x02, 0x03, 0x09, 0x0b, 0x0d, 0x0e, 0xff })
+    {
+        CryptoBitset<8> byte(ctxt, 0xb5);
+        REQUIRE ( HE_GF256_mul_circuit(byte, ClearBitset<8>(constant)).decrypt().to_ulong()
+                  == gf256_mul(0xb5, constant) );
+    }
+
+    // no multiplication at all
+    REQUIRE ( ctxt.mult_count(0) == 0 );
+    REQUIRE ( mixed.min_noise_budget() > 0 );
+}
+
+TEST_CASE("Recorded and compiled circuits", "[Test39]")
+{
+    // (a ^ b) is computed twice, !!c is c and the AND of d is dead
+    Circuit toy = record_circuit<4>([](SymbolicBitset<4> const& in) {
+        SymbolicBitset<4> out(in);
+        const SymbolicBit dead = in[3] & in[0];
+        (void) dead;
+        out[0] = (in[0] ^ in[1]) & in[2];
+        out[1] = (in[1] ^ in[0]) & !!in[2];
+        out[2] = !in[0] ^ !in[1];
+        out[3] = in[3];
+        return out;
+    });
+    REQUIRE ( toy.report().and_count == 1 );
+    REQUIRE ( toy.report().xor_count == 1 );
+    REQUIRE ( toy.report().not_count == 0 );
+    REQUIRE ( toy.report().and_depth == 1 );
+    for (unsigned val = 0; val < 16; val++) {
+        const unsigned a = val & 1, b = (val >> 1) & 1, c = (val >> 2) & 1, d = (val >> 3) & 1;
+        const unsigned expected = ((a ^ b) & c) | ((a ^ b) & c) << 1 | (a ^ b) << 2 | d << 3;
+        REQUIRE ( toy.run(ClearBitset<4>(val)).decode().to_ulong() == expected );
+    }
+
+    // AES S-box: the compiled circuit against its definition (inverse in
+    // GF(2^8) then affine map), on every byte
+    Circuit forward = record_circuit<8>(AES_SBox_Forward_Circuit<SymbolicBitset<8>>);
+    Circuit reverse = record_circuit<8>(AES_SBox_Reverse_Circuit<SymbolicBitset<8>>);
+    CircuitReport traced = trace_circuit<8>(AES_SBox_Forward_Circuit<TracedBitset<8>>);
+    std::cout << "[Test39] AES S-box traced: " << traced << ", compiled: " << forward.report()
+              << ", registers: " << forward.nb_registers() << std::endl;
+    REQUIRE ( forward.report().and_count == traced.and_count );
+    REQUIRE ( forward.report().and_depth == traced.and_depth );
+    REQUIRE ( forward.report().xor_count + forward.report().not_count
+              <= traced.xor_count + traced.not_count );
+    REQUIRE ( forward.nb_registers() < forward.nb_gates() );
+
+    for (unsigned x = 0; x < 256; x++) {
+        uint8_t inverse = 0;
+        for (unsigned y = 1; y < 256 && x; y++)
+            if (gf256_mul(x, y) == 1)
+                inverse = y;
+        uint8_t sbox = 0x63;
+        for (unsigned r = 0; r < 5; r++)
+            sbox ^= static_cast<uint8_t>((inverse << r) | (inverse >> (8 - r)));
+        REQUIRE ( forward.run(ClearBitset<8>(x)).decode().to_ulong() == sbox );
+        REQUIRE ( reverse.run(ClearBitset<8>(sbox)).decode().to_ulong() == x );
+    }
+
+    BitEncryptionContext ctxt;
+    ctxt.reset_mult_count();
+    CryptoBitset<8> byte(ctxt, 0x53);
+    CryptoBitset<8> substituted = forward.run(byte);
+    REQUIRE ( substituted.decrypt().to_ulong() == 0xed );
+    // (the default parameters only have room for one S-box)
+    substituted.refresh();
+    REQUIRE ( reverse.run(substituted).decrypt().to_ulong() == 0x53 );
+    REQUIRE ( ctxt.mult_count(0) == 2 * 34 );
+}
+
+TEST_CASE("Bounded stream pipeline", "[Test40]")
+{
+    BitEncryptionContext ctxt;
+
+    // (a cheap transformation: the S-box would take minutes for the stream)
+    std::atomic<std::size_t> running{0}, max_running{0};
+    StreamPipeline<CryptoBitset<8>> pipeline([&](CryptoBitset<8> const& byte) {
+        const std::size_t now = ++running;
+        for (std::size_t seen = max_running; now > seen && !max_running.compare_exchange_weak(seen, now); )
+            ;
+        CryptoBitset<8> res = byte ^ ClearBitset<8>(0x5a);
+        running--;
+        return res;
+    }, 3);
+    REQUIRE ( pipeline.window() == 3 );
+
+    std::vector<CryptoBitset<8>> stream;
+    for (unsigned i = 0; i < 20; i++)
+        stream.push_back(CryptoBitset<8>(ctxt, i * 13));
+
+    std::vector<unsigned long> results;
+    StreamStats stats = pipeline.run(stream.cbegin(), stream.cend(), [&](CryptoBitset<8>& byte) {
+        results.push_back(byte.decrypt().to_ulong());
+    });
+    std::cout << "[Test40] " << stats << std::endl;
+
+    REQUIRE ( stats.blocks == 20 );
+    REQUIRE ( stats.blocks_per_second() > 0 );
+    REQUIRE ( max_running <= 3 );
+    REQUIRE ( results.size() == 20 );
+    for (unsigned i = 0; i < 20; i++)
+        REQUIRE ( results[i] == (((i * 13) & 0xff) ^ 0x5a) );
+
+    // an error in a block is reported by run()
+    StreamPipeline<CryptoBitset<8>> failing([](CryptoBitset<8> const&) -> CryptoBitset<8> {
+        throw std::runtime_error("failing block");
+    });
+    REQUIRE_THROWS_AS ( failing.run(stream.cbegin(), stream.cend(), [](CryptoBitset<8> const&) {}),
+                        std::runtime_error );
+
+    // ... and so is an error in the sink, once the blocks in flight are done
+    std::atomic<std::size_t> started{0}, finished{0};
+    StreamPipeline<CryptoBitset<8>> counting([&](CryptoBitset<8> const& byte) {
+        started++;
+        CryptoBitset<8> res = byte ^ ClearBitset<8>(0x5a);
+        finished++;
+        return res;
+    }, 3);
+    REQUIRE_THROWS_AS ( counting.run(stream.cbegin(), stream.cend(), [](CryptoBitset<8> const&) {
+                            throw std::runtime_error("failing sink");
+                        }), std::runtime_error );
+    REQUIRE ( started == finished );
+}
+
+TEST_CASE("Homomorphic AES-128 key-switching of a stream", "[Test41]")
+{
+    BitEncryptionContext ctxt;
+
+    std::array<uint8_t, 16> key0 = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+        0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+    };
+    std::array<uint8_t, 16> key1 = {
+        0x47, 0x2D, 0x4B, 0x61, 0x50, 0x64, 0x53, 0x67,
+        0x56, 0x6B, 0x58, 0x70, 0x32, 0x73, 0x35, 0x76
+    };
+    CryptoBitset<128> k0(ctxt, arrayToBitset(key0));
+    CryptoBitset<128> k1(ctxt, arrayToBitset(key1));
+
+    // 00112233445566778899aabbccddeeff encrypted under key0 (FIPS-197) and key1
+    std::array<uint8_t, 16> enc_with_key0 = {
+        0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+        0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a
+    };
+    std::array<uint8_t, 16> enc_with_key1 = {
+        0x5b, 0xe7, 0xaa, 0xb3, 0x9b, 0xd9, 0xb2, 0x3b,
+        0x4b, 0x53, 0x09, 0x29, 0x5b, 0xe2, 0x77, 0xd7
+    };
+
+    // (a single block: each one costs a homomorphic AES decryption and encryption)
+    std::vector<CryptoBitset<128>> blocks = { CryptoBitset<128>(ctxt, arrayToBitset(enc_with_key0)) };
+
+    HE_AES_KeyScheduleCache<AES_128> cache;
+    HE_AES_KeyswitchingStream<AES_128> stream(k0, k1, cache);
+    std::stringstream serialized;
+    StreamStats stats = stream.run_and_save(blocks.cbegin(), blocks.cend(), serialized);
+    std::cout << "[Test41] " << stats << ", " << stats.bytes << " bytes" << std::endl;
+    REQUIRE ( stats.blocks == 1 );
+    REQUIRE ( stats.bytes > 0 );
+    REQUIRE ( stream.total().blocks == 1 );
+    REQUIRE ( cache.size() == 2 );
+
+    CryptoBitset<128> block = CryptoBitset<128>::load(ctxt, serialized);
+    REQUIRE ( block.decrypt() == arrayToBitset(enc_with_key1) );
+
+    // (the first run expanded k1 with the first blocks, the next ones go
+    // through the pipeline)
+    std::vector<CryptoBitset<128>> results;
+    stats = stream.run(blocks.cbegin(), blocks.cend(), [&](CryptoBitset<128> const& block) {
+        results.push_back(block);
+    });
+    REQUIRE ( stats.blocks == 1 );
+    REQUIRE ( stream.total().blocks == 2 );
+    REQUIRE ( results.size() == 1 );
+    REQUIRE ( results[0].decrypt() == arrayToBitset(enc_with_key1) );
+}
+
+TEST_CASE("Thread-local memory pools of the bit layer", "[Test42]")
+{
+    BitEncryptionContext ctxt;
+    std::bitset<64> lhs_data(0x0123456789abcdefULL), rhs_data(0xfedcba9876543210ULL);
+    CryptoBitset<64> lhs(ctxt, lhs_data), rhs(ctxt, rhs_data);
+
+    const BitMemoryStats before = ctxt.memory_stats();
+    const std::size_t global_bytes = seal::MemoryManager::GetPool().alloc_byte_count();
+
+    // The gates run in parallel (see CryptoBitset::parallel_bitwise)
+    CryptoBitset<64> res = (lhs & rhs) ^ !lhs;
+    res.refresh();
+
+    REQUIRE ( res.decrypt() == ((lhs_data & rhs_data) ^ ~lhs_data) );
+
+    // Every ciphertext comes from the pool of its thread: the global pool is
+    // never used by the gates, the decryptions or the refreshes
+    const BitMemoryStats after = ctxt.memory_stats();
+    std::cout << "[Test42] " << after.nb_pools << " pools, " << after.nb_ciphertexts
+              << " ciphertexts, " << after.alloc_byte_count << " bytes" << std::endl;
+    REQUIRE ( seal::MemoryManager::GetPool().alloc_byte_count() == global_bytes );
+    REQUIRE ( after.nb_pools >= 1 );
+    REQUIRE ( after.nb_pools <= default_scheduler().nb_workers() + 1 );
+    REQUIRE ( after.nb_ciphertexts >= before.nb_ciphertexts + 4 * 64 );
+    REQUIRE ( after.alloc_byte_count >= before.alloc_byte_count );
+}
+
+TEST_CASE("Batched GF(256) arithmetic on packed bytes", "[Test43]")
+{
+    // Parameters sized for the deepest operation, so that nothing is
+    // refreshed (see PackedBitsEncryptionContext): only pmd = 32768 can
+    // run the S-boxes
+    const std::size_t depth = std::max({ PackedGF256<32768>::mul_depth(),
+                                         PackedGF256<32768>::inverse_depth(),
+                                         PackedGF256<32768>::sbox_depth() });
+    PackedBitsEncryptionContext<32768> ctxt(depth);
+    std::cout << "[Test43] product depth " << depth << ", " << *ctxt.level_plan() << std::endl;
+
+    // every pair (a, b) with a in [0, 256) and b a "random" byte
+    std::vector<uint8_t> a_bytes(ctxt.slot_count()), b_bytes(ctxt.slot_count());
+    for (std::size_t j = 0; j < a_bytes.size(); j++) {
+        a_bytes[j] = static_cast<uint8_t>(j);
+        b_bytes[j] = static_cast<uint8_t>((j * 151 + 17) >> 3);
+    }
+    PackedGF256<32768> a(ctxt, a_bytes), b(ctxt, b_bytes);
+
+    std::vector<uint8_t> sum = (a + b).decrypt();
+    std::vector<uint8_t> product = (a * b).decrypt();
+    std::vector<uint8_t> by_constant = (a * uint8_t(0x57)).decrypt();
+    std::vector<uint8_t> squared = a.square().decrypt();
+
+    for (std::size_t j = 0; j < a_bytes.size(); j++) {
+        REQUIRE ( sum[j] == (a_bytes[j] ^ b_bytes[j]) );
+        REQUIRE ( product[j] == gf256_mul(a_bytes[j], b_bytes[j]) );
+        REQUIRE ( by_constant[j] == gf256_mul(a_bytes[j], 0x57) );
+        REQUIRE ( squared[j] == gf256_mul(a_bytes[j], a_bytes[j]) );
+    }
+
+    // x.x^-1 = 1 and the batched S-box matches the AES table
+    std::vector<uint8_t> inverse = a.inverse().decrypt();
+    std::vector<uint8_t> substituted = HE_GF256_SBox_Forward(a).decrypt();
+    for (std::size_t j = 0; j < 256; j++)
+        REQUIRE ( gf256_mul(a_bytes[j], inverse[j]) == (j ? 1 : 0) );
+    REQUIRE ( substituted[0x00] == 0x63 );
+    REQUIRE ( substituted[0x01] == 0x7c );
+    REQUIRE ( substituted[0x53] == 0xed );
+    REQUIRE ( substituted[0xff] == 0x16 );
+    for (std::size_t j = 0; j < a_bytes.size(); j++)
+        REQUIRE ( substituted[j] == substituted[a_bytes[j]] );
+
+    REQUIRE ( ctxt.refresh_count() == 0 );
+}
+
+TEST_CASE("LUT S-box interpolated over Z_p (Paterson-Stockmeyer)", "[Test44]")
+{
+    IntegerEncryptionContext ctxt;
+
+    // AES S-box: affine map of the inverse in GF(2^8)
+    std::vector<std::uint64_t> sbox(256);
+    for (unsigned x = 0; x < 256; x++) {
+        unsigned inverse = 0;
+        for (unsigned y = 1; y < 256 && x; y++)
+            if (gf256_mul(static_cast<uint8_t>(x), static_cast<uint8_t>(y)) == 1)
+                inverse = y;
+        unsigned substituted = AES_SBox_Affine_Constant;
+        for (unsigned i = 0; i < 8; i++)
+            if (__builtin_popcountll(AES_SBox_Affine_Matrix[i] & inverse) & 1)
+                substituted ^= 1u << i;
+        sbox[x] = substituted;
+    }
+    REQUIRE ( sbox[0x00] == 0x63 );
+    REQUIRE ( sbox[0x53] == 0xed );
+
+    LUTPolynomial polynomial(sbox, ctxt.plain_modulus());
+    for (unsigned x = 0; x < 256; x++)
+        REQUIRE ( polynomial.evaluate(x) == sbox[x] );
+
+    // about 2.sqrt(256) nonscalar multiplications
+    CircuitReport report = polynomial.report();
+    std::cout << "[Test44] degree " << polynomial.degree() << ", " << report.and_count
+              << " multiplications, depth " << report.and_depth << std::endl;
+    REQUIRE ( report.and_count <= 34 );
+
+    // every byte in every slot
+    std::vector<std::uint64_t> bytes(ctxt.slot_count());
+    for (std::size_t j = 0; j < bytes.size(); j++)
+        bytes[j] = (j * 7) % 256;
+    seal::Ciphertext encrypted = ctxt.encrypt(bytes);
+    seal::Ciphertext substituted = polynomial.evaluate(ctxt, encrypted);
+    std::cout << "[Test44] noise budget left: " << ctxt.noise_budget(substituted) << std::endl;
+    REQUIRE ( ctxt.noise_budget(substituted) > 0 );
+
+    std::vector<std::uint64_t> decrypted = ctxt.decrypt(substituted);
+    for (std::size_t j = 0; j < bytes.size(); j++)
+        REQUIRE ( decrypted[j] == sbox[bytes[j]] );
+
+    // LUT given by entries (the other inputs are not constrained)
+    std::vector<LUTEntry<uint8_t>> entries = {
+        LUTInput<uint8_t>(3) ->* LUTOutput<uint8_t>(7),
+        LUTInput<uint8_t>(5) ->* LUTOutput<uint8_t>(1),
+        LUTInput<uint8_t>(200) ->* LUTOutput<uint8_t>(42)
+    };
+    LUTPolynomial sparse(entries, ctxt.plain_modulus());
+    REQUIRE ( sparse.degree() <= 2 );
+    std::vector<std::uint64_t> sparse_decrypted = ctxt.decrypt(sparse.evaluate(ctxt, ctxt.encrypt({ 3, 5, 200 })));
+    REQUIRE ( sparse_decrypted[0] == 7 );
+    REQUIRE ( sparse_decrypted[1] == 1 );
+    REQUIRE ( sparse_decrypted[2] == 42 );
+}
+
+TEST_CASE("Compact form of the idle bits and peak memory", "[Test45]")
+{
+    BitEncryptionContext ctxt;
+    std::bitset<32> lhs_data(0x89abcdefULL), rhs_data(0x76543210ULL);
+    CryptoBitset<32> lhs(ctxt, lhs_data), rhs(ctxt, rhs_data);
+    // a lazily relinearized product (size-3 ciphertexts) is compacted too
+    ctxt.set_lazy_relinearization(true);
+    CryptoBitset<32> product = lhs & rhs;
+
+    const std::size_t full_bytes = ctxt.memory_stats().live_bytes;
+    lhs.compact();
+    product.compact();
+    REQUIRE ( lhs[0].is_compact() );
+    REQUIRE ( product[0].ciphertext_size() == 2 );
+
+    // the compact form is lossless and smaller
+    const std::size_t compact_bytes = ctxt.memory_stats().live_bytes;
+    std::cout << "[Test45] live bytes: " << full_bytes << " -> " << compact_bytes << std::endl;
+    REQUIRE ( compact_bytes < full_bytes );
+    REQUIRE ( lhs.decrypt() == lhs_data );
+    REQUIRE ( product.decrypt() == (lhs_data & rhs_data) );
+
+    // a gate expands a compact operand for its own time only
+    ctxt.reset_peak_bytes();
+    CryptoBitset<32> res = (lhs ^ rhs) & product;
+    REQUIRE ( lhs[0].is_compact() );
+    REQUIRE ( res.decrypt() == ((lhs_data ^ rhs_data) & lhs_data & rhs_data) );
+
+    const BitMemoryStats stats = ctxt.memory_stats();
+    REQUIRE ( stats.peak_bytes > compact_bytes );
+    REQUIRE ( stats.peak_bytes >= stats.live_bytes );
+
+    lhs.expand();
+    REQUIRE ( !lhs[0].is_compact() );
+    REQUIRE ( lhs.decrypt() == lhs_data );
+
+    // the copies of a bit are compacted once
+    CryptoBitset<8> ones = CryptoBitset<8>::broadcast(ctxt, CryptoBit(ctxt, 1));
+    ones.compact();
+    for (size_t i = 0; i < 8; i++)
+        REQUIRE (( ones[i].is_compact() && ones[i].shares_encryption(ones[0]) ));
+    REQUIRE ( ones.decrypt().all() );
+
+    // the copy of a bit may be released after its context
+    std::unique_ptr<CryptoBit> orphan;
+    {
+        BitEncryptionContext scoped;
+        CryptoBit bit(scoped, 1);
+        bit.compact();
+        orphan = std::make_unique<CryptoBit>(bit);
+    }
+    orphan.reset();
+}
+
+TEST_CASE("Fused gates on packed bits", "[Test46]")
+{
+    PackedBitsEncryptionContext<4096> ctxt;
+    std::vector<uint64_t> vec;
+    PackedCryptoBits<4096> a(ctxt, vec = { 0b0, 0b0, 0b1, 0b1 });
+    PackedCryptoBits<4096> b(ctxt, vec = { 0b0, 0b1, 0b0, 0b1 });
+
+    // x + y - 2xy, x + y - xy and 1 - x - y + 2xy, each with a single
+    // multiply-add and relinearization
+    std::vector<uint64_t> xor_res = (a ^ b).decrypt();
+    std::vector<uint64_t> or_res = (a | b).decrypt();
+    std::vector<uint64_t> xnor_res = (a == b).decrypt();
+
+    const std::vector<uint64_t> exp_xor = { 0, 1, 1, 0 }, exp_or = { 0, 1, 1, 1 };
+    for (size_t i = 0; i < a.nb_elements(); i++) {
+        REQUIRE ( xor_res[i] == (i < 4 ? exp_xor[i] : 0) );
+        REQUIRE ( or_res[i] == (i < 4 ? exp_or[i] : 0) );
+        REQUIRE ( xnor_res[i] == 1 - xor_res[i] );
+    }
+    REQUIRE ( (a ^ b).noise_budget() > 0 );
+}
+
+TEST_CASE("Bitsets packed in the slots: rotations and ShiftRows", "[Test47]")
+{
+    PackedBitsEncryptionContext<4096> ctxt;
+
+    // RotWord (see KeyExpansion) and the shifts on 32-bit words
+    std::bitset<32> word(0x0a0b0c0dULL);
+    SlotPackedCryptoBitset<32, 4096> he_word(ctxt, std::vector<std::bitset<32>>{ word, ~word });
+    REQUIRE ( he_word.nb_values() == 128 );
+
+    std::vector<std::bitset<32>> rotated = he_word.rotate_right(8).decrypt();
+    std::vector<std::bitset<32>> shifted = (he_word << 5).decrypt();
+    std::vector<std::bitset<32>> masked = (he_word ^ ClearBitset<32>(0xff00ff00ULL)).decrypt();
+    REQUIRE ( rotated[0] == ((word >> 8) | (word << 24)) );
+    REQUIRE ( rotated[1] == ((~word >> 8) | (~word << 24)) );
+    REQUIRE ( shifted[0] == (word << 5) );
+    REQUIRE ( shifted[1] == (~word << 5) );
+    REQUIRE ( masked[1] == (~word ^ std::bitset<32>(0xff00ff00ULL)) );
+    for (size_t j = 2; j < rotated.size(); j++)
+        REQUIRE ( (rotated[j].none() && shifted[j].none()) );
+
+    // ShiftRows on 32 blocks at once, the byte (row r, column c) being at
+    // the index 4*c + r
+    std::vector<std::bitset<128>> blocks;
+    for (unsigned j = 0; j < 32; j++) {
+        std::array<uint8_t, 16> block;
+        for (unsigned k = 0; k < 16; k++)
+            block[k] = static_cast<uint8_t>(16*j + k);
+        blocks.push_back(arrayToBitset(block));
+    }
+    SlotPackedCryptoBitset<128, 4096> he_blocks(ctxt, blocks);
+    SlotPackedCryptoBitset<128, 4096> he_shifted = ShiftRows(he_blocks);
+    std::vector<std::bitset<128>> shiftedRows = he_shifted.decrypt();
+    std::cout << "[Test47] noise budget after ShiftRows: " << he_shifted.min_noise_budget() << std::endl;
+    // (the masks of a permutation cost about a product, beyond the depth
+    // capacity of pmd = 4096)
+    he_shifted.refresh_for(1);
+    std::vector<std::bitset<128>> restored = InvShiftRows(he_shifted).decrypt();
+
+    for (unsigned j = 0; j < 32; j++) {
+        std::array<uint8_t, 16> res = bitsetToArray<uint8_t, 128>(shiftedRows[j]);
+        for (unsigned c = 0; c < 4; c++)
+            for (unsigned r = 0; r < 4; r++)
+                REQUIRE ( res[4*c + r] == static_cast<uint8_t>(16*j + 4*((c + r) % 4) + r) );
+        REQUIRE ( restored[j] == blocks[j] );
+    }
+}
+
+TEST_CASE("AES-CTR transciphering with a stub keystream", "[Test48]")
+{
+    BitEncryptionContext ctxt;
+
+    // the carry crosses the 64-bit half of the counter block
+    std::array<uint8_t, 16> iv = {
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x07,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xfe
+    };
+    std::array<uint8_t, 16> ctr2 = {
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+    };
+    std::array<uint8_t, 16> ctr_large = {
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xed
+    };
+    REQUIRE ( AES_CTR_CounterBlock(iv, 2) == arrayToBitset(ctr2) );
+    REQUIRE ( AES_CTR_CounterBlock(iv, 0x0123456789abcdefULL) == arrayToBitset(ctr_large) );
+
+    // (the keystream block of a counter block is its plain encryption: the
+    // transciphered block i is then c_i XOR ctr_i)
+    std::atomic<std::size_t> nb_encrypted{0};
+    auto encrypt_counter = [&](std::bitset<128> const& counterBlock) {
+        nb_encrypted++;
+        return CryptoBitset<128>(ctxt, counterBlock);
+    };
+
+    std::vector<std::bitset<128>> aes_ctr_data;
+    for (unsigned block = 0; block < 3; block++) {
+        std::array<uint8_t, 16> data;
+        for (unsigned k = 0; k < 16; k++)
+            data[k] = static_cast<uint8_t>(0x11 * block + 7 * k);
+        aes_ctr_data.push_back(arrayToBitset(data));
+    }
+
+    {
+        HE_AES_CTR_Transcipher<AES_128> transcipher(encrypt_counter, iv, 2);
+        REQUIRE ( transcipher.position() == 0 );
+        for (uint64_t block = 0; block < 3; block++) {
+            CryptoBitset<128> he_data = transcipher.transcipher(aes_ctr_data[block]);
+            REQUIRE ( transcipher.position() == block + 1 );
+            REQUIRE ( he_data.decrypt() == (aes_ctr_data[block] ^ AES_CTR_CounterBlock(iv, block)) );
+        }
+    }
+
+    // Without workers, the blocks are only computed by the waiting thread:
+    // the ones in flight at destruction are cancelled
+    nb_encrypted = 0;
+    TaskScheduler sequential(0);
+    {
+        HE_AES_CTR_Transcipher<AES_128> transcipher(encrypt_counter, iv, 3, sequential);
+        for (uint64_t block = 0; block < 2; block++) {
+            CryptoBitset<128> he_data = transcipher.transcipher(aes_ctr_data[block]);
+            REQUIRE ( he_data.decrypt() == (aes_ctr_data[block] ^ AES_CTR_CounterBlock(iv, block)) );
+        }
+        REQUIRE ( transcipher.position() == 2 );
+    }
+    REQUIRE ( nb_encrypted < 5 );
+}
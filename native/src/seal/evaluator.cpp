@@ -45,6 +45,17 @@ namespace seal
 
             return !(scale <= 0 || (static_cast<int>(log2(scale)) >= scale_bit_count_bound));
         }
+
+        // An integer factor reduced (and negated if negative) modulo modulus
+        SEAL_NODISCARD inline MultiplyUIntModOperand reduce_factor(int64_t factor, const Modulus &modulus)
+        {
+            const uint64_t factor_abs =
+                factor < 0 ? 0 - static_cast<uint64_t>(factor) : static_cast<uint64_t>(factor);
+            uint64_t reduced = barrett_reduce_64(factor_abs, modulus);
+            MultiplyUIntModOperand operand;
+            operand.set(factor < 0 ? negate_uint_mod(reduced, modulus) : reduced, modulus);
+            return operand;
+        }
     } // namespace
 
     Evaluator::Evaluator(const SEALContext &context) : context_(context)
@@ -265,6 +276,305 @@ namespace seal
 #endif
     }
 
+    vector<int> Evaluator::sum_slots_steps(size_t count) const
+    {
+        auto &context_data = *context_.first_context_data();
+        if (!context_data.qualifiers().using_batching)
+        {
+            throw logic_error("encryption parameters do not support batching");
+        }
+        size_t row_size = context_data.parms().poly_modulus_degree() >> 1;
+        size_t slot_count = context_data.parms().scheme() == scheme_type::bfv ? row_size << 1 : row_size;
+        if (count != slot_count && (count == 0 || count > row_size || (count & (count - 1))))
+        {
+            throw invalid_argument("count must be a power of two at most the row size or the number of slots");
+        }
+
+        vector<int> steps;
+        for (size_t step = 1; step < min(count, row_size); step <<= 1)
+        {
+            steps.push_back(safe_cast<int>(step));
+        }
+        if (count > row_size)
+        {
+            steps.push_back(0);
+        }
+        return steps;
+    }
+
+    void Evaluator::sum_slots_inplace(
+        Ciphertext &encrypted, size_t count, const GaloisKeys &galois_keys, MemoryPoolHandle pool) const
+    {
+        if (!is_metadata_valid_for(encrypted, context_) || !is_buffer_valid(encrypted))
+        {
+            throw invalid_argument("encrypted is not valid for encryption parameters");
+        }
+
+        // Each step doubles the number of slots summed
+        Ciphertext rotated(pool);
+        for (int step : sum_slots_steps(count))
+        {
+            rotated = encrypted;
+            if (step)
+            {
+                rotate_internal(rotated, step, galois_keys, pool);
+            }
+            else
+            {
+                conjugate_internal(rotated, galois_keys, pool);
+            }
+            add_inplace(encrypted, rotated);
+        }
+    }
+
+    void Evaluator::multiply_add_inplace(
+        Ciphertext &destination, const Ciphertext &encrypted1, const Ciphertext &encrypted2, int64_t factor,
+        MemoryPoolHandle pool) const
+    {
+        // Verify parameters.
+        if (!is_metadata_valid_for(destination, context_) || !is_buffer_valid(destination))
+        {
+            throw invalid_argument("destination is not valid for encryption parameters");
+        }
+        if (!is_metadata_valid_for(encrypted1, context_) || !is_buffer_valid(encrypted1))
+        {
+            throw invalid_argument("encrypted1 is not valid for encryption parameters");
+        }
+        if (!is_metadata_valid_for(encrypted2, context_) || !is_buffer_valid(encrypted2))
+        {
+            throw invalid_argument("encrypted2 is not valid for encryption parameters");
+        }
+        if (destination.parms_id() != encrypted1.parms_id() || encrypted1.parms_id() != encrypted2.parms_id())
+        {
+            throw invalid_argument("destination, encrypted1 and encrypted2 parameter mismatch");
+        }
+        if (!util::are_close<double>(destination.scale(), encrypted1.scale() * encrypted2.scale()))
+        {
+            throw invalid_argument("scale mismatch");
+        }
+        if (!pool)
+        {
+            throw invalid_argument("pool is uninitialized");
+        }
+
+        auto context_data_ptr = context_.first_context_data();
+        switch (context_data_ptr->parms().scheme())
+        {
+        case scheme_type::bfv:
+            bfv_multiply_add(destination, encrypted1, encrypted2, factor, pool);
+            break;
+
+        case scheme_type::ckks:
+            ckks_multiply_add(destination, encrypted1, encrypted2, factor, pool);
+            break;
+
+        default:
+            throw invalid_argument("unsupported scheme");
+        }
+#ifdef SEAL_THROW_ON_TRANSPARENT_CIPHERTEXT
+        // Transparent ciphertext output is not allowed.
+        if (destination.is_transparent())
+        {
+            throw logic_error("result ciphertext is transparent");
+        }
+#endif
+    }
+
+    void Evaluator::bfv_multiply_add(
+        Ciphertext &destination, const Ciphertext &encrypted1, const Ciphertext &encrypted2, int64_t factor,
+        MemoryPoolHandle pool) const
+    {
+        if (destination.is_ntt_form() || encrypted1.is_ntt_form() || encrypted2.is_ntt_form())
+        {
+            throw invalid_argument("destination, encrypted1 or encrypted2 cannot be in NTT form");
+        }
+
+        // Extract encryption parameters.
+        auto &context_data = *context_.get_context_data(encrypted1.parms_id());
+        auto &parms = context_data.parms();
+        size_t coeff_count = parms.poly_modulus_degree();
+        size_t base_q_size = parms.coeff_modulus().size();
+        size_t encrypted1_size = encrypted1.size();
+        size_t encrypted2_size = encrypted2.size();
+        uint64_t plain_modulus = parms.plain_modulus().value();
+
+        auto rns_tool = context_data.rns_tool();
+        size_t base_Bsk_size = rns_tool->base_Bsk()->size();
+        size_t base_Bsk_m_tilde_size = rns_tool->base_Bsk_m_tilde()->size();
+
+        // Size of the product and of the result
+        size_t product_size = sub_safe(add_safe(encrypted1_size, encrypted2_size), size_t(1));
+        size_t dest_size = max(destination.size(), product_size);
+
+        // Size check
+        if (!product_fits_in(dest_size, coeff_count, base_Bsk_m_tilde_size))
+        {
+            throw logic_error("invalid parameters");
+        }
+
+        // Set up iterators for bases
+        auto base_q = iter(parms.coeff_modulus());
+        auto base_Bsk = iter(rns_tool->base_Bsk()->base());
+
+        // Set up iterators for NTT tables
+        auto base_q_ntt_tables = iter(context_data.small_ntt_tables());
+        auto base_Bsk_ntt_tables = iter(rns_tool->base_Bsk_ntt_tables());
+
+        // The factor modulo each prime of base q
+        vector<MultiplyUIntModOperand> factor_q(base_q_size);
+        SEAL_ITERATE(iter(base_q, factor_q), base_q_size, [&](auto I) {
+            get<1>(I) = reduce_factor(factor, get<0>(I));
+        });
+
+        // BEHZ multiplication as in bfv_multiply, except that each component of the product is accumulated (scaled by
+        // factor) in destination as soon as step (8) produces it: the product is never stored in a ciphertext.
+        auto behz_extend_base_convert_to_ntt = [&](auto I) {
+            set_poly(get<0>(I), coeff_count, base_q_size, get<1>(I));
+            ntt_negacyclic_harvey_lazy(get<1>(I), base_q_size, base_q_ntt_tables);
+
+            SEAL_ALLOCATE_GET_RNS_ITER(temp, coeff_count, base_Bsk_m_tilde_size, pool);
+            rns_tool->fastbconv_m_tilde(get<0>(I), temp, pool);
+            rns_tool->sm_mrq(temp, get<2>(I), pool);
+            ntt_negacyclic_harvey_lazy(get<2>(I), base_Bsk_size, base_Bsk_ntt_tables);
+        };
+
+        // Perform BEHZ steps (1)-(3) for encrypted1 and encrypted2
+        SEAL_ALLOCATE_GET_POLY_ITER(encrypted1_q, encrypted1_size, coeff_count, base_q_size, pool);
+        SEAL_ALLOCATE_GET_POLY_ITER(encrypted1_Bsk, encrypted1_size, coeff_count, base_Bsk_size, pool);
+        SEAL_ITERATE(iter(encrypted1, encrypted1_q, encrypted1_Bsk), encrypted1_size, behz_extend_base_convert_to_ntt);
+
+        SEAL_ALLOCATE_GET_POLY_ITER(encrypted2_q, encrypted2_size, coeff_count, base_q_size, pool);
+        SEAL_ALLOCATE_GET_POLY_ITER(encrypted2_Bsk, encrypted2_size, coeff_count, base_Bsk_size, pool);
+        SEAL_ITERATE(iter(encrypted2, encrypted2_q, encrypted2_Bsk), encrypted2_size, behz_extend_base_convert_to_ntt);
+
+        // The inputs are not read anymore: destination may be one of them
+        destination.resize(context_, context_data.parms_id(), dest_size);
+
+        // Perform BEHZ step (4): dyadic multiplication on arbitrary size ciphertexts
+        SEAL_ALLOCATE_ZERO_GET_POLY_ITER(temp_dest_q, product_size, coeff_count, base_q_size, pool);
+        SEAL_ALLOCATE_ZERO_GET_POLY_ITER(temp_dest_Bsk, product_size, coeff_count, base_Bsk_size, pool);
+        SEAL_ITERATE(iter(size_t(0)), product_size, [&](auto I) {
+            size_t curr_encrypted1_last = min<size_t>(I, encrypted1_size - 1);
+            size_t curr_encrypted2_first = min<size_t>(I, encrypted2_size - 1);
+            size_t curr_encrypted1_first = I - curr_encrypted2_first;
+            size_t steps = curr_encrypted1_last - curr_encrypted1_first + 1;
+
+            auto behz_ciphertext_product = [&](ConstPolyIter in1_iter, ConstPolyIter in2_iter,
+                                               ConstModulusIter base_iter, size_t base_size, PolyIter out_iter) {
+                auto shifted_in1_iter = in1_iter + curr_encrypted1_first;
+                auto shifted_reversed_in2_iter = reverse_iter(in2_iter + curr_encrypted2_first);
+                auto shifted_out_iter = out_iter[I];
+
+                SEAL_ITERATE(iter(shifted_in1_iter, shifted_reversed_in2_iter), steps, [&](auto J) {
+                    SEAL_ITERATE(iter(J, base_iter, shifted_out_iter), base_size, [&](auto K) {
+                        SEAL_ALLOCATE_GET_COEFF_ITER(temp, coeff_count, pool);
+                        dyadic_product_coeffmod(get<0, 0>(K), get<0, 1>(K), coeff_count, get<1>(K), temp);
+                        add_poly_coeffmod(temp, get<2>(K), coeff_count, get<1>(K), get<2>(K));
+                    });
+                });
+            };
+
+            behz_ciphertext_product(encrypted1_q, encrypted2_q, base_q, base_q_size, temp_dest_q);
+            behz_ciphertext_product(encrypted1_Bsk, encrypted2_Bsk, base_Bsk, base_Bsk_size, temp_dest_Bsk);
+        });
+
+        // Perform BEHZ step (5): transform data from NTT form
+        inverse_ntt_negacyclic_harvey_lazy(temp_dest_q, product_size, base_q_ntt_tables);
+        inverse_ntt_negacyclic_harvey_lazy(temp_dest_Bsk, product_size, base_Bsk_ntt_tables);
+
+        // Perform BEHZ steps (6)-(8) and accumulate factor times the result in destination
+        SEAL_ITERATE(iter(temp_dest_q, temp_dest_Bsk, destination), product_size, [&](auto I) {
+            SEAL_ALLOCATE_GET_RNS_ITER(temp_q_Bsk, coeff_count, base_q_size + base_Bsk_size, pool);
+            multiply_poly_scalar_coeffmod(get<0>(I), base_q_size, plain_modulus, base_q, temp_q_Bsk);
+            multiply_poly_scalar_coeffmod(get<1>(I), base_Bsk_size, plain_modulus, base_Bsk, temp_q_Bsk + base_q_size);
+
+            SEAL_ALLOCATE_GET_RNS_ITER(temp_Bsk, coeff_count, base_Bsk_size, pool);
+            rns_tool->fast_floor(temp_q_Bsk, temp_Bsk, pool);
+
+            SEAL_ALLOCATE_GET_RNS_ITER(temp_q, coeff_count, base_q_size, pool);
+            rns_tool->fastbconv_sk(temp_Bsk, temp_q, pool);
+
+            SEAL_ITERATE(iter(temp_q, factor_q, base_q, get<2>(I)), base_q_size, [&](auto J) {
+                multiply_add_poly_scalar_coeffmod(get<0>(J), coeff_count, get<1>(J), get<2>(J), get<3>(J));
+            });
+        });
+    }
+
+    void Evaluator::ckks_multiply_add(
+        Ciphertext &destination, const Ciphertext &encrypted1, const Ciphertext &encrypted2, int64_t factor,
+        MemoryPoolHandle pool) const
+    {
+        if (!(destination.is_ntt_form() && encrypted1.is_ntt_form() && encrypted2.is_ntt_form()))
+        {
+            throw invalid_argument("destination, encrypted1 or encrypted2 must be in NTT form");
+        }
+
+        // The products are accumulated in destination while the inputs are read: an input aliased by destination is
+        // copied first
+        Ciphertext encrypted1_copy(pool), encrypted2_copy(pool);
+        const Ciphertext *in1 = &encrypted1;
+        const Ciphertext *in2 = &encrypted2;
+        if (&destination == in1)
+        {
+            encrypted1_copy = encrypted1;
+            in1 = &encrypted1_copy;
+        }
+        if (&destination == in2)
+        {
+            encrypted2_copy = encrypted2;
+            in2 = &encrypted2_copy;
+        }
+
+        // Extract encryption parameters.
+        auto &context_data = *context_.get_context_data(encrypted1.parms_id());
+        auto &parms = context_data.parms();
+        size_t coeff_count = parms.poly_modulus_degree();
+        size_t coeff_modulus_size = parms.coeff_modulus().size();
+        size_t encrypted1_size = in1->size();
+        size_t encrypted2_size = in2->size();
+
+        // Size of the product and of the result
+        size_t product_size = sub_safe(add_safe(encrypted1_size, encrypted2_size), size_t(1));
+        size_t dest_size = max(destination.size(), product_size);
+
+        // Size check
+        if (!product_fits_in(dest_size, coeff_count, coeff_modulus_size))
+        {
+            throw logic_error("invalid parameters");
+        }
+
+        auto coeff_modulus = iter(parms.coeff_modulus());
+        vector<MultiplyUIntModOperand> factors(coeff_modulus_size);
+        SEAL_ITERATE(iter(coeff_modulus, factors), coeff_modulus_size, [&](auto I) {
+            get<1>(I) = reduce_factor(factor, get<0>(I));
+        });
+
+        destination.resize(context_, context_data.parms_id(), dest_size);
+        PolyIter destination_iter = iter(destination);
+        ConstPolyIter encrypted1_iter = iter(*in1);
+        ConstPolyIter encrypted2_iter = iter(*in2);
+
+        // destination[I] += factor * sum of encrypted1[J] * encrypted2[I - J], e.g. c0 += a0.b0, c1 += a0.b1 + a1.b0
+        // and c2 += a1.b1 (times factor) for two ciphertexts of size 2
+        SEAL_ALLOCATE_GET_COEFF_ITER(prod, coeff_count, pool);
+        SEAL_ITERATE(iter(size_t(0)), product_size, [&](auto I) {
+            size_t curr_encrypted1_last = min<size_t>(I, encrypted1_size - 1);
+            size_t curr_encrypted2_first = min<size_t>(I, encrypted2_size - 1);
+            size_t curr_encrypted1_first = I - curr_encrypted2_first;
+            size_t steps = curr_encrypted1_last - curr_encrypted1_first + 1;
+
+            auto shifted_encrypted1_iter = encrypted1_iter + curr_encrypted1_first;
+            auto shifted_reversed_encrypted2_iter = reverse_iter(encrypted2_iter + curr_encrypted2_first);
+
+            SEAL_ITERATE(iter(shifted_encrypted1_iter, shifted_reversed_encrypted2_iter), steps, [&](auto J) {
+                SEAL_ITERATE(iter(J, coeff_modulus, factors, destination_iter[I]), coeff_modulus_size, [&](auto K) {
+                    dyadic_product_coeffmod(get<0, 0>(K), get<0, 1>(K), coeff_count, get<1>(K), prod);
+                    multiply_add_poly_scalar_coeffmod(prod, coeff_count, get<2>(K), get<1>(K), get<3>(K));
+                });
+            });
+        });
+    }
+
     void Evaluator::bfv_multiply(Ciphertext &encrypted1, const Ciphertext &encrypted2, MemoryPoolHandle pool) const
     {
         if (encrypted1.is_ntt_form() || encrypted2.is_ntt_form())
@@ -2108,6 +2418,61 @@ namespace seal
             throw invalid_argument("CKKS encrypted must be in NTT form");
         }
 
+        // Extract encryption parameters.
+        size_t coeff_count = parms.poly_modulus_degree();
+        size_t decomp_modulus_size = parms.coeff_modulus().size();
+        auto &key_modulus = key_parms.coeff_modulus();
+        auto key_ntt_tables = iter(key_context_data.small_ntt_tables());
+
+        // Create a copy of target_iter
+        SEAL_ALLOCATE_GET_RNS_ITER(t_target, coeff_count, decomp_modulus_size, pool);
+        set_uint(target_iter, decomp_modulus_size * coeff_count, t_target);
+
+        // In CKKS t_target is in NTT form; switch back to normal form
+        if (scheme == scheme_type::ckks)
+        {
+            inverse_ntt_negacyclic_harvey(t_target, decomp_modulus_size, key_ntt_tables);
+        }
+
+        // The J-th RNS component of target_iter, in NTT form modulo the key_index-th key modulus
+        switch_key_ntt_inplace(
+            encrypted,
+            [&](size_t key_index, size_t J, CoeffIter t_ntt) -> ConstCoeffIter {
+                // RNS-NTT form exists in input
+                if ((scheme == scheme_type::ckks) && (key_index == J))
+                {
+                    return target_iter[J];
+                }
+
+                // Perform RNS-NTT conversion
+                // No need to perform RNS conversion (modular reduction)
+                if (key_modulus[J] <= key_modulus[key_index])
+                {
+                    set_uint(t_target[J], coeff_count, t_ntt);
+                }
+                // Perform RNS conversion (modular reduction)
+                else
+                {
+                    modulo_poly_coeffs(t_target[J], coeff_count, key_modulus[key_index], t_ntt);
+                }
+                // NTT conversion lazy outputs in [0, 4q)
+                ntt_negacyclic_harvey_lazy(t_ntt, key_ntt_tables[key_index]);
+                return t_ntt;
+            },
+            kswitch_keys, kswitch_keys_index, pool);
+    }
+
+    template <typename Decomposed>
+    void Evaluator::switch_key_ntt_inplace(
+        Ciphertext &encrypted, Decomposed &&decomposed, const KSwitchKeys &kswitch_keys, size_t kswitch_keys_index,
+        MemoryPoolHandle pool) const
+    {
+        auto &context_data = *context_.get_context_data(encrypted.parms_id());
+        auto &parms = context_data.parms();
+        auto &key_context_data = *context_.key_context_data();
+        auto &key_parms = key_context_data.parms();
+        auto scheme = parms.scheme();
+
         // Extract encryption parameters.
         size_t coeff_count = parms.poly_modulus_degree();
         size_t decomp_modulus_size = parms.coeff_modulus().size();
@@ -2136,16 +2501,6 @@ namespace seal
             }
         }
 
-        // Create a copy of target_iter
-        SEAL_ALLOCATE_GET_RNS_ITER(t_target, coeff_count, decomp_modulus_size, pool);
-        set_uint(target_iter, decomp_modulus_size * coeff_count, t_target);
-
-        // In CKKS t_target is in NTT form; switch back to normal form
-        if (scheme == scheme_type::ckks)
-        {
-            inverse_ntt_negacyclic_harvey(t_target, decomp_modulus_size, key_ntt_tables);
-        }
-
         // Temporary result
         auto t_poly_prod(allocate_zero_poly_array(key_component_count, coeff_count, rns_modulus_size, pool));
 
@@ -2165,30 +2520,7 @@ namespace seal
             // Multiply with keys and perform lazy reduction on product's coefficients
             SEAL_ITERATE(iter(size_t(0)), decomp_modulus_size, [&](auto J) {
                 SEAL_ALLOCATE_GET_COEFF_ITER(t_ntt, coeff_count, pool);
-                ConstCoeffIter t_operand;
-
-                // RNS-NTT form exists in input
-                if ((scheme == scheme_type::ckks) && (I == J))
-                {
-                    t_operand = target_iter[J];
-                }
-                // Perform RNS-NTT conversion
-                else
-                {
-                    // No need to perform RNS conversion (modular reduction)
-                    if (key_modulus[J] <= key_modulus[key_index])
-                    {
-                        set_uint(t_target[J], coeff_count, t_ntt);
-                    }
-                    // Perform RNS conversion (modular reduction)
-                    else
-                    {
-                        modulo_poly_coeffs(t_target[J], coeff_count, key_modulus[key_index], t_ntt);
-                    }
-                    // NTT conversion lazy outputs in [0, 4q)
-                    ntt_negacyclic_harvey_lazy(t_ntt, key_ntt_tables[key_index]);
-                    t_operand = t_ntt;
-                }
+                ConstCoeffIter t_operand = decomposed(key_index, J, t_ntt);
 
                 // Multiply with keys and modular accumulate products in a lazy fashion
                 SEAL_ITERATE(iter(key_vector[J].data(), accumulator_iter), key_component_count, [&](auto K) {
@@ -2305,4 +2637,151 @@ namespace seal
             });
         });
     }
+
+    void Evaluator::rotate_hoisted(
+        const Ciphertext &encrypted, const vector<int> &steps, const GaloisKeys &galois_keys,
+        vector<Ciphertext> &destinations, MemoryPoolHandle pool) const
+    {
+        // Verify parameters.
+        if (!is_metadata_valid_for(encrypted, context_) || !is_buffer_valid(encrypted))
+        {
+            throw invalid_argument("encrypted is not valid for encryption parameters");
+        }
+        auto &context_data = *context_.get_context_data(encrypted.parms_id());
+        if (!context_data.qualifiers().using_batching)
+        {
+            throw logic_error("encryption parameters do not support batching");
+        }
+        if (galois_keys.parms_id() != context_.key_parms_id())
+        {
+            throw invalid_argument("galois_keys is not valid for encryption parameters");
+        }
+        if (!context_.using_keyswitching())
+        {
+            throw logic_error("keyswitching is not supported by the context");
+        }
+        if (!pool)
+        {
+            throw invalid_argument("pool is uninitialized");
+        }
+        if (encrypted.size() > 2)
+        {
+            throw invalid_argument("encrypted size must be 2");
+        }
+
+        auto &parms = context_data.parms();
+        auto scheme = parms.scheme();
+        if (scheme == scheme_type::bfv && encrypted.is_ntt_form())
+        {
+            throw invalid_argument("BFV encrypted cannot be in NTT form");
+        }
+        if (scheme == scheme_type::ckks && !encrypted.is_ntt_form())
+        {
+            throw invalid_argument("CKKS encrypted must be in NTT form");
+        }
+
+        // Extract encryption parameters.
+        auto &key_context_data = *context_.key_context_data();
+        auto &coeff_modulus = parms.coeff_modulus();
+        auto &key_modulus = key_context_data.parms().coeff_modulus();
+        size_t coeff_count = parms.poly_modulus_degree();
+        size_t decomp_modulus_size = coeff_modulus.size();
+        size_t key_modulus_size = key_modulus.size();
+        size_t rns_modulus_size = decomp_modulus_size + 1;
+        auto key_ntt_tables = iter(key_context_data.small_ntt_tables());
+        // Use key_context_data where permutation tables exist since previous runs.
+        auto galois_tool = key_context_data.galois_tool();
+
+        // Size check
+        if (!product_fits_in(coeff_count, rns_modulus_size, decomp_modulus_size))
+        {
+            throw logic_error("invalid parameters");
+        }
+
+        // Check the Galois keys before the decomposition
+        vector<uint32_t> galois_elts(steps.size(), 0);
+        for (size_t i = 0; i < steps.size(); i++)
+        {
+            if (steps[i])
+            {
+                galois_elts[i] = context_data.galois_tool()->get_elt_from_step(steps[i]);
+                if (!galois_keys.has_key(galois_elts[i]))
+                {
+                    throw invalid_argument("Galois key not present");
+                }
+            }
+        }
+
+        // encrypted.data(1) in normal form
+        auto encrypted_iter = iter(encrypted);
+        SEAL_ALLOCATE_GET_RNS_ITER(t_target, coeff_count, decomp_modulus_size, pool);
+        set_uint(encrypted_iter[1], decomp_modulus_size * coeff_count, t_target);
+        if (scheme == scheme_type::ckks)
+        {
+            inverse_ntt_negacyclic_harvey(t_target, decomp_modulus_size, key_ntt_tables);
+        }
+
+        // Decomposition of encrypted.data(1): the J-th RNS component in NTT form modulo each key modulus, as in
+        // switch_key_inplace. A Galois automorphism is a permutation of the NTT form, so the decomposition of each
+        // rotated ciphertext is a permutation of this one.
+        auto t_decomp(allocate_poly_array(rns_modulus_size, coeff_count, decomp_modulus_size, pool));
+        PolyIter t_decomp_iter(t_decomp.get(), coeff_count, decomp_modulus_size);
+        SEAL_ITERATE(iter(size_t(0), t_decomp_iter), rns_modulus_size, [&](auto I) {
+            size_t key_index = (get<0>(I) == decomp_modulus_size ? key_modulus_size - 1 : get<0>(I));
+            SEAL_ITERATE(iter(size_t(0), get<1>(I)), decomp_modulus_size, [&](auto J) {
+                size_t j = get<0>(J);
+                if (key_modulus[j] <= key_modulus[key_index])
+                {
+                    set_uint(t_target[j], coeff_count, get<1>(J));
+                }
+                else
+                {
+                    modulo_poly_coeffs(t_target[j], coeff_count, key_modulus[key_index], get<1>(J));
+                }
+                ntt_negacyclic_harvey_lazy(get<1>(J), key_ntt_tables[key_index]);
+            });
+        });
+
+        destinations.resize(steps.size());
+        for (size_t i = 0; i < steps.size(); i++)
+        {
+            uint32_t galois_elt = galois_elts[i];
+            Ciphertext &destination = destinations[i];
+            destination = encrypted;
+            if (!galois_elt)
+            {
+                continue;
+            }
+
+            // (galois(ct[0]), 0)
+            auto destination_iter = iter(destination);
+            if (scheme == scheme_type::bfv)
+            {
+                galois_tool->apply_galois(
+                    encrypted_iter[0], decomp_modulus_size, galois_elt, coeff_modulus, destination_iter[0]);
+            }
+            else
+            {
+                galois_tool->apply_galois_ntt(encrypted_iter[0], decomp_modulus_size, galois_elt, destination_iter[0]);
+            }
+            set_zero_poly(coeff_count, decomp_modulus_size, destination.data(1));
+
+            // Calculate (galois(ct[1]) * galois_key[0], galois(ct[1]) * galois_key[1]) + (galois(ct[0]), 0)
+            switch_key_ntt_inplace(
+                destination,
+                [&](size_t key_index, size_t J, CoeffIter t_ntt) -> ConstCoeffIter {
+                    size_t decomp_index = (key_index == key_modulus_size - 1 ? decomp_modulus_size : key_index);
+                    galois_tool->apply_galois_ntt(t_decomp_iter[decomp_index][J], galois_elt, t_ntt);
+                    return t_ntt;
+                },
+                static_cast<const KSwitchKeys &>(galois_keys), GaloisKeys::get_index(galois_elt), pool);
+#ifdef SEAL_THROW_ON_TRANSPARENT_CIPHERTEXT
+            // Transparent ciphertext output is not allowed.
+            if (destination.is_transparent())
+            {
+                throw logic_error("result ciphertext is transparent");
+            }
+#endif
+        }
+    }
 } // namespace seal
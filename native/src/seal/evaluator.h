@@ -282,6 +282,33 @@ namespace seal
             square_inplace(destination, std::move(pool));
         }
 
+        /**
+        Multiplies two ciphertexts and adds their product, scaled by an integer factor, to a ciphertext. This function
+        computes destination + factor * (encrypted1 * encrypted2) and stores the result in destination. Each component
+        of the tensor product is accumulated (scaled by factor) in destination as soon as it is computed, instead of
+        going through the product ciphertext and the extra passes of multiply, multiply_plain and add. For instance,
+        from destination = x + y, the factors -1 and -2 give the OR (x + y - xy) and the XOR (x + y - 2xy) of bits
+        encrypted with BFV. The result is not relinearized, and the noise of the product grows with the absolute value
+        of factor. Dynamic memory allocations in the process are allocated from the memory pool pointed to by the given
+        MemoryPoolHandle.
+
+        @param[in,out] destination The ciphertext to add the scaled product to
+        @param[in] encrypted1 The first ciphertext to multiply
+        @param[in] encrypted2 The second ciphertext to multiply
+        @param[in] factor The integer the product is multiplied by
+        @param[in] pool The MemoryPoolHandle pointing to a valid memory pool
+        @throws std::invalid_argument if destination, encrypted1 or encrypted2 is not valid for the encryption
+        parameters
+        @throws std::invalid_argument if destination, encrypted1 and encrypted2 are at different level
+        @throws std::invalid_argument if destination, encrypted1 or encrypted2 is not in the default NTT form
+        @throws std::invalid_argument if the scale of destination is not the scale of the product
+        @throws std::invalid_argument if pool is uninitialized
+        @throws std::logic_error if result ciphertext is transparent
+        */
+        void multiply_add_inplace(
+            Ciphertext &destination, const Ciphertext &encrypted1, const Ciphertext &encrypted2,
+            std::int64_t factor = 1, MemoryPoolHandle pool = MemoryManager::GetPool()) const;
+
         /**
         Relinearizes a ciphertext. This functions relinearizes encrypted, reducing its size down to 2. If the size of
         encrypted is K+1, the given relinearization keys need to have size at least K-1. Dynamic memory allocations in
@@ -1131,6 +1158,33 @@ namespace seal
             rotate_vector_inplace(destination, steps, galois_keys, std::move(pool));
         }
 
+        /**
+        Rotates a ciphertext by several steps at once, as rotate_rows (BFV) or rotate_vector (CKKS) for each of them.
+        The rotations are hoisted: the key switching decomposition of encrypted (its RNS components in NTT form modulo
+        each key modulus) is computed once and only permuted by each Galois automorphism, so the NTTs of the
+        decomposition are shared between all the rotations. Each step must have its own Galois key (no NAF
+        decomposition as in rotate_rows) and step 0 gives a copy of encrypted. Dynamic memory allocations in the
+        process are allocated from the memory pool pointed to by the given MemoryPoolHandle.
+
+        @param[in] encrypted The ciphertext to rotate
+        @param[in] steps The numbers of steps to rotate (positive left, negative right)
+        @param[in] galois_keys The Galois keys
+        @param[out] destinations The ciphertexts to overwrite with the rotated results, one per step
+        @param[in] pool The MemoryPoolHandle pointing to a valid memory pool
+        @throws std::logic_error if the encryption parameters do not support batching
+        @throws std::invalid_argument if encrypted or galois_keys is not valid for
+        the encryption parameters
+        @throws std::invalid_argument if encrypted is in NTT form (BFV) or is not (CKKS)
+        @throws std::invalid_argument if encrypted has size larger than 2
+        @throws std::invalid_argument if the Galois key of a step is not present
+        @throws std::invalid_argument if pool is uninitialized
+        @throws std::logic_error if keyswitching is not supported by the context
+        @throws std::logic_error if result ciphertext is transparent
+        */
+        void rotate_hoisted(
+            const Ciphertext &encrypted, const std::vector<int> &steps, const GaloisKeys &galois_keys,
+            std::vector<Ciphertext> &destinations, MemoryPoolHandle pool = MemoryManager::GetPool()) const;
+
         /**
         Complex conjugates plaintext slot values. When using the CKKS scheme, this function complex conjugates all
         values in the underlying plaintext. Dynamic memory allocations in the process are allocated from the memory pool
@@ -1192,6 +1246,70 @@ namespace seal
             complex_conjugate_inplace(destination, galois_keys, std::move(pool));
         }
 
+        /**
+        Sums the slots of a ciphertext by rotations of power-of-two steps. If count is a power of two at most the row
+        size (the number of slots for CKKS), each slot i becomes the sum of the count slots i, i + 1, ..., i + count - 1
+        of its row (cyclically): slot 0 then holds the sum of the first count slots. If count is the number of slots of
+        a BFV ciphertext, both rows are summed too (with rotate_columns) and every slot holds the sum of all the slots.
+        It costs log2(count) rotations (plus rotate_columns), i.e. as many key switchings with the Galois keys of
+        sum_slots_steps, instead of count - 1 rotations by one step. Dynamic memory allocations in the process are
+        allocated from the memory pool pointed to by the given MemoryPoolHandle.
+
+        @param[in] encrypted The ciphertext whose slots to sum
+        @param[in] count The number of slots to sum
+        @param[in] galois_keys The Galois keys
+        @param[in] pool The MemoryPoolHandle pointing to a valid memory pool
+        @throws std::logic_error if the encryption parameters do not support batching
+        @throws std::invalid_argument if count is not a power of two at most the row size or the number of slots
+        @throws std::invalid_argument if encrypted or galois_keys is not valid for the encryption parameters
+        @throws std::invalid_argument if encrypted has size larger than 2
+        @throws std::invalid_argument if necessary Galois keys are not present
+        @throws std::invalid_argument if pool is uninitialized
+        @throws std::logic_error if keyswitching is not supported by the context
+        */
+        void sum_slots_inplace(
+            Ciphertext &encrypted, std::size_t count, const GaloisKeys &galois_keys,
+            MemoryPoolHandle pool = MemoryManager::GetPool()) const;
+
+        /**
+        Returns the rotation steps of sum_slots_inplace for count slots (0 standing for rotate_columns), e.g. to create
+        only their Galois keys with KeyGenerator::create_galois_keys.
+
+        @param[in] count The number of slots to sum
+        @throws std::invalid_argument if count is not a power of two at most the row size or the number of slots
+        */
+        std::vector<int> sum_slots_steps(std::size_t count) const;
+
+        /**
+        Computes the inner product of the first count slots of two ciphertexts: their product is relinearized and
+        summed by sum_slots_inplace, so that slot 0 of destination holds the inner product (and, if count is the number
+        of slots, every slot holds it). Dynamic memory allocations in the process are allocated from the memory pool
+        pointed to by the given MemoryPoolHandle.
+
+        @param[in] encrypted1 The first vector
+        @param[in] encrypted2 The second vector
+        @param[in] count The number of slots to sum (see sum_slots_inplace)
+        @param[in] relin_keys The relinearization keys
+        @param[in] galois_keys The Galois keys
+        @param[out] destination The ciphertext to overwrite with the inner product
+        @param[in] pool The MemoryPoolHandle pointing to a valid memory pool
+        @throws std::invalid_argument if encrypted1 and encrypted2 cannot be multiplied (see multiply)
+        @throws std::invalid_argument if count is not a power of two at most the row size or the number of slots
+        @throws std::invalid_argument if relin_keys or galois_keys is not valid for the encryption parameters
+        @throws std::invalid_argument if necessary Galois keys are not present
+        @throws std::invalid_argument if pool is uninitialized
+        @throws std::logic_error if keyswitching is not supported by the context
+        */
+        inline void inner_product(
+            const Ciphertext &encrypted1, const Ciphertext &encrypted2, std::size_t count,
+            const RelinKeys &relin_keys, const GaloisKeys &galois_keys, Ciphertext &destination,
+            MemoryPoolHandle pool = MemoryManager::GetPool()) const
+        {
+            multiply(encrypted1, encrypted2, destination, pool);
+            relinearize_inplace(destination, relin_keys, pool);
+            sum_slots_inplace(destination, count, galois_keys, std::move(pool));
+        }
+
         /**
         Enables access to private members of seal::Evaluator for SEAL_C.
         */
@@ -1210,6 +1328,14 @@ namespace seal
 
         void ckks_multiply(Ciphertext &encrypted1, const Ciphertext &encrypted2, MemoryPoolHandle pool) const;
 
+        void bfv_multiply_add(
+            Ciphertext &destination, const Ciphertext &encrypted1, const Ciphertext &encrypted2, std::int64_t factor,
+            MemoryPoolHandle pool) const;
+
+        void ckks_multiply_add(
+            Ciphertext &destination, const Ciphertext &encrypted1, const Ciphertext &encrypted2, std::int64_t factor,
+            MemoryPoolHandle pool) const;
+
         void bfv_square(Ciphertext &encrypted, MemoryPoolHandle pool) const;
 
         void ckks_square(Ciphertext &encrypted, MemoryPoolHandle pool) const;
@@ -1255,6 +1381,13 @@ namespace seal
             Ciphertext &encrypted, util::ConstRNSIter target_iter, const KSwitchKeys &kswitch_keys,
             std::size_t key_index, MemoryPoolHandle pool = MemoryManager::GetPool()) const;
 
+        // Key switching of the decomposed target: decomposed(key_index, J, scratch) gives its J-th RNS component in
+        // NTT form modulo the key_index-th key modulus (possibly written to scratch)
+        template <typename Decomposed>
+        void switch_key_ntt_inplace(
+            Ciphertext &encrypted, Decomposed &&decomposed, const KSwitchKeys &kswitch_keys, std::size_t key_index,
+            MemoryPoolHandle pool) const;
+
         void multiply_plain_normal(Ciphertext &encrypted, const Plaintext &plain, MemoryPoolHandle pool) const;
 
         void multiply_plain_ntt(Ciphertext &encrypted_ntt, const Plaintext &plain_ntt) const;
@@ -223,6 +223,36 @@ namespace seal
 #endif
         }
 
+        void multiply_add_poly_scalar_coeffmod(
+            ConstCoeffIter poly, size_t coeff_count, MultiplyUIntModOperand scalar, const Modulus &modulus,
+            CoeffIter result)
+        {
+#ifdef SEAL_DEBUG
+            if (!poly && coeff_count > 0)
+            {
+                throw invalid_argument("poly");
+            }
+            if (!result && coeff_count > 0)
+            {
+                throw invalid_argument("result");
+            }
+            if (modulus.is_zero())
+            {
+                throw invalid_argument("modulus");
+            }
+#endif
+
+#ifdef SEAL_USE_INTEL_HEXL
+            intel::hexl::EltwiseFMAMod(
+                &result[0], &poly[0], scalar.operand, &result[0], coeff_count, modulus.value(), 1);
+#else
+            SEAL_ITERATE(iter(poly, result), coeff_count, [&](auto I) {
+                const uint64_t x = get<0>(I);
+                get<1>(I) = add_uint_mod(multiply_uint_mod(x, scalar, modulus), get<1>(I), modulus);
+            });
+#endif
+        }
+
         void dyadic_product_coeffmod(
             ConstCoeffIter operand1, ConstCoeffIter operand2, size_t coeff_count, const Modulus &modulus,
             CoeffIter result)
@@ -447,6 +447,24 @@ namespace seal
             multiply_poly_scalar_coeffmod(poly, coeff_count, temp_scalar, modulus, result);
         }
 
+        /**
+        Adds poly * scalar to result, coefficient-wise and in a single pass (a fused multiply-add). The coefficients of
+        result must be reduced modulo modulus.
+        */
+        void multiply_add_poly_scalar_coeffmod(
+            ConstCoeffIter poly, std::size_t coeff_count, MultiplyUIntModOperand scalar, const Modulus &modulus,
+            CoeffIter result);
+
+        inline void multiply_add_poly_scalar_coeffmod(
+            ConstCoeffIter poly, std::size_t coeff_count, std::uint64_t scalar, const Modulus &modulus,
+            CoeffIter result)
+        {
+            // Scalar must be first reduced modulo modulus
+            MultiplyUIntModOperand temp_scalar;
+            temp_scalar.set(barrett_reduce_64(scalar, modulus), modulus);
+            multiply_add_poly_scalar_coeffmod(poly, coeff_count, temp_scalar, modulus, result);
+        }
+
         inline void multiply_poly_scalar_coeffmod(
             ConstRNSIter poly, std::size_t coeff_modulus_size, std::uint64_t scalar, ConstModulusIter modulus,
             RNSIter result)
@@ -3489,6 +3489,126 @@ namespace sealtest
         ASSERT_TRUE(encrypted.parms_id() == context.first_parms_id());
     }
 
+    TEST(EvaluatorTest, BFVEncryptMultiplyAddDecrypt)
+    {
+        EncryptionParameters parms(scheme_type::bfv);
+        Modulus plain_modulus(1 << 6);
+        parms.set_poly_modulus_degree(128);
+        parms.set_plain_modulus(plain_modulus);
+        parms.set_coeff_modulus(CoeffModulus::Create(128, { 40, 40, 40 }));
+
+        SEALContext context(parms, false, sec_level_type::none);
+        KeyGenerator keygen(context);
+        PublicKey pk;
+        keygen.create_public_key(pk);
+        RelinKeys rlk;
+        keygen.create_relin_keys(rlk);
+
+        Encryptor encryptor(context, pk);
+        Evaluator evaluator(context);
+        Decryptor decryptor(context, keygen.secret_key());
+
+        Ciphertext encrypted1;
+        Ciphertext encrypted2;
+        Ciphertext destination;
+        Plaintext plain;
+
+        // 5 + 2.(3x.2) = 12x + 5
+        encryptor.encrypt(Plaintext("5"), destination);
+        encryptor.encrypt(Plaintext("3x^1"), encrypted1);
+        encryptor.encrypt(Plaintext("2"), encrypted2);
+        evaluator.multiply_add_inplace(destination, encrypted1, encrypted2, 2);
+        ASSERT_EQ(3ULL, destination.size());
+        decryptor.decrypt(destination, plain);
+        ASSERT_EQ(plain.to_string(), "Cx^1 + 5");
+        ASSERT_TRUE(destination.parms_id() == context.first_parms_id());
+
+        // x + y - xy and x + y - 2xy on bits (OR and XOR)
+        for (uint64_t x = 0; x < 2; x++)
+        {
+            for (uint64_t y = 0; y < 2; y++)
+            {
+                encryptor.encrypt(Plaintext(x ? "1" : "0"), encrypted1);
+                encryptor.encrypt(Plaintext(y ? "1" : "0"), encrypted2);
+
+                evaluator.add(encrypted1, encrypted2, destination);
+                evaluator.multiply_add_inplace(destination, encrypted1, encrypted2, -1);
+                evaluator.relinearize_inplace(destination, rlk);
+                ASSERT_EQ(2ULL, destination.size());
+                decryptor.decrypt(destination, plain);
+                ASSERT_EQ(x | y, plain.is_zero() ? 0 : plain[0]);
+
+                evaluator.add(encrypted1, encrypted2, destination);
+                evaluator.multiply_add_inplace(destination, encrypted1, encrypted2, -2);
+                decryptor.decrypt(destination, plain);
+                ASSERT_EQ(x ^ y, plain.is_zero() ? 0 : plain[0]);
+            }
+        }
+
+        // destination may be one of the operands: 3 + 3.3 = 12
+        encryptor.encrypt(Plaintext("3"), encrypted1);
+        evaluator.multiply_add_inplace(encrypted1, encrypted1, encrypted1);
+        ASSERT_EQ(3ULL, encrypted1.size());
+        decryptor.decrypt(encrypted1, plain);
+        ASSERT_EQ(plain.to_string(), "C");
+    }
+
+    TEST(EvaluatorTest, CKKSEncryptMultiplyAddDecrypt)
+    {
+        EncryptionParameters parms(scheme_type::ckks);
+        size_t slot_size = 32;
+        parms.set_poly_modulus_degree(slot_size * 2);
+        parms.set_coeff_modulus(CoeffModulus::Create(slot_size * 2, { 60, 60, 60 }));
+
+        SEALContext context(parms, false, sec_level_type::none);
+        KeyGenerator keygen(context);
+        PublicKey pk;
+        keygen.create_public_key(pk);
+
+        CKKSEncoder encoder(context);
+        Encryptor encryptor(context, pk);
+        Decryptor decryptor(context, keygen.secret_key());
+        Evaluator evaluator(context);
+
+        vector<complex<double>> input1(slot_size), input2(slot_size), input3(slot_size);
+        vector<complex<double>> expected(slot_size), output(slot_size);
+        srand(static_cast<unsigned>(time(NULL)));
+        for (size_t i = 0; i < slot_size; i++)
+        {
+            input1[i] = static_cast<double>(rand() % 10);
+            input2[i] = static_cast<double>(rand() % 10);
+            input3[i] = static_cast<double>(rand() % 10);
+            expected[i] = input3[i] - 2.0 * input1[i] * input2[i];
+        }
+
+        // destination at the scale of the product
+        const double delta = static_cast<double>(1ULL << 30);
+        Plaintext plain1, plain2, plain3, plain_res;
+        encoder.encode(input1, context.first_parms_id(), delta, plain1);
+        encoder.encode(input2, context.first_parms_id(), delta, plain2);
+        encoder.encode(input3, context.first_parms_id(), delta * delta, plain3);
+
+        Ciphertext encrypted1, encrypted2, destination;
+        encryptor.encrypt(plain1, encrypted1);
+        encryptor.encrypt(plain2, encrypted2);
+        encryptor.encrypt(plain3, destination);
+
+        evaluator.multiply_add_inplace(destination, encrypted1, encrypted2, -2);
+        ASSERT_EQ(3ULL, destination.size());
+        ASSERT_TRUE(destination.parms_id() == context.first_parms_id());
+
+        decryptor.decrypt(destination, plain_res);
+        encoder.decode(plain_res, output);
+        for (size_t i = 0; i < slot_size; i++)
+        {
+            auto tmp = abs(expected[i].real() - output[i].real());
+            ASSERT_TRUE(tmp < 0.5);
+        }
+
+        // the scale of destination must be the one of the product
+        ASSERT_THROW(evaluator.multiply_add_inplace(encrypted1, encrypted1, encrypted2), invalid_argument);
+    }
+
     TEST(EvaluatorTest, BFVEncryptMultiplyManyDecrypt)
     {
         EncryptionParameters parms(scheme_type::bfv);
@@ -4016,6 +4136,175 @@ namespace sealtest
         ASSERT_TRUE("1x^3 + 2x^2 + 1x^1 + 1" == plain.to_string());
     }
 
+    TEST(EvaluatorTest, BFVEncryptSumSlotsDecrypt)
+    {
+        EncryptionParameters parms(scheme_type::bfv);
+        Modulus plain_modulus(257);
+        parms.set_poly_modulus_degree(8);
+        parms.set_plain_modulus(plain_modulus);
+        parms.set_coeff_modulus(CoeffModulus::Create(8, { 40, 40 }));
+
+        SEALContext context(parms, false, sec_level_type::none);
+        KeyGenerator keygen(context);
+        PublicKey pk;
+        keygen.create_public_key(pk);
+        RelinKeys rlk;
+        keygen.create_relin_keys(rlk);
+
+        Encryptor encryptor(context, pk);
+        Evaluator evaluator(context);
+        Decryptor decryptor(context, keygen.secret_key());
+        BatchEncoder batch_encoder(context);
+
+        ASSERT_TRUE((evaluator.sum_slots_steps(4) == vector<int>{ 1, 2 }));
+        ASSERT_TRUE((evaluator.sum_slots_steps(8) == vector<int>{ 1, 2, 0 }));
+        ASSERT_THROW(evaluator.sum_slots_steps(3), invalid_argument);
+        ASSERT_THROW(evaluator.sum_slots_steps(16), invalid_argument);
+
+        // Only the Galois keys of the steps are needed
+        GaloisKeys glk;
+        keygen.create_galois_keys(evaluator.sum_slots_steps(8), glk);
+        ASSERT_EQ(3ULL, glk.size());
+
+        Plaintext plain;
+        vector<uint64_t> plain_vec{ 1, 2, 3, 4, 5, 6, 7, 8 };
+        batch_encoder.encode(plain_vec, plain);
+        Ciphertext encrypted;
+        encryptor.encrypt(plain, encrypted);
+
+        Ciphertext summed = encrypted;
+        evaluator.sum_slots_inplace(summed, 2, glk);
+        decryptor.decrypt(summed, plain);
+        batch_encoder.decode(plain, plain_vec);
+        ASSERT_TRUE((plain_vec == vector<uint64_t>{ 3, 5, 7, 5, 11, 13, 15, 13 }));
+
+        summed = encrypted;
+        evaluator.sum_slots_inplace(summed, 8, glk);
+        decryptor.decrypt(summed, plain);
+        batch_encoder.decode(plain, plain_vec);
+        ASSERT_TRUE((plain_vec == vector<uint64_t>(8, 36)));
+
+        Ciphertext encrypted2;
+        batch_encoder.encode(vector<uint64_t>{ 1, 1, 1, 1, 2, 2, 2, 2 }, plain);
+        encryptor.encrypt(plain, encrypted2);
+
+        Ciphertext product;
+        evaluator.inner_product(encrypted, encrypted2, 4, rlk, glk, product);
+        ASSERT_EQ(2ULL, product.size());
+        decryptor.decrypt(product, plain);
+        batch_encoder.decode(plain, plain_vec);
+        ASSERT_EQ(10ULL, plain_vec[0]);
+        ASSERT_EQ(52ULL, plain_vec[4]);
+
+        evaluator.inner_product(encrypted, encrypted2, 8, rlk, glk, product);
+        decryptor.decrypt(product, plain);
+        batch_encoder.decode(plain, plain_vec);
+        ASSERT_TRUE((plain_vec == vector<uint64_t>(8, 62)));
+    }
+
+    TEST(EvaluatorTest, BFVEncryptRotateHoistedDecrypt)
+    {
+        EncryptionParameters parms(scheme_type::bfv);
+        Modulus plain_modulus(257);
+        parms.set_poly_modulus_degree(8);
+        parms.set_plain_modulus(plain_modulus);
+        parms.set_coeff_modulus(CoeffModulus::Create(8, { 40, 40, 40 }));
+
+        SEALContext context(parms, true, sec_level_type::none);
+        KeyGenerator keygen(context);
+        PublicKey pk;
+        keygen.create_public_key(pk);
+        GaloisKeys glk;
+        keygen.create_galois_keys(vector<int>{ 1, 2, -1, 3 }, glk);
+
+        Encryptor encryptor(context, pk);
+        Evaluator evaluator(context);
+        Decryptor decryptor(context, keygen.secret_key());
+        BatchEncoder batch_encoder(context);
+
+        Plaintext plain;
+        vector<uint64_t> plain_vec{ 1, 2, 3, 4, 5, 6, 7, 8 };
+        batch_encoder.encode(plain_vec, plain);
+        Ciphertext encrypted;
+        encryptor.encrypt(plain, encrypted);
+
+        vector<int> steps{ 1, 0, 2, -1, 3 };
+        vector<vector<uint64_t>> expected{ { 2, 3, 4, 1, 6, 7, 8, 5 },
+                                           { 1, 2, 3, 4, 5, 6, 7, 8 },
+                                           { 3, 4, 1, 2, 7, 8, 5, 6 },
+                                           { 4, 1, 2, 3, 8, 5, 6, 7 },
+                                           { 4, 1, 2, 3, 8, 5, 6, 7 } };
+
+        // Top level and a lower level of the modulus chain
+        for (int level = 0; level < 2; level++)
+        {
+            vector<Ciphertext> rotated;
+            evaluator.rotate_hoisted(encrypted, steps, glk, rotated);
+            ASSERT_EQ(steps.size(), rotated.size());
+            for (size_t i = 0; i < steps.size(); i++)
+            {
+                ASSERT_TRUE(rotated[i].parms_id() == encrypted.parms_id());
+                decryptor.decrypt(rotated[i], plain);
+                batch_encoder.decode(plain, plain_vec);
+                ASSERT_TRUE(plain_vec == expected[i]);
+            }
+            if (!level)
+            {
+                evaluator.mod_switch_to_next_inplace(encrypted);
+            }
+        }
+
+        // Each step needs its own key
+        GaloisKeys glk1;
+        keygen.create_galois_keys(vector<int>{ 1 }, glk1);
+        vector<Ciphertext> rotated;
+        ASSERT_THROW(evaluator.rotate_hoisted(encrypted, vector<int>{ 1, 2 }, glk1, rotated), invalid_argument);
+    }
+
+    TEST(EvaluatorTest, CKKSEncryptRotateHoistedDecrypt)
+    {
+        EncryptionParameters parms(scheme_type::ckks);
+        size_t slot_size = 4;
+        parms.set_poly_modulus_degree(slot_size * 2);
+        parms.set_coeff_modulus(CoeffModulus::Create(slot_size * 2, { 40, 40, 40, 40 }));
+
+        SEALContext context(parms, false, sec_level_type::none);
+        KeyGenerator keygen(context);
+        PublicKey pk;
+        keygen.create_public_key(pk);
+        GaloisKeys glk;
+        keygen.create_galois_keys(vector<int>{ 1, 2, 3 }, glk);
+
+        Encryptor encryptor(context, pk);
+        Evaluator evaluator(context);
+        Decryptor decryptor(context, keygen.secret_key());
+        CKKSEncoder encoder(context);
+        const double delta = static_cast<double>(1ULL << 30);
+
+        vector<complex<double>> input{ complex<double>(1, 1), complex<double>(2, 2), complex<double>(3, 3),
+                                       complex<double>(4, 4) };
+        Plaintext plain;
+        encoder.encode(input, context.first_parms_id(), delta, plain);
+        Ciphertext encrypted;
+        encryptor.encrypt(plain, encrypted);
+
+        vector<int> steps{ 3, 1, 0, 2 };
+        vector<Ciphertext> rotated;
+        evaluator.rotate_hoisted(encrypted, steps, glk, rotated);
+        for (size_t i = 0; i < steps.size(); i++)
+        {
+            vector<complex<double>> output;
+            decryptor.decrypt(rotated[i], plain);
+            encoder.decode(plain, output);
+            for (size_t j = 0; j < slot_size; j++)
+            {
+                complex<double> expected = input[(j + static_cast<size_t>(steps[i])) % slot_size];
+                ASSERT_EQ(round(expected.real()), round(output[j].real()));
+                ASSERT_EQ(round(expected.imag()), round(output[j].imag()));
+            }
+        }
+    }
+
     TEST(EvaluatorTest, BFVEncryptRotateMatrixDecrypt)
     {
         EncryptionParameters parms(scheme_type::bfv);
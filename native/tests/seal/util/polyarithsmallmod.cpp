@@ -408,6 +408,35 @@ namespace sealtest
             }
         }
 
+        TEST(PolyArithSmallMod, MultiplyAddPolyScalarCoeffMod)
+        {
+            MemoryPool &pool = *global_variables::global_memory_pool;
+            {
+                SEAL_ALLOCATE_ZERO_GET_COEFF_ITER(poly, 3, pool);
+                SEAL_ALLOCATE_ZERO_GET_COEFF_ITER(result, 3, pool);
+
+                poly[0] = 1;
+                poly[1] = 3;
+                poly[2] = 4;
+                result[0] = 4;
+                result[1] = 0;
+                result[2] = 2;
+
+                uint64_t scalar = 3;
+                Modulus mod(5);
+                multiply_add_poly_scalar_coeffmod(poly, 3, scalar, mod, result);
+                ASSERT_EQ(2ULL, result[0]);
+                ASSERT_EQ(4ULL, result[1]);
+                ASSERT_EQ(4ULL, result[2]);
+
+                // poly being result itself
+                multiply_add_poly_scalar_coeffmod(result, 3, scalar, mod, result);
+                ASSERT_EQ(3ULL, result[0]);
+                ASSERT_EQ(1ULL, result[1]);
+                ASSERT_EQ(1ULL, result[2]);
+            }
+        }
+
         TEST(PolyArithSmallMod, MultiplyPolyMonoCoeffMod)
         {
             MemoryPool &pool = *global_variables::global_memory_pool;